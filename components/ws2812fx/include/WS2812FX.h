@@ -203,6 +203,9 @@ public:
     numLEDs = num_leds;
     numBytes = num_leds * 3;
     brightness = DEFAULT_BRIGHTNESS;
+    rOffset = wOffset = 0; // RGB: wOffset == rOffset
+    gOffset = 1;
+    bOffset = 2;
     _running = false;
 
     _segments_len = max_num_segments;
@@ -471,6 +474,7 @@ protected:
 
 private:
   led_strip_handle_t _led_strip;
+  bool _refresh_pending = false; // A frame is on its way to the strip
   uint16_t _rand16seed;
   uint16_t (*customModes[MAX_CUSTOM_MODES])(void){
       []
@@ -1261,7 +1265,9 @@ struct Oscillator
   int8_t speed;
 };
 
-#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_RP2040) || defined(ESP_PLATFORM)
+#if defined(ESP_PLATFORM) && defined(CONFIG_WS2812FX_MODE_SET_SELECTED)
+#include "modes_selected.h"
+#elif defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_RP2040) || defined(ESP_PLATFORM)
 #include "modes_esp.h"
 #elif defined(MEGATINYCORE)
 #include "modes_attiny.h"
@@ -0,0 +1,78 @@
+/*
+  modes_selected.h - WS2812FX mode table with only a chosen set of effects,
+  used on ESP-IDF with CONFIG_WS2812FX_MODE_SET_SELECTED
+
+  LICENSE
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016  Harm Aldick
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+
+
+  CHANGELOG
+
+  2026-10-14   Generated from a list of effects, based on modes_esp.h
+*/
+#ifndef mode_selected_h
+#define mode_selected_h
+
+// The effects to build in, one X(id, name, category, function) per effect.
+// FX_MODE_<id> is numbered in list order; the FX_MODE_* of the effects left
+// out are not defined, so using one fails at compile time. Can be overridden
+// by defining WS2812FX_SELECTED_MODES before WS2812FX.h is included.
+#ifndef WS2812FX_SELECTED_MODES
+#define WS2812FX_SELECTED_MODES(X)                  \
+  X(STATIC, "Static", cat_simple, mode_static)      \
+  X(BLINK,  "Blink",  cat_simple, mode_blink)       \
+  X(BREATH, "Breath", cat_special, mode_breath)
+#endif
+
+#define MODE_COUNT (sizeof(_modes)/sizeof(_modes[0]))
+#define MODE_PTR(x) this->*_modes[x].mode_ptr
+#define MODE_NAME(x) _modes[x].name
+
+#define WS2812FX_MODE_ID(id, name, cat, fn) FX_MODE_##id,
+enum { WS2812FX_SELECTED_MODES(WS2812FX_MODE_ID) FX_MODE_SELECTED_COUNT };
+#undef WS2812FX_MODE_ID
+
+#define FX_MODE_CUSTOM_0 FX_MODE_SELECTED_COUNT // no custom mode slots, setCustomMode() returns 0
+#define FX_MODE_CUSTOM   FX_MODE_CUSTOM_0
+
+typedef struct Mode {
+  const __FlashStringHelper* name;
+  const __FlashStringHelper* category;
+  uint16_t (WS2812FX::*mode_ptr)(void);
+} mode;
+
+// mode categories
+const char cat_simple[]  = "Simple";
+const char cat_wipe[]    = "Wipe";
+const char cat_sweep[]   = "Sweep";
+const char cat_special[] = "Special";
+const char cat_custom[]  = "Custom";
+
+// static array of member function pointers, in FX_MODE_* order by construction
+#define WS2812FX_MODE_ENTRY(id, name, cat, fn) { FSH(name), FSH(cat), &WS2812FX::fn },
+__attribute__ ((unused)) static mode _modes[] = {
+  WS2812FX_SELECTED_MODES(WS2812FX_MODE_ENTRY)
+};
+#undef WS2812FX_MODE_ENTRY
+#endif
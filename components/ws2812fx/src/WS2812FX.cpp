@@ -62,8 +62,25 @@ void WS2812FX::clear() {
   memset(pixels, 0, numBytes);
 }
 
+// pixels is the back buffer the effects draw into; led_strip's own buffer is
+// what the RMT (DMA) channel sends. It is only rewritten once the previous
+// frame is out, and show() returns as soon as the new one has been queued.
 void WS2812FX::show() {
-  led_strip_refresh(_led_strip);
+  if (_refresh_pending) {
+    led_strip_refresh_wait_done(_led_strip); // Long done at service() rates
+    _refresh_pending = false;
+  }
+  for (uint16_t n = 0; n < numLEDs; n++) {
+    uint8_t *p = &pixels[n * 3];
+    uint32_t r = p[rOffset], g = p[gOffset], b = p[bOffset];
+    if (brightness) {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+    }
+    led_strip_set_pixel(_led_strip, n, r, g, b);
+  }
+  _refresh_pending = led_strip_refresh_async(_led_strip) == ESP_OK;
 }
 
 uint8_t WS2812FX::getBrightness() {
@@ -105,7 +122,9 @@ bool WS2812FX::service() {
       }
     }
     if(doShow) {
+#if !defined(ESP_PLATFORM) // show() is asynchronous there and needs no settling time
       delay(1); // for ESP32 (see https://forums.adafruit.com/viewtopic.php?f=47&t=117327)
+#endif
       execShow();
     }
     _triggered = false;
@@ -129,12 +148,9 @@ void WS2812FX::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
 
 void WS2812FX::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
 #if defined(ESP_PLATFORM)
-  if (brightness) {
-    r = (r * brightness) >> 8;
-    g = (g * brightness) >> 8;
-    b = (b * brightness) >> 8;
-  }
-  led_strip_set_pixel(_led_strip, n, r, g, b);
+  // Unscaled, so getPixelColor() and the effects that shift pixels see the
+  // colors they set; show() applies the brightness
+  setRawPixelColor(n, ((uint32_t)r << 16) | ((uint32_t)g << 8) | b);
 #elif defined(MEGATINYCORE)  // if compiling for an ATtiny device (to conserve memory, no gamma correction)
   tinyNeoPixel::setPixelColor(n, r, g, b, w);
 #else
@@ -60,11 +60,121 @@ class DatasetEditor {
         const file = event.target.files[0];
         if (!file) return;
 
-        const text = await file.text();
-        const lines = text.split('\n').filter(line => line.trim() && !line.startsWith('#'));
+        const buffer = await file.arrayBuffer();
+        const magic = new TextDecoder().decode(new Uint8Array(buffer, 0, Math.min(4, buffer.byteLength)));
         
         this.frames = [];
         
+        if (magic === 'TNLG') {
+            this.loadBinary(buffer);
+        } else {
+            this.loadCsv(new TextDecoder().decode(buffer));
+        }
+        
+        if (this.frames.length > 0) {
+            this.currentFrame = 0;
+            this.renderFrame();
+            this.drawTimeline();
+            document.getElementById('exportBtn').disabled = false;
+        }
+    }
+
+    // Binary log (LOG_FORMAT_BINARY): file header, then a record header and pixel data per frame.
+    // Version 2 records are raw keyframes or deltas from the previous frame of the same depth
+    // sensor (LOG_COMPRESSION). Only the front sensor's frames (sensor 0) are shown.
+    loadBinary(buffer) {
+        const view = new DataView(buffer);
+        const version = view.getUint8(4);
+        const headerSize = view.getUint8(5);
+        const recordSize = view.getUint8(6);
+        const encoding = view.getUint8(8);
+        const unitMm = view.getUint16(10, true);
+        this.metadata.binningFactor = view.getUint8(7);
+        
+        const toMm = (raw) => encoding === 1 ? raw * unitMm : (encoding === 2 ? (raw / 5.1) ** 2 : raw);
+        const bytes = new Uint8Array(buffer);
+        let prev = new Map(); // Raw bytes of each sensor's previous frame, missing until its next keyframe
+        let lastFrameNum = -1;
+        
+        let pos = headerSize;
+        while (pos + recordSize <= buffer.byteLength) {
+            const width = view.getUint16(pos + 20, true);
+            const height = view.getUint16(pos + 22, true);
+            const pixelEncoding = version >= 2 ? view.getUint8(pos + 24) : 0;
+            const sensor = version >= 2 ? view.getUint8(pos + 25) : 0;
+            const payloadBytes = version >= 2 ? view.getUint16(pos + 26, true) : width * height;
+            const end = pos + recordSize + payloadBytes;
+            // "TNDF" record magic; skip forward byte by byte after a torn write
+            if (view.getUint32(pos, true) !== 0x46444E54 || end > buffer.byteLength) {
+                prev.clear();
+                pos++;
+                continue;
+            }
+            
+            const frameNum = view.getUint32(pos + 4, true);
+            if (frameNum < lastFrameNum) {
+                break; // Stale data in the preallocated tail of a log cut short by a power loss
+            }
+            lastFrameNum = frameNum;
+            
+            const start = pos;
+            const payload = bytes.subarray(pos + recordSize, end);
+            pos = end;
+            const base = prev.get(sensor);
+            prev.delete(sensor);
+            let raw;
+            if (pixelEncoding === 0 && payloadBytes === width * height) {
+                raw = payload;
+            } else if (pixelEncoding === 1 && base && base.length === width * height) {
+                raw = this.decodeDelta(payload, base);
+            } else {
+                continue;
+            }
+            prev.set(sensor, raw);
+            if (sensor !== 0) {
+                continue;
+            }
+            
+            const frame = {
+                frameNum: frameNum,
+                steering: view.getInt16(start + 16, true),
+                throttle: view.getInt16(start + 18, true),
+                width: width,
+                height: height,
+                data: Array.from(raw, toMm),
+                active: true
+            };
+            
+            this.frames.push(frame);
+            this.metadata.width = frame.width;
+            this.metadata.height = frame.height;
+        }
+    }
+
+    // LOG_PIXELS_DELTA: token < 0x80 keeps token + 1 pixels, otherwise (token & 0x7F) + 1 deltas follow
+    decodeDelta(payload, prev) {
+        const out = Uint8Array.from(prev);
+        let i = 0;
+        let o = 0;
+        while (i < payload.length) {
+            const token = payload[i++];
+            if (token < 0x80) {
+                o += token + 1;
+            } else {
+                const n = (token & 0x7F) + 1;
+                for (let k = 0; k < n; k++) {
+                    out[o + k] = (out[o + k] + payload[i + k]) & 0xFF;
+                }
+                i += n;
+                o += n;
+            }
+        }
+        return out;
+    }
+
+    loadCsv(text) {
+        const lines = text.split('\n').filter(line => line.trim() && !line.startsWith('#'));
+        
         for (const line of lines) {
             const values = line.split(',').map(v => parseFloat(v.trim()));
             if (values.length < 6) continue;
@@ -91,13 +201,6 @@ class DatasetEditor {
             this.metadata.width = frame.width;
             this.metadata.height = frame.height;
         }
-        
-        if (this.frames.length > 0) {
-            this.currentFrame = 0;
-            this.renderFrame();
-            this.drawTimeline();
-            document.getElementById('exportBtn').disabled = false;
-        }
     }
 
     renderFrame() {
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""
+Read depth sensor logs recorded on the SD card, CSV or binary.
+
+CSV logs (revised_log_XXXX.csv) have one line per frame:
+    frame,steering,throttle,width,height,d0,d1,...
+Binary logs (revised_log_XXXX.bin, LOG_FORMAT_BINARY in depth_sensor.h) have a
+file header followed by one fixed record header and the sensor bytes per
+frame, either raw (keyframes) or as the change from the previous frame
+(LOG_COMPRESSION); see log_file_header_t and log_record_header_t.
+
+read_depth_log() returns the same frames for both, with depth in millimetres.
+Binary logs of a car with several depth sensors (DEPTH_SENSOR_COUNT) hold all
+of their frames, each record says which; read_depth_log() returns the front
+sensor's unless asked for another.
+Run as a script to convert a binary log to CSV:
+    python depth_log.py logs/revised_log_0060.bin -o logs/revised_log_0060.csv
+"""
+
+import argparse
+import struct
+
+import numpy as np
+
+FILE_MAGIC = b'TNLG'
+RECORD_MAGIC = b'TNDF'
+FILE_HEADER = struct.Struct('<4sBBBBBBH')  # magic, version, header size, record header size, binning, encoding, reserved, unit
+RECORD_HEADER_V1 = struct.Struct('<4sIqhhHH')  # magic, frame, timestamp_us, steering, throttle, width, height
+RECORD_HEADER = struct.Struct('<4sIqhhHHBBH')  # V1 fields, pixel encoding, sensor, payload bytes
+PIXELS_RAW, PIXELS_DELTA = 0, 1
+
+DEPTH_RAW, DEPTH_LINEAR, DEPTH_NONLINEAR = 0, 1, 2
+
+
+class DepthFrame:
+    """One logged frame: depth is a (height, width) float32 array in millimetres"""
+
+    def __init__(self, frame, steering, throttle, depth, timestamp_us=None, sensor=0):
+        self.frame = frame
+        self.steering = steering  # Integer millis, as logged
+        self.throttle = throttle
+        self.depth = depth
+        self.timestamp_us = timestamp_us  # Binary logs only
+        self.sensor = sensor  # 0 = front
+
+    @property
+    def width(self):
+        return self.depth.shape[1]
+
+    @property
+    def height(self):
+        return self.depth.shape[0]
+
+
+def _millimeter_table(encoding, unit_mm):
+    raw = np.arange(256, dtype=np.float32)
+    if encoding == DEPTH_LINEAR:
+        return raw * unit_mm
+    if encoding == DEPTH_NONLINEAR:
+        return (raw / 5.1) ** 2
+    return raw
+
+
+def _delta_decode(payload, prev):
+    """Apply a PIXELS_DELTA payload to the previous frame's raw bytes"""
+    out = bytearray(prev)
+    i = o = 0
+    while i < len(payload):
+        token = payload[i]
+        i += 1
+        if token < 0x80:
+            o += token + 1  # Unchanged pixels
+        else:
+            n = (token & 0x7F) + 1
+            for k in range(n):
+                out[o + k] = (out[o + k] + payload[i + k]) & 0xFF
+            i += n
+            o += n
+    return bytes(out)
+
+
+def _read_binary(data, sensor):
+    magic, version, header_size, record_size, _, encoding, _, unit_mm = FILE_HEADER.unpack_from(data, 0)
+    if magic != FILE_MAGIC:
+        raise ValueError('not a binary depth log')
+    if version not in (1, 2):
+        raise ValueError('unsupported binary log version %d' % version)
+    to_mm = _millimeter_table(encoding, unit_mm)
+
+    frames = []
+    prev = {}  # Raw bytes of each sensor's previous frame, missing until its next keyframe
+    last_frame = -1
+    pos = header_size
+    while pos + record_size <= len(data):
+        if version == 1:
+            magic, frame, timestamp_us, steering, throttle, width, height = RECORD_HEADER_V1.unpack_from(data, pos)
+            pixel_encoding, record_sensor, payload_bytes = PIXELS_RAW, 0, width * height
+        else:
+            (magic, frame, timestamp_us, steering, throttle, width, height,
+             pixel_encoding, record_sensor, payload_bytes) = RECORD_HEADER.unpack_from(data, pos)
+        end = pos + record_size + payload_bytes
+        if magic != RECORD_MAGIC or end > len(data):
+            # Torn write (e.g. power cut mid-record): skip to the next record magic. Deltas
+            # after it have no base until the next keyframe.
+            prev = {}
+            nxt = data.find(RECORD_MAGIC, pos + 1)
+            if nxt < 0:
+                break
+            pos = nxt
+            continue
+        if frame < last_frame:
+            break  # Stale data in the preallocated tail of a log cut short by a power loss
+        last_frame = frame
+        payload = data[pos + record_size:end]
+        pos = end
+        base = prev.pop(record_sensor, None)
+        if pixel_encoding == PIXELS_RAW and payload_bytes == width * height:
+            raw = payload
+        elif pixel_encoding == PIXELS_DELTA and base is not None and len(base) == width * height:
+            raw = _delta_decode(payload, base)
+        else:
+            continue
+        prev[record_sensor] = raw
+        if sensor is not None and record_sensor != sensor:
+            continue
+        depth = to_mm[np.frombuffer(raw, dtype=np.uint8)].reshape(height, width)
+        frames.append(DepthFrame(frame, steering, throttle, depth, timestamp_us, record_sensor))
+    return frames
+
+
+def _read_csv(text):
+    frames = []
+    for line in text.splitlines():
+        if not line.strip() or line.startswith('#'):
+            continue
+        values = line.split(',')
+        if len(values) < 6:
+            continue
+        try:
+            w, h = int(values[3]), int(values[4])
+            depth = np.asarray(values[5:5 + w * h], dtype=np.float32).reshape(h, w)
+            frames.append(DepthFrame(int(values[0]), int(values[1]), int(values[2]), depth))
+        except ValueError:
+            continue  # Torn line, or the preallocated tail of a log cut short by a power loss
+    return frames
+
+
+def read_depth_log(path, sensor=0):
+    """Return the list of DepthFrame of one sensor (None = all of them, in log order) in a CSV or binary log"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] == FILE_MAGIC:
+        return _read_binary(data, sensor)
+    if sensor not in (0, None):
+        return []  # CSV logs have the front sensor only
+    return _read_csv(data.decode('ascii', errors='ignore'))
+
+
+def write_csv(frames, path, binning_factor=4):
+    """Write frames in the firmware's CSV log format"""
+    with open(path, 'w') as f:
+        f.write('# Depth Sensor Log\n')
+        f.write('# Binning Factor: %d\n' % binning_factor)
+        f.write('# Frame,Steering(millis),Throttle(millis),Width,Height,Data...\n')
+        for fr in frames:
+            pixels = ','.join(str(int(v)) for v in fr.depth.ravel())
+            f.write('%d,%d,%d,%d,%d,%s\n' % (fr.frame, fr.steering, fr.throttle, fr.width, fr.height, pixels))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Convert a depth log (CSV or binary) to CSV',
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument('log', help='Input log file (.bin or .csv)')
+    parser.add_argument('-o', '--output', required=True, help='Output CSV file')
+    parser.add_argument('--sensor', type=int, default=0, help='Depth sensor to convert, 0 = front')
+    args = parser.parse_args()
+
+    frames = read_depth_log(args.log, args.sensor)
+    binning = 4
+    with open(args.log, 'rb') as f:
+        head = f.read(FILE_HEADER.size)
+    if head[:4] == FILE_MAGIC:
+        binning = FILE_HEADER.unpack(head)[4]
+    write_csv(frames, args.output, binning)
+    print('Wrote %d frames to %s' % (len(frames), args.output))
+
+
+if __name__ == "__main__":
+    main()
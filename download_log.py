@@ -11,6 +11,8 @@ import sys
 import os
 import time
 import curses
+import struct
+import zlib
 from datetime import datetime
 import argparse
 
@@ -27,6 +29,14 @@ parser.add_argument('-d', '--dir', default='./logs', dest='download_dir',
                     help='Download directory')
 parser.add_argument('-t', '--timeout', type=float, default=5.0,
                     help='Serial communication timeout in seconds')
+parser.add_argument('--frames', nargs=3, metavar=('LOG', 'FIRST', 'LAST'),
+                    help='Download only frames FIRST..LAST of a binary log (e.g. /revised_log_0024.bin 1000 2000) '
+                         'instead of starting the file browser')
+parser.add_argument('--get', metavar='FILE',
+                    help='Download one file (e.g. /revised_log_0024.bin) without the file browser; '
+                         'an interrupted download of the same file resumes where it stopped')
+parser.add_argument('--text', action='store_true',
+                    help='Use the old line-based DOWNLOAD_FILE transfer instead of binary chunks')
 
 args = parser.parse_args()
 
@@ -36,6 +46,11 @@ BAUD = args.baud
 TIMEOUT = args.timeout
 DOWNLOAD_DIR = args.download_dir
 
+# DOWNLOAD_BIN chunk header (bin_chunk_header_t in main/serial_commands.cc)
+BIN_HEADER = struct.Struct('<IIIHHI')
+BIN_CHUNK_MAGIC = struct.pack('<I', 0x4B434E54)
+BIN_CRC_BYTES = 16  # Header bytes covered by the CRC
+
 class SerialFileDownloader:
     def __init__(self, port, baudrate, timeout=5):
         self.ser = serial.Serial(port, baudrate, timeout=timeout)
@@ -115,10 +130,101 @@ class SerialFileDownloader:
     def download_file(self, filename, progress_callback=None):
         """Download file from SD card"""
         self.send_command(f"DOWNLOAD_FILE:{filename}")
-        
+        return self._receive_file(progress_callback)
+
+    def download_file_binary(self, filename, local_path, progress_callback=None):
+        """Download a file with DOWNLOAD_BIN into local_path. If local_path
+        already holds the start of the file, only the rest is requested.
+        Returns (file size, error)."""
+        offset = os.path.getsize(local_path) if os.path.exists(local_path) else 0
+        self.send_command(f"DOWNLOAD_BIN:{filename}:{offset}")
+
+        file_size = None
+        start = time.time()
+        while file_size is None and time.time() - start < TIMEOUT:
+            line = self.ser.readline().decode('ascii', errors='ignore').strip()
+            if line.startswith("BIN_START:"):
+                fields = line.split(":")[1:]
+                info = dict(zip(fields[0::2], fields[1::2]))
+                file_size = int(info["size"])
+                max_chunk = int(info["chunk"])
+            elif line.startswith("BIN_ERROR:"):
+                return None, line.split(":", 1)[1]
+        if file_size is None:
+            return None, "No response to DOWNLOAD_BIN"
+
+        expected = 0      # Next chunk to write
+        nak_sent = 0.0    # Time of the last NAK, so a burst of bad chunks asks for one resend
+        received = offset
+        done = False
+        finished = False  # BIN_END or BIN_ERROR seen
+        buffer = bytearray()
+        with open(local_path, 'ab') as out:
+            start = time.time()
+            while time.time() - start < TIMEOUT:
+                buffer += self.ser.read(self.ser.in_waiting or 1)
+                finished = finished or b"BIN_END:" in buffer or b"BIN_ERROR:" in buffer
+                while True:
+                    pos = buffer.find(BIN_CHUNK_MAGIC)
+                    if pos < 0:
+                        del buffer[:max(0, len(buffer) - 9)]  # Keep what may be the start of a marker
+                        break
+                    del buffer[:pos]  # Console output that isn't a chunk
+                    if len(buffer) < BIN_HEADER.size:
+                        break
+                    _, seq, _, length, _, crc = BIN_HEADER.unpack_from(buffer)
+                    if length > max_chunk:
+                        del buffer[:1]
+                        continue
+                    end = BIN_HEADER.size + length
+                    if len(buffer) < end:
+                        break
+                    payload = bytes(buffer[BIN_HEADER.size:end])
+                    if zlib.crc32(payload, zlib.crc32(bytes(buffer[:BIN_CRC_BYTES]))) != crc:
+                        del buffer[:1]  # Damaged, or the magic was only part of a payload
+                        if time.time() - nak_sent > 0.2:
+                            self.ser.write(f"NAK:{expected}\n".encode('ascii'))
+                            nak_sent = time.time()
+                        continue
+                    del buffer[:end]
+
+                    if seq == expected:
+                        out.write(payload)
+                        received += length
+                        expected += 1
+                        done = done or length == 0
+                        self.ser.write(f"ACK:{seq}\n".encode('ascii'))
+                        start = time.time()
+                        if progress_callback and file_size > 0:
+                            progress_callback(received * 100 / file_size, received, file_size)
+                    elif seq < expected:
+                        # A resend because our ACK got lost
+                        self.ser.write(f"ACK:{expected - 1}\n".encode('ascii'))
+                    elif time.time() - nak_sent > 0.2:
+                        self.ser.write(f"NAK:{expected}\n".encode('ascii'))
+                        nak_sent = time.time()
+                if finished:
+                    break
+
+        if not done:
+            self.ser.write(b"ABORT\n")
+            return None, f"Transfer stopped at {received} of {file_size} bytes, run again to resume"
+        if os.path.getsize(local_path) != file_size:
+            return None, f"Size mismatch: {os.path.getsize(local_path)} of {file_size} bytes"
+        return file_size, None
+
+    def download_frames(self, log_path, first, last):
+        """Download frames first..last of a binary log, as a binary log of its own.
+        Starts at the keyframe before first, so the result decodes on its own."""
+        self.send_command(f"DOWNLOAD_FRAMES:{log_path}:{first}:{last}")
+        return self._receive_file()
+
+    def _receive_file(self, progress_callback=None):
+        """Collect a FILE_START..FILE_END transfer"""
         # Wait for file transfer to begin
         file_data = []
         receiving = False
+        hex_encoded = False
         file_size = 0
         bytes_received = 0
         
@@ -132,6 +238,9 @@ class SerialFileDownloader:
                     receiving = True
                     start = time.time()  # Reset timeout
                 
+                elif line == "FILE_ENCODING:hex":
+                    hex_encoded = True  # Binary log, sent as hex lines
+
                 elif line == "FILE_START":
                     receiving = True
                     start = time.time()
@@ -144,6 +253,18 @@ class SerialFileDownloader:
                     error = line.split(":", 1)[1]
                     return None, error
                 
+                elif receiving and line and hex_encoded:
+                    try:
+                        chunk = bytes.fromhex(line)
+                    except ValueError:
+                        return None, "Corrupt hex line"
+                    file_data.append(chunk)
+                    bytes_received += len(chunk)
+
+                    if progress_callback and file_size > 0:
+                        progress = (bytes_received / file_size) * 100
+                        progress_callback(progress, bytes_received, file_size)
+
                 elif receiving and line:
                     file_data.append(line)
                     bytes_received += len(line) + 1  # +1 for newline
@@ -155,7 +276,9 @@ class SerialFileDownloader:
         
         if not file_data:
             return None, "No data received"
-        
+
+        if hex_encoded:
+            return b"".join(file_data), None
         return "\n".join(file_data), None
     
     def close(self):
@@ -291,6 +414,10 @@ def tui_main(stdscr, downloader):
                     msg = f"Downloading: {percent:.1f}% ({format_size(current)} / {format_size(total)})"
                     draw_menu(stdscr, files, current_row, msg)
                 
+                if not args.text:
+                    status_msg = download_binary(downloader, filename, progress_cb)
+                    continue
+
                 file_content, error = downloader.download_file(filename, progress_cb)
                 
                 if error:
@@ -298,10 +425,12 @@ def tui_main(stdscr, downloader):
                 elif file_content:
                     # Save file
                     timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
-                    local_filename = f"{DOWNLOAD_DIR}/{selected['name'].replace('.csv', '')}_{timestamp}.csv"
+                    base, ext = os.path.splitext(selected['name'])
+                    local_filename = f"{DOWNLOAD_DIR}/{base}_{timestamp}{ext or '.csv'}"
                     
                     try:
-                        with open(local_filename, 'w') as f:
+                        # Binary logs come back as bytes
+                        with open(local_filename, 'wb' if isinstance(file_content, bytes) else 'w') as f:
                             f.write(file_content)
                         status_msg = f"✓ Saved to {local_filename} ({format_size(len(file_content))})"
                     except IOError as e:
@@ -312,6 +441,33 @@ def tui_main(stdscr, downloader):
     return None
 
 
+def download_binary(downloader, filename, progress_callback=None):
+    """DOWNLOAD_BIN into DOWNLOAD_DIR/<name>.part, renamed to a timestamped
+    name when complete. A .part left by an interrupted run is resumed."""
+    name = os.path.basename(filename)
+    part_path = os.path.join(DOWNLOAD_DIR, name + ".part")
+    size, error = downloader.download_file_binary(filename, part_path, progress_callback)
+    if error:
+        return f"ERROR: {error}"
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    base, ext = os.path.splitext(name)
+    local_path = os.path.join(DOWNLOAD_DIR, f"{base}_{timestamp}{ext}")
+    os.replace(part_path, local_path)
+    return f"✓ Saved to {local_path} ({format_size(size)})"
+
+
+def download_frame_range(downloader, log_path, first, last):
+    """Non-interactive DOWNLOAD_FRAMES, saved next to the other downloads"""
+    data, error = downloader.download_frames(log_path, first, last)
+    if error:
+        return f"ERROR: {error}"
+    base, ext = os.path.splitext(os.path.basename(log_path))
+    local_path = os.path.join(DOWNLOAD_DIR, f"{base}_frames_{first}-{last}{ext}")
+    with open(local_path, 'wb') as f:
+        f.write(data)
+    return f"Saved {len(data)} bytes to {local_path}"
+
+
 def main():
     # Create download directory if it doesn't exist
     try:
@@ -324,11 +480,26 @@ def main():
     try:
         print(f"Connecting to {PORT} at {BAUD} baud...")
         downloader = SerialFileDownloader(PORT, BAUD, TIMEOUT)
-        print("Connected! Starting file browser...")
-        time.sleep(0.5)
-        
-        # Launch TUI
-        result = curses.wrapper(tui_main, downloader)
+        if args.frames:
+            log_path, first, last = args.frames
+            print(f"Connected! Downloading frames {first}..{last} of {log_path}...")
+            time.sleep(0.5)
+            result = download_frame_range(downloader, log_path, int(first), int(last))
+        elif args.get:
+            print(f"Connected! Downloading {args.get}...")
+            time.sleep(0.5)
+
+            def progress_cb(percent, current, total):
+                print(f"\r{percent:5.1f}% ({format_size(current)} / {format_size(total)})", end="", flush=True)
+
+            result = download_binary(downloader, args.get, progress_cb)
+            print()
+        else:
+            print("Connected! Starting file browser...")
+            time.sleep(0.5)
+
+            # Launch TUI
+            result = curses.wrapper(tui_main, downloader)
         
         downloader.close()
         
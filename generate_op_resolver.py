@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+"""
+Generate the TFLM op resolver and tensor arena size for the bundled model.
+
+Reads the model flatbuffer, either from main/model.cc (xxd -i output) or a
+.tflite file, and writes a C++ header with:
+  - kModelOpCount       number of distinct ops in the graph
+  - register_model_ops  adds exactly those ops to a MicroMutableOpResolver
+  - kTensorArenaSize    arena size for the graph
+
+The arena size is estimated from the activation tensor lifetimes unless the
+real value from the device is given with --arena-used (printed at boot as
+"arena used N of M bytes"). A margin is added on top either way.
+
+Runs as part of the build (see main/CMakeLists.txt), but can also be run by
+hand to inspect a model:
+    python generate_op_resolver.py main/model.cc -o model_ops.h
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+parser = argparse.ArgumentParser(
+    description='Generate a TFLM op resolver and arena size from a model',
+    formatter_class=argparse.ArgumentDefaultsHelpFormatter
+)
+parser.add_argument('model', help='model.cc (C array) or .tflite file')
+parser.add_argument('-o', '--output', default='-',
+                    help='Output header ("-" for stdout)')
+parser.add_argument('--arena-used', type=int, default=0,
+                    help='arena_used_bytes() measured on the device (0 = estimate)')
+parser.add_argument('--margin', type=float, default=0.25,
+                    help='Extra arena on top of the used/estimated size, as a fraction')
+
+# BuiltinOperator code -> MicroMutableOpResolver method
+OP_REGISTRATIONS = {
+    0: 'AddAdd',
+    1: 'AddAveragePool2D',
+    2: 'AddConcatenation',
+    3: 'AddConv2D',
+    4: 'AddDepthwiseConv2D',
+    6: 'AddDequantize',
+    9: 'AddFullyConnected',
+    14: 'AddLogistic',
+    17: 'AddMaxPool2D',
+    18: 'AddMul',
+    19: 'AddRelu',
+    21: 'AddRelu6',
+    22: 'AddReshape',
+    25: 'AddSoftmax',
+    28: 'AddTanh',
+    34: 'AddPad',
+    37: 'AddBatchToSpaceNd',
+    38: 'AddSpaceToBatchNd',
+    39: 'AddTranspose',
+    40: 'AddMean',
+    41: 'AddSub',
+    43: 'AddSqueeze',
+    45: 'AddStridedSlice',
+    55: 'AddMaximum',
+    57: 'AddMinimum',
+    59: 'AddNeg',
+    70: 'AddExpandDims',
+    76: 'AddRsqrt',
+    77: 'AddShape',
+    82: 'AddReduceMax',
+    83: 'AddPack',
+    98: 'AddLeakyRelu',
+    99: 'AddSquaredDifference',
+    114: 'AddQuantize',
+    117: 'AddHardSwish',
+    126: 'AddBatchMatMul',
+}
+
+# TensorType -> element size in bytes
+TYPE_SIZES = {0: 4, 1: 2, 2: 4, 3: 1, 4: 8, 6: 1, 7: 2, 9: 1, 10: 8, 16: 4}
+
+ARENA_ALIGNMENT = 16
+# Rough TFLM bookkeeping kept in the arena (eval tensors, node data, scratch handles)
+PERSISTENT_BYTES_PER_TENSOR = 64
+PERSISTENT_BYTES_PER_OP = 256
+# Room for the largest kernel scratch buffer (ESP-NN Conv2D requests one during Prepare)
+KERNEL_SCRATCH_BYTES = 16 * 1024
+
+
+def load_model(path):
+    """Return the flatbuffer bytes from a .tflite file or an xxd -i C array"""
+    if path.endswith('.tflite'):
+        with open(path, 'rb') as f:
+            return f.read()
+    with open(path) as f:
+        source = f.read()
+    body = source[source.index('{') + 1:source.index('};')]
+    return bytes(int(x, 16) for x in re.findall(r'0x([0-9a-fA-F]{2})', body))
+
+
+class Table:
+    """Minimal read-only flatbuffer table accessor"""
+
+    def __init__(self, buf, pos):
+        self.buf = buf
+        self.pos = pos
+        self.vtable = pos - struct.unpack_from('<i', buf, pos)[0]
+        self.vtable_len = struct.unpack_from('<H', buf, self.vtable)[0]
+
+    def _offset(self, field):
+        o = 4 + 2 * field
+        if o >= self.vtable_len:
+            return 0
+        return struct.unpack_from('<H', self.buf, self.vtable + o)[0]
+
+    def scalar(self, field, fmt, default=0):
+        o = self._offset(field)
+        return struct.unpack_from('<' + fmt, self.buf, self.pos + o)[0] if o else default
+
+    def _vector(self, field):
+        o = self._offset(field)
+        if not o:
+            return None, 0
+        p = self.pos + o
+        p += struct.unpack_from('<I', self.buf, p)[0]
+        return p + 4, struct.unpack_from('<I', self.buf, p)[0]
+
+    def tables(self, field):
+        p, n = self._vector(field)
+        if p is None:
+            return []
+        return [Table(self.buf, p + 4 * k + struct.unpack_from('<I', self.buf, p + 4 * k)[0])
+                for k in range(n)]
+
+    def ints(self, field):
+        p, n = self._vector(field)
+        if p is None:
+            return []
+        return list(struct.unpack_from('<%di' % n, self.buf, p))
+
+    def vector_length(self, field):
+        return self._vector(field)[1]
+
+
+def align(n):
+    return (n + ARENA_ALIGNMENT - 1) // ARENA_ALIGNMENT * ARENA_ALIGNMENT
+
+
+def estimate_arena(model):
+    """Peak size of the live activation tensors plus scratch and TFLM bookkeeping"""
+    buffers = model.tables(4)
+    total = 0
+    for subgraph in model.tables(2):
+        tensors = subgraph.tables(0)
+        operators = subgraph.tables(3)
+
+        def activation_bytes(index):
+            tensor = tensors[index]
+            if buffers and buffers[tensor.scalar(2, 'I')].vector_length(0) > 0:
+                return 0  # Constant, stays in the flatbuffer
+            size = TYPE_SIZES.get(tensor.scalar(1, 'b'), 4)
+            for dim in tensor.ints(0):
+                size *= max(dim, 1)
+            return align(size)
+
+        # Lifetime of every activation tensor, in operator steps
+        first = {t: 0 for t in subgraph.ints(1)}
+        last = {t: len(operators) for t in subgraph.ints(2)}
+        for step, op in enumerate(operators):
+            for t in op.ints(2):
+                if t >= 0:
+                    first.setdefault(t, step)
+            for t in op.ints(1):
+                if t >= 0:
+                    last[t] = max(last.get(t, step), step)
+
+        peak = 0
+        for step in range(len(operators) + 1):
+            live = sum(activation_bytes(t) for t in first
+                       if first[t] <= step <= last.get(t, first[t]))
+            peak = max(peak, live)
+
+        total += peak + KERNEL_SCRATCH_BYTES
+        total += len(tensors) * PERSISTENT_BYTES_PER_TENSOR
+        total += len(operators) * PERSISTENT_BYTES_PER_OP
+    return total
+
+
+def main():
+    args = parser.parse_args()
+    buf = load_model(args.model)
+    model = Table(buf, struct.unpack_from('<I', buf, 0)[0])
+
+    codes = []
+    for opcode in model.tables(1):
+        # builtin_code (field 3) replaced deprecated_builtin_code (field 0) above 127
+        codes.append(max(opcode.scalar(0, 'b'), opcode.scalar(3, 'i')))
+
+    used = sorted({codes[op.scalar(0, 'I')]
+                   for subgraph in model.tables(2) for op in subgraph.tables(3)})
+    missing = [c for c in used if c not in OP_REGISTRATIONS]
+    if missing:
+        sys.exit('generate_op_resolver.py: no resolver method for builtin op(s) %s, '
+                 'add them to OP_REGISTRATIONS' % missing)
+
+    if args.arena_used > 0:
+        base, source = args.arena_used, 'arena_used_bytes() %d' % args.arena_used
+    else:
+        base = estimate_arena(model)
+        source = 'estimated %d from tensor lifetimes' % base
+    arena_size = align(int(base * (1.0 + args.margin)))
+
+    lines = [
+        '// Generated by generate_op_resolver.py from %s, do not edit.' % args.model.replace('\\', '/').split('/')[-1],
+        '#ifndef MODEL_OPS_H',
+        '#define MODEL_OPS_H',
+        '',
+        '#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"',
+        '',
+        '// Distinct ops used by the model graph',
+        'constexpr int kModelOpCount = %d;' % len(used),
+        '',
+        '// Tensor arena: %s, plus %d%% margin' % (source, round(args.margin * 100)),
+        'constexpr int kTensorArenaSize = %d;' % arena_size,
+        '',
+        'typedef tflite::MicroMutableOpResolver<kModelOpCount> ModelOpResolver;',
+        '',
+        '// Register exactly the ops the model uses',
+        'inline TfLiteStatus register_model_ops(ModelOpResolver &resolver)',
+        '{',
+    ]
+    for code in used:
+        lines.append('  if (resolver.%s() != kTfLiteOk)' % OP_REGISTRATIONS[code])
+        lines.append('    return kTfLiteError;')
+    lines += [
+        '  return kTfLiteOk;',
+        '}',
+        '',
+        '#endif // MODEL_OPS_H',
+        '',
+    ]
+    header = '\n'.join(lines)
+
+    if args.output == '-':
+        sys.stdout.write(header)
+        return
+    # Only touch the file when it changes, so the build doesn't recompile needlessly
+    try:
+        with open(args.output) as f:
+            if f.read() == header:
+                return
+    except OSError:
+        pass
+    with open(args.output, 'w') as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
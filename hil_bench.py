@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""
+Hardware-in-the-loop bench: send depth frames to the car over serial
+(HIL_START in SERIAL_DOWNLOAD.md) and collect its predictions and stage
+timings. The frames go through the firmware's sensor parser and inference
+pipeline exactly like frames from the sensor, with the motors stopped.
+
+    python hil_bench.py logs/revised_log_0060.bin -o logs/hil_0060.csv
+    python hil_bench.py --synthetic 300
+
+Prints latency percentiles, and for a log the mean absolute error of the
+predictions against the logged steering and throttle.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import numpy as np
+import serial
+
+from depth_log import DEPTH_LINEAR, DEPTH_NONLINEAR, read_depth_log
+
+# FrameHeader in main/drive_system/depth_sensor.h, after the 0x00 0xFF start bytes
+FRAME_HEADER = struct.Struct('<HHBBBB4sBBBBHBB')
+FRAME_BEGIN = 0xFF00
+FRAME_END = 0xDD
+HEADER_DATA_LEN = 16  # Header bytes counted in the data length
+
+
+def build_frame(frame_id, raw):
+    """Sensor frame for the rows x cols uint8 array raw"""
+    rows, cols = raw.shape if raw is not None else (0, 0)
+    pixels = raw.astype(np.uint8).tobytes() if raw is not None else b''
+    header = FRAME_HEADER.pack(FRAME_BEGIN, HEADER_DATA_LEN + len(pixels), 0, 0, 0, 0, b'\0' * 4, 0, 0,
+                               rows, cols, frame_id & 0xFFFF, 0, 0)
+    body = header + pixels
+    return body + bytes([sum(body) & 0xFF, FRAME_END])
+
+
+def to_raw(depth_mm, encoding, unit_mm):
+    """Millimetres back to sensor bytes, the inverse of _millimeter_table()"""
+    if encoding == DEPTH_LINEAR:
+        raw = depth_mm / max(unit_mm, 1)
+    elif encoding == DEPTH_NONLINEAR:
+        raw = np.sqrt(np.maximum(depth_mm, 0)) * 5.1
+    else:
+        raw = depth_mm
+    return np.clip(np.rint(raw), 0, 255).astype(np.uint8)
+
+
+def parse_fields(line):
+    """'HIL_RESULT:frame_id:3:ran:1:...' -> {'frame_id': 3, 'ran': 1, ...}"""
+    parts = line.split(':')[1:]
+    fields = {}
+    for key, value in zip(parts[0::2], parts[1::2]):
+        try:
+            fields[key] = int(value)
+        except ValueError:
+            fields[key] = value
+    return fields
+
+
+def read_line(ser, deadline):
+    while time.time() < deadline:
+        line = ser.readline().decode('ascii', errors='ignore').strip()
+        if line:
+            return line
+    return None
+
+
+def run(ser, depth_frames, timeout):
+    ser.reset_input_buffer()
+    ser.write(b'HIL_START\n')
+    deadline = time.time() + timeout
+    ready = None
+    while ready is None:
+        line = read_line(ser, deadline)
+        if line is None:
+            sys.exit('No HIL_READY from the car')
+        if line.startswith('HIL_READY'):
+            ready = parse_fields(line)
+        elif line.startswith('HIL_ERROR'):
+            sys.exit(line)
+    window = ready.get('queue', 4)
+    max_size = ready.get('max_size', 25)
+    encoding, unit_mm = ready.get('encoding', 0), ready.get('unit', 1)
+    print(f'HIL session: up to {max_size}x{max_size}, {window} frames in flight')
+
+    results = []
+    dropped = 0
+    sent = 0
+    end = None
+    while end is None:
+        # Keep the device queue full, but no more, so queue_us stays meaningful
+        while sent < len(depth_frames) and sent - len(results) - dropped < window:
+            depth = depth_frames[sent][:max_size, :max_size]
+            ser.write(build_frame(sent, to_raw(depth, encoding, unit_mm)))
+            sent += 1
+        if sent == len(depth_frames) and sent == len(results) + dropped:
+            ser.write(build_frame(sent, None))
+            sent += 1
+        line = read_line(ser, time.time() + timeout)
+        if line is None:
+            sys.exit(f'Car stopped answering after {len(results)} results')
+        if line.startswith('HIL_RESULT'):
+            results.append(parse_fields(line))
+        elif line.startswith('HIL_DROPPED'):
+            dropped += 1
+            print(line)
+        elif line.startswith('HIL_END'):
+            end = parse_fields(line)
+    return results, end
+
+
+def percentiles(values):
+    if not values:
+        return 'n/a'
+    p50, p95, p99 = np.percentile(values, [50, 95, 99])
+    return f'p50 {p50:8.0f}  p95 {p95:8.0f}  p99 {p99:8.0f}  max {max(values):8d}'
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run depth frames through the car\'s inference pipeline over serial',
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument('log', nargs='?', help='Depth log (.bin or .csv) to send')
+    parser.add_argument('--synthetic', type=int, metavar='N',
+                        help='Send N random 25x25 frames instead of a log')
+    parser.add_argument('-p', '--port', default='/dev/ttyACM0', help='Serial port')
+    parser.add_argument('-b', '--baud', type=int, default=921600, help='Baud rate')
+    parser.add_argument('--timeout', type=float, default=10.0, help='Seconds to wait for an answer')
+    parser.add_argument('-o', '--output', help='Write every HIL_RESULT to this CSV file')
+    args = parser.parse_args()
+
+    if args.synthetic:
+        rng = np.random.default_rng(0)
+        logged = None
+        depth_frames = [rng.uniform(100, 2500, (25, 25)).astype(np.float32) for _ in range(args.synthetic)]
+    elif args.log:
+        logged = read_depth_log(args.log)
+        depth_frames = [f.depth for f in logged]
+    else:
+        parser.error('give a log or --synthetic N')
+    if not depth_frames:
+        sys.exit('No frames to send')
+
+    with serial.Serial(args.port, args.baud, timeout=0.5) as ser:
+        t_start = time.time()
+        results, end = run(ser, depth_frames, args.timeout)
+        seconds = time.time() - t_start
+
+    ran = [r for r in results if r.get('ran') == 1]
+    print(f'{len(results)} frames, {len(ran)} inferences in {seconds:.1f} s '
+          f'({len(results) / max(seconds, 1e-6):.1f} fps)')
+    if end.get('timeout'):
+        print('Session ended by the idle timeout')
+    for stage in ('queue_us', 'add_frame_us', 'input_fill_us', 'invoke_us', 'total_us'):
+        print(f'{stage:>14}: {percentiles([r[stage] for r in ran if stage in r])}')
+
+    if logged is not None and ran:
+        steering = np.array([r['steering'] - logged[r['frame_id']].steering for r in ran])
+        throttle = np.array([r['throttle'] - logged[r['frame_id']].throttle for r in ran])
+        print(f'MAE vs log (millis): steering {np.abs(steering).mean():.1f}, throttle {np.abs(throttle).mean():.1f}')
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write('frame_id,ran,steering,throttle,queue_us,add_frame_us,input_fill_us,invoke_us,total_us\n')
+            for r in results:
+                f.write(','.join(str(r.get(k, '')) for k in
+                        ('frame_id', 'ran', 'steering', 'throttle', 'queue_us', 'add_frame_us',
+                         'input_fill_us', 'invoke_us', 'total_us')) + '\n')
+        print(f'Results written to {args.output}')
+
+
+if __name__ == '__main__':
+    main()
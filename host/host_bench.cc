@@ -0,0 +1,552 @@
+// Host microbenchmarks for the hardware-independent stages of the depth
+// pipeline, built from the firmware's own sources (see CMakeLists.txt):
+// frame parsing, processDepth(), the reflex stop check, the
+// add_frame_to_buffer() ingest kernels, the run_inference() input fill, the
+// appendDepthFrame() record formatting and, with TFLM available, Invoke() of
+// the bundled g_model.
+//
+//   tinynav_bench [--frames N] [--iterations N] [--log FILE.bin] [--save FILE] [--check FILE]
+//
+// Prints one BENCH_STAGE line per stage (time per call in ns) and one
+// BENCH_CHECK line per equivalence check between kernel variants. --save
+// writes the quantized model frame and the prediction for every input frame,
+// --check compares this build against such a file, so an optimization can be
+// checked against the code it replaces on the same frames.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "input_kernels.h"
+#include "drive_system/depth_sensor.h"
+#include "drive_system/depth_format.h"
+#include "drive_system/frame_parser.h"
+#include "drive_system/reflex_stop.h"
+
+#ifdef TINYNAV_HOST_TFLM
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "model.h"
+#include "model_ops.h" // Generated from model.cc by generate_op_resolver.py
+#endif
+
+namespace
+{
+  constexpr int kSrcSize = INPUT_KERNEL_SRC_SIZE;
+  constexpr int kDstSize = INPUT_KERNEL_DST_SIZE;
+  constexpr int kSrcPixels = kSrcSize * kSrcSize;
+  constexpr int kDstPixels = kDstSize * kDstSize;
+  constexpr int kWindowFrames = 20; // DEFAULT_NUM_FRAMES in main_functions.cc, the bundled model
+
+  // Input quantization without a model: [0, 1] onto the full int8 range
+  constexpr float kDefaultScale = 1.0f / 255.0f;
+  constexpr int32_t kDefaultZeroPoint = -128;
+
+  constexpr uint32_t kSaveMagic = 0x42484E54; // "TNHB" in file byte order
+
+  struct Options
+  {
+    int frames = 64;
+    int iterations = 200;
+    const char *log = nullptr;
+    const char *save = nullptr;
+    const char *check = nullptr;
+  };
+
+  // -------------------- Input Frames --------------------
+  // Deterministic synthetic scene: a floor that gets further away towards the
+  // top, an obstacle sweeping across and some sensor noise
+  std::vector<std::vector<uint8_t>> synthetic_frames(int count)
+  {
+    std::vector<std::vector<uint8_t>> frames(count, std::vector<uint8_t>(kSrcPixels));
+    uint32_t rng = 12345;
+    for (int f = 0; f < count; f++)
+    {
+      int obstacle_col = f % kSrcSize;
+      for (int row = 0; row < kSrcSize; row++)
+      {
+        for (int col = 0; col < kSrcSize; col++)
+        {
+          float mm = 300.0f + (kSrcSize - row) * 80.0f;
+          if (col >= obstacle_col && col < obstacle_col + 5 && row > 8)
+            mm = 450.0f;
+          rng = rng * 1664525u + 1013904223u;
+          mm += (float)((rng >> 24) % 40) - 20.0f;
+          int raw = (int)(mm / UNIT_VALUE);
+          frames[f][row * kSrcSize + col] = (uint8_t)(raw < 0 ? 0 : (raw > 255 ? 255 : raw));
+        }
+      }
+    }
+    return frames;
+  }
+
+  // The 25x25 frames of a binary SD log (revised_log_XXXX.bin), delta records decoded
+  bool read_log_frames(const char *path, int max_frames, std::vector<std::vector<uint8_t>> *frames)
+  {
+    FILE *fp = fopen(path, "rb");
+    if (fp == nullptr)
+      return false;
+    log_file_header_t header;
+    bool ok = fread(&header, 1, sizeof(header), fp) == sizeof(header) &&
+              memcmp(header.magic, LOG_FILE_MAGIC, sizeof(header.magic)) == 0;
+    std::vector<uint8_t> raw(MAX_FRAME_PIXELS);
+    std::vector<uint8_t> payload(MAX_FRAME_PIXELS);
+    int raw_pixels = 0;
+    log_record_header_t record;
+    while (ok && (int)frames->size() < max_frames && fread(&record, 1, sizeof(record), fp) == sizeof(record))
+    {
+      int pixels = record.width * record.height;
+      if (record.magic != LOG_RECORD_MAGIC || record.payload_bytes > MAX_FRAME_PIXELS || pixels > MAX_FRAME_PIXELS ||
+          fread(payload.data(), 1, record.payload_bytes, fp) != record.payload_bytes)
+        break;
+      if (record.pixel_encoding == LOG_PIXELS_RAW && record.payload_bytes == pixels)
+        memcpy(raw.data(), payload.data(), pixels);
+      else if (record.pixel_encoding != LOG_PIXELS_DELTA || raw_pixels != pixels ||
+               !log_delta_apply(payload.data(), record.payload_bytes, raw.data(), pixels))
+        break;
+      raw_pixels = pixels;
+      if (record.width == kSrcSize && record.height == kSrcSize)
+        frames->emplace_back(raw.begin(), raw.begin() + pixels);
+    }
+    fclose(fp);
+    return ok && !frames->empty();
+  }
+
+  // Sensor packet for a frame, as the UART delivers it (see frame_parser.h)
+  std::vector<uint8_t> build_packet(const std::vector<uint8_t> &pixels, uint16_t frame_id)
+  {
+    FrameHeader header = {};
+    header.frame_begin_flag = 0xFF00;
+    header.frame_data_len = (uint16_t)(FRAME_MIN_DATA_LEN + pixels.size());
+    header.resolution_rows = kSrcSize;
+    header.resolution_cols = kSrcSize;
+    header.frame_id = frame_id;
+    // Header, pixels, checksum over both, end flag
+    std::vector<uint8_t> packet(sizeof(header) + pixels.size() + 2);
+    memcpy(packet.data(), &header, sizeof(header));
+    memcpy(packet.data() + sizeof(header), pixels.data(), pixels.size());
+    uint8_t sum = 0;
+    for (size_t i = 0; i < packet.size() - 2; i++)
+      sum += packet[i];
+    packet[packet.size() - 2] = sum;
+    packet[packet.size() - 1] = 0xDD;
+    return packet;
+  }
+
+  // -------------------- Timing --------------------
+  int64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Time calls of fn(frame_index), every frame `iterations` times
+  template <typename Fn>
+  void bench_stage(const char *name, int frames, int iterations, Fn fn)
+  {
+    std::vector<int64_t> ns;
+    ns.reserve((size_t)frames * iterations);
+    for (int it = 0; it < iterations; it++)
+    {
+      for (int f = 0; f < frames; f++)
+      {
+        int64_t t0 = now_ns();
+        fn(f);
+        ns.push_back(now_ns() - t0);
+      }
+    }
+    if (ns.empty())
+      return;
+    int64_t sum = 0;
+    for (int64_t v : ns)
+      sum += v;
+    std::sort(ns.begin(), ns.end());
+    auto pct = [&](int p) { return (long long)ns[(ns.size() - 1) * p / 100]; };
+    printf("BENCH_STAGE:%s:calls:%zu:mean_ns:%lld:p50_ns:%lld:p99_ns:%lld\n", name, ns.size(),
+           (long long)(sum / (int64_t)ns.size()), pct(50), pct(99));
+  }
+
+  // Differing values between two results, and the largest difference
+  struct Mismatch
+  {
+    int count = 0;
+    int max_diff = 0;
+    void add(const int8_t *a, const int8_t *b, int n)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        int diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        count += diff != 0;
+        max_diff = diff > max_diff ? diff : max_diff;
+      }
+    }
+  };
+
+  void report_check(const char *name, int mismatches)
+  {
+    if (mismatches == 0)
+      printf("BENCH_CHECK:%s:ok\n", name);
+    else
+      printf("BENCH_CHECK:%s:mismatch:%d\n", name, mismatches);
+  }
+
+  void report_check(const char *name, const Mismatch &m)
+  {
+    if (m.count == 0)
+      printf("BENCH_CHECK:%s:ok\n", name);
+    else
+      printf("BENCH_CHECK:%s:mismatch:%d:max_lsb:%d\n", name, m.count, m.max_diff);
+  }
+
+  // A 2x2 near blob at known upright (model view) positions: ahead of the car
+  // it has to trigger, on the floor below the region or at the far left it
+  // must not. The model input of the blob frame has to show it at the same
+  // upright position. Returns the number of failed cases.
+  int check_reflex_roi(uint8_t near_raw, float scale, int32_t zero_point)
+  {
+    struct Blob
+    {
+      int row, col; // Upright, top left pixel
+      bool near;
+    };
+    const Blob blobs[] = {
+        {kSrcSize * REFLEX_ROI_TOP_PCT / 100, kSrcSize * REFLEX_ROI_LEFT_PCT / 100, true}, // Ahead, top left of the region
+        {kSrcSize * REFLEX_ROI_BOTTOM_PCT / 100, kSrcSize / 2, false},                      // Floor
+        {kSrcSize * REFLEX_ROI_TOP_PCT / 100, 0, false},                                    // Far left
+    };
+    static uint8_t pixels[kSrcPixels];
+    alignas(4) static int8_t ingested[kDstPixels];
+    int8_t lut[INPUT_KERNEL_LUT_SIZE];
+    build_raw_input_lut(depth_mm_lut.mm, lut, scale, zero_point);
+    sensor_frame_t frame = {};
+    frame.rows = kSrcSize;
+    frame.cols = kSrcSize;
+    frame.pixels = pixels;
+
+    int errors = lut[near_raw - 1] == lut[255] ? 1 : 0; // Else the blob wouldn't show in the model input
+    for (const Blob &blob : blobs)
+    {
+      memset(pixels, 255, sizeof(pixels));
+      for (int i = blob.row; i < blob.row + 2; i++)
+        for (int j = blob.col; j < blob.col + 2; j++)
+          pixels[(kSrcSize - 1 - j) * kSrcSize + i] = (uint8_t)(near_raw - 1); // upright[i][j] = raw[24-j][i]
+      uint8_t min_raw;
+      int near = depth_count_near(&frame, REFLEX_ROI_TOP_PCT, REFLEX_ROI_BOTTOM_PCT, REFLEX_ROI_LEFT_PCT,
+                                  REFLEX_ROI_RIGHT_PCT, near_raw, &min_raw);
+      if ((near >= REFLEX_STOP_MIN_PIXELS) != blob.near)
+        errors++;
+      ingest_raw_frame(pixels, ingested, lut);
+      if (ingested[blob.row * kDstSize + blob.col] != lut[near_raw - 1])
+        errors++;
+    }
+    return errors;
+  }
+
+  bool parse_options(int argc, char **argv, Options *opt)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+      const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (value == nullptr)
+        return false;
+      if (strcmp(arg, "--frames") == 0)
+        opt->frames = atoi(value);
+      else if (strcmp(arg, "--iterations") == 0)
+        opt->iterations = atoi(value);
+      else if (strcmp(arg, "--log") == 0)
+        opt->log = value;
+      else if (strcmp(arg, "--save") == 0)
+        opt->save = value;
+      else if (strcmp(arg, "--check") == 0)
+        opt->check = value;
+      else
+        return false;
+      i++;
+    }
+    return opt->frames > 0 && opt->iterations > 0;
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  if (!parse_options(argc, argv, &opt))
+  {
+    fprintf(stderr, "usage: %s [--frames N] [--iterations N] [--log FILE.bin] [--save FILE] [--check FILE]\n",
+            argv[0]);
+    return 2;
+  }
+
+  std::vector<std::vector<uint8_t>> raw_frames;
+  if (opt.log != nullptr)
+  {
+    if (!read_log_frames(opt.log, opt.frames, &raw_frames))
+    {
+      fprintf(stderr, "No 25x25 frames in %s\n", opt.log);
+      return 1;
+    }
+  }
+  else
+  {
+    raw_frames = synthetic_frames(opt.frames);
+  }
+  const int frames = (int)raw_frames.size();
+  printf("BENCH_START:frames:%d:iterations:%d:source:%s\n", frames, opt.iterations,
+         opt.log != nullptr ? opt.log : "synthetic");
+
+  // -------------------- Model --------------------
+  float scale = kDefaultScale;
+  int32_t zero_point = kDefaultZeroPoint;
+#ifdef TINYNAV_HOST_TFLM
+  static ModelOpResolver resolver;
+  alignas(16) static uint8_t tensor_arena[kTensorArenaSize];
+  if (register_model_ops(resolver) != kTfLiteOk)
+  {
+    fprintf(stderr, "Failed to register model ops\n");
+    return 1;
+  }
+  tflite::MicroInterpreter interpreter(tflite::GetModel(g_model), resolver, tensor_arena, kTensorArenaSize);
+  if (interpreter.AllocateTensors() != kTfLiteOk || interpreter.outputs_size() < 2 ||
+      interpreter.input(0)->bytes != (size_t)(kDstPixels * kWindowFrames))
+  {
+    fprintf(stderr, "g_model does not fit the 24x24x20 pipeline\n");
+    return 1;
+  }
+  TfLiteTensor *input = interpreter.input(0);
+  scale = input->params.scale;
+  zero_point = input->params.zero_point;
+  printf("BENCH_MODEL:arena_used:%zu:arena:%d:scale:%g:zero_point:%d\n", interpreter.arena_used_bytes(),
+         kTensorArenaSize, scale, (int)zero_point);
+#else
+  printf("BENCH_MODEL:none (configure with TFLM_DIR for the interpreter)\n");
+#endif
+
+  // -------------------- Sensor Input --------------------
+  std::vector<std::vector<uint8_t>> packets;
+  for (int f = 0; f < frames; f++)
+    packets.push_back(build_packet(raw_frames[f], (uint16_t)f));
+
+  static frame_parser_t parser;
+  frame_parser_reset(&parser);
+  static uint8_t packet_out[MAX_FRAME_BYTES];
+  bench_stage("frame_parser", frames, opt.iterations, [&](int f) {
+    bool checksum_ok;
+    frame_parser_push(&parser, packets[f].data(), packets[f].size());
+    frame_parser_next(&parser, packet_out, sizeof(packet_out), &checksum_ok);
+  });
+  report_check("frame_parser", (int)(parser.checksum_errors + parser.resync_bytes + parser.overflow_bytes));
+
+  static uint8_t pixels[MAX_FRAME_PIXELS];
+  sensor_frame_t frame = {};
+  frame.rows = kSrcSize;
+  frame.cols = kSrcSize;
+  frame.pixels = pixels;
+  bench_stage("process_depth", frames, opt.iterations, [&](int f) {
+    depth_copy_packet_pixels(&frame, packets[f].data(), (int)packets[f].size());
+  });
+
+  std::vector<std::vector<float>> depth_mm(frames, std::vector<float>(kSrcPixels));
+  for (int f = 0; f < frames; f++)
+  {
+    frame.pixels = raw_frames[f].data();
+    depth_frame_to_mm(&frame, depth_mm[f].data());
+  }
+  frame.pixels = pixels;
+  bench_stage("frame_to_mm", frames, opt.iterations, [&](int f) {
+    frame.pixels = raw_frames[f].data();
+    depth_frame_to_mm(&frame, depth_mm[f].data());
+  });
+  frame.pixels = pixels;
+  // Reflex stop region scan, at this build's REFLEX_* settings
+  uint8_t near_raw = 1;
+  while (near_raw < 255 && depth_mm_lut.mm[near_raw] < REFLEX_STOP_MM)
+    near_raw++;
+  bench_stage("reflex_check", frames, opt.iterations, [&](int f) {
+    frame.pixels = raw_frames[f].data();
+    uint8_t min_raw;
+    depth_count_near(&frame, REFLEX_ROI_TOP_PCT, REFLEX_ROI_BOTTOM_PCT, REFLEX_ROI_LEFT_PCT, REFLEX_ROI_RIGHT_PCT,
+                     near_raw, &min_raw);
+  });
+  frame.pixels = pixels;
+
+  report_check("reflex_upright_roi", check_reflex_roi(near_raw, scale, zero_point));
+
+  // -------------------- Ingest (add_frame_to_buffer) --------------------
+  int8_t lut[INPUT_KERNEL_LUT_SIZE];
+  build_raw_input_lut(depth_mm_lut.mm, lut, scale, zero_point);
+  std::vector<int8_t> ingested_scalar((size_t)frames * kDstPixels);
+  std::vector<int8_t> model_frames((size_t)frames * kDstPixels); // What add_raw_frame_to_buffer() puts in the ring
+  alignas(4) static int8_t ingested[kDstPixels];
+  static float resampled[kDstPixels];
+  auto as_map = [&](int f) { return reinterpret_cast<const float(*)[kSrcSize]>(depth_mm[f].data()); };
+
+  bench_stage("ingest_scalar", frames, opt.iterations, [&](int f) {
+    ingest_frame_scalar(as_map(f), &ingested_scalar[(size_t)f * kDstPixels], scale, zero_point);
+  });
+  Mismatch raw_mismatches;
+  for (int f = 0; f < frames; f++)
+  {
+    ingest_raw_frame(raw_frames[f].data(), ingested, lut);
+    raw_mismatches.add(ingested, &ingested_scalar[(size_t)f * kDstPixels], kDstPixels);
+    memcpy(&model_frames[(size_t)f * kDstPixels], ingested, kDstPixels);
+  }
+  bench_stage("ingest_raw", frames, opt.iterations,
+              [&](int f) { ingest_raw_frame(raw_frames[f].data(), ingested, lut); });
+  bench_stage("resample_frame", frames, opt.iterations, [&](int f) {
+    resample_frame(depth_mm[f].data(), kSrcSize, kSrcSize, resampled, kDstSize, kDstSize);
+  });
+  report_check("ingest_raw_vs_scalar", raw_mismatches);
+
+  // -------------------- Input Fill (run_inference) --------------------
+  // Newest kWindowFrames frames in chronological order, as run_inference() fills the tensor
+  std::vector<int8_t> window_scalar((size_t)kDstPixels * kWindowFrames);
+  std::vector<int8_t> window_fast((size_t)kDstPixels * kWindowFrames);
+  auto window_frame = [&](int end, int idx) {
+    int f = end - kWindowFrames + idx;
+    return &model_frames[(size_t)((f % frames + frames) % frames) * kDstPixels];
+  };
+  bench_stage("input_fill_scalar", frames, opt.iterations, [&](int f) {
+    for (int idx = 0; idx < kWindowFrames; idx++)
+      scatter_channel_scalar(window_frame(f, idx), &window_scalar[idx], kWindowFrames, kDstPixels);
+  });
+  Mismatch fill_mismatches;
+  for (int f = 0; f < frames; f++)
+  {
+    for (int idx = 0; idx < kWindowFrames; idx++)
+    {
+      scatter_channel_scalar(window_frame(f, idx), &window_scalar[idx], kWindowFrames, kDstPixels);
+      scatter_channel_fast(window_frame(f, idx), &window_fast[idx], kWindowFrames, kDstPixels);
+    }
+    fill_mismatches.add(window_fast.data(), window_scalar.data(), (int)window_fast.size());
+  }
+  bench_stage("input_fill_fast", frames, opt.iterations, [&](int f) {
+    for (int idx = 0; idx < kWindowFrames; idx++)
+      scatter_channel_fast(window_frame(f, idx), &window_fast[idx], kWindowFrames, kDstPixels);
+  });
+  // What run_inference() runs: the kernels instantiated for the window length
+  std::vector<int8_t> window_gather((size_t)kDstPixels * kWindowFrames);
+  const int8_t *gather_frames[kWindowFrames];
+  auto gather = [&](int f) {
+    for (int idx = 0; idx < kWindowFrames; idx++)
+      gather_frames[idx] = window_frame(f, idx);
+    gather_window<kWindowFrames>(gather_frames, window_gather.data(), kDstPixels);
+  };
+  bench_stage("input_fill_gather", frames, opt.iterations, gather);
+  Mismatch gather_mismatches;
+  for (int f = 0; f < frames; f++)
+  {
+    for (int idx = 0; idx < kWindowFrames; idx++)
+      scatter_channel_scalar(window_frame(f, idx), &window_scalar[idx], kWindowFrames, kDstPixels);
+    gather(f);
+    gather_mismatches.add(window_gather.data(), window_scalar.data(), (int)window_gather.size());
+  }
+  report_check("input_fill_fast_vs_scalar", fill_mismatches);
+  report_check("input_fill_gather_vs_scalar", gather_mismatches);
+
+  // -------------------- SD Log Formatting (appendDepthFrame) --------------------
+  static uint8_t record[SD_RECORD_MAX];
+  static char line[SD_LINE_MAX];
+  static uint8_t delta[SD_RECORD_MAX];
+  bench_stage("log_record", frames, opt.iterations, [&](int f) {
+    frame.pixels = raw_frames[f].data();
+    depth_format_record(&frame, (uint32_t)f, 0.25f, 0.5f, record);
+  });
+  bench_stage("log_csv_line", frames, opt.iterations, [&](int f) {
+    depth_format_csv_line((uint32_t)f, 0.25f, 0.5f, depth_mm[f].data(), kSrcSize, kSrcSize, line, sizeof(line));
+  });
+  bench_stage("log_delta_encode", frames, opt.iterations, [&](int f) {
+    log_delta_encode(raw_frames[f].data(), raw_frames[(f + frames - 1) % frames].data(), kSrcPixels, delta,
+                     kSrcPixels - 1);
+  });
+  int delta_mismatches = 0;
+  for (int f = 1; f < frames; f++)
+  {
+    int len = log_delta_encode(raw_frames[f].data(), raw_frames[f - 1].data(), kSrcPixels, delta, kSrcPixels - 1);
+    if (len < 0)
+      continue; // Stored as a keyframe on the car
+    memcpy(pixels, raw_frames[f - 1].data(), kSrcPixels);
+    if (!log_delta_apply(delta, len, pixels, kSrcPixels))
+      delta_mismatches++;
+    else
+      delta_mismatches += memcmp(pixels, raw_frames[f].data(), kSrcPixels) != 0;
+  }
+  frame.pixels = pixels;
+  report_check("log_delta_round_trip", delta_mismatches);
+
+  // -------------------- Inference --------------------
+  std::vector<float> predictions((size_t)frames * 2, 0.0f);
+#ifdef TINYNAV_HOST_TFLM
+  auto fill_and_invoke = [&](int f) {
+    for (int idx = 0; idx < kWindowFrames; idx++)
+      scatter_channel_fast(window_frame(f, idx), &input->data.int8[idx], kWindowFrames, kDstPixels);
+    return interpreter.Invoke();
+  };
+  int invoke_errors = 0;
+  for (int f = kWindowFrames - 1; f < frames; f++)
+  {
+    if (fill_and_invoke(f) != kTfLiteOk)
+    {
+      invoke_errors++;
+      continue;
+    }
+    // Dequantized and clamped like store_prediction(), output 0 is throttle
+    const TfLiteTensor *throttle = interpreter.output(0);
+    const TfLiteTensor *steering = interpreter.output(1);
+    float s = (steering->data.int8[0] - steering->params.zero_point) * steering->params.scale;
+    float t = (throttle->data.int8[0] - throttle->params.zero_point) * throttle->params.scale;
+    predictions[(size_t)f * 2] = s < -1.0f ? -1.0f : (s > 1.0f ? 1.0f : s);
+    predictions[(size_t)f * 2 + 1] = t < -1.0f ? -1.0f : (t > 1.0f ? 1.0f : t);
+  }
+  report_check("invoke", invoke_errors);
+  int invoke_iterations = opt.iterations / 10 > 0 ? opt.iterations / 10 : 1; // Invoke() is ms, not us
+  bench_stage("invoke", frames, invoke_iterations, [&](int f) { interpreter.Invoke(); });
+  bench_stage("fill_and_invoke", frames, invoke_iterations, [&](int f) { fill_and_invoke(f); });
+#endif
+
+  // -------------------- Save / Check --------------------
+  if (opt.save != nullptr)
+  {
+    FILE *fp = fopen(opt.save, "wb");
+    uint32_t head[2] = {kSaveMagic, (uint32_t)frames};
+    bool ok = fp != nullptr && fwrite(head, sizeof(head), 1, fp) == 1 &&
+              fwrite(model_frames.data(), 1, model_frames.size(), fp) == model_frames.size() &&
+              fwrite(predictions.data(), sizeof(float), predictions.size(), fp) == predictions.size();
+    if (fp != nullptr)
+      fclose(fp);
+    printf("BENCH_SAVE:%s:%s\n", opt.save, ok ? "ok" : "failed");
+  }
+  if (opt.check != nullptr)
+  {
+    FILE *fp = fopen(opt.check, "rb");
+    uint32_t head[2] = {};
+    std::vector<int8_t> ref_frames(model_frames.size());
+    std::vector<float> ref_predictions(predictions.size());
+    bool ok = fp != nullptr && fread(head, sizeof(head), 1, fp) == 1 && head[0] == kSaveMagic &&
+              head[1] == (uint32_t)frames &&
+              fread(ref_frames.data(), 1, ref_frames.size(), fp) == ref_frames.size() &&
+              fread(ref_predictions.data(), sizeof(float), ref_predictions.size(), fp) == ref_predictions.size();
+    if (fp != nullptr)
+      fclose(fp);
+    if (!ok)
+    {
+      printf("BENCH_CHECK:reference:unreadable (saved from another --frames/--log?)\n");
+      return 1;
+    }
+    Mismatch frame_mismatches;
+    frame_mismatches.add(ref_frames.data(), model_frames.data(), (int)ref_frames.size());
+    report_check("reference_frames", frame_mismatches);
+    int prediction_mismatches = 0;
+    for (size_t i = 0; i < predictions.size(); i++)
+      prediction_mismatches += predictions[i] != ref_predictions[i];
+    report_check("reference_predictions", prediction_mismatches);
+  }
+
+  printf("BENCH_END\n");
+  return 0;
+}
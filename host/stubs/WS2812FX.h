@@ -0,0 +1,4 @@
+#pragma once
+
+// Host build: depth_sensor.h pulls in the LED library, nothing in the
+// benchmarked code uses it
@@ -0,0 +1,5 @@
+#pragma once
+
+// Host build: the only part of the UART driver depth_sensor.h names
+typedef int uart_port_t;
+#define UART_NUM_2 2
@@ -0,0 +1,163 @@
+#include "boot_init.h"
+#include "power_manager.h"
+#include "task_layout.h"
+#include <stdio.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include "led_manager.h"
+
+#define BOOT_LED_BLINK_SPEED 200 // ms per blink while booting
+#define BOOT_LED_RESULT_MS 2000  // How long the result stays on the LEDs
+
+typedef struct
+{
+  bool (*fn)();
+  uint32_t needs;   // Steps that must be done first
+  int64_t start_us; // 0 = not started
+  int64_t end_us;   // 0 = not done
+  int8_t core;
+  bool ok;
+} boot_step_info_t;
+
+static const char *const g_step_names[BOOT_STEP_COUNT] = {"sd", "sd_log", "sensor", "drive", "model"};
+
+static EventGroupHandle_t g_done = nullptr;
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static boot_step_info_t g_steps[BOOT_STEP_COUNT] = {}; // Under g_lock
+static int64_t g_ready_us = 0;                         // All steps done, under g_lock
+
+static void show_progress(uint32_t done, bool failed)
+{
+  if (done != BOOT_ALL_STEPS)
+  {
+    led_manager_set(LED_PRIORITY_HIGH, FX_MODE_BLINK, failed ? RED : YELLOW, BOOT_LED_BLINK_SPEED, 0);
+  }
+  else if (failed)
+  {
+    led_manager_set(LED_PRIORITY_HIGH, FX_MODE_BLINK, RED, BOOT_LED_BLINK_SPEED, BOOT_LED_RESULT_MS);
+  }
+  else
+  {
+    led_manager_set(LED_PRIORITY_HIGH, FX_MODE_STATIC, GREEN, 0, BOOT_LED_RESULT_MS);
+  }
+}
+
+static void step_begin(boot_step_t step)
+{
+  portENTER_CRITICAL(&g_lock);
+  g_steps[step].start_us = esp_timer_get_time();
+  g_steps[step].core = (int8_t)xPortGetCoreID();
+  portEXIT_CRITICAL(&g_lock);
+}
+
+static void step_done(boot_step_t step, bool ok)
+{
+  int64_t now = esp_timer_get_time();
+  uint32_t done = 0;
+  bool failed = false;
+  portENTER_CRITICAL(&g_lock);
+  g_steps[step].end_us = now;
+  g_steps[step].ok = ok;
+  for (int i = 0; i < BOOT_STEP_COUNT; i++)
+  {
+    if (g_steps[i].end_us != 0)
+    {
+      done |= BOOT_BIT(i);
+      failed |= !g_steps[i].ok;
+    }
+  }
+  // Under the lock, so a step finishing at the same time can't put the
+  // blinking back after the result
+  show_progress(done, failed);
+  if (done == BOOT_ALL_STEPS)
+  {
+    g_ready_us = now;
+  }
+  portEXIT_CRITICAL(&g_lock);
+
+  printf("Boot: %s %s after %d ms\n", g_step_names[step], ok ? "ready" : "FAILED", (int)(now / 1000));
+  if (done == BOOT_ALL_STEPS)
+  {
+    power_release(POWER_LOCK_BOOT);
+  }
+  xEventGroupSetBits(g_done, BOOT_BIT(step));
+}
+
+static void boot_task(void *arg)
+{
+  boot_step_t step = (boot_step_t)(intptr_t)arg;
+  boot_wait(g_steps[step].needs);
+  boot_run(step, g_steps[step].fn);
+  vTaskDelete(NULL);
+}
+
+void boot_init()
+{
+  g_done = xEventGroupCreate();
+  configASSERT(g_done != nullptr);
+  power_acquire(POWER_LOCK_BOOT); // Boot at the full clock
+  show_progress(0, false);
+}
+
+bool boot_start(boot_step_t step, bool (*fn)(), uint32_t needs, int core)
+{
+  g_steps[step].fn = fn;
+  g_steps[step].needs = needs;
+  if (xTaskCreatePinnedToCore(boot_task, "boot", BOOT_TASK_STACK, (void *)(intptr_t)step, BOOT_TASK_PRIORITY, NULL,
+                              core) != pdPASS)
+  {
+    printf("Boot: cannot create the task for %s\n", g_step_names[step]);
+    step_begin(step);
+    step_done(step, false);
+    return false;
+  }
+  return true;
+}
+
+void boot_run(boot_step_t step, bool (*fn)())
+{
+  step_begin(step);
+  step_done(step, fn());
+}
+
+void boot_wait(uint32_t steps)
+{
+  if (steps != 0)
+  {
+    xEventGroupWaitBits(g_done, steps, pdFALSE, pdTRUE, portMAX_DELAY);
+  }
+}
+
+bool boot_step_ok(boot_step_t step)
+{
+  portENTER_CRITICAL(&g_lock);
+  bool ok = g_steps[step].end_us != 0 && g_steps[step].ok;
+  portEXIT_CRITICAL(&g_lock);
+  return ok;
+}
+
+void boot_print()
+{
+  boot_step_info_t steps[BOOT_STEP_COUNT];
+  portENTER_CRITICAL(&g_lock);
+  for (int i = 0; i < BOOT_STEP_COUNT; i++)
+  {
+    steps[i] = g_steps[i];
+  }
+  int64_t ready_us = g_ready_us;
+  portEXIT_CRITICAL(&g_lock);
+
+  printf("BOOT_START\n");
+  for (int i = 0; i < BOOT_STEP_COUNT; i++)
+  {
+    const boot_step_info_t *s = &steps[i];
+    const char *state = s->end_us == 0 ? "pending" : s->ok ? "ok" : "failed";
+    printf("BOOT_STEP:%s:%s:core:%d:start_ms:%d:end_ms:%d\n", g_step_names[i], state,
+           s->start_us != 0 ? s->core : -1, (int)(s->start_us / 1000), (int)(s->end_us / 1000));
+  }
+  task_layout_print();
+  printf("BOOT_READY:ms:%d\n", ready_us != 0 ? (int)(ready_us / 1000) : -1);
+  printf("BOOT_END\n");
+}
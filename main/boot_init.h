@@ -0,0 +1,51 @@
+#ifndef BOOT_INIT_H
+#define BOOT_INIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Boot runs as init steps in parallel instead of one after another: the SD
+// card, the log file and the model load on their own tasks while the main
+// task configures the depth sensor. Every step sets its bit in an event group
+// when it is done, successful or not, and a step only starts once the bits
+// of the steps it needs are set. The LEDs blink yellow until all steps are
+// done (red once one failed), then show green (or red) for a moment.
+
+#define BOOT_TASK_STACK 6144 // The model step builds the interpreter
+#define BOOT_TASK_PRIORITY 5
+
+typedef enum
+{
+  BOOT_STEP_SD = 0, // sd_card_init()
+  BOOT_STEP_SD_LOG, // Log file, SD writer and flight recorder (needs the card)
+  BOOT_STEP_SENSOR, // Depth sensor handshake and configuration
+  BOOT_STEP_DRIVE,  // RC capture, motors, battery and the drive task
+  BOOT_STEP_MODEL,  // Model, tensor arena, frame ring and inference task (the model may be on the card)
+  BOOT_STEP_COUNT,
+} boot_step_t;
+
+#define BOOT_BIT(step) (1u << (step))
+#define BOOT_ALL_STEPS (BOOT_BIT(BOOT_STEP_COUNT) - 1)
+
+// Create the event group and hold the full clock until boot is done. Call
+// once, before any other boot_ function.
+void boot_init();
+
+// Run fn on a new task pinned to core once every step in `needs` is done.
+// fn's result is the step's. False if the task could not be created (the
+// step is then done and failed).
+bool boot_start(boot_step_t step, bool (*fn)(), uint32_t needs, int core);
+
+// Run fn on the calling task now
+void boot_run(boot_step_t step, bool (*fn)());
+
+// Block until every step in `steps` is done
+void boot_wait(uint32_t steps);
+
+// Done and successful
+bool boot_step_ok(boot_step_t step);
+
+// Print BOOT_START ... BOOT_END, see SERIAL_DOWNLOAD.md
+void boot_print();
+
+#endif // BOOT_INIT_H
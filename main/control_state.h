@@ -0,0 +1,79 @@
+#ifndef CONTROL_STATE_H
+#define CONTROL_STATE_H
+
+#include <stdint.h>
+
+// Steering and throttle travel between tasks (and cores) as whole snapshots:
+// the inference result from the inference task to the drive task, and the
+// command the drive task applied to the motors for the logger and the LEDs.
+// Every snapshot carries where it came from, a sequence number and when it
+// was published, so a reader can tell how old it is.
+
+typedef enum
+{
+  CONTROL_SOURCE_NONE = 0,  // Nothing published yet
+  CONTROL_SOURCE_RC,        // Receiver channels
+  CONTROL_SOURCE_INFERENCE, // Model output
+  CONTROL_SOURCE_FALLBACK,  // Inference result too old, INFERENCE_FALLBACK_POLICY applied
+  CONTROL_SOURCE_REFLEX,    // Reflex stop holding off a forward command (reflex_stop.h)
+} control_source_t;
+
+typedef struct
+{
+  uint32_t seq;         // Publication number, set by publish()
+  uint8_t source;       // control_source_t
+  int8_t mode;          // write_to_sd when it was published
+  uint8_t brake;        // Motors actively braked
+  uint8_t reserved;
+  int64_t timestamp_us; // When it was published
+  int64_t frame_us;     // Inference: arrival of the newest frame behind it, 0 otherwise
+  float steering;       // -1 (right) to +1 (left)
+  float throttle;       // -1 (reverse) to +1 (forward)
+  float ch3;            // 0 to 1, RC mode switch
+} control_state_t;
+
+// Double-buffered snapshot. publish() fills the slot readers are not on and
+// then moves seq to it; read() copies the current slot and retries only if a
+// publish completed in the meantime. Reads never lock and never wait on a
+// writer that was preempted halfway. One writer at a time per channel.
+class ControlChannel
+{
+public:
+  void publish(control_state_t state)
+  {
+    uint32_t seq = __atomic_load_n(&seq_, __ATOMIC_RELAXED) + 1;
+    state.seq = seq;
+    // The slot being overwritten was current two publications ago; readers
+    // still on it see seq move and retry
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slots_[seq & 1] = state;
+    __atomic_store_n(&seq_, seq, __ATOMIC_RELEASE);
+  }
+
+  // Latest snapshot; false (and source CONTROL_SOURCE_NONE) if none was published yet
+  bool read(control_state_t *out) const
+  {
+    while (true)
+    {
+      uint32_t seq = __atomic_load_n(&seq_, __ATOMIC_ACQUIRE);
+      *out = slots_[seq & 1];
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&seq_, __ATOMIC_RELAXED) == seq)
+        return seq != 0;
+    }
+  }
+
+private:
+  control_state_t slots_[2] = {};
+  uint32_t seq_ = 0;
+};
+
+// Model output (store_prediction(), inference or head task). Read it through
+// get_inference_result(), which also drops results from before the last
+// reset_frame_buffer().
+extern ControlChannel g_inference_result;
+
+// What drive_system_loop() last sent to the motors (drive task)
+extern ControlChannel g_drive_command;
+
+#endif // CONTROL_STATE_H
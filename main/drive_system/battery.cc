@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <atomic> // Before WS2812FX.h (via led_manager.h), which defines min()
+#include "battery.h"
+#include "driver/gpio.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_timer.h"
+#include "../led_manager.h"
+
+#define ADC_GPIO GPIO_NUM_51
+#define ADC_UNIT ADC_UNIT_2
+#define ADC_CHANNEL ADC_CHANNEL_2
+#define ADC_ATTEN ADC_ATTEN_DB_12
+
+// Voltage divider resistor values (in ohms)
+#define R1 30000.0f
+#define R2 7500.0f
+#define REF_VOLTAGE 3.3f
+
+#define BATTERY_FRAME_BYTES (BATTERY_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+#define BATTERY_POOL_BYTES (BATTERY_FRAME_BYTES * 8)
+#define BATTERY_LOW_BLINK_PERIOD_MS 5000 // Low: a short warning this often, so the mode LEDs stay readable
+#define BATTERY_LOW_BLINK_MS 500
+
+static adc_continuous_handle_t adc_handle = NULL;
+static adc_cali_handle_t cali_handle = NULL;
+
+// Moving average over the last BATTERY_FILTER_READINGS means, battery_update() only
+static float readings[BATTERY_FILTER_READINGS];
+static int reading_count = 0;
+static int reading_next = 0;
+static float reading_sum = 0.0f;
+static int64_t last_led_ms = 0;
+
+static std::atomic<float> g_voltage{0.0f};
+static std::atomic<int> g_state{BATTERY_UNKNOWN};
+
+void battery_init()
+{
+  // Analog input, no digital pad functions
+  gpio_config_t io_conf = {
+      .pin_bit_mask = (1ULL << ADC_GPIO),
+      .mode = GPIO_MODE_DISABLE,
+      .pull_up_en = GPIO_PULLUP_DISABLE,
+      .pull_down_en = GPIO_PULLDOWN_DISABLE,
+      .intr_type = GPIO_INTR_DISABLE,
+      .hys_ctrl_mode = GPIO_HYS_SOFT_DISABLE,
+  };
+  gpio_config(&io_conf);
+
+  adc_continuous_handle_cfg_t handle_config = {};
+  handle_config.max_store_buf_size = BATTERY_POOL_BYTES;
+  handle_config.conv_frame_size = BATTERY_FRAME_BYTES;
+  handle_config.flags.flush_pool = 1; // Main loop stalled (replay bench): drop the old samples, keep sampling
+  if (adc_continuous_new_handle(&handle_config, &adc_handle) != ESP_OK)
+  {
+    printf("Battery: cannot create the ADC continuous driver, voltage unknown\n");
+    adc_handle = NULL;
+    return;
+  }
+
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN;
+  pattern.channel = ADC_CHANNEL;
+  pattern.unit = ADC_UNIT;
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  adc_continuous_config_t adc_config = {};
+  adc_config.pattern_num = 1;
+  adc_config.adc_pattern = &pattern;
+  adc_config.sample_freq_hz = BATTERY_SAMPLE_HZ;
+  adc_config.conv_mode = ADC_CONV_SINGLE_UNIT_2;
+  adc_config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+  if (adc_continuous_config(adc_handle, &adc_config) != ESP_OK || adc_continuous_start(adc_handle) != ESP_OK)
+  {
+    printf("Battery: cannot start the ADC conversion, voltage unknown\n");
+    adc_handle = NULL;
+    return;
+  }
+
+  // Initialize calibration (ESP32-P4 uses curve fitting)
+  adc_cali_curve_fitting_config_t cali_config = {
+      .unit_id = ADC_UNIT,
+      .chan = ADC_CHANNEL,
+      .atten = ADC_ATTEN,
+      .bitwidth = ADC_BITWIDTH_12,
+  };
+  if (adc_cali_create_scheme_curve_fitting(&cali_config, &cali_handle) != ESP_OK)
+  {
+    printf("Battery: ADC calibration not available\n");
+    cali_handle = NULL;
+  }
+  printf("Battery: ADC DMA at %d Hz on GPIO %d, low below %d mV, critical below %d mV\n", BATTERY_SAMPLE_HZ, ADC_GPIO,
+         (int)(BATTERY_LOW_V * 1000), (int)(BATTERY_CRITICAL_V * 1000));
+}
+
+// Divider input voltage for a raw ADC reading
+static float raw_to_volts(int raw)
+{
+  float adc_voltage;
+  int adc_voltage_mv;
+  if (cali_handle != NULL && adc_cali_raw_to_voltage(cali_handle, raw, &adc_voltage_mv) == ESP_OK)
+  {
+    adc_voltage = adc_voltage_mv / 1000.0f;
+  }
+  else
+  {
+    // Fallback if no calibration (less accurate)
+    adc_voltage = (raw / 4095.0f) * REF_VOLTAGE;
+  }
+  // Vin = Vadc * (R1 + R2) / R2
+  return adc_voltage * (R1 + R2) / R2;
+}
+
+static battery_state_t next_state(battery_state_t state, float volts)
+{
+  if (volts < BATTERY_CRITICAL_V)
+    return BATTERY_CRITICAL;
+  if (state == BATTERY_CRITICAL && volts < BATTERY_CRITICAL_V + BATTERY_HYSTERESIS_V)
+    return BATTERY_CRITICAL;
+  if (volts < BATTERY_LOW_V)
+    return BATTERY_LOW;
+  if ((state == BATTERY_LOW || state == BATTERY_CRITICAL) && volts < BATTERY_LOW_V + BATTERY_HYSTERESIS_V)
+    return BATTERY_LOW;
+  return BATTERY_OK;
+}
+
+void battery_update()
+{
+  if (adc_handle == NULL)
+    return;
+
+  // Everything the DMA gathered since the last call, without waiting for more
+  static uint8_t raw_bytes[BATTERY_FRAME_BYTES];
+  static adc_continuous_data_t samples[BATTERY_FRAME_SAMPLES];
+  uint32_t raw_sum = 0;
+  uint32_t raw_count = 0;
+  uint32_t length = 0;
+  while (adc_continuous_read(adc_handle, raw_bytes, sizeof(raw_bytes), &length, 0) == ESP_OK && length > 0)
+  {
+    uint32_t parsed = 0;
+    if (adc_continuous_parse_data(adc_handle, raw_bytes, length, samples, &parsed) != ESP_OK)
+      continue;
+    for (uint32_t i = 0; i < parsed; i++)
+    {
+      if (samples[i].valid && samples[i].channel == ADC_CHANNEL)
+      {
+        raw_sum += samples[i].raw_data;
+        raw_count++;
+      }
+    }
+  }
+  if (raw_count == 0)
+    return;
+
+  float volts = raw_to_volts((int)(raw_sum / raw_count));
+  if (reading_count == BATTERY_FILTER_READINGS)
+    reading_sum -= readings[reading_next];
+  else
+    reading_count++;
+  readings[reading_next] = volts;
+  reading_sum += volts;
+  reading_next = (reading_next + 1) % BATTERY_FILTER_READINGS;
+  float filtered = reading_sum / reading_count;
+  g_voltage.store(filtered);
+
+  // Only judge the battery on a full filter, a single reading can be a current spike
+  if (reading_count < BATTERY_FILTER_READINGS)
+    return;
+  battery_state_t state = (battery_state_t)g_state.load();
+  battery_state_t next = next_state(state == BATTERY_UNKNOWN ? BATTERY_OK : state, filtered);
+  if (next != state)
+  {
+    g_state.store(next);
+    printf("Battery: %s (%d mV)\n", battery_state_name(next), (int)(filtered * 1000));
+    last_led_ms = 0;
+  }
+
+  int64_t now_ms = esp_timer_get_time() / 1000;
+  if (next == BATTERY_CRITICAL && now_ms - last_led_ms >= 1000)
+  {
+    // Renewed every second, so it ends within one once the voltage recovers
+    led_manager_set(LED_PRIORITY_CRITICAL, FX_MODE_BLINK, RED, 100, 1500);
+    last_led_ms = now_ms;
+  }
+  else if (next == BATTERY_LOW && now_ms - last_led_ms >= BATTERY_LOW_BLINK_PERIOD_MS)
+  {
+    led_manager_set(LED_PRIORITY_CRITICAL, FX_MODE_BLINK, ORANGE, 100, BATTERY_LOW_BLINK_MS);
+    last_led_ms = now_ms;
+  }
+}
+
+float battery_voltage()
+{
+  return g_voltage.load();
+}
+
+battery_state_t battery_state()
+{
+  return (battery_state_t)g_state.load();
+}
+
+const char *battery_state_name(battery_state_t state)
+{
+  switch (state)
+  {
+  case BATTERY_OK:
+    return "ok";
+  case BATTERY_LOW:
+    return "low";
+  case BATTERY_CRITICAL:
+    return "critical";
+  default:
+    return "unknown";
+  }
+}
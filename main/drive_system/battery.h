@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Battery voltage from the divider on GPIO51, sampled continuously by the ADC
+// through DMA. battery_update() averages what the DMA collected since the last
+// call, and the filtered value is cached, so reading it costs nothing.
+
+// -------------------- Configuration --------------------
+#define BATTERY_SAMPLE_HZ 1000     // ADC conversions per second
+#define BATTERY_FRAME_SAMPLES 32   // Conversions per DMA frame
+#define BATTERY_FILTER_READINGS 16 // Moving average over this many battery_update() means, about 0.5 s
+#define BATTERY_LOW_V 7.0f         // 2S LiPo at 3.5 V/cell: LED warning
+#define BATTERY_CRITICAL_V 6.6f    // 3.3 V/cell: continuous LED alarm
+#define BATTERY_HYSTERESIS_V 0.1f  // A state is left only this far above its threshold
+
+typedef enum
+{
+  BATTERY_OK = 0,
+  BATTERY_LOW,
+  BATTERY_CRITICAL,
+  BATTERY_UNKNOWN, // No reading yet, or the ADC could not be started
+} battery_state_t;
+
+// -------------------- API --------------------
+// Start the continuous conversion. Call once from drive_system_setup().
+void battery_init();
+
+// Drain the DMA pool into the filter and update the LED warning. Never blocks;
+// call periodically from a low-priority loop.
+void battery_update();
+
+// Filtered battery voltage in volts, 0 before the first reading. Any task.
+float battery_voltage();
+
+// State of the last battery_update(). Any task.
+battery_state_t battery_state();
+
+// "ok", "low", "critical" or "unknown"
+const char *battery_state_name(battery_state_t state);
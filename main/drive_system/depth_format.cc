@@ -0,0 +1,147 @@
+#include "depth_format.h"
+#include <stdio.h>
+#include <string.h>
+
+// -------------------- Frames --------------------
+void depth_copy_packet_pixels(sensor_frame_t *frame, const uint8_t *packet, int packet_len)
+{
+  // Pixel data starts at HEADER_SIZE, ends 2 bytes before end marker
+  int count = frame->rows * frame->cols; // readHeader() checked it fits MAX_FRAME_PIXELS
+  int available = packet_len - 2 - HEADER_SIZE;
+  if (available < 0)
+    available = 0;
+  if (available < count)
+  {
+    memset(frame->pixels + available, 0, count - available); // Short frame, pad with 0 mm
+    count = available;
+  }
+  memcpy(frame->pixels, packet + HEADER_SIZE, count);
+}
+
+void depth_frame_to_mm(const sensor_frame_t *frame, float *depth_mm)
+{
+  const uint8_t *pixel = frame->pixels;
+  int count = frame->rows * frame->cols;
+  for (int i = 0; i < count; i++)
+    depth_mm[i] = depth_mm_lut.mm[*pixel++];
+}
+
+int depth_count_near(const sensor_frame_t *frame, int top_pct, int bottom_pct, int left_pct, int right_pct,
+                     uint8_t near_raw, uint8_t *min_raw)
+{
+  // The model sees the frame rotated 90° clockwise, upright[i][j] =
+  // raw[rows-1-j][i]: upright rows are raw columns, and upright columns are
+  // raw rows counted from the bottom. The upright frame is cols x rows.
+  int col_begin = frame->cols * top_pct / 100;
+  int col_end = frame->cols * bottom_pct / 100;
+  int row_begin = frame->rows - frame->rows * right_pct / 100;
+  int row_end = frame->rows - frame->rows * left_pct / 100;
+  int near = 0;
+  uint8_t nearest = 0xFF;
+  for (int r = row_begin; r < row_end; r++)
+  {
+    const uint8_t *pixel = frame->pixels + r * frame->cols;
+    for (int c = col_begin; c < col_end; c++)
+    {
+      uint8_t raw = pixel[c];
+      if (raw != 0 && raw < near_raw)
+      {
+        near++;
+        nearest = raw < nearest ? raw : nearest;
+      }
+    }
+  }
+  *min_raw = near > 0 ? nearest : 0;
+  return near;
+}
+
+// -------------------- Log Records --------------------
+int depth_format_record(const sensor_frame_t *frame, uint32_t frame_number, float steering, float throttle,
+                        uint8_t *out)
+{
+  // Fixed header and the raw bytes as the sensor sent them
+  log_record_header_t record;
+  record.magic = LOG_RECORD_MAGIC;
+  record.frame = frame_number;
+  record.timestamp_us = frame->timestamp_us;
+  record.steering_millis = (int16_t)(int)(steering * 1000);
+  record.throttle_millis = (int16_t)(int)(throttle * 1000);
+  record.width = (uint16_t)frame->cols;
+  record.height = (uint16_t)frame->rows;
+  int pixels = frame->rows * frame->cols;
+  record.pixel_encoding = LOG_PIXELS_RAW; // The writer task may turn it into a delta
+  record.sensor = frame->sensor;
+  record.payload_bytes = (uint16_t)pixels;
+  memcpy(out, &record, sizeof(record));
+  memcpy(out + sizeof(record), frame->pixels, pixels);
+  return (int)sizeof(record) + pixels;
+}
+
+int depth_format_csv_line(uint32_t frame_number, float steering, float throttle, const float *depth_mm, int rows,
+                          int cols, char *out, size_t out_size)
+{
+  int pos = snprintf(out, out_size, "%d,%d,%d,%d,%d", (int)frame_number, (int)(steering * 1000),
+                     (int)(throttle * 1000), cols, rows);
+
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      pos += snprintf(out + pos, out_size - pos, ",%d", (int)depth_mm[i * cols + j]);
+
+  out[pos++] = '\n';
+  return pos;
+}
+
+int log_delta_encode(const uint8_t *cur, const uint8_t *prev, int count, uint8_t *out, int out_max)
+{
+  int o = 0;
+  int i = 0;
+  while (i < count)
+  {
+    int n = 1;
+    if (cur[i] == prev[i])
+    {
+      while (i + n < count && n < 128 && cur[i + n] == prev[i + n])
+        n++;
+      if (o + 1 > out_max)
+        return -1;
+      out[o++] = (uint8_t)(n - 1);
+    }
+    else
+    {
+      // A single unchanged pixel is cheaper inside the span than as its own run
+      while (i + n < count && n < 128 &&
+             !(cur[i + n] == prev[i + n] && (i + n + 1 == count || cur[i + n + 1] == prev[i + n + 1])))
+        n++;
+      if (o + 1 + n > out_max)
+        return -1;
+      out[o++] = (uint8_t)(0x80 | (n - 1));
+      for (int k = 0; k < n; k++)
+        out[o++] = (uint8_t)(cur[i + k] - prev[i + k]);
+    }
+    i += n;
+  }
+  return o;
+}
+
+bool log_delta_apply(const uint8_t *payload, int payload_bytes, uint8_t *raw, int pixels)
+{
+  int i = 0;
+  int o = 0;
+  while (i < payload_bytes)
+  {
+    int token = payload[i++];
+    int n = (token & 0x7F) + 1;
+    if (o + n > pixels)
+      return false;
+    if (token >= 0x80)
+    {
+      if (i + n > payload_bytes)
+        return false;
+      for (int k = 0; k < n; k++)
+        raw[o + k] = (uint8_t)(raw[o + k] + payload[i + k]);
+      i += n;
+    }
+    o += n;
+  }
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "depth_sensor.h"
+
+// Frame conversion and SD log record encoding for the depth sensor pipeline.
+// No I/O and no RTOS calls, so the host benchmark (host/) builds exactly the
+// code that runs on the car.
+
+// -------------------- Frames --------------------
+// Copy the pixels of a sensor packet (start bytes to end byte, packet_len
+// bytes) into frame->pixels. frame->rows/cols come from readHeader(); a short
+// packet is padded with 0 mm.
+void depth_copy_packet_pixels(sensor_frame_t *frame, const uint8_t *packet, int packet_len);
+
+// Raw bytes to millimetres with depth_mm_lut, rows x cols row-major
+void depth_frame_to_mm(const sensor_frame_t *frame, float *depth_mm);
+
+// Pixels in rows top_pct..bottom_pct and columns left_pct..right_pct (percent
+// of the upright frame, rotated as the model input is) whose raw byte is below
+// near_raw, and the smallest such byte in *min_raw (0 if none). Raw 0 is no
+// return or padding and never counts.
+int depth_count_near(const sensor_frame_t *frame, int top_pct, int bottom_pct, int left_pct, int right_pct,
+                     uint8_t near_raw, uint8_t *min_raw);
+
+// -------------------- Log Records --------------------
+// One binary record (log_record_header_t, LOG_PIXELS_RAW, then the raw bytes)
+// into out, which holds SD_RECORD_MAX bytes. Returns its length.
+int depth_format_record(const sensor_frame_t *frame, uint32_t frame_number, float steering, float throttle,
+                        uint8_t *out);
+
+// One CSV log line for a rows x cols millimetre map, newline included.
+// Returns its length.
+int depth_format_csv_line(uint32_t frame_number, float steering, float throttle, const float *depth_mm, int rows,
+                          int cols, char *out, size_t out_size);
+
+// LOG_PIXELS_DELTA payload taking prev to cur (count bytes each), at most
+// out_max bytes. Returns its length, or -1 if it doesn't fit.
+int log_delta_encode(const uint8_t *cur, const uint8_t *prev, int count, uint8_t *out, int out_max);
+
+// Apply a LOG_PIXELS_DELTA payload to the previous frame's raw bytes in place.
+// False if the payload is malformed for a frame of this many pixels.
+bool log_delta_apply(const uint8_t *payload, int payload_bytes, uint8_t *raw, int pixels);
@@ -5,50 +5,319 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "../sdcard/sd.h"
+#include "depth_format.h"
+#include "frame_parser.h"
+#include "frame_ring.h"
+#include "reflex_stop.h"
+#include "../log_index.h"
+#include "../flight_recorder.h"
+#include "../latency_histogram.h"
+#include "../trace_events.h"
+#include "../memory_report.h"
+#include "../power_manager.h"
 #include <WS2812FX.h>
 #include "../led_manager.h"
 #include "../main_functions.h"
+#include "../serial_commands.h"
+#include "../net_telemetry.h"
+#include "../task_layout.h"
 
 // -------------------- Constants --------------------
-#define FRAME_START_BYTE_1 0x00
-#define FRAME_START_BYTE_2 0xFF
-#define FRAME_END_BYTE 0xDD
-#define SD_CARD_COOLDOWN 10 // Ticks
+#define SD_CARD_COOLDOWN 25 // loop() calls, ~500ms at 50 Hz
+#define UART_EVENT_QUEUE_DEPTH 32
+#define PACKET_WAIT_MS 100 // getPacket() gives up after this long without a frame, so the rx task can't wedge
+
+// Sensor configuration: every AT command waits for the sensor's reply instead of a fixed delay
+#define AT_REPLY_TIMEOUT_MS 300    // Per attempt
+#define AT_RETRIES 3
+#define SENSOR_BOOT_TIMEOUT_MS 4000 // How long to wait for a cold sensor to answer at all
+
+// Frames with a checksum mismatch are counted; uncomment to also drop them
+// #define DROP_BAD_CHECKSUM
+
+// Frames written to the log: every sensor's in binary logs (the record says
+// which), the front sensor's in CSV logs, which have no column for it
+#ifdef LOG_FORMAT_BINARY
+#define LOGGED_SENSORS ((1u << DEPTH_SENSOR_COUNT) - 1)
+#else
+#define LOGGED_SENSORS 0x1u
+#endif
+
+// -------------------- Sensors --------------------
+// Everything one sensor's receive task works with. The bulk UART reader: the
+// driver's event queue wakes getPacket(), which reads everything buffered
+// into the frame parser in one go. Only that sensor's sensor_rx_task()
+// writes the state; the counters are free-running, so readers (the FPS
+// print, link health) work with differences and never reset them.
+typedef struct
+{
+  // Configuration
+  uint8_t index;
+  const char *name;
+  const char *task_name;
+  const char *ring_name; // In the memory report
+  uart_port_t port;
+  int rx_pin;
+  int tx_pin;
+
+  QueueHandle_t uart_queue;
+  frame_ring_t *ring;
+  frame_parser_t parser;
+  uint8_t packet[FRAME_PARSER_CAPACITY]; // The frame being decoded, start bytes to end byte
+  int packet_len;
+  int64_t read_time_us;   // When the bytes in the parser were last read from the UART
+  int64_t packet_time_us; // When the start of the frame in packet arrived on the wire
+  uint32_t parse_us;      // Read and parse time of the frame in progress
+  uint32_t seq;
+  bool have_last_id;
+  uint16_t last_id;
+
+  // Receive statistics and link health, see depth_sensor_get_link_health().
+  // A reset only moves the baseline that readers subtract.
+  volatile uint32_t rx_frames;      // Published to the frame ring
+  volatile uint32_t uart_overflows; // Driver buffer / FIFO overruns
+  volatile uint32_t frames_missed;
+  volatile uint32_t invalid_frames;
+  volatile uint32_t error_frames;
+  volatile uint8_t last_error_code;
+  volatile uint8_t sensor_temp;
+  volatile uint8_t driver_temp;
+  link_health_t baseline;
+  int64_t baseline_us;
+} depth_sensor_t;
+
+static_assert(DEPTH_SENSOR_COUNT >= 1 && DEPTH_SENSOR_COUNT <= DEPTH_SENSOR_MAX, "DEPTH_SENSOR_COUNT out of range");
+static_assert((INFERENCE_SENSORS & ~((1u << DEPTH_SENSOR_COUNT) - 1)) == 0 && INFERENCE_SENSORS != 0,
+              "INFERENCE_SENSORS must name sensors below DEPTH_SENSOR_COUNT");
+
+static depth_sensor_t g_sensors[DEPTH_SENSOR_COUNT] = {
+    {0, "front", "sensor_rx", "sensor_frame_ring", UART_PORT_NUM, UART_RX_PIN, UART_TX_PIN},
+#if DEPTH_SENSOR_COUNT > 1
+    {1, "rear", "sensor_rx1", "sensor_frame_ring1", SENSOR1_UART_PORT_NUM, SENSOR1_UART_RX_PIN, SENSOR1_UART_TX_PIN},
+#endif
+};
 
 // -------------------- Globals --------------------
 int imageRows = 25;
 int imageCols = 25;
 
-static int tempBuffer = 0;
-static int packetState = 0;
-static int bufferIndex = 0;
+static bool g_buffers_ready = false; // depthMap and the frame rings are allocated
 
-float depthMap[MAX_IMAGE_SIZE][MAX_IMAGE_SIZE];
-uint8_t rxBuffer[BUFFER_SIZE];
+// Written by depth_sensor_task(), reported with every sensor's link health
+static volatile uint32_t link_sd_queue_drops = 0;
+static volatile uint32_t link_stream_drops = 0;
+
+float *depthMap = NULL;
 
 char g_depth_log_filename[64];
 int g_frame_counter = 0;
-FILE *g_depth_log_file = NULL;
+FILE *g_depth_log_file = NULL;        // Current segment, swapped by the writer task
+static FILE *g_log_index_file = NULL; // Session index, log_index_entry_t per keyframe
+static int g_log_segment = 0;         // Segment g_depth_log_file belongs to
 short write_to_sd = 0;
 
 int sd_card_cooldown = 0;
 static int dropped_frames = 0;
 
-// SD async writer queue
+// SD async writer: buffers from the pool go sensor loop -> g_sd_queue ->
+// writer task -> g_sd_free_queue -> sensor loop. A NULL in g_sd_queue asks the
+// writer to flush, so it has room for a few of those on top of the pool.
+#define SD_FLUSH_REQUESTS 4
+#define LOG_FILE_BUFFER 32768 // stdio buffer of the open CSV segment
+static sd_frame_t *g_sd_pool = NULL;
 static QueueHandle_t g_sd_queue = NULL;
 static StaticQueue_t g_sd_queue_static;
-static uint8_t g_sd_queue_storage[SD_QUEUE_DEPTH * sizeof(sd_frame_t)];
+static uint8_t g_sd_queue_storage[(SD_POOL_BUFFERS + SD_FLUSH_REQUESTS) * sizeof(sd_frame_t *)];
+static QueueHandle_t g_sd_free_queue = NULL;
+static StaticQueue_t g_sd_free_queue_static;
+static uint8_t g_sd_free_queue_storage[SD_POOL_BUFFERS * sizeof(sd_frame_t *)];
+
+// -------------------- Sensor Configuration --------------------
+static_assert(2 * MAX_FRAME_BYTES <= FRAME_PARSER_CAPACITY, "frame parser must hold two frames at BINNING_FACTOR");
+static_assert(sizeof(log_file_header_t) == 12 && sizeof(log_record_header_t) == 28, "binary log layout is read by depth_log.py and the data editor");
+
+// AT+BAUD code for a baud rate
+static int sensorBaudCode(int baud)
+{
+  static const int rates[] = {9600, 57600, 115200, 230400, 460800, 921600, 1000000, 2000000, 3000000};
+  for (int i = 0; i < (int)(sizeof(rates) / sizeof(rates[0])); i++)
+  {
+    if (rates[i] == baud)
+      return i;
+  }
+  printf("Warning: sensor doesn't support %d baud, using 230400\n", baud);
+  return 3;
+}
+
+float depth_sensor_link_max_fps(int rows, int cols)
+{
+  // 8N1: 10 bits on the wire per byte
+  int frame_bytes = HEADER_SIZE + rows * cols + FRAME_TRAILER_SIZE;
+  return (float)UART_BAUD_RATE / 10.0f / (float)frame_bytes;
+}
+
+// Read sensor output until it contains `match` or "ERROR", for up to timeout_ms.
+// Frames may be streaming at the same time, so the reply is searched for in a
+// sliding window of the raw byte stream. With value != NULL the match must be
+// followed by a number and '\r', which is parsed into *value.
+static bool sensorReadReply(depth_sensor_t *s, const char *match, int timeout_ms, int *value)
+{
+  char window[128];
+  size_t len = 0;
+  size_t match_len = strlen(match);
+  int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+  while (esp_timer_get_time() < deadline)
+  {
+    if (len == sizeof(window) - 1)
+    {
+      // Keep the tail, a reply may straddle the cut
+      memmove(window, window + len - 32, 32);
+      len = 32;
+    }
+    int n = uart_read_bytes(s->port, (uint8_t *)window + len, sizeof(window) - 1 - len, pdMS_TO_TICKS(10));
+    if (n <= 0)
+      continue;
+    len += n;
+    window[len] = '\0';
+
+    // Frame bytes can contain 0x00, so search with memcmp rather than strstr
+    for (size_t i = 0; i + match_len <= len; i++)
+    {
+      if (memcmp(window + i, match, match_len) != 0)
+        continue;
+      if (value == NULL)
+        return true;
+      char *end;
+      long parsed = strtol(window + i + match_len, &end, 10);
+      if (end != window + i + match_len && *end == '\r')
+      {
+        *value = (int)parsed;
+        return true;
+      }
+    }
+    for (size_t i = 0; i + 5 <= len; i++)
+    {
+      if (memcmp(window + i, "ERROR", 5) == 0)
+        return false;
+    }
+  }
+  return false;
+}
+
+// Send "cmd\r" and wait for "OK", retrying a few times
+static bool sensorCommand(depth_sensor_t *s, const char *cmd)
+{
+  for (int attempt = 0; attempt < AT_RETRIES; attempt++)
+  {
+    uart_flush_input(s->port);
+    uart_write_bytes(s->port, cmd, strlen(cmd));
+    uart_write_bytes(s->port, "\r", 1);
+    if (sensorReadReply(s, "OK\r\n", AT_REPLY_TIMEOUT_MS, NULL))
+      return true;
+  }
+  printf("Warning: no OK from %s sensor for %s\n", s->name, cmd);
+  return false;
+}
+
+// Is there a sensor at the current baud rate? Single short attempt.
+static bool sensorProbe(depth_sensor_t *s)
+{
+  uart_flush_input(s->port);
+  uart_write_bytes(s->port, "AT\r", 3);
+  return sensorReadReply(s, "OK\r\n", AT_REPLY_TIMEOUT_MS, NULL);
+}
+
+// Set AT+<name>=<value> unless the sensor reports it already has that value
+static void sensorSetting(depth_sensor_t *s, const char *name, int value)
+{
+  char cmd[24];
+  char match[16];
+  snprintf(cmd, sizeof(cmd), "AT+%s?\r", name);
+  snprintf(match, sizeof(match), "+%s=", name);
+
+  int current = -1;
+  uart_flush_input(s->port);
+  uart_write_bytes(s->port, cmd, strlen(cmd));
+  if (sensorReadReply(s, match, AT_REPLY_TIMEOUT_MS, &current) && current == value)
+  {
+    printf("Sensor %s: %s already %d\n", s->name, name, value);
+    return;
+  }
+
+  printf("Setting %s sensor %s=%d\n", s->name, name, value);
+  snprintf(cmd, sizeof(cmd), "AT+%s=%d", name, value);
+  sensorCommand(s, cmd);
+}
+
+// -------------------- Log Files --------------------
+void fillLogFileHeader(log_file_header_t *header)
+{
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, LOG_FILE_MAGIC, sizeof(header->magic));
+  header->version = LOG_FORMAT_VERSION;
+  header->header_size = sizeof(log_file_header_t);
+  header->record_header_size = sizeof(log_record_header_t);
+  header->binning_factor = BINNING_FACTOR;
+#ifdef USE_NONLINEAR
+  header->depth_encoding = LOG_DEPTH_NONLINEAR;
+#elif defined(USE_LINEAR)
+  header->depth_encoding = LOG_DEPTH_LINEAR;
+#else
+  header->depth_encoding = LOG_DEPTH_RAW;
+#endif
+  header->unit_mm = UNIT_VALUE;
+}
+
+// Open one segment of the session and write its file header, so every segment
+// can be read on its own
+static FILE *openLogSegment(const char *path)
+{
+  FILE *fp = sd_card_fopen(path, "w");
+  if (fp == NULL)
+    return NULL;
+
+#ifndef SD_DIRECT_WRITE
+  // Each frame is ~3KB of CSV. 32KB buffers ~10 frames before a physical SD write,
+  // reducing write stalls from every 2-3 frames down to every ~10 frames.
+  // Only one segment is open at a time.
+  // Only the SD writer fills it, keep it out of internal SRAM
+  static char *file_buffer = (char *)memory_alloc("log_file_buffer", LOG_FILE_BUFFER, MEMORY_COLD);
+  if (file_buffer != NULL)
+    setvbuf(fp, file_buffer, _IOFBF, LOG_FILE_BUFFER);
+#endif
+
+  // Write header
+#ifdef LOG_FORMAT_BINARY
+  log_file_header_t header;
+  fillLogFileHeader(&header);
+  fwrite(&header, 1, sizeof(header), fp);
+#else
+  fprintf(fp, "# Depth Sensor Log\n");
+  fprintf(fp, "# Binning Factor: %d\n", BINNING_FACTOR);
+  fprintf(fp, "# Frame,Steering(millis),Throttle(millis),Width,Height,Data...\n");
+#endif
+
+  fflush(fp);
+  return fp;
+}
 
 // -------------------- Initialization --------------------
-void depth_sensor_init()
+static void sensor_rx_task(void *pvParameters);
+
+// UART and handshake of one sensor. False if it never answered.
+static bool sensorInit(depth_sensor_t *s)
 {
   uart_config_t uart_config = {
-      .baud_rate = 115200, // Start at 115200; switched to UART_BAUD_RATE via AT+BAUD below
+      .baud_rate = UART_BAUD_RATE, // Try the target rate first, the sensor may still be there after a warm reset
       .data_bits = UART_DATA_8_BITS,
       .parity = UART_PARITY_DISABLE,
       .stop_bits = UART_STOP_BITS_1,
@@ -59,60 +328,162 @@ void depth_sensor_init()
           .allow_pd = 0,
           .backup_before_sleep = 0}};
 
-  uart_param_config(UART_PORT_NUM, &uart_config);
-  uart_set_pin(UART_PORT_NUM, UART_TX_PIN, UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-  uart_driver_install(UART_PORT_NUM, BUFFER_SIZE * 2, 0, 0, NULL, 0);
+  uart_param_config(s->port, &uart_config);
+  uart_set_pin(s->port, s->tx_pin, s->rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+  uart_driver_install(s->port, BUFFER_SIZE * 2, 0, UART_EVENT_QUEUE_DEPTH, &s->uart_queue, 0);
+  frame_parser_reset(&s->parser);
 
-  printf("Depth sensor UART initialized\n");
+  printf("Depth sensor %s: UART%d initialized (RX %d, TX %d)\n", s->name, (int)s->port, s->rx_pin, s->tx_pin);
 
-  // Wait before sending commands (mimics Arduino delay)
-  vTaskDelay(pdMS_TO_TICKS(1000));
+  int64_t t_config_start = esp_timer_get_time();
 
-  // Switch sensor baud rate to 230400, then re-init UART to match.
-  // Send at current rate (115200), sensor switches immediately after ACK.
-  printf("Switching baud rate to 230400\n");
-  const char *baud_cmd = "AT+BAUD=3\r";
-  uart_write_bytes(UART_PORT_NUM, baud_cmd, strlen(baud_cmd));
-  vTaskDelay(pdMS_TO_TICKS(200)); // Wait for sensor to apply change
+  // Find the sensor: still at UART_BAUD_RATE after a warm reset, or at its
+  // power-on default. A cold sensor needs a moment before it answers at all.
+  bool responding = false;
+  bool at_target_baud = false;
+  while (!responding && esp_timer_get_time() - t_config_start < (int64_t)SENSOR_BOOT_TIMEOUT_MS * 1000)
+  {
+    uart_set_baudrate(s->port, UART_BAUD_RATE);
+    at_target_baud = responding = sensorProbe(s);
+    if (!responding)
+    {
+      uart_set_baudrate(s->port, SENSOR_DEFAULT_BAUD);
+      responding = sensorProbe(s);
+    }
+  }
+  if (!responding)
+  {
+    printf("Depth sensor %s not answering, sending configuration without confirmation\n", s->name);
+    uart_set_baudrate(s->port, SENSOR_DEFAULT_BAUD);
+  }
 
-  // Re-configure ESP32 UART to 230400 to match sensor
-  uart_set_baudrate(UART_PORT_NUM, UART_BAUD_RATE);
-  uart_flush(UART_PORT_NUM); // Discard any garbage from the baud transition
-  vTaskDelay(pdMS_TO_TICKS(200));
-  printf("UART now at %d baud\n", UART_BAUD_RATE);
+  if (at_target_baud)
+  {
+    printf("Sensor %s already at %d baud\n", s->name, UART_BAUD_RATE);
+  }
+  else
+  {
+    // Sent at the current rate; the sensor replies, then switches
+    printf("Switching %s sensor baud rate to %d\n", s->name, UART_BAUD_RATE);
+    char baud_cmd[20];
+    snprintf(baud_cmd, sizeof(baud_cmd), "AT+BAUD=%d", sensorBaudCode(UART_BAUD_RATE));
+    sensorCommand(s, baud_cmd);
+
+    // Re-configure ESP32 UART to match sensor
+    uart_set_baudrate(s->port, UART_BAUD_RATE);
+    uart_flush_input(s->port); // Discard any garbage from the baud transition
+    if (responding && !sensorProbe(s))
+    {
+      printf("Warning: %s sensor not answering at %d baud\n", s->name, UART_BAUD_RATE);
+    }
+    printf("UART%d now at %d baud\n", (int)s->port, UART_BAUD_RATE);
+  }
 
-  // Send sensor commands
+  // Send sensor commands, skipping settings the sensor already has
 #ifdef USE_NONLINEAR
-  const char *unit_cmd = "AT+UNIT=0\r";
-  uart_write_bytes(UART_PORT_NUM, unit_cmd, strlen(unit_cmd));
-  vTaskDelay(pdMS_TO_TICKS(2000));
+  sensorSetting(s, "UNIT", 0);
 #elif defined(USE_LINEAR)
-  char unit_cmd[20];
-  snprintf(unit_cmd, sizeof(unit_cmd), "AT+UNIT=%d\r", UNIT_VALUE);
-  uart_write_bytes(UART_PORT_NUM, unit_cmd, strlen(unit_cmd));
-  vTaskDelay(pdMS_TO_TICKS(2000));
+  sensorSetting(s, "UNIT", UNIT_VALUE);
 #endif
+  sensorSetting(s, "DISP", 7); // UART display on
+  sensorSetting(s, "FPS", SENSOR_FPS);
+  sensorSetting(s, "BINN", BINNING_FACTOR); // Pixel compression
+
+  printf("Sensor %s configured in %d ms\n", s->name, (int)((esp_timer_get_time() - t_config_start) / 1000));
 
-  printf("UART display turning on\n");
-  const char *disp_cmd = "AT+DISP=7\r";
-  uart_write_bytes(UART_PORT_NUM, disp_cmd, strlen(disp_cmd));
-  vTaskDelay(pdMS_TO_TICKS(5000));
+  // Forget the command replies and baud-switch garbage before the first frame
+  uart_flush_input(s->port);
+  xQueueReset(s->uart_queue);
+  frame_parser_reset(&s->parser);
 
-  printf("Setting FPS\n");
-  const char *fps_cmd = "AT+FPS=19\r";
-  uart_write_bytes(UART_PORT_NUM, fps_cmd, strlen(fps_cmd));
-  vTaskDelay(pdMS_TO_TICKS(5000));
+  printf("SENSOR READY (%s, %d ms)\n", s->name, (int)((esp_timer_get_time() - t_config_start) / 1000));
+  return responding;
+}
 
-  printf("Pixel compression\n");
-  char binning_cmd[20];
-  snprintf(binning_cmd, sizeof(binning_cmd), "AT+BINN=%d\r", BINNING_FACTOR);
-  uart_write_bytes(UART_PORT_NUM, binning_cmd, strlen(binning_cmd));
-  vTaskDelay(pdMS_TO_TICKS(5000));
+bool depth_sensor_init()
+{
+  // Frame buffers for the configured resolution: internal RAM if it fits, PSRAM otherwise
+  depthMap = (float *)heap_caps_malloc(MAX_FRAME_PIXELS * sizeof(float), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (depthMap == NULL)
+    depthMap = (float *)heap_caps_malloc(MAX_FRAME_PIXELS * sizeof(float), MALLOC_CAP_SPIRAM);
+  for (int i = 0; i < DEPTH_SENSOR_COUNT && depthMap != NULL; i++)
+  {
+    g_sensors[i].ring = frame_ring_create(MAX_FRAME_PIXELS, g_sensors[i].ring_name);
+    if (g_sensors[i].ring == NULL)
+    {
+      heap_caps_free(depthMap);
+      depthMap = NULL;
+    }
+  }
+  if (depthMap == NULL)
+  {
+    printf("Depth sensor: out of memory for %dx%d frame buffers\n", MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
+    return false;
+  }
+  memset(depthMap, 0, MAX_FRAME_PIXELS * sizeof(float));
+  g_buffers_ready = true;
+  memory_report_add("depth_map", depthMap, MAX_FRAME_PIXELS * sizeof(float));
+  memory_report_add("depth_sensors", g_sensors, sizeof(g_sensors)); // Frame parsers and packet buffers
+
+  // Can the link carry the requested frame rate at this resolution?
+  float link_fps = depth_sensor_link_max_fps(MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
+  printf("Depth sensor link: %dx%d frames, %d bytes at %d baud, max %.1f FPS for %d requested%s\n",
+         MAX_IMAGE_SIZE, MAX_IMAGE_SIZE, MAX_FRAME_BYTES, UART_BAUD_RATE, (double)link_fps, SENSOR_FPS,
+         link_fps < SENSOR_FPS ? " - TOO SLOW, raise UART_BAUD_RATE" : "");
+
+  // One after the other: each handshake only waits on its own sensor, but
+  // they share the log output
+  bool responding = true;
+  for (int i = 0; i < DEPTH_SENSOR_COUNT; i++)
+  {
+    responding &= sensorInit(&g_sensors[i]);
+  }
+  return responding;
+}
 
-  printf("SENSOR READY\n");
+void depth_sensor_start()
+{
+  if (!g_buffers_ready)
+    return; // depth_sensor_init() failed, nothing to publish into
+  for (int i = 0; i < DEPTH_SENSOR_COUNT; i++)
+  {
+    depth_sensor_t *s = &g_sensors[i];
+    if (xTaskCreatePinnedToCore(sensor_rx_task, s->task_name, SENSOR_RX_TASK_STACK, s, SENSOR_RX_TASK_PRIORITY, NULL,
+                                SENSOR_RX_TASK_CORE) != pdPASS)
+    {
+      printf("Depth sensor %s: cannot create the receive task\n", s->name);
+      continue;
+    }
+    memory_report_add_task(s->task_name, SENSOR_RX_TASK_STACK);
+  }
+}
 
-  g_sd_queue = xQueueCreateStatic(SD_QUEUE_DEPTH, sizeof(sd_frame_t),
+const char *depth_sensor_name(int sensor)
+{
+  return sensor >= 0 && sensor < DEPTH_SENSOR_COUNT ? g_sensors[sensor].name : "unknown";
+}
+
+// Runs next to depth_sensor_init() at boot, it only needs the SD card
+bool depth_sensor_log_init()
+{
+  // Frame buffers live in PSRAM, the queues only hold pointers to them
+  g_sd_pool = (sd_frame_t *)memory_alloc("sd_pool", SD_POOL_BUFFERS * sizeof(sd_frame_t), MEMORY_COLD);
+  if (g_sd_pool == NULL)
+  {
+    printf("Failed to allocate SD buffer pool (%d bytes)\n", (int)(SD_POOL_BUFFERS * sizeof(sd_frame_t)));
+    write_to_sd = -1;
+    return false;
+  }
+  g_sd_queue = xQueueCreateStatic(SD_POOL_BUFFERS + SD_FLUSH_REQUESTS, sizeof(sd_frame_t *),
                                    g_sd_queue_storage, &g_sd_queue_static);
+  g_sd_free_queue = xQueueCreateStatic(SD_POOL_BUFFERS, sizeof(sd_frame_t *),
+                                        g_sd_free_queue_storage, &g_sd_free_queue_static);
+  memory_report_add("sd_queues", g_sd_queue_storage, sizeof(g_sd_queue_storage) + sizeof(g_sd_free_queue_storage));
+  for (int i = 0; i < SD_POOL_BUFFERS; i++)
+  {
+    sd_frame_t *buffer = &g_sd_pool[i];
+    xQueueSend(g_sd_free_queue, &buffer, 0);
+  }
 
   char buffer[256];
   size_t bytes_read = 0;
@@ -151,13 +522,9 @@ void depth_sensor_init()
   }
 
   // Write updated counter back to file
-  FILE *g_counter_file = sd_card_fopen("/counter.txt", "w");
-  if (g_counter_file)
-  {
-    fprintf(g_counter_file, "%d", counter);
-    fclose(g_counter_file);
-  }
-  else
+  char counter_text[16];
+  snprintf(counter_text, sizeof(counter_text), "%d", counter);
+  if (sd_card_write_file("/counter.txt", counter_text, 0) != ESP_OK)
   {
     printf("Failed to open counter file for writing\n");
   }
@@ -166,93 +533,135 @@ void depth_sensor_init()
   snprintf(
       g_depth_log_filename,
       sizeof(g_depth_log_filename),
+#ifdef LOG_FORMAT_BINARY
+      "/revised_log_%04d.bin",
+#else
       "/revised_log_%04d.csv",
+#endif
       counter);
   if (write_to_sd != -1)
   {
     printf("Logging to: %s\n", g_depth_log_filename);
 
     // Create and open file
-    g_depth_log_file = sd_card_fopen(g_depth_log_filename, "w");
+    g_depth_log_file = openLogSegment(g_depth_log_filename);
     if (g_depth_log_file == NULL)
     {
       printf("Failed to open log file: %s\n", g_depth_log_filename);
       write_to_sd = -1;
       printf("Initial mode: Error - SD card not available (toggle with CH3)\n");
-      return;
+      return false;
+    }
+    char index_path[80];
+    log_index_path(g_depth_log_filename, index_path, sizeof(index_path));
+    g_log_index_file = sd_card_fopen(index_path, "wb");
+    if (g_log_index_file == NULL)
+    {
+      printf("Failed to open log index: %s (recording continues without it)\n", index_path);
     }
 
-    // Each frame is ~3KB of CSV. 32KB buffers ~10 frames before a physical SD write,
-    // reducing write stalls from every 2-3 frames down to every ~10 frames.
-    static char file_buffer[32768];
-    setvbuf(g_depth_log_file, file_buffer, _IOFBF, sizeof(file_buffer));
-
-    // Write header
-    fprintf(g_depth_log_file, "# Depth Sensor Log\n");
-    fprintf(g_depth_log_file, "# Binning Factor: %d\n", BINNING_FACTOR);
-    fprintf(g_depth_log_file, "# Frame,Steering(millis),Throttle(millis),Width,Height,Data...\n");
-
-    fflush(g_depth_log_file);
     printf("Initial mode: Off (cycle modes with CH3: Off -> Serial -> SD -> Inference -> Off)\n");
   }
   else
   {
     printf("Initial mode: Error - SD card not available (toggle with CH3 for serial print)\n");
   }
+  return write_to_sd != -1;
 }
 
 // -------------------- Header Parsing --------------------
-bool readHeader()
+static bool readHeader(depth_sensor_t *s, sensor_frame_t *frame)
 {
   FrameHeader header;
-  memcpy(&header, rxBuffer, sizeof(FrameHeader));
+  memcpy(&header, s->packet, sizeof(FrameHeader));
 
-  imageRows = header.resolution_rows;
-  imageCols = header.resolution_cols;
+  frame->rows = header.resolution_rows;
+  frame->cols = header.resolution_cols;
+  frame->frame_id = header.frame_id;
+  frame->sensor = s->index;
 
   // Validate resolution
-  if (imageRows > MAX_IMAGE_SIZE || imageCols > MAX_IMAGE_SIZE ||
-      imageRows <= 0 || imageCols <= 0)
+  if (frame->rows > MAX_IMAGE_SIZE || frame->cols > MAX_IMAGE_SIZE ||
+      frame->rows <= 0 || frame->cols <= 0)
   {
-    // printf("Warning: Invalid resolution %dx%d, dropping frame\n", imageRows, imageCols);
+    // printf("Warning: Invalid resolution %dx%d, dropping frame\n", frame->rows, frame->cols);
     return false; // Invalid frame, drop it
   }
   return true; // Valid frame
 }
 
 // -------------------- Depth Processing --------------------
-void processDepth()
+// Keep the raw pixel bytes; consumers convert them with depth_mm_lut (or
+// straight to the model input) only when they need to
+static void processDepth(depth_sensor_t *s, sensor_frame_t *frame)
 {
-  int pixelIndex = 0;
+  depth_copy_packet_pixels(frame, s->packet, s->packet_len);
+}
 
-  // Read pixel data (starts at headerSize, ends 2 bytes before end marker)
-  for (int i = HEADER_SIZE; i < tempBuffer - 2; i++)
-  {
-    int row = pixelIndex / imageCols;
-    int col = pixelIndex % imageCols;
+// The pixels of the packet in s->packet, where they are, for checks that must
+// not wait for a ring slot. A short packet is padded with 0 mm in place, the
+// same way processDepth() pads the copy.
+static uint8_t *packetPixels(depth_sensor_t *s, const sensor_frame_t *frame)
+{
+  int count = frame->rows * frame->cols; // readHeader() checked it fits MAX_FRAME_PIXELS
+  int available = s->packet_len - FRAME_TRAILER_SIZE - HEADER_SIZE;
+  if (available < 0)
+    available = 0;
+  if (available < count)
+    memset(s->packet + HEADER_SIZE + available, 0, count - available); // The checksum was checked already
+  return s->packet + HEADER_SIZE;
+}
 
-    // Safety check
-    if (row < MAX_IMAGE_SIZE && col < MAX_IMAGE_SIZE)
-    {
-      depthMap[row][col] = toMillimeters(rxBuffer[i]);
-    }
-    pixelIndex++;
-  }
+// Convert a frame to millimetres in depthMap, for logging and preview
+void loadDepthMap(const sensor_frame_t *frame)
+{
+  imageRows = frame->rows;
+  imageCols = frame->cols;
+  depth_frame_to_mm(frame, depthMap);
 }
 
 float toMillimeters(uint8_t pixelValue)
 {
-#ifdef USE_NONLINEAR
-  // Sensor uses formula 5.1*sqrt(x)
-  // Reverse: divide by 5.1 then square
-  float normalized = pixelValue / 5.1f;
-  return normalized * normalized;
-#elif defined(USE_LINEAR)
-  return pixelValue * UNIT_VALUE;
-#else
-  // Default: return raw pixel value if no mode is defined
-  return (float)pixelValue;
-#endif
+  return depth_mm_lut.mm[pixelValue];
+}
+
+// -------------------- Live Stream --------------------
+// Never blocks: a packet the console TX ring can't take right now is dropped,
+// and the seq gap tells the viewer
+void streamDepthFrame(const sensor_frame_t *frame, float steering, float throttle)
+{
+  static uint8_t packet[sizeof(stream_packet_header_t) + MAX_FRAME_PIXELS];
+  static uint32_t seq = 0;
+  static uint8_t depth_encoding = 0xFF;
+  static uint8_t unit_mm = 0;
+  if (depth_encoding == 0xFF)
+  {
+    memory_report_add("stream_packet", packet, sizeof(packet));
+    log_file_header_t log_header;
+    fillLogFileHeader(&log_header);
+    depth_encoding = log_header.depth_encoding;
+    unit_mm = (uint8_t)log_header.unit_mm;
+  }
+
+  int pixels = frame->rows * frame->cols;
+  stream_packet_header_t *header = (stream_packet_header_t *)packet;
+  header->magic = STREAM_PACKET_MAGIC;
+  header->seq = seq++;
+  header->timestamp_us = frame->timestamp_us;
+  header->steering_millis = (int16_t)(steering * 1000);
+  header->throttle_millis = (int16_t)(throttle * 1000);
+  header->width = (uint8_t)frame->cols;
+  header->height = (uint8_t)frame->rows;
+  header->depth_encoding = depth_encoding;
+  header->unit_mm = unit_mm;
+  memcpy(packet + sizeof(stream_packet_header_t), frame->pixels, pixels);
+  uint32_t crc = esp_rom_crc32_le(0, packet, offsetof(stream_packet_header_t, crc));
+  header->crc = esp_rom_crc32_le(crc, packet + sizeof(stream_packet_header_t), pixels);
+
+  if (!serial_stream_write(packet, sizeof(stream_packet_header_t) + pixels))
+  {
+    link_stream_drops = link_stream_drops + 1;
+  }
 }
 
 // -------------------- Print --------------------
@@ -270,7 +679,7 @@ void printDepthAscii()
   {
     for (int j = 0; j < imageCols; j++)
     {
-      float d = depthMap[i][j];
+      float d = depthMap[i * imageCols + j];
 
       if (d < minDepth)
         d = minDepth;
@@ -295,70 +704,237 @@ void printDepthAscii()
 }
 
 // -------------------- Packet Reception --------------------
-bool getPacket()
+// Move the next complete frame out of the parser into s->packet
+static bool takeNextFrame(depth_sensor_t *s)
 {
-  uint8_t byte;
-  int len = uart_read_bytes(UART_PORT_NUM, &byte, 1, 0); // non-blocking
+  bool checksum_ok = true;
+  size_t len;
+  while ((len = frame_parser_next(&s->parser, s->packet, sizeof(s->packet), &checksum_ok)) > 0)
+  {
+#ifdef DROP_BAD_CHECKSUM
+    if (!checksum_ok)
+      continue;
+#endif
+    s->packet_len = (int)len;
+
+    // The frame's bytes, and whatever is still buffered behind it, were on
+    // the wire before read_time_us. Work back at the line rate (8N1, 10 bits
+    // per byte) to when its start bytes arrived.
+    int64_t bytes_since_start = (int64_t)len + (int64_t)s->parser.len;
+    s->packet_time_us = s->read_time_us - bytes_since_start * 10 * 1000000 / UART_BAUD_RATE;
+    return true;
+  }
+  return false;
+}
 
-  if (len <= 0)
-    return false;
+// Return the next frame in s->packet. Frames already buffered in the parser
+// come first; otherwise wait for the UART driver to report data, read all of
+// it at once and parse whole frames. Returns false if no complete frame
+// arrived within PACKET_WAIT_MS.
+static bool getPacket(depth_sensor_t *s)
+{
+  if (takeNextFrame(s))
+    return true;
 
-  // ---------------------------------------STATE 0------------------------------
-  if (packetState == 0)
+  uart_event_t event;
+  while (xQueueReceive(s->uart_queue, &event, pdMS_TO_TICKS(PACKET_WAIT_MS)) == pdTRUE)
   {
-    // STATE 0, waiting for start (0x00)
-    if (byte == FRAME_START_BYTE_1)
+    int64_t t0 = esp_timer_get_time();
+    if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL)
     {
-      // Found start byte (0x00), reset buffer and save the byte
-      bufferIndex = 0;
-      rxBuffer[bufferIndex++] = byte;
-      // Transitioning to state 1 now
-      packetState = 1;
+      // Data was lost, so whatever is buffered can't be trusted to line up
+      s->uart_overflows = s->uart_overflows + 1;
+      uart_flush_input(s->port);
+      xQueueReset(s->uart_queue);
+      frame_parser_clear(&s->parser);
+      continue;
     }
-  }
-  // ---------------------------------------STATE 1-----------------------------------
-  else if (packetState == 1)
-  {
-    // STATE 1, waiting for second start byte (0xFF)
-    if (byte == FRAME_START_BYTE_2)
+    if (event.type != UART_DATA)
     {
-      // Save new byte to the buffer
-      rxBuffer[bufferIndex++] = byte;
-      // Transitioning to state 2 now
-      packetState = 2;
+      continue;
     }
-    else
+
+    // Pull everything the driver has buffered, straight into the parser
+    size_t buffered = 0;
+    uart_get_buffered_data_len(s->port, &buffered);
+    while (buffered > 0)
     {
-      // ERROR, follow up byte after 0x00 was not 0xFF, return to packet state 0
-      packetState = 0;
+      size_t space;
+      uint8_t *dst = frame_parser_space(&s->parser, &space);
+      int n = uart_read_bytes(s->port, dst, buffered < space ? buffered : space, 0);
+      if (n <= 0)
+        break;
+      frame_parser_commit(&s->parser, n);
+      buffered -= n;
     }
+    s->read_time_us = esp_timer_get_time();
+
+    bool found = takeNextFrame(s);
+    s->parse_us += (uint32_t)(esp_timer_get_time() - t0);
+    if (found)
+      return true;
   }
-  // -------------------------------------STATE 2---------------------------------------
-  else if (packetState == 2)
+  return false;
+}
+
+// -------------------- Link Health --------------------
+// Count frames the sensor sent that never got here, from gaps in the header's
+// frame_id, and keep the header's status fields of the newest frame
+static void trackFrameId(depth_sensor_t *s)
+{
+  FrameHeader header;
+  memcpy(&header, s->packet, sizeof(FrameHeader));
+  if (s->have_last_id)
   {
-    // STATE 2, data collection
-    // This loop continues here to collect bytes until the final byte is sent (0xDD)
-    rxBuffer[bufferIndex++] = byte;
+    uint16_t gap = (uint16_t)(header.frame_id - s->last_id - 1);
+    // A backwards jump means the sensor restarted its counter, not 65k lost frames
+    if (gap < 0x8000)
+      s->frames_missed = s->frames_missed + gap;
+  }
+  s->have_last_id = true;
+  s->last_id = header.frame_id;
+
+  if (header.error_code != 0)
+    s->error_frames = s->error_frames + 1;
+  s->last_error_code = header.error_code;
+  s->sensor_temp = header.sensor_temp;
+  s->driver_temp = header.driver_temp;
+}
 
-    if (byte == FRAME_END_BYTE)
+static void readLinkCounters(const depth_sensor_t *s, link_health_t *out)
+{
+  out->elapsed_us = esp_timer_get_time();
+  out->frames_received = s->rx_frames;
+  out->frames_missed = s->frames_missed;
+  out->invalid_frames = s->invalid_frames;
+  out->error_frames = s->error_frames;
+  out->checksum_errors = s->parser.checksum_errors;
+  out->resync_bytes = s->parser.resync_bytes;
+  out->parser_overflow_bytes = s->parser.overflow_bytes;
+  out->uart_overflows = s->uart_overflows;
+  out->ring_overruns = s->ring != NULL ? frame_ring_overruns(s->ring) : 0;
+  out->sd_queue_drops = link_sd_queue_drops;
+  out->stream_drops = link_stream_drops;
+  out->last_error_code = s->last_error_code;
+  out->sensor_temp = s->sensor_temp;
+  out->driver_temp = s->driver_temp;
+}
+
+void depth_sensor_get_link_health(int sensor, link_health_t *out)
+{
+  const depth_sensor_t *s = &g_sensors[sensor];
+  const link_health_t *base = &s->baseline;
+  readLinkCounters(s, out);
+  out->elapsed_us -= s->baseline_us;
+  out->frames_received -= base->frames_received;
+  out->frames_missed -= base->frames_missed;
+  out->invalid_frames -= base->invalid_frames;
+  out->error_frames -= base->error_frames;
+  out->checksum_errors -= base->checksum_errors;
+  out->resync_bytes -= base->resync_bytes;
+  out->parser_overflow_bytes -= base->parser_overflow_bytes;
+  out->uart_overflows -= base->uart_overflows;
+  out->ring_overruns -= base->ring_overruns;
+  out->sd_queue_drops -= base->sd_queue_drops;
+  out->stream_drops -= base->stream_drops;
+}
+
+void depth_sensor_get_sd_queue(int *queued, int *free_buffers)
+{
+  *queued = g_sd_queue ? (int)uxQueueMessagesWaiting(g_sd_queue) : 0;
+  *free_buffers = g_sd_free_queue ? (int)uxQueueMessagesWaiting(g_sd_free_queue) : 0;
+}
+
+void depth_sensor_reset_link_health()
+{
+  for (int i = 0; i < DEPTH_SENSOR_COUNT; i++)
+  {
+    depth_sensor_t *s = &g_sensors[i];
+    readLinkCounters(s, &s->baseline);
+    s->baseline_us = s->baseline.elapsed_us;
+  }
+}
+
+// -------------------- Sensor Receive Task --------------------
+// Pinned, high-priority task per sensor: decodes every frame as soon as it
+// arrives and publishes it to the sensor's frame ring. Nothing else runs
+// here, so a slow SD write, serial print or inference never makes us miss a
+// frame. The task sleeps on the UART event queue, so every extra sensor
+// only costs its own bytes.
+static void sensor_rx_task(void *pvParameters)
+{
+  depth_sensor_t *s = (depth_sensor_t *)pvParameters;
+  while (true)
+  {
+    if (!getPacket(s))
+      continue;
+
+    PowerLock full_clock(POWER_LOCK_FRAMES); // Frame into the ring at the full clock
+    int64_t t0 = esp_timer_get_time();
+    trackFrameId(s);
+
+    sensor_frame_t decoded = {};
+    if (!readHeader(s, &decoded)) // Read resolution and frame id from the header
     {
-      // This is the end marker, now all of the data is in the rxBuffer array
-      // Reset to state 0 and wait for next frame
-      packetState = 0;
-      tempBuffer = bufferIndex;
-      bufferIndex = 0;
-      return true;
+      s->invalid_frames = s->invalid_frames + 1;
+      continue; // Drop frame if invalid resolution
     }
-    else if (bufferIndex >= BUFFER_SIZE)
+    decoded.timestamp_us = s->packet_time_us;
+    decoded.seq = s->seq;
+
+    // On the packet itself, so frames the ring has no room for are checked too:
+    // a full ring means the consumer stalled, when the stop matters most
+    decoded.pixels = packetPixels(s, &decoded);
+    reflex_stop_check(&decoded);
+
+    sensor_frame_t *frame = frame_ring_acquire(s->ring);
+    if (frame == NULL)
+      continue; // Consumer is a full ring behind, counted by the ring
+
+    uint8_t *pixels = frame->pixels;
+    *frame = decoded;
+    frame->pixels = pixels;
+    processDepth(s, frame); // Keep the raw bytes
+    frame_ring_publish(s->ring);
+    trace_event(TRACE_FRAME_RX, (int32_t)s->seq++);
+
+    s->rx_frames = s->rx_frames + 1;
+    stage_record(g_sensor_parse_latency, s->parse_us + (esp_timer_get_time() - t0));
+    s->parse_us = 0;
+  }
+}
+
+// Receive counters of all sensors added up, for the FPS print
+static void sumLinkCounters(link_health_t *total)
+{
+  memset(total, 0, sizeof(*total));
+  for (int i = 0; i < DEPTH_SENSOR_COUNT; i++)
+  {
+    link_health_t counters;
+    readLinkCounters(&g_sensors[i], &counters);
+    total->frames_received += counters.frames_received;
+    total->ring_overruns += counters.ring_overruns;
+    total->checksum_errors += counters.checksum_errors;
+    total->uart_overflows += counters.uart_overflows;
+  }
+}
+
+// Oldest frame any sensor has waiting, so frames from all sensors reach the
+// consumer in arrival order. NULL (and *frame NULL) when every ring is empty.
+static depth_sensor_t *peekOldestFrame(const sensor_frame_t **frame)
+{
+  depth_sensor_t *oldest = NULL;
+  *frame = NULL;
+  for (int i = 0; i < DEPTH_SENSOR_COUNT; i++)
+  {
+    const sensor_frame_t *f = frame_ring_peek(g_sensors[i].ring);
+    if (f != NULL && (*frame == NULL || f->timestamp_us < (*frame)->timestamp_us))
     {
-      // Safety check so that if we miss 0xDD the buffer does not overflow
-      printf("\n----- BUFFER OVERFLOW (Dropping packet) -----\n");
-      packetState = 0;
-      bufferIndex = 0;
+      *frame = f;
+      oldest = &g_sensors[i];
     }
   }
-
-  return false;
+  return oldest;
 }
 
 // -------------------- Full Processing --------------------
@@ -367,67 +943,53 @@ void fullPrint()
 }
 
 // -------------------- Main Task --------------------
-void depth_sensor_task(float *steering_ptr, float *throttle_ptr, float *ch3_ptr)
+void depth_sensor_task()
 {
   static float prev_ch3 = 0.0;
   static int fps_frame_count = 0;
   static int64_t fps_last_time = 0;
-  static int64_t t_getpacket_us = 0, t_processdepth_us = 0, t_append_us = 0;
+  static link_health_t last = {}; // All sensors at the last FPS print
 
   int64_t t0;
+  int64_t now = esp_timer_get_time(); // microseconds
 
-  t0 = esp_timer_get_time();
-  while (!getPacket())
-  {
-    vTaskDelay(pdMS_TO_TICKS(1)); // Small delay to avoid hogging CPU
-  }
-  t_getpacket_us += esp_timer_get_time() - t0;
-
-  // Discard any frames that queued up while we were processing the previous one.
-  // This ensures we always work with the freshest data, not stale buffered frames.
-  uart_flush_input(UART_PORT_NUM);
-  packetState = 0;
-  bufferIndex = 0;
-
-  if (!readHeader()) // Create the header structure, sync rows and columns
-  {
-    return; // Drop frame if invalid resolution
-  }
-
-  t0 = esp_timer_get_time();
-  processDepth(); // Convert raw bytes into mm and create 2D array depthMap
-  t_processdepth_us += esp_timer_get_time() - t0;
+  // The controls the drive task applied last, logged with the frames
+  control_state_t command;
+  g_drive_command.read(&command);
 
   // FPS tracking: print every second
-  fps_frame_count++;
-  int64_t now = esp_timer_get_time(); // microseconds
   if (fps_last_time == 0)
   {
     fps_last_time = now;
   }
   else if (now - fps_last_time >= 1000000)
   {
+    link_health_t total;
+    sumLinkCounters(&total);
     if (write_to_sd == 2)
     {
       float elapsed_s = (now - fps_last_time) / 1000000.0f;
       float fps = fps_frame_count / elapsed_s;
-      printf("FPS: %.1f | getPacket: %ldus  processDepth: %ldus  appendFrame: %ldus  dropped: %d\n",
+      printf("FPS: %.1f | received: %lu  dropped: %d  overruns: %lu  checksum: %lu  overflows: %lu\n",
              fps,
-             (long)(t_getpacket_us / fps_frame_count),
-             (long)(t_processdepth_us / fps_frame_count),
-             (long)(t_append_us / fps_frame_count),
-             dropped_frames);
+             (unsigned long)(total.frames_received - last.frames_received),
+             dropped_frames,
+             (unsigned long)(total.ring_overruns - last.ring_overruns),
+             (unsigned long)(total.checksum_errors - last.checksum_errors),
+             (unsigned long)(total.uart_overflows - last.uart_overflows));
+#ifdef STAGE_TIMING
+      g_sensor_parse_latency.print_window("Parse");
+      g_log_append_latency.print_window("Append frame");
+#endif
     }
     fps_frame_count = 0;
     fps_last_time = now;
-    t_getpacket_us = 0;
-    t_processdepth_us = 0;
-    t_append_us = 0;
     dropped_frames = 0;
+    last = total;
   }
 
   // Mode cycling with CH3 button (edge detection: rising edge when ch3 goes from <0.5 to >=0.5)
-  if (*ch3_ptr >= 0.5 && prev_ch3 < 0.5 && sd_card_cooldown == 0)
+  if (command.ch3 >= 0.5 && prev_ch3 < 0.5 && sd_card_cooldown == 0)
   {
     if (write_to_sd == -1)
     {
@@ -471,10 +1033,14 @@ void depth_sensor_task(float *steering_ptr, float *throttle_ptr, float *ch3_ptr)
         // Enqueue a sentinel so the writer task flushes cleanly before we stop sending
         if (prev_mode == 2 && g_sd_queue != NULL)
         {
-          sd_frame_t sentinel = {};
-          sentinel.len = 0;
+          sd_frame_t *sentinel = NULL;
           xQueueSend(g_sd_queue, &sentinel, portMAX_DELAY);
         }
+        // End of an autonomous run: keep its last seconds
+        if (prev_mode == 3)
+        {
+          flight_recorder_trigger(FLIGHT_TRIGGER_CH3);
+        }
         printf("Mode: Off (no output)\n");
         led_manager_set(LED_PRIORITY_HIGH, FX_MODE_STATIC, GREEN, 0, 2000);
       }
@@ -483,8 +1049,7 @@ void depth_sensor_task(float *steering_ptr, float *throttle_ptr, float *ch3_ptr)
         // Enqueue a sentinel so the writer task flushes cleanly before we stop sending
         if (prev_mode == 2 && g_sd_queue != NULL)
         {
-          sd_frame_t sentinel = {};
-          sentinel.len = 0;
+          sd_frame_t *sentinel = NULL;
           xQueueSend(g_sd_queue, &sentinel, portMAX_DELAY);
         }
         printf("Mode: Serial print\n");
@@ -500,8 +1065,7 @@ void depth_sensor_task(float *steering_ptr, float *throttle_ptr, float *ch3_ptr)
         // Enqueue a sentinel so the writer task flushes cleanly before we stop sending
         if (prev_mode == 2 && g_sd_queue != NULL)
         {
-          sd_frame_t sentinel = {};
-          sentinel.len = 0;
+          sd_frame_t *sentinel = NULL;
           xQueueSend(g_sd_queue, &sentinel, portMAX_DELAY);
         }
         // Clear stale frames so inference waits for 10 fresh ones
@@ -512,32 +1076,71 @@ void depth_sensor_task(float *steering_ptr, float *throttle_ptr, float *ch3_ptr)
     }
   }
 
-  prev_ch3 = *ch3_ptr; // Update previous value
+  prev_ch3 = command.ch3; // Update previous value
 
-  // Execute based on current mode
-  if (write_to_sd == 1)
+  // Consume every frame the rx tasks published since the last call, all
+  // sensors merged in arrival order
+  bool new_front_frames = false;
+  bool new_input_frames = false;
+  const sensor_frame_t *frame;
+  depth_sensor_t *source;
+  while ((source = peekOldestFrame(&frame)) != NULL)
   {
-    printDepthAscii(); // Print to serial
+    PowerLock full_clock(POWER_LOCK_FRAMES);
+    fps_frame_count++;
+    uint32_t sensor_bit = 1u << frame->sensor;
+
+    // Execute based on current mode
+    if (write_to_sd == 3)
+    {
+      if (sensor_bit & INFERENCE_SENSORS)
+      {
+        // Raw bytes straight to the model input, no millimetre floats in between
+        add_raw_frame_to_buffer(frame->pixels, frame->rows, frame->cols, frame->timestamp_us);
+        flight_recorder_record(frame);
+        new_input_frames = true;
+      }
+    }
+    else if (write_to_sd == 2)
+    {
+      if (sensor_bit & LOGGED_SENSORS)
+      {
+        t0 = esp_timer_get_time();
+#ifndef LOG_FORMAT_BINARY
+        loadDepthMap(frame); // CSV lines are formatted from depthMap
+#endif
+        appendDepthFrame(frame, command.steering, command.throttle); // Write to SD card with control values
+        int64_t append_us = esp_timer_get_time() - t0;
+        stage_record(g_log_append_latency, append_us);
+        trace_event(TRACE_LOG_APPEND, (int32_t)append_us);
+      }
+    }
+#ifdef SERIAL_STREAM_BINARY
+    else if (write_to_sd == 1)
+    {
+      if (frame->sensor == 0)
+        streamDepthFrame(frame, command.steering, command.throttle);
+    }
+#endif
+    else if (frame->sensor == 0)
+    {
+      loadDepthMap(frame); // Convert raw bytes into mm and create 2D array depthMap
+    }
+    net_telemetry_frame(frame, command.steering, command.throttle);
+    new_front_frames |= frame->sensor == 0;
+    frame_ring_release(source->ring);
   }
-  else if (write_to_sd == 2)
+  net_telemetry_update(write_to_sd);
+
+#ifndef SERIAL_STREAM_BINARY
+  if (new_front_frames && write_to_sd == 1)
   {
-    t0 = esp_timer_get_time();
-    appendDepthFrame(*steering_ptr, *throttle_ptr); // Write to SD card with control values
-    t_append_us += esp_timer_get_time() - t0;
+    printDepthAscii(); // Print the newest frame to serial (loadDepthMap() left it in depthMap)
   }
-  else if (write_to_sd == 3)
+#endif
+  if (new_input_frames && write_to_sd == 3)
   {
-    // if (frame_skip_counter % 2 == 0)
-    // {
-    add_frame_to_buffer();
     request_inference();
-    // }
-    // frame_skip_counter++;
-    // if (frame_skip_counter >= 10000)
-    // {
-    //   frame_skip_counter = 0;
-    // }
-    // Add current frame to buffer (rotated and cropped to 24x24)
   }
 
   // Decrement cooldown
@@ -548,69 +1151,329 @@ void depth_sensor_task(float *steering_ptr, float *throttle_ptr, float *ch3_ptr)
 }
 
 // -------------------- Frame Export --------------------
-// Formats the frame into a CSV line and enqueues it for the writer task.
-// Returns immediately - does NOT block on SD card I/O.
+// Formats the frame into a CSV line or a binary record and enqueues it for the
+// writer task. Returns immediately - does NOT block on SD card I/O.
 // Steering/throttle are stored as integer millis (e.g. 1.234 -> 1234) to avoid
 // float formatting, which uses the deep-stack Ryu algorithm and causes stack overflows.
-bool appendDepthFrame(float steering, float throttle)
+bool appendDepthFrame(const sensor_frame_t *frame, float steering, float throttle)
 {
   if (g_sd_queue == NULL)
     return false;
 
-  static sd_frame_t item;
-  int steering_i = (int)(steering * 1000);
-  int throttle_i = (int)(throttle * 1000);
-  int pos = snprintf(item.data, sizeof(item.data), "%d,%d,%d,%d,%d",
-                     g_frame_counter++, steering_i, throttle_i, imageCols, imageRows);
+  // Non-blocking: drop frame if the writer task has fallen behind and the pool is empty
+  sd_frame_t *item;
+  if (xQueueReceive(g_sd_free_queue, &item, 0) != pdTRUE)
+  {
+    dropped_frames++;
+    link_sd_queue_drops = link_sd_queue_drops + 1;
+    return false;
+  }
+  item->frame = (uint32_t)g_frame_counter;
+  item->timestamp_us = frame->timestamp_us;
 
-  for (int i = 0; i < imageRows; i++)
-    for (int j = 0; j < imageCols; j++)
-      pos += snprintf(item.data + pos, sizeof(item.data) - pos, ",%d", (int)depthMap[i][j]);
+#ifdef LOG_FORMAT_BINARY
+  item->len = depth_format_record(frame, (uint32_t)g_frame_counter++, steering, throttle, (uint8_t *)item->data);
+#else
+  item->len = depth_format_csv_line((uint32_t)g_frame_counter++, steering, throttle, depthMap, imageRows, imageCols,
+                                    item->data, sizeof(item->data));
+#endif
 
-  item.data[pos++] = '\n';
-  item.len = pos;
+  xQueueSend(g_sd_queue, &item, 0); // Never full: it has room for every pool buffer
+  return true;
+}
 
-  // Non-blocking: drop frame if the writer task has fallen behind
-  if (xQueueSend(g_sd_queue, &item, 0) != pdTRUE)
+// -------------------- Log Compression --------------------
+// Runs in the writer task: records arrive raw from appendDepthFrame() and
+// leave either unchanged (keyframe) or as LOG_PIXELS_DELTA against the
+// previous frame of the same sensor, whichever the interval and the encoded
+// size call for. Only the front sensor's keyframes go into the index: a
+// reader starting there reaches the other sensors' next keyframes within
+// LOG_KEYFRAME_INTERVAL of their frames.
+#if defined(LOG_FORMAT_BINARY) && defined(LOG_COMPRESSION)
+static uint8_t log_prev_pixels[DEPTH_SENSOR_COUNT][MAX_FRAME_PIXELS]; // Pixels of the last record written
+static int log_prev_count[DEPTH_SENSOR_COUNT] = {};                   // 0 = next record must be a keyframe
+static int log_since_keyframe[DEPTH_SENSOR_COUNT] = {};
+static char log_delta_record[SD_RECORD_MAX];
+
+// Record to write for item, its length, and whether it is a keyframe for the index
+static const char *compressRecord(const sd_frame_t *item, int *len, bool *keyframe)
+{
+  log_record_header_t record;
+  memcpy(&record, item->data, sizeof(record));
+  const uint8_t *pixels = (const uint8_t *)item->data + sizeof(record);
+  int count = record.width * record.height;
+  int sensor = record.sensor;
+
+  const char *out = item->data;
+  *len = item->len;
+  if (count == log_prev_count[sensor] && log_since_keyframe[sensor] < LOG_KEYFRAME_INTERVAL - 1)
   {
-    dropped_frames++;
+    int encoded = log_delta_encode(pixels, log_prev_pixels[sensor], count,
+                                   (uint8_t *)log_delta_record + sizeof(record), count - 1);
+    if (encoded >= 0)
+    {
+      record.pixel_encoding = LOG_PIXELS_DELTA;
+      record.payload_bytes = (uint16_t)encoded;
+      memcpy(log_delta_record, &record, sizeof(record));
+      out = log_delta_record;
+      *len = (int)sizeof(record) + encoded;
+    }
+  }
+  bool raw = out == item->data;
+  log_since_keyframe[sensor] = raw ? 0 : log_since_keyframe[sensor] + 1;
+  *keyframe = raw && sensor == 0;
+
+  memcpy(log_prev_pixels[sensor], pixels, count);
+  log_prev_count[sensor] = count;
+  return out;
+}
+
+// Start the next recording stretch with a keyframe from every sensor
+static void resetCompression()
+{
+  memset(log_prev_count, 0, sizeof(log_prev_count));
+}
+#else
+static int log_since_keyframe = 0;
+
+// Every record decodes on its own; every LOG_KEYFRAME_INTERVAL-th one of the
+// front sensor counts as a keyframe for the index
+static const char *compressRecord(const sd_frame_t *item, int *len, bool *keyframe)
+{
+#ifdef LOG_FORMAT_BINARY
+  bool front = ((const log_record_header_t *)item->data)->sensor == 0;
+#else
+  bool front = true; // CSV logs have the front sensor only
+#endif
+  *keyframe = front && log_since_keyframe == 0;
+  if (front)
+    log_since_keyframe = (log_since_keyframe + 1) % LOG_KEYFRAME_INTERVAL;
+  *len = item->len;
+  return item->data;
+}
+
+static void resetCompression()
+{
+  log_since_keyframe = 0;
+}
+#endif
+
+// -------------------- Log Segments --------------------
+#define SD_SEGMENT_BYTES ((off_t)SD_SEGMENT_MB * 1024 * 1024)
+
+// Record where a keyframe starts, for DOWNLOAD_FRAMES and REPLAY_BENCH seeks
+static void indexRecord(const sd_frame_t *item, off_t offset)
+{
+  if (g_log_index_file == NULL)
+    return;
+  log_index_entry_t entry;
+  entry.frame = item->frame;
+  entry.segment = (uint16_t)g_log_segment;
+  entry.reserved = 0;
+  entry.offset = (uint32_t)offset;
+  entry.timestamp_us = item->timestamp_us;
+  fwrite(&entry, 1, sizeof(entry), g_log_index_file);
+}
+
+// Close the full segment and continue in the next one. The caller has flushed
+// and cut the old file; the new one starts with a keyframe.
+static bool startNextSegment()
+{
+  fclose(g_depth_log_file);
+  g_log_segment++;
+  char path[80];
+  log_segment_path(g_depth_log_filename, g_log_segment, path, sizeof(path));
+  g_depth_log_file = openLogSegment(path);
+  resetCompression();
+  if (g_log_index_file != NULL)
+    fflush(g_log_index_file);
+  if (g_depth_log_file == NULL)
+  {
+    printf("SD writer: cannot open %s, recording stopped\n", path);
     return false;
   }
+  printf("SD writer: continuing in %s\n", path);
   return true;
 }
 
 // -------------------- SD Writer Task --------------------
 // Runs on its own FreeRTOS task. Drains the queue and writes to the SD card.
 // SD write stalls (erase/wear-levelling) no longer affect the sensor loop.
-// A sentinel item (len == 0) triggers a final fflush + fsync on the file.
+// A sentinel item (NULL) triggers a final flush + fsync on the file.
+#ifdef SD_DIRECT_WRITE
+// Frames are gathered into one block that ends on the next SD_WRITE_BLOCK
+// boundary of the file, so after the header (and after each sentinel's partial
+// block) every write() is one whole aligned block.
+void sd_writer_task(void *pvParameters)
+{
+  if (g_sd_queue == NULL)
+  {
+    vTaskDelete(NULL); // No SD buffer pool, nothing will ever be queued
+    return;
+  }
+
+  uint8_t *block = (uint8_t *)heap_caps_malloc(SD_WRITE_BLOCK, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+  if (block == NULL)
+    block = (uint8_t *)heap_caps_malloc(SD_WRITE_BLOCK, MALLOC_CAP_SPIRAM);
+  if (block == NULL)
+  {
+    printf("SD writer: cannot allocate %d byte block, logging disabled\n", SD_WRITE_BLOCK);
+    vTaskDelete(NULL);
+    return;
+  }
+  memory_report_add("sd_write_block", block, SD_WRITE_BLOCK);
+#ifdef LOG_COMPRESSION
+  memory_report_add("log_delta", log_prev_pixels, sizeof(log_prev_pixels) + sizeof(log_delta_record));
+#endif
+
+  sd_frame_t *item;
+  int fd = -1;
+  off_t file_pos = 0;   // Logged bytes on the card, including the file header
+  int fill = 0;          // Bytes gathered in block, to be written at file_pos
+  bool reserved = false; // Clusters past file_pos are allocated
+
+  while (true)
+  {
+    if (xQueueReceive(g_sd_queue, &item, portMAX_DELAY) != pdTRUE)
+      continue;
+    // Compression, block copies and FATFS at the full clock
+    PowerLock full_clock(POWER_LOCK_SD);
+
+    if (g_depth_log_file != NULL && fd < 0)
+    {
+      fd = fileno(g_depth_log_file);
+      fflush(g_depth_log_file); // The file header went through stdio
+      file_pos = lseek(fd, 0, SEEK_CUR);
+    }
+
+    if (item == NULL)
+    {
+      // Sentinel: drain is done, write the partial block and cut the file to what was logged
+      if (fd >= 0)
+      {
+        if (fill > 0 && write(fd, block, fill) == fill)
+          file_pos += fill;
+        fill = 0;
+        ftruncate(fd, file_pos);
+        fsync(fd);
+        reserved = false;
+      }
+      if (g_log_index_file != NULL)
+        fflush(g_log_index_file);
+      resetCompression();
+      continue;
+    }
+
+    if (fd >= 0 && file_pos + fill + item->len > SD_SEGMENT_BYTES)
+    {
+      // Segment full: finish it like a sentinel would, then move on
+      if (fill > 0 && write(fd, block, fill) == fill)
+        file_pos += fill;
+      fill = 0;
+      ftruncate(fd, file_pos);
+      fsync(fd);
+      reserved = false;
+      fd = -1;
+      if (startNextSegment())
+      {
+        fd = fileno(g_depth_log_file);
+        file_pos = lseek(fd, 0, SEEK_CUR);
+      }
+    }
+
+    if (fd >= 0)
+    {
+      if (!reserved)
+      {
+        // Recording starts: allocate the rest of the segment in one go, before the first frame
+        if (ftruncate(fd, SD_SEGMENT_BYTES) != 0)
+          printf("SD writer: could not preallocate the log, it grows as it is written\n");
+        lseek(fd, file_pos, SEEK_SET);
+        reserved = true;
+      }
+
+      int left;
+      bool keyframe;
+      const char *src = compressRecord(item, &left, &keyframe);
+      if (keyframe)
+        indexRecord(item, file_pos + fill);
+      while (left > 0)
+      {
+        int block_len = SD_WRITE_BLOCK - (int)(file_pos % SD_WRITE_BLOCK);
+        int n = block_len - fill < left ? block_len - fill : left;
+        memcpy(block + fill, src, n);
+        fill += n;
+        src += n;
+        left -= n;
+        if (fill == block_len)
+        {
+          if (write(fd, block, fill) == fill)
+            file_pos += fill;
+          else
+            lseek(fd, file_pos, SEEK_SET); // Card error: drop the block, keep the file consistent
+          fill = 0;
+        }
+      }
+    }
+    xQueueSend(g_sd_free_queue, &item, 0); // Back to the pool
+  }
+}
+#else
 void sd_writer_task(void *pvParameters)
 {
-  static sd_frame_t item;
+  if (g_sd_queue == NULL)
+  {
+    vTaskDelete(NULL); // No SD buffer pool, nothing will ever be queued
+    return;
+  }
+
+  sd_frame_t *item;
   int flush_counter = 0;
 
   while (true)
   {
     if (xQueueReceive(g_sd_queue, &item, portMAX_DELAY) == pdTRUE)
     {
-      if (g_depth_log_file == NULL)
+      PowerLock full_clock(POWER_LOCK_SD); // CSV and FATFS at the full clock
+      if (item == NULL)
+      {
+        // Sentinel: drain is done, safe to flush and sync
+        if (g_depth_log_file != NULL)
+        {
+          fflush(g_depth_log_file);
+          fsync(fileno(g_depth_log_file));
+        }
+        if (g_log_index_file != NULL)
+          fflush(g_log_index_file);
+        flush_counter = 0;
+        resetCompression();
         continue;
+      }
 
-      if (item.len == 0)
+      if (g_depth_log_file != NULL && ftell(g_depth_log_file) + item->len > SD_SEGMENT_BYTES)
       {
-        // Sentinel: drain is done, safe to flush and sync
         fflush(g_depth_log_file);
         fsync(fileno(g_depth_log_file));
         flush_counter = 0;
+        startNextSegment();
       }
-      else
+
+      if (g_depth_log_file != NULL)
       {
-        fwrite(item.data, 1, item.len, g_depth_log_file);
+        int len;
+        bool keyframe;
+        const char *data = compressRecord(item, &len, &keyframe);
+        if (keyframe)
+          indexRecord(item, ftell(g_depth_log_file));
+        fwrite(data, 1, len, g_depth_log_file);
         if (++flush_counter >= 20)
         {
           fflush(g_depth_log_file);
           flush_counter = 0;
         }
       }
+      xQueueSend(g_sd_free_queue, &item, 0); // Back to the pool
     }
   }
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
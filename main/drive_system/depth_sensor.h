@@ -1,25 +1,76 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
 #include "driver/uart.h"
 #include "WS2812FX.h"
 
 // -------------------- Configuration --------------------
-#define UART_PORT_NUM UART_NUM_2
+#define UART_PORT_NUM UART_NUM_2 // Sensor 0 (front)
+// Sensor link speed: 115200, 230400, 460800, 921600, 1000000, 2000000 or 3000000.
+// 25x25 frames need 230400 for 19 FPS, 50x50 frames need 921600 (see the
+// throughput estimate printed at boot and in GET_LINK_HEALTH).
 #define UART_BAUD_RATE 230400
+#define SENSOR_DEFAULT_BAUD 115200 // Sensor baud rate after a power cycle
 #define UART_RX_PIN 20
 #define UART_TX_PIN 21
 
-#define BUFFER_SIZE 16000
+// More sensors (rear, sides) next to the front one, each on its own UART with
+// its own receive task, parser and frame ring. All run at the settings here
+// and their frames meet in depth_sensor_task() in arrival order. Sensor 0 is
+// the front sensor: the serial preview and stream and CSV logs show only
+// its frames, binary logs and network telemetry carry every sensor's (the
+// record says which).
+#define DEPTH_SENSOR_COUNT 1 // Up to DEPTH_SENSOR_MAX, 2 with a rear sensor wired to SENSOR1_UART_*
+#define DEPTH_SENSOR_MAX 2
+#define SENSOR1_UART_PORT_NUM UART_NUM_1
+#define SENSOR1_UART_RX_PIN 22
+#define SENSOR1_UART_TX_PIN 23
+
+// Sensors whose frames go into the model's frame window, bit n = sensor n.
+// With several, their frames are interleaved in the window by arrival time,
+// for a model trained on such windows. The flight recorder keeps the same
+// frames.
+#define INFERENCE_SENSORS 0x1
+
+#define BUFFER_SIZE 16000 // Half the UART driver's receive buffer, per sensor
 #define HEADER_SIZE 20
-#define MAX_IMAGE_SIZE 25
 
+// AT+BINN: 4 = 25x25, 2 = 50x50 (1 = 100x100 needs a larger FRAME_PARSER_CAPACITY).
+// Frame buffers are allocated at init for this resolution; each frame is then
+// handled at the resolution_rows/cols its header reports, up to that size.
 #define BINNING_FACTOR 4
+#define SENSOR_NATIVE_SIZE 100                                // Unbinned sensor resolution
+#define MAX_IMAGE_SIZE (SENSOR_NATIVE_SIZE / BINNING_FACTOR) // Largest frame side accepted
+#define MAX_FRAME_PIXELS (MAX_IMAGE_SIZE * MAX_IMAGE_SIZE)
+#define FRAME_TRAILER_SIZE 2                                  // Checksum and end byte
+#define MAX_FRAME_BYTES (HEADER_SIZE + MAX_FRAME_PIXELS + FRAME_TRAILER_SIZE)
+#define SENSOR_FPS 19 // AT+FPS, frames per second the sensor is asked to send
 
 // #define USE_NONLINEAR
 #define USE_LINEAR
 #define UNIT_VALUE 10
 
+// SD log format. Binary logs (revised_log_XXXX.bin) store a fixed header and
+// the raw sensor bytes per frame, about 650 bytes for 25x25 instead of ~3300
+// of CSV text and no per-pixel formatting. Comment out for CSV logs
+// (revised_log_XXXX.csv). Both are read by the tools and REPLAY_BENCH.
+#define LOG_FORMAT_BINARY
+
+// Binary logs only: the SD writer task stores a full keyframe every
+// LOG_KEYFRAME_INTERVAL frames and in between only the change from the
+// previous frame, as runs of unchanged pixels and spans of byte deltas
+// (LOG_PIXELS_DELTA below). Nothing extra runs in the sensor path. Comment out
+// to store every frame in full.
+#define LOG_COMPRESSION
+#define LOG_KEYFRAME_INTERVAL 30 // About 1.5 s at SENSOR_FPS: what a torn write can cost, and the index spacing
+
+// Serial mode (write_to_sd == 1): stream every frame as a binary packet
+// (stream_packet_header_t and the raw bytes) for read_serial.py. Packets are
+// queued on the console TX ring without waiting and dropped when the link is
+// saturated. Comment out for the ASCII preview of the newest frame.
+#define SERIAL_STREAM_BINARY
+
 // -------------------- Data Structures --------------------
 typedef struct __attribute__((packed))
 {
@@ -47,12 +98,164 @@ typedef struct
   float data[MAX_IMAGE_SIZE][MAX_IMAGE_SIZE];
 } DepthFrame;
 
-// SD writer queue item: one pre-formatted CSV line
-#define SD_LINE_MAX 3300
-#define SD_QUEUE_DEPTH 30
+// One decoded frame as published by the sensor receive task
 typedef struct
 {
-  char data[SD_LINE_MAX];
+  int64_t timestamp_us; // esp_timer time the frame's start bytes arrived on the UART
+  uint32_t seq;         // Frames received from this sensor since boot, gaps mean ring overruns
+  uint16_t frame_id;    // Sensor's own frame counter from the header
+  uint8_t sensor;       // Which depth sensor it came from, 0 = front
+  int rows;
+  int cols;
+  uint8_t *pixels; // Raw sensor bytes, rows x cols row-major (see depth_mm_lut), MAX_FRAME_PIXELS allocated
+} sensor_frame_t;
+
+// Link health counters of one sensor since boot or the last
+// depth_sensor_reset_link_health()
+typedef struct
+{
+  int64_t elapsed_us;             // Time the counters cover
+  uint32_t frames_received;       // Valid frames published to the frame ring
+  uint32_t frames_missed;         // Gaps in the sensor's frame_id: sent, but never parsed
+  uint32_t invalid_frames;        // Parsed, but dropped for a bad resolution
+  uint32_t error_frames;          // Header error_code was non-zero
+  uint32_t checksum_errors;       // Checksum mismatches (kept unless DROP_BAD_CHECKSUM)
+  uint32_t resync_bytes;          // Bytes skipped looking for a frame start
+  uint32_t parser_overflow_bytes; // Bytes dropped because the frame parser was full
+  uint32_t uart_overflows;        // UART driver FIFO / buffer overruns
+  uint32_t ring_overruns;         // Dropped because the consumer was a full frame ring behind
+  uint32_t sd_queue_drops;        // Not logged because the SD writer fell behind (all sensors)
+  uint32_t stream_drops;          // Not streamed because the console TX ring was full (all sensors)
+  uint8_t last_error_code;        // Header values of the newest frame
+  uint8_t sensor_temp;
+  uint8_t driver_temp;
+} link_health_t;
+
+// -------------------- Raw Pixel Conversion --------------------
+// Raw sensor byte to millimetres, per USE_NONLINEAR / USE_LINEAR above
+constexpr float raw_to_millimeters(uint8_t pixelValue)
+{
+#ifdef USE_NONLINEAR
+  // Sensor uses formula 5.1*sqrt(x)
+  // Reverse: divide by 5.1 then square
+  return (pixelValue / 5.1f) * (pixelValue / 5.1f);
+#elif defined(USE_LINEAR)
+  return pixelValue * UNIT_VALUE;
+#else
+  // Default: return raw pixel value if no mode is defined
+  return (float)pixelValue;
+#endif
+}
+
+// raw_to_millimeters() for all 256 byte values, built at compile time
+struct DepthMmLut
+{
+  float mm[256];
+  constexpr DepthMmLut() : mm()
+  {
+    for (int i = 0; i < 256; i++)
+      mm[i] = raw_to_millimeters((uint8_t)i);
+  }
+};
+inline constexpr DepthMmLut depth_mm_lut;
+
+// -------------------- Binary Log Format --------------------
+// File: one log_file_header_t, then one log_record_header_t plus
+// payload_bytes of pixel data per frame. The pixels are width * height raw
+// sensor bytes (row-major), stored per pixel_encoding. All fields are
+// little-endian. Readers convert raw bytes to millimetres with depth_encoding
+// and unit_mm, the same way as raw_to_millimeters().
+#define LOG_FILE_MAGIC "TNLG"
+#define LOG_RECORD_MAGIC 0x46444E54 // "TNDF" in file byte order
+#define LOG_FORMAT_VERSION 2        // 1 had no pixel_encoding/payload_bytes, always raw
+
+#define LOG_PIXELS_RAW 0 // The raw bytes themselves (keyframe)
+// Change from the previous record's pixels: a token byte t < 0x80 keeps the
+// next t + 1 pixels, t >= 0x80 is followed by (t & 0x7F) + 1 bytes to add
+// (mod 256) to the next pixels
+#define LOG_PIXELS_DELTA 1
+
+#define LOG_DEPTH_RAW 0       // Millimetres = raw byte
+#define LOG_DEPTH_LINEAR 1    // Millimetres = raw byte * unit_mm
+#define LOG_DEPTH_NONLINEAR 2 // Millimetres = (raw byte / 5.1)^2
+
+typedef struct __attribute__((packed))
+{
+  char magic[4];              // LOG_FILE_MAGIC
+  uint8_t version;            // LOG_FORMAT_VERSION
+  uint8_t header_size;        // sizeof(log_file_header_t)
+  uint8_t record_header_size; // sizeof(log_record_header_t)
+  uint8_t binning_factor;
+  uint8_t depth_encoding;     // LOG_DEPTH_*
+  uint8_t reserved;
+  uint16_t unit_mm;           // UNIT_VALUE for LOG_DEPTH_LINEAR
+} log_file_header_t;
+
+typedef struct __attribute__((packed))
+{
+  uint32_t magic;          // LOG_RECORD_MAGIC, lets a reader resync after a torn write
+  uint32_t frame;          // Same counter as the CSV Frame column
+  int64_t timestamp_us;    // Start-of-frame time on the UART (sensor_frame_t::timestamp_us)
+  int16_t steering_millis; // Same integer millis as the CSV
+  int16_t throttle_millis;
+  uint16_t width;
+  uint16_t height;
+  uint8_t pixel_encoding;  // LOG_PIXELS_*
+  uint8_t sensor;          // sensor_frame_t::sensor; deltas are against the previous record of the same sensor
+  uint16_t payload_bytes;  // Pixel data following this header
+} log_record_header_t;
+
+// -------------------- Live Stream Format --------------------
+// Serial mode packet: one stream_packet_header_t, then width * height raw
+// sensor bytes (row-major). Little-endian; millimetres as for binary logs.
+#define STREAM_PACKET_MAGIC 0x53444E54 // "TNDS" in byte order
+
+typedef struct __attribute__((packed))
+{
+  uint32_t magic;          // STREAM_PACKET_MAGIC
+  uint32_t seq;            // Packets attempted since boot, gaps mean dropped packets
+  int64_t timestamp_us;    // Start-of-frame time on the UART
+  int16_t steering_millis; // Control values when the frame was consumed
+  int16_t throttle_millis;
+  uint8_t width;
+  uint8_t height;
+  uint8_t depth_encoding;  // LOG_DEPTH_*
+  uint8_t unit_mm;         // UNIT_VALUE for LOG_DEPTH_LINEAR
+  uint32_t crc;            // CRC32 (zlib) of the header before this field and the pixels
+} stream_packet_header_t;
+
+// SD writer buffer: one pre-formatted CSV line (up to 5 characters per pixel)
+// or one binary record. A pool of SD_POOL_BUFFERS lives in PSRAM; only
+// pointers travel between the sensor loop and the writer task.
+#define SD_LINE_MAX (MAX_FRAME_PIXELS * 5 + 64 > 3300 ? MAX_FRAME_PIXELS * 5 + 64 : 3300)
+#define SD_RECORD_MAX (sizeof(log_record_header_t) + MAX_FRAME_PIXELS)
+#ifdef LOG_FORMAT_BINARY
+#define SD_ITEM_MAX SD_RECORD_MAX
+#else
+#define SD_ITEM_MAX SD_LINE_MAX
+#endif
+#define SD_POOL_BUFFERS 128 // Frames the writer can fall behind by, ~6 s at SENSOR_FPS
+
+// Sessions are written as segment files of at most SD_SEGMENT_MB, plus an
+// index of keyframe offsets (log_index.h), so parts of a long session can be
+// downloaded (DOWNLOAD_FRAMES) and replayed without reading everything before
+#define SD_SEGMENT_MB 64 // About 1.5 h of 25x25 binary frames, 17 min of CSV
+
+// SD writer: gather frames into SD_WRITE_BLOCK-aligned blocks and write() them
+// straight to the file descriptor, bypassing stdio. When recording starts the
+// segment file is extended to SD_SEGMENT_MB in one go, so no cluster
+// allocation or periodic fflush happens while recording. The file is cut back
+// to the logged data at each flush sentinel (leaving SD mode) and when the
+// next segment starts; after a power cut mid-recording it keeps the reserved
+// size and the readers stop at the end of the valid records. Comment out for
+// buffered fwrite with an fflush every 20 frames.
+#define SD_DIRECT_WRITE
+#define SD_WRITE_BLOCK (32 * 1024) // Two 16 KB clusters
+typedef struct
+{
+  uint32_t frame;       // Log frame number, for the index
+  int64_t timestamp_us; // Start-of-frame time, for the index
+  char data[SD_ITEM_MAX];
   int len;
 } sd_frame_t;
 
@@ -60,8 +263,7 @@ typedef struct
 extern int imageRows;
 extern int imageCols;
 
-extern float depthMap[MAX_IMAGE_SIZE][MAX_IMAGE_SIZE];
-extern uint8_t rxBuffer[BUFFER_SIZE];
+extern float *depthMap; // imageRows x imageCols millimetres of the newest front frame, row-major
 
 extern int g_frame_counter;
 extern FILE *g_depth_log_file;
@@ -69,16 +271,34 @@ extern char g_depth_log_filename[64];
 extern short write_to_sd; // 0=off, 1=serial, 2=SD, 3=inference
 
 // -------------------- API --------------------
-void depth_sensor_task(float *steering_ptr, float *throttle_ptr, float *ch3_ptr);
-void depth_sensor_init();
+void depth_sensor_task(); // Mode switching and frame consumption, from the main loop
+bool depth_sensor_init();     // UARTs and sensor handshakes; false without buffers or an answer from every sensor
+bool depth_sensor_log_init(); // SD buffer pool, queues and log file; false without a log file
+void depth_sensor_start();    // One receive task per sensor, once everything the frames go to is set up
 void sd_writer_task(void *pvParameters);
 
-bool getPacket();
-bool readHeader();
-void processDepth();
+// Name of a sensor ("front", "rear")
+const char *depth_sensor_name(int sensor);
+
+void loadDepthMap(const sensor_frame_t *frame);
 void printDepthAscii();
+void streamDepthFrame(const sensor_frame_t *frame, float steering, float throttle);
 void printDepthSerial();
 float toMillimeters(uint8_t pixelValue);
 void fullPrint();
 
-bool appendDepthFrame(float steering, float throttle);
+// Queue one frame for the SD writer. CSV logs format depthMap (call
+// loadDepthMap() first), binary logs copy the frame's raw bytes.
+bool appendDepthFrame(const sensor_frame_t *frame, float steering, float throttle);
+
+// File header of a binary log written by this build (resolution, depth encoding)
+void fillLogFileHeader(log_file_header_t *header);
+
+// Highest frame rate the UART link can carry for frames of this size
+float depth_sensor_link_max_fps(int rows, int cols);
+
+void depth_sensor_get_link_health(int sensor, link_health_t *out);
+
+// Frames waiting for the SD writer and pool buffers still free (SD_POOL_BUFFERS in total)
+void depth_sensor_get_sd_queue(int *queued, int *free_buffers);
+void depth_sensor_reset_link_health(); // All sensors
@@ -10,11 +10,14 @@
 #include <WS2812FX.h>
 #include "../led_manager.h"
 #include "depth_sensor.h"
+#include "battery.h"
 #include "../main_functions.h"
+#include "../latency_histogram.h"
+#include "../trace_events.h"
+#include "../memory_report.h"
+#include "../flight_recorder.h"
+#include "../task_layout.h"
 
-#include "esp_adc/adc_oneshot.h"
-#include "esp_adc/adc_cali.h"
-#include "esp_adc/adc_cali_scheme.h"
 #include "esp_log.h"
 
 #define RECEIVER_CH1 GPIO_NUM_32
@@ -22,17 +25,11 @@
 #define RECEIVER_CH3 GPIO_NUM_27
 #define CHANNEL_COUNT 3
 
-#define ADC_GPIO GPIO_NUM_51
-#define ADC_UNIT ADC_UNIT_2
-#define ADC_CHANNEL ADC_CHANNEL_2
-#define ADC_ATTEN ADC_ATTEN_DB_12
-adc_oneshot_unit_handle_t adc_handle;
-adc_cali_handle_t cali_handle = NULL;
-
-// Voltage divider resistor values (in ohms)
-#define R1 30000.0f
-#define R2 7500.0f
-#define REF_VOLTAGE 3.3f
+// Receiver pulses are timed by the MCPWM capture unit: it latches the timer
+// on both edges, so interrupt latency no longer shows up in the width
+#define RC_PULSE_MIN_US 800  // Shorter or longer pulses are glitches and ignored
+#define RC_PULSE_MAX_US 2200
+#define RC_FAILSAFE_MS 100   // No valid pulse for this long: the channel reads neutral
 
 #define IN1 GPIO_NUM_25
 #define IN2 GPIO_NUM_24
@@ -60,33 +57,144 @@ mcpwm_gen_handle_t generator_b = NULL;
 static int64_t min_pulse = 985;
 static int64_t max_pulse = 1980;
 
-// Pulse measurement
-static volatile int64_t last_rise_us[CHANNEL_COUNT] = {0, 0, 0};
-static volatile int64_t last_edge_us[CHANNEL_COUNT] = {0, 0, 0};
-static volatile int64_t pulse_width_us[CHANNEL_COUNT] = {0, 0, 0};
-static volatile int64_t period_us[CHANNEL_COUNT] = {0, 0, 0};
+// Pulse measurement, written by the capture callback
+static mcpwm_cap_timer_handle_t cap_timer = NULL;
+static mcpwm_cap_channel_handle_t cap_channels[CHANNEL_COUNT] = {};
+static uint32_t cap_ticks_per_us = 1;
+static volatile uint32_t last_rise_ticks[CHANNEL_COUNT] = {0, 0, 0};
+static volatile uint32_t pulse_width_us[CHANNEL_COUNT] = {0, 0, 0};
+static volatile uint32_t valid_pulses[CHANNEL_COUNT] = {0, 0, 0};    // Since boot
+static volatile uint32_t rejected_pulses[CHANNEL_COUNT] = {0, 0, 0}; // Outside RC_PULSE_MIN_US..RC_PULSE_MAX_US
+
+// Failsafe, drive task only
+static uint32_t seen_pulses[CHANNEL_COUNT] = {0, 0, 0};
+static int64_t last_pulse_us[CHANNEL_COUNT] = {0, 0, 0};
+static bool channel_ok[CHANNEL_COUNT] = {false, false, false};
+static bool rc_ok = false;
+
+ControlChannel g_drive_command;
+
+static bool IRAM_ATTR rc_capture_callback(mcpwm_cap_channel_handle_t chan, const mcpwm_capture_event_data_t *edata,
+                                           void *user_data)
+{
+  int ch = (int)(intptr_t)user_data;
+  if (edata->cap_edge == MCPWM_CAP_EDGE_POS)
+  {
+    last_rise_ticks[ch] = edata->cap_value;
+    return false;
+  }
+  // Unsigned difference, right across a wrap of the capture timer
+  uint32_t width_us = (edata->cap_value - last_rise_ticks[ch]) / cap_ticks_per_us;
+  if (width_us >= RC_PULSE_MIN_US && width_us <= RC_PULSE_MAX_US)
+  {
+    pulse_width_us[ch] = width_us;
+    valid_pulses[ch] = valid_pulses[ch] + 1;
+  }
+  else
+  {
+    rejected_pulses[ch] = rejected_pulses[ch] + 1;
+  }
+  return false;
+}
 
-float steering_scaled = 0.0;
-float throttle_scaled = 0.0;
-float ch3_scaled = 0.0;
+static void setup_rc_capture()
+{
+  mcpwm_capture_timer_config_t cap_timer_config = {};
+  cap_timer_config.group_id = 0; // The capture timer is separate from the motor PWM timer
+  cap_timer_config.clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT;
+  ESP_ERROR_CHECK(mcpwm_new_capture_timer(&cap_timer_config, &cap_timer));
+  uint32_t resolution_hz = 0;
+  ESP_ERROR_CHECK(mcpwm_capture_timer_get_resolution(cap_timer, &resolution_hz));
+  cap_ticks_per_us = resolution_hz / 1000000 > 0 ? resolution_hz / 1000000 : 1;
+
+  const gpio_num_t pins[CHANNEL_COUNT] = {RECEIVER_CH1, RECEIVER_CH2, RECEIVER_CH3};
+  mcpwm_capture_event_callbacks_t callbacks = {};
+  callbacks.on_cap = rc_capture_callback;
+  for (int ch = 0; ch < CHANNEL_COUNT; ch++)
+  {
+    mcpwm_capture_channel_config_t cap_config = {};
+    cap_config.gpio_num = pins[ch];
+    cap_config.prescale = 1;
+    cap_config.flags.pos_edge = true;
+    cap_config.flags.neg_edge = true;
+    ESP_ERROR_CHECK(mcpwm_new_capture_channel(cap_timer, &cap_config, &cap_channels[ch]));
+    ESP_ERROR_CHECK(mcpwm_capture_channel_register_event_callbacks(cap_channels[ch], &callbacks, (void *)(intptr_t)ch));
+    ESP_ERROR_CHECK(mcpwm_capture_channel_enable(cap_channels[ch]));
+  }
+  ESP_ERROR_CHECK(mcpwm_capture_timer_enable(cap_timer));
+  ESP_ERROR_CHECK(mcpwm_capture_timer_start(cap_timer));
+}
 
-static void IRAM_ATTR signal_isr(void *arg)
+// Mark channels without a valid pulse for RC_FAILSAFE_MS, once per drive loop
+static void update_rc_failsafe()
 {
-  int ch = (int)arg;
-  int level = gpio_get_level(ch == 0 ? RECEIVER_CH1 : (ch == 1 ? RECEIVER_CH2 : RECEIVER_CH3));
   int64_t now = esp_timer_get_time();
-
-  if (level)
+  bool all_ok = true;
+  for (int ch = 0; ch < CHANNEL_COUNT; ch++)
   {
-    // rising edge
-    period_us[ch] = now - last_edge_us[ch];
-    last_edge_us[ch] = now;
-    last_rise_us[ch] = now;
+    uint32_t count = valid_pulses[ch];
+    if (count != seen_pulses[ch])
+    {
+      seen_pulses[ch] = count;
+      last_pulse_us[ch] = now;
+    }
+    channel_ok[ch] = last_pulse_us[ch] != 0 && now - last_pulse_us[ch] <= (int64_t)RC_FAILSAFE_MS * 1000;
+    all_ok = all_ok && channel_ok[ch];
   }
-  else
+  if (all_ok != rc_ok)
   {
-    // falling edge
-    pulse_width_us[ch] = now - last_rise_us[ch];
+    rc_ok = all_ok;
+    if (all_ok)
+    {
+      printf("RC signal OK\n");
+    }
+    else
+    {
+      printf("RC signal lost (valid pulses CH1/CH2/CH3: %lu/%lu/%lu, rejected: %lu/%lu/%lu), failsafe to neutral\n",
+             (unsigned long)valid_pulses[0], (unsigned long)valid_pulses[1], (unsigned long)valid_pulses[2],
+             (unsigned long)rejected_pulses[0], (unsigned long)rejected_pulses[1], (unsigned long)rejected_pulses[2]);
+    }
+  }
+}
+
+// -------------------- Drive Task --------------------
+
+static TaskHandle_t drive_task_handle = NULL;
+static esp_timer_handle_t drive_timer = NULL;
+static volatile bool drive_hold = false; // drive_system_hold()
+static volatile bool drive_held = false; // The task saw drive_hold and stopped the motors
+
+// Reflex stop. The drive loop applies its commands and drive_system_reflex_stop()
+// stops the motors under motor_lock, so a command computed before a stop can't
+// reach the motors after it.
+static portMUX_TYPE motor_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t reflex_until_us = 0; // Under motor_lock: forward commands held off until then
+static bool reflex_brake = false;   // Under motor_lock: brake rather than coast while held off
+static bool motors_forward = false; // Under motor_lock: the last inference command applied drives forward
+
+static void drive_timer_callback(void *arg)
+{
+  xTaskNotifyGive(drive_task_handle);
+}
+
+// One drive_system_loop() per timer tick; ticks that arrive while it runs collapse into one
+static void drive_task(void *pvParameters)
+{
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (drive_hold)
+    {
+      if (!drive_held)
+      {
+        set_motor_a_speed(0);
+        set_motor_b_speed(0);
+        drive_held = true;
+      }
+      continue;
+    }
+    drive_held = false;
+    drive_system_loop();
   }
 }
 
@@ -99,139 +207,120 @@ float normalize_pulse(int64_t pulse)
   return (float)(pulse - min_pulse) / (max_pulse - min_pulse);
 }
 
-void setup_voltage_sensor()
+// Channel scaled to 0..1, or neutral while it is in failsafe
+static float read_channel(int ch, float neutral)
 {
-  // Configure GPIO51 as analog input
-  gpio_config_t io_conf = {
-      .pin_bit_mask = (1ULL << ADC_GPIO),
-      .mode = GPIO_MODE_DISABLE,
-      .pull_up_en = GPIO_PULLUP_DISABLE,
-      .pull_down_en = GPIO_PULLDOWN_DISABLE,
-      .intr_type = GPIO_INTR_DISABLE,
-      .hys_ctrl_mode = GPIO_HYS_SOFT_DISABLE,
-  };
-  gpio_config(&io_conf);
+  return channel_ok[ch] ? normalize_pulse(pulse_width_us[ch]) : neutral;
+}
 
-  // Initialize ADC2 unit
-  adc_oneshot_unit_init_cfg_t init_config = {
-      .unit_id = ADC_UNIT,
-      .clk_src = ADC_RTC_CLK_SRC_DEFAULT,
-      .ulp_mode = ADC_ULP_MODE_DISABLE,
-  };
-  ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config, &adc_handle));
+void drive_system_setup()
+{
+  setup_rc_capture();
 
-  // Configure ADC2 Channel 2
-  adc_oneshot_chan_cfg_t config = {
-      .atten = ADC_ATTEN,
-      .bitwidth = ADC_BITWIDTH_DEFAULT,
-  };
-  ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, ADC_CHANNEL, &config));
-
-  // Initialize calibration (ESP32-P4 uses curve fitting)
-  adc_cali_curve_fitting_config_t cali_config = {
-      .unit_id = ADC_UNIT,
-      .chan = ADC_CHANNEL,
-      .atten = ADC_ATTEN,
-      .bitwidth = ADC_BITWIDTH_DEFAULT,
-  };
+  printf("drive_system initialized on GPIO %d (CH1), GPIO %d (CH2), and GPIO %d (CH3)\n", RECEIVER_CH1, RECEIVER_CH2, RECEIVER_CH3);
 
-  esp_err_t ret = adc_cali_create_scheme_curve_fitting(&cali_config, &cali_handle);
-  if (ret == ESP_OK)
-  {
-    printf("ADC calibration initialized on GPIO51");
-  }
-  else
+  drive_system_motors_setup();
+  battery_init();
+
+  if (xTaskCreatePinnedToCore(drive_task, "drive", DRIVE_TASK_STACK, NULL, DRIVE_TASK_PRIORITY, &drive_task_handle,
+                              DRIVE_TASK_CORE) != pdPASS)
   {
-    printf("ADC calibration not available");
-    cali_handle = NULL;
+    printf("Cannot create the drive task, motors stay off\n");
+    return;
   }
+  memory_report_add_task("drive", DRIVE_TASK_STACK);
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = drive_timer_callback;
+  timer_args.name = "drive";
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &drive_timer));
+  ESP_ERROR_CHECK(esp_timer_start_periodic(drive_timer, 1000000 / DRIVE_LOOP_HZ));
+  printf("Drive loop running at %d Hz\n", DRIVE_LOOP_HZ);
 }
 
-float read_voltage_mv(void)
+void drive_system_hold(bool hold)
 {
-  int raw_value;
-  int adc_voltage_mv;
-  float adc_voltage;
-  float input_voltage;
-
-  // Read raw ADC value
-  ESP_ERROR_CHECK(adc_oneshot_read(adc_handle, ADC_CHANNEL, &raw_value));
-
-  // Get calibrated voltage at ADC pin (in millivolts)
-  if (cali_handle != NULL)
+  drive_hold = hold;
+  if (!hold)
+    return;
+  if (drive_task_handle == NULL)
   {
-    ESP_ERROR_CHECK(adc_cali_raw_to_voltage(cali_handle, raw_value, &adc_voltage_mv));
-    adc_voltage = adc_voltage_mv / 1000.0f; // Convert to volts
+    set_motor_a_speed(0);
+    set_motor_b_speed(0);
+    return;
   }
-  else
+  // The task stops the motors itself, so none of its updates can land after this returns
+  while (!drive_held)
   {
-    // Fallback if no calibration (less accurate)
-    adc_voltage = (raw_value / 4095.0f) * REF_VOLTAGE;
+    vTaskDelay(1);
   }
-
-  // Calculate actual input voltage using voltage divider formula
-  // Vin = Vadc * (R1 + R2) / R2
-  input_voltage = adc_voltage * (R1 + R2) / R2;
-
-  return input_voltage;
 }
 
-void drive_system_setup()
+void drive_system_loop()
 {
-  gpio_config_t io_conf = {};
-  io_conf.pin_bit_mask = (1ULL << RECEIVER_CH1) | (1ULL << RECEIVER_CH2) | (1ULL << RECEIVER_CH3);
-  io_conf.mode = GPIO_MODE_INPUT;
-  io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-  io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-  io_conf.intr_type = GPIO_INTR_ANYEDGE;
-  gpio_config(&io_conf);
-
-  gpio_install_isr_service(0);
-  gpio_isr_handler_add(RECEIVER_CH1, signal_isr, (void *)0);
-  gpio_isr_handler_add(RECEIVER_CH2, signal_isr, (void *)1);
-  gpio_isr_handler_add(RECEIVER_CH3, signal_isr, (void *)2);
+  static bool fallback_active = false;
+  static int fallback_count = 0;
+  static int64_t last_applied_frame_us = 0; // Frame behind the last inference command sent to the motors
+  int64_t now = esp_timer_get_time();
+  control_state_t command = {};
+  command.mode = (int8_t)write_to_sd; // Read once, the sensor task may switch it at any time
 
-  printf("drive_system initialized on GPIO %d (CH1), GPIO %d (CH2), and GPIO %d (CH3)\n", RECEIVER_CH1, RECEIVER_CH2, RECEIVER_CH3);
+  update_rc_failsafe();
 
-  drive_system_motors_setup();
-  setup_voltage_sensor();
-}
-void drive_system_loop()
-{
-  float throttle_input, steering_input;
-  
   // Check if we're in inference mode (mode 3)
-  if (write_to_sd == 3)
+  if (command.mode == 3)
   {
-    // Use AI inference results
-    steering_input = get_inference_steering(); // -1.0 to +1.0
-    throttle_input = get_inference_throttle(); // 0.0 to 1.0 (assumed)
-    
-    // Convert throttle from [0, 1] to [-1, 1] if needed
-    // Assuming inference gives positive throttle only
-    throttle_scaled = throttle_input;
-    steering_scaled = steering_input;
+    // Use AI inference results, unless they are too old to trust
+    control_state_t result;
+    bool have_result = get_inference_result(&result);
+    int64_t result_age_us = have_result ? now - result.frame_us : INT64_MAX;
+    bool stale = result_age_us > (int64_t)INFERENCE_RESULT_MAX_AGE_MS * 1000;
+    if (stale != fallback_active)
+    {
+      fallback_active = stale;
+      if (stale)
+      {
+        fallback_count++;
+        printf("Inference results stale, fallback: %s (%d times this session)\n",
+               INFERENCE_FALLBACK_POLICY == FALLBACK_BRAKE ? "brake" : (INFERENCE_FALLBACK_POLICY == FALLBACK_HOLD ? "hold" : "coast"),
+               fallback_count);
+      }
+      else
+      {
+        printf("Inference results fresh again\n");
+      }
+    }
+
+    if (!stale || (INFERENCE_FALLBACK_POLICY == FALLBACK_HOLD && have_result))
+    {
+      command.source = stale ? CONTROL_SOURCE_FALLBACK : CONTROL_SOURCE_INFERENCE;
+      command.frame_us = result.frame_us;
+      command.steering = result.steering; // -1.0 to +1.0
+      command.throttle = result.throttle; // -1.0 to +1.0
+    }
+    else
+    {
+      command.source = CONTROL_SOURCE_FALLBACK;
+      command.brake = INFERENCE_FALLBACK_POLICY == FALLBACK_BRAKE;
+    }
   }
   else
   {
     // Use RC controller input
-    float throttle = normalize_pulse(pulse_width_us[1]); // CH1: 0=reverse, 1=forward
-    float steering = normalize_pulse(pulse_width_us[0]); // CH2: 0=right, 1=left
-    float ch3 = normalize_pulse(pulse_width_us[2]);      // CH3: 0.0 to 1.0
-    
+    float throttle = read_channel(1, 0.5f); // CH1: 0=reverse, 1=forward
+    float steering = read_channel(0, 0.5f); // CH2: 0=right, 1=left
+
     // Convert to -1.0 to +1.0 range
-    throttle_scaled = (throttle * 2.0f) - 1.0f; // -1.0 (reverse) to +1.0 (forward)
-    steering_scaled = (steering * 2.0f) - 1.0f; // -1.0 (right) to +1.0 (left)
-    ch3_scaled = ch3;                           // Store for other systems
+    command.source = CONTROL_SOURCE_RC;
+    command.throttle = (throttle * 2.0f) - 1.0f; // -1.0 (reverse) to +1.0 (forward)
+    command.steering = (steering * 2.0f) - 1.0f; // -1.0 (right) to +1.0 (left)
   }
 
-  // Get ch3 for mode switching (always from RC)
-  float ch3 = normalize_pulse(pulse_width_us[2]);
-  ch3_scaled = ch3;
+  // ch3 for mode switching (always from RC)
+  command.ch3 = read_channel(2, 0.0f);
 
   // Tank drive mixing
-  float left_motor = throttle_scaled + steering_scaled;
-  float right_motor = throttle_scaled - steering_scaled;
+  float left_motor = command.throttle + command.steering;
+  float right_motor = command.throttle - command.steering;
 
   // Clamp to -1.0 to +1.0 range
   if (left_motor > 1.0f)
@@ -247,25 +336,108 @@ void drive_system_loop()
   int left_speed = (int)(-left_motor * 100.0f);
   int right_speed = (int)(right_motor * 100.0f);
 
-  // Set motor speeds
-  set_motor_a_speed(left_speed);  // Left motor
-  set_motor_b_speed(right_speed); // Right motor
+  // Set motor speeds. While a reflex stop holds, anything but a stop or
+  // reversing is replaced by a stop.
+  portENTER_CRITICAL(&motor_lock);
+  bool forward =
+      command.mode == 3 && !command.brake && command.throttle >= 0.0f && (left_speed != 0 || right_speed != 0);
+  bool reflex = forward && now < reflex_until_us;
+  if (reflex)
+  {
+    command.source = CONTROL_SOURCE_REFLEX;
+    command.steering = 0.0f;
+    command.throttle = 0.0f;
+    command.brake = reflex_brake;
+    left_speed = 0;
+    right_speed = 0;
+    forward = false;
+  }
+  motors_forward = forward;
+  if (command.brake)
+  {
+    brake_motors();
+  }
+  else
+  {
+    set_motor_a_speed(left_speed);  // Left motor
+    set_motor_b_speed(right_speed); // Right motor
+  }
+  portEXIT_CRITICAL(&motor_lock);
+
+  // Sensor-to-motor latency, once per new result: from the start of the
+  // newest frame in the window to the command reaching the PWM
+  if (!command.brake && !reflex && command.frame_us != 0 && command.frame_us != last_applied_frame_us)
+  {
+    int64_t latency_us = esp_timer_get_time() - command.frame_us;
+    g_sensor_to_motor_latency.record(latency_us);
+    trace_event(TRACE_MOTOR, (int32_t)latency_us);
+    last_applied_frame_us = command.frame_us;
+  }
+  command.timestamp_us = now;
+  g_drive_command.publish(command);
 
-  float input_voltage = read_voltage_mv();
+  if (command.mode == 3)
+  {
+    flight_recorder_set_command(command.brake ? 0 : left_speed, command.brake ? 0 : right_speed,
+                                (fallback_active ? FLIGHT_FLAG_FALLBACK : 0) | (command.brake ? FLIGHT_FLAG_BRAKE : 0) |
+                                    (reflex ? FLIGHT_FLAG_REFLEX : 0));
+  }
+}
+
+bool drive_system_reflex_stop(uint32_t hold_ms, bool brake)
+{
+  int64_t until_us = esp_timer_get_time() + (int64_t)hold_ms * 1000;
+  portENTER_CRITICAL(&motor_lock);
+  reflex_until_us = until_us;
+  reflex_brake = brake;
+  bool stop = motors_forward && !drive_hold;
+  if (stop)
+  {
+    if (brake)
+    {
+      brake_motors();
+    }
+    else
+    {
+      set_motor_a_speed(0);
+      set_motor_b_speed(0);
+    }
+    motors_forward = false;
+  }
+  portEXIT_CRITICAL(&motor_lock);
+  return stop;
+}
+
+bool drive_system_reflex_active()
+{
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&motor_lock);
+  bool active = now < reflex_until_us;
+  portEXIT_CRITICAL(&motor_lock);
+  return active;
+}
+
+void drive_system_update_status()
+{
+  // Drains the ADC DMA pool, raises the low-battery LEDs
+  battery_update();
+
+  control_state_t command;
+  g_drive_command.read(&command);
 
   // Debug output
-  // printf("VOLTAGE: %.2f | Throttle: %.2f | Steering: %.2f | CH3: %.2f | Left: %d%% | Right: %d%%\n",
-  //        input_voltage, throttle_scaled, steering_scaled, ch3_scaled, left_speed, right_speed);
+  // printf("VOLTAGE: %.2f | Throttle: %.2f | Steering: %.2f | CH3: %.2f\n",
+  //        battery_voltage(), command.throttle, command.steering, command.ch3);
 
   // Use LED manager with normal priority for drive status (only in mode 0)
   if (write_to_sd == 0)
   {
-    if (throttle_scaled > 0.1f)
+    if (command.throttle > 0.1f)
     {
       // Moving forward
       led_manager_set(LED_PRIORITY_NORMAL, FX_MODE_STATIC, BLUE, 0, 0);
     }
-    else if (throttle_scaled < -0.1f)
+    else if (command.throttle < -0.1f)
     {
       // Moving backward
       led_manager_set(LED_PRIORITY_NORMAL, FX_MODE_STATIC, RED, 0, 0);
@@ -406,4 +578,15 @@ void set_motor_b_speed(int speed) // -100 to +100
     gpio_set_level(IN4, 0);
     mcpwm_comparator_set_compare_value(comparator_b, 0);
   }
-}
\ No newline at end of file
+}
+
+// Both bridge inputs high with full enable shorts the motor windings
+void brake_motors()
+{
+  gpio_set_level(IN1, 1);
+  gpio_set_level(IN2, 1);
+  gpio_set_level(IN3, 1);
+  gpio_set_level(IN4, 1);
+  mcpwm_comparator_set_compare_value(comparator_a, PWM_PERIOD_TICKS);
+  mcpwm_comparator_set_compare_value(comparator_b, PWM_PERIOD_TICKS);
+}
@@ -2,15 +2,32 @@
 #include <freertos/task.h>
 #include <WS2812FX.h>
 
-void drive_system_setup();
-void drive_system_loop();
+// drive_system_loop() runs in its own task, woken by a periodic esp_timer, so
+// RC and motor updates don't wait for sensor frames or the LED strip
+// (core, priority and stack in task_layout.h)
+#define DRIVE_LOOP_HZ 200
+
+void drive_system_setup(); // Also starts the drive task
+void drive_system_loop();  // One update: latest RC or inference command to the motors
+void drive_system_update_status(); // Drive status LEDs, from the main loop
+void drive_system_hold(bool hold); // true: stop the motors and keep them stopped (benches) until false
 void drive_system_motors_setup();
 void set_motor_a_speed(int speed);
 void set_motor_b_speed(int speed);
-void setup_voltage_sensor();
-float read_voltage_mv();
+void brake_motors(); // Short both motors (active brake), unlike speed 0 which lets them coast
+
+// Reflex stop (reflex_stop.h), from any task: brake (or coast) now if the
+// motors are driving forward in inference mode, and keep forward commands off
+// them for hold_ms, counted again from every call. False if nothing had to
+// be stopped.
+bool drive_system_reflex_stop(uint32_t hold_ms, bool brake);
+bool drive_system_reflex_active(); // Forward commands are being held off
 
-// Shared channel values for other systems
-extern float steering_scaled;
-extern float throttle_scaled;
-extern float ch3_scaled;
\ No newline at end of file
+// What the car does in inference mode when the latest result is older than
+// INFERENCE_RESULT_MAX_AGE_MS (inference stalled or fell behind)
+#define FALLBACK_COAST 0 // Motors off, car rolls out
+#define FALLBACK_BRAKE 1 // Active brake
+#define FALLBACK_HOLD 2  // Keep driving on the last result (coasts if there is none yet)
+#define INFERENCE_FALLBACK_POLICY FALLBACK_BRAKE
+// Must stay above the adaptive skip horizon (MAX_SKIPPED_FRAMES sensor frames)
+#define INFERENCE_RESULT_MAX_AGE_MS 400
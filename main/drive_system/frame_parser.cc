@@ -0,0 +1,112 @@
+#include "frame_parser.h"
+#include <string.h>
+
+#define FRAME_START_BYTE_1 0x00
+#define FRAME_START_BYTE_2 0xFF
+#define FRAME_END_BYTE 0xDD
+
+static void discard(frame_parser_t *parser, size_t count)
+{
+  memmove(parser->buf, parser->buf + count, parser->len - count);
+  parser->len -= count;
+}
+
+void frame_parser_reset(frame_parser_t *parser)
+{
+  parser->len = 0;
+  parser->frames = 0;
+  parser->resync_bytes = 0;
+  parser->checksum_errors = 0;
+  parser->overflow_bytes = 0;
+}
+
+void frame_parser_clear(frame_parser_t *parser)
+{
+  parser->len = 0;
+}
+
+uint8_t *frame_parser_space(frame_parser_t *parser, size_t *available)
+{
+  if (parser->len == FRAME_PARSER_CAPACITY)
+  {
+    // Nobody is taking frames out fast enough, keep the newest half
+    size_t drop = FRAME_PARSER_CAPACITY / 2;
+    parser->overflow_bytes += drop;
+    discard(parser, drop);
+  }
+  *available = FRAME_PARSER_CAPACITY - parser->len;
+  return parser->buf + parser->len;
+}
+
+void frame_parser_commit(frame_parser_t *parser, size_t count)
+{
+  parser->len += count;
+}
+
+void frame_parser_push(frame_parser_t *parser, const uint8_t *data, size_t count)
+{
+  while (count > 0)
+  {
+    size_t available;
+    uint8_t *space = frame_parser_space(parser, &available);
+    size_t chunk = count < available ? count : available;
+    memcpy(space, data, chunk);
+    frame_parser_commit(parser, chunk);
+    data += chunk;
+    count -= chunk;
+  }
+}
+
+size_t frame_parser_next(frame_parser_t *parser, uint8_t *out, size_t out_size, bool *checksum_ok)
+{
+  while (parser->len >= 4)
+  {
+    // Find the start bytes
+    const uint8_t *buf = parser->buf;
+    if (buf[0] != FRAME_START_BYTE_1 || buf[1] != FRAME_START_BYTE_2)
+    {
+      const uint8_t *start = (const uint8_t *)memchr(buf + 1, FRAME_START_BYTE_1, parser->len - 1);
+      size_t skip = start ? (size_t)(start - buf) : parser->len;
+      parser->resync_bytes += skip;
+      discard(parser, skip);
+      continue;
+    }
+
+    // The length field says where the frame ends, so 0xDD inside the pixel data is harmless
+    size_t data_len = buf[2] | (buf[3] << 8);
+    size_t total = data_len + FRAME_OVERHEAD;
+    if (data_len < FRAME_MIN_DATA_LEN || data_len > FRAME_MAX_DATA_LEN || total > out_size)
+    {
+      parser->resync_bytes += 1; // Not a real frame start
+      discard(parser, 1);
+      continue;
+    }
+    if (parser->len < total)
+    {
+      return 0; // Rest of the frame hasn't arrived yet
+    }
+    if (buf[total - 1] != FRAME_END_BYTE)
+    {
+      parser->resync_bytes += 1;
+      discard(parser, 1);
+      continue;
+    }
+
+    uint8_t sum = 0;
+    for (size_t i = 0; i < total - 2; i++)
+    {
+      sum += buf[i];
+    }
+    *checksum_ok = sum == buf[total - 2];
+    if (!*checksum_ok)
+    {
+      parser->checksum_errors++;
+    }
+
+    memcpy(out, buf, total);
+    discard(parser, total);
+    parser->frames++;
+    return total;
+  }
+  return 0;
+}
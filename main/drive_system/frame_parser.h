@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Length-based parser for MaixSense A010 frames. Bytes go in as they arrive
+// from the UART (any chunk size), complete frames come out. Does no I/O, so
+// it can parse any byte stream that carries the sensor's frame format.
+//
+// Frame layout: 0x00 0xFF | u16 data length (LE) | data | checksum | 0xDD
+// where checksum is the low byte of the sum of everything before it.
+
+// -------------------- Configuration --------------------
+#define FRAME_PARSER_CAPACITY 8192 // Several 25x25 frames (~650 bytes each), three 50x50 frames (~2.5 KB)
+#define FRAME_OVERHEAD 6           // Start bytes, length, checksum, end byte
+#define FRAME_MIN_DATA_LEN 16      // Rest of the 20-byte header
+#define FRAME_MAX_DATA_LEN (FRAME_PARSER_CAPACITY - FRAME_OVERHEAD)
+
+// -------------------- Data Structures --------------------
+typedef struct
+{
+  uint8_t buf[FRAME_PARSER_CAPACITY];
+  size_t len; // Bytes buffered
+
+  // Counters since frame_parser_reset()
+  uint32_t frames;          // Complete frames returned
+  uint32_t resync_bytes;    // Bytes discarded while looking for a frame start
+  uint32_t checksum_errors; // Frames whose checksum didn't match
+  uint32_t overflow_bytes;  // Bytes dropped because the buffer was full
+} frame_parser_t;
+
+// -------------------- API --------------------
+void frame_parser_reset(frame_parser_t *parser);
+
+// Drop buffered bytes (e.g. after a UART overflow) but keep the counters
+void frame_parser_clear(frame_parser_t *parser);
+
+// Space for reading straight into the parser; commit the bytes written.
+// Makes room by dropping the oldest bytes if the buffer is full.
+uint8_t *frame_parser_space(frame_parser_t *parser, size_t *available);
+void frame_parser_commit(frame_parser_t *parser, size_t count);
+
+// Copy bytes into the parser (frame_parser_space + memcpy + commit)
+void frame_parser_push(frame_parser_t *parser, const uint8_t *data, size_t count);
+
+// Extract the next complete frame into out (start bytes to end byte). Returns
+// its length, or 0 if no complete frame is buffered yet. *checksum_ok tells
+// whether the checksum matched; the frame is returned either way.
+size_t frame_parser_next(frame_parser_t *parser, uint8_t *out, size_t out_size, bool *checksum_ok);
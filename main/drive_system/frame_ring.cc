@@ -0,0 +1,84 @@
+#include <atomic>
+#include <new>
+#include <esp_heap_caps.h>
+#include "frame_ring.h"
+#include "../memory_report.h"
+
+static_assert((FRAME_RING_SLOTS & (FRAME_RING_SLOTS - 1)) == 0, "FRAME_RING_SLOTS must be a power of two");
+
+struct frame_ring
+{
+  sensor_frame_t slots[FRAME_RING_SLOTS];
+
+  // Free-running counters, the slot is counter % FRAME_RING_SLOTS. head is
+  // only written by the producer, tail only by the consumer.
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  std::atomic<uint32_t> overruns{0};
+};
+
+frame_ring_t *frame_ring_create(size_t pixels_per_frame, const char *name)
+{
+  // One block for all slots; internal RAM for the small binned frames, PSRAM when that doesn't fit
+  size_t total = pixels_per_frame * FRAME_RING_SLOTS;
+  uint8_t *pixels = (uint8_t *)heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (pixels == NULL)
+    pixels = (uint8_t *)heap_caps_malloc(total, MALLOC_CAP_SPIRAM);
+  frame_ring_t *ring = new (std::nothrow) frame_ring_t();
+  if (pixels == NULL || ring == NULL)
+  {
+    heap_caps_free(pixels);
+    delete ring;
+    return NULL;
+  }
+  for (int i = 0; i < FRAME_RING_SLOTS; i++)
+    ring->slots[i].pixels = pixels + i * pixels_per_frame;
+  memory_report_add(name, pixels, total);
+  return ring;
+}
+
+sensor_frame_t *frame_ring_acquire(frame_ring_t *ring)
+{
+  uint32_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= FRAME_RING_SLOTS)
+  {
+    ring->overruns.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+  }
+  return &ring->slots[head % FRAME_RING_SLOTS];
+}
+
+void frame_ring_publish(frame_ring_t *ring)
+{
+  // Release: the slot contents are visible before the new head
+  ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const sensor_frame_t *frame_ring_peek(frame_ring_t *ring)
+{
+  uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+  if (tail == ring->head.load(std::memory_order_acquire))
+    return NULL;
+  return &ring->slots[tail % FRAME_RING_SLOTS];
+}
+
+void frame_ring_release(frame_ring_t *ring)
+{
+  // Release: we're done reading the slot before the producer may reuse it
+  ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void frame_ring_discard(frame_ring_t *ring)
+{
+  ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+int frame_ring_count(frame_ring_t *ring)
+{
+  return (int)(ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_relaxed));
+}
+
+uint32_t frame_ring_overruns(frame_ring_t *ring)
+{
+  return ring->overruns.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "depth_sensor.h"
+
+// Single-producer single-consumer ring of decoded depth frames, one per
+// sensor. That sensor's receive task is the only producer and
+// depth_sensor_task() the only consumer, so no locks are needed: each side
+// owns one index.
+//
+// Producer:  slot = frame_ring_acquire(ring); fill it; frame_ring_publish(ring);
+// Consumer:  frame = frame_ring_peek(ring); use it; frame_ring_release(ring);
+
+// -------------------- Configuration --------------------
+#define FRAME_RING_SLOTS 8 // Power of two. ~400ms of frames at 19 FPS
+
+// -------------------- API --------------------
+typedef struct frame_ring frame_ring_t;
+
+// A ring with pixels_per_frame bytes of pixel storage for every slot, listed
+// as `name` in the memory report. Call before the producer starts. Returns
+// NULL if out of memory.
+frame_ring_t *frame_ring_create(size_t pixels_per_frame, const char *name);
+
+// Slot to decode the next frame into, or NULL if the consumer is a full ring
+// behind (the frame is then counted as an overrun and should be dropped)
+sensor_frame_t *frame_ring_acquire(frame_ring_t *ring);
+
+// Make the slot returned by frame_ring_acquire() visible to the consumer
+void frame_ring_publish(frame_ring_t *ring);
+
+// Oldest unconsumed frame, or NULL if the ring is empty
+const sensor_frame_t *frame_ring_peek(frame_ring_t *ring);
+
+// Hand the frame returned by frame_ring_peek() back to the producer
+void frame_ring_release(frame_ring_t *ring);
+
+// Drop everything that hasn't been consumed yet (consumer side only)
+void frame_ring_discard(frame_ring_t *ring);
+
+// Frames waiting for the consumer
+int frame_ring_count(frame_ring_t *ring);
+
+// Frames dropped because the ring was full, since boot
+uint32_t frame_ring_overruns(frame_ring_t *ring);
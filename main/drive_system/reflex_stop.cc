@@ -0,0 +1,78 @@
+#include "reflex_stop.h"
+
+#include "esp_timer.h"
+#include "depth_format.h"
+#include "drive_system.h"
+#include "../flight_recorder.h"
+#include "../latency_histogram.h"
+#include "../trace_events.h"
+
+#ifdef REFLEX_STOP
+
+static_assert(REFLEX_ROI_TOP_PCT < REFLEX_ROI_BOTTOM_PCT && REFLEX_ROI_BOTTOM_PCT <= 100 &&
+                  REFLEX_ROI_LEFT_PCT < REFLEX_ROI_RIGHT_PCT && REFLEX_ROI_RIGHT_PCT <= 100,
+              "empty reflex stop region");
+
+// Smallest raw byte at or beyond mm; the lookup is monotonic in both encodings
+static constexpr uint8_t near_raw_for(float mm)
+{
+  int raw = 1;
+  while (raw < 255 && depth_mm_lut.mm[raw] < mm)
+    raw++;
+  return (uint8_t)raw;
+}
+static constexpr uint8_t kNearRaw = near_raw_for(REFLEX_STOP_MM);
+static_assert(kNearRaw > 1, "REFLEX_STOP_MM is below the sensor's smallest step");
+
+// Sensor receive task of REFLEX_STOP_SENSOR only
+static volatile uint32_t g_frames_checked = 0;
+static volatile uint32_t g_near_frames = 0;
+static volatile uint32_t g_triggers = 0;
+static volatile uint16_t g_last_min_mm = 0;
+
+void reflex_stop_check(const sensor_frame_t *frame)
+{
+  if (frame->sensor != REFLEX_STOP_SENSOR || write_to_sd != 3)
+    return;
+
+  g_frames_checked = g_frames_checked + 1;
+  uint8_t min_raw = 0;
+  int near = depth_count_near(frame, REFLEX_ROI_TOP_PCT, REFLEX_ROI_BOTTOM_PCT, REFLEX_ROI_LEFT_PCT,
+                              REFLEX_ROI_RIGHT_PCT, kNearRaw, &min_raw);
+  if (near < REFLEX_STOP_MIN_PIXELS)
+    return;
+
+  g_near_frames = g_near_frames + 1;
+  g_last_min_mm = (uint16_t)depth_mm_lut.mm[min_raw];
+  if (!drive_system_reflex_stop(REFLEX_STOP_HOLD_MS, REFLEX_STOP_BRAKE))
+    return; // Already stopped, or not driving forward: the hold was extended
+
+  // From the start of the frame on the UART to the motors stopping
+  int64_t latency_us = esp_timer_get_time() - frame->timestamp_us;
+  g_reflex_stop_latency.record(latency_us);
+  trace_event(TRACE_REFLEX_STOP, (int32_t)latency_us);
+  g_triggers = g_triggers + 1;
+  flight_recorder_trigger(FLIGHT_TRIGGER_REFLEX); // Keep what led up to it (rate limited)
+}
+
+void reflex_stop_get_stats(reflex_stop_stats_t *out)
+{
+  out->frames_checked = g_frames_checked;
+  out->near_frames = g_near_frames;
+  out->triggers = g_triggers;
+  out->last_min_mm = g_last_min_mm;
+  out->active = drive_system_reflex_active();
+}
+
+#else
+
+void reflex_stop_check(const sensor_frame_t *frame)
+{
+}
+
+void reflex_stop_get_stats(reflex_stop_stats_t *out)
+{
+  *out = {};
+}
+
+#endif // REFLEX_STOP
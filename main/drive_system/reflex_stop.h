@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "depth_sensor.h"
+
+// Reflex stop: in inference mode every front sensor frame is checked in the
+// sensor receive task, right after it is decoded and before it goes into the
+// frame ring, also when the ring is full and the frame is dropped. When
+// enough pixels of a forward region are nearer than REFLEX_STOP_MM, the
+// motors are stopped there and then (drive_system_reflex_stop()), without
+// waiting for the frame window, Invoke() or the next drive loop tick. The
+// drive loop keeps forward commands off the motors until no frame has been
+// that near for REFLEX_STOP_HOLD_MS; reversing away stays possible. The check
+// is one pass over the region's raw bytes, so the worst-case stopping latency
+// is the frame's UART transfer plus a few microseconds, whatever the model
+// costs. Comment out to disable.
+#define REFLEX_STOP
+#define REFLEX_STOP_SENSOR 0     // Sensor whose frames are checked (0 = front)
+#define REFLEX_STOP_MM 300       // Stop when something is nearer than this
+#define REFLEX_STOP_MIN_PIXELS 2 // Pixels that must be that near, so a single noisy pixel doesn't stop the car
+#define REFLEX_STOP_HOLD_MS 500  // No forward command this long after the last near frame
+#define REFLEX_STOP_BRAKE 1      // 1: active brake (brake_motors()), 0: motors off and coast
+
+// Forward region of interest in percent of the upright frame, the view the
+// model gets after the 90° rotation (rows top..bottom, columns left..right),
+// so it covers the same view at any BINNING_FACTOR. The rows below it mostly
+// see the floor.
+#define REFLEX_ROI_TOP_PCT 20
+#define REFLEX_ROI_BOTTOM_PCT 60
+#define REFLEX_ROI_LEFT_PCT 25
+#define REFLEX_ROI_RIGHT_PCT 75
+
+// Since boot
+typedef struct
+{
+  uint32_t frames_checked; // Frames checked in inference mode
+  uint32_t near_frames;    // Of those, frames with an obstacle nearer than REFLEX_STOP_MM
+  uint32_t triggers;       // Near frames that stopped moving motors (the others extended the hold)
+  uint16_t last_min_mm;    // Nearest pixel of the region in the last near frame
+  bool active;             // Forward commands are held off right now
+} reflex_stop_stats_t;
+
+// Check one frame, and stop the motors if it is too near (sensor receive
+// task, on the decoded packet before it takes a ring slot)
+void reflex_stop_check(const sensor_frame_t *frame);
+
+void reflex_stop_get_stats(reflex_stop_stats_t *out);
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic> // Before WS2812FX.h (via depth_sensor.h), which defines min()
+#include "flight_recorder.h"
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "main_functions.h"
+#include "memory_report.h"
+#include "task_layout.h"
+#include "sdcard/sd.h"
+
+#ifdef FLIGHT_RECORDER
+
+#define FLIGHT_RING_MAGIC 0x52464E54 // "TNFR"
+#define FLIGHT_FILE_BUFFER 16384     // stdio buffer for the dump, so the card sees few large writes
+
+// One sensor frame and the state of the pipeline when it arrived
+typedef struct
+{
+  uint32_t frame;          // Frames recorded since boot
+  int64_t timestamp_us;    // Start-of-frame time
+  int64_t result_frame_us; // Start-of-frame time of the newest frame behind the output, 0 = no result yet
+  int16_t steering_millis; // Newest model output
+  int16_t throttle_millis;
+  uint32_t input_fill_us; // Stage timings of the newest inference
+  uint32_t invoke_us;
+  int8_t motor_left; // Last motor command, -100..100
+  int8_t motor_right;
+  uint8_t flags; // FLIGHT_FLAG_*
+  uint8_t rows;
+  uint8_t cols;
+  uint8_t pixels[MAX_FRAME_PIXELS];
+} flight_record_t;
+
+typedef struct
+{
+  uint32_t magic; // FLIGHT_RING_MAGIC once head and count are valid
+  uint32_t head;  // Next slot to write
+  uint32_t count; // Valid slots before head, up to FLIGHT_RECORDER_FRAMES
+  flight_record_t records[FLIGHT_RECORDER_FRAMES];
+} flight_ring_t;
+
+#if CONFIG_SPIRAM_ALLOW_NOINIT_SEG_EXTERNAL_MEMORY
+// Not cleared at boot, so the ring outlives a panic or watchdog reset
+EXT_RAM_NOINIT_ATTR static flight_ring_t g_flight_ring_storage;
+#endif
+
+static const char *trigger_names[] = {"ch3", "serial", "deadline", "crash", "reflex"};
+
+static flight_ring_t *g_ring = NULL;
+static TaskHandle_t g_task = NULL;
+static uint32_t g_frames = 0;
+static int g_dumps = 0; // Dumps written this session, numbers the files
+
+// record() and the writer task on the other core hand the ring over with
+// these two flags: the task sets frozen and waits until writing is clear
+static std::atomic<bool> g_frozen{false};
+static std::atomic<bool> g_writing{false};
+static std::atomic<int> g_pending{-1}; // flight_trigger_t of the requested dump, -1 = none
+static int64_t g_last_auto_dump_us = 0;
+
+// Last motor command, set from the drive task: left, right and flags packed
+// into one word so record() never sees half of an update
+static std::atomic<uint32_t> g_motor_command{0};
+
+// -------------------- Recording --------------------
+
+void flight_recorder_set_command(int left, int right, uint8_t flags)
+{
+  g_motor_command.store((uint32_t)(uint8_t)(int8_t)left | (uint32_t)(uint8_t)(int8_t)right << 8 |
+                        (uint32_t)flags << 16);
+}
+
+void flight_recorder_record(const sensor_frame_t *frame)
+{
+  if (g_ring == NULL)
+    return;
+  g_writing.store(true);
+  if (g_frozen.load())
+  {
+    g_writing.store(false); // A dump is reading the ring, this frame is not kept
+    return;
+  }
+
+  flight_record_t *r = &g_ring->records[g_ring->head];
+  inference_timing_t timing = get_last_inference_timing();
+  r->frame = g_frames++;
+  r->timestamp_us = frame->timestamp_us;
+  control_state_t result;
+  get_inference_result(&result); // All zero when there is none
+  r->result_frame_us = result.frame_us;
+  r->steering_millis = (int16_t)(result.steering * 1000);
+  r->throttle_millis = (int16_t)(result.throttle * 1000);
+  r->input_fill_us = (uint32_t)timing.input_fill_us;
+  r->invoke_us = (uint32_t)timing.invoke_us;
+  uint32_t command = g_motor_command.load();
+  r->motor_left = (int8_t)(command & 0xFF);
+  r->motor_right = (int8_t)(command >> 8 & 0xFF);
+  r->flags = (uint8_t)(command >> 16);
+  r->rows = (uint8_t)frame->rows;
+  r->cols = (uint8_t)frame->cols;
+  memcpy(r->pixels, frame->pixels, frame->rows * frame->cols);
+
+  g_ring->head = (g_ring->head + 1) % FLIGHT_RECORDER_FRAMES;
+  if (g_ring->count < FLIGHT_RECORDER_FRAMES)
+    g_ring->count++;
+  g_writing.store(false);
+}
+
+bool flight_recorder_trigger(flight_trigger_t trigger)
+{
+  if (g_ring == NULL || g_task == NULL || g_ring->count == 0)
+    return false;
+
+  int64_t now = esp_timer_get_time();
+  bool automatic = trigger == FLIGHT_TRIGGER_DEADLINE || trigger == FLIGHT_TRIGGER_REFLEX;
+  if (automatic && g_last_auto_dump_us != 0 &&
+      now - g_last_auto_dump_us < (int64_t)FLIGHT_RECORDER_HOLDOFF_S * 1000000)
+    return false;
+
+  int idle = -1;
+  if (!g_pending.compare_exchange_strong(idle, (int)trigger))
+    return false; // A dump is already queued or running
+  if (automatic)
+    g_last_auto_dump_us = now;
+  xTaskNotifyGive(g_task);
+  return true;
+}
+
+// -------------------- Dump --------------------
+
+// Inputs as a binary log (model outputs in the steering/throttle fields), so
+// depth_log.py, the data editor and REPLAY_BENCH read them, plus a CSV with
+// the rest of every record
+static void writeDump(flight_trigger_t trigger, char *file_buffer)
+{
+  char base[64];
+  strncpy(base, g_depth_log_filename, sizeof(base) - 1);
+  base[sizeof(base) - 1] = '\0';
+  char *ext = strrchr(base, '.');
+  if (ext != NULL)
+    *ext = '\0';
+
+  g_dumps++;
+  char bin_path[80];
+  char csv_path[80];
+  snprintf(bin_path, sizeof(bin_path), "%s_flight%02d.bin", base, g_dumps);
+  snprintf(csv_path, sizeof(csv_path), "%s_flight%02d.csv", base, g_dumps);
+
+  int64_t t_start = esp_timer_get_time();
+  FILE *bin = sd_card_fopen(bin_path, "wb");
+  FILE *csv = bin != NULL ? sd_card_fopen(csv_path, "w") : NULL;
+  if (csv == NULL)
+  {
+    printf("FLIGHT_ERROR:Cannot create %s\n", bin_path);
+    if (bin != NULL)
+      fclose(bin);
+    return;
+  }
+  if (file_buffer != NULL)
+    setvbuf(bin, file_buffer, _IOFBF, FLIGHT_FILE_BUFFER);
+
+  log_file_header_t header;
+  fillLogFileHeader(&header);
+  fwrite(&header, 1, sizeof(header), bin);
+
+  uint32_t count = g_ring->count;
+  uint32_t first = (g_ring->head + FLIGHT_RECORDER_FRAMES - count) % FLIGHT_RECORDER_FRAMES;
+  fprintf(csv, "# Flight recorder: trigger %s, %lu frames, inputs in %s\n", trigger_names[trigger],
+          (unsigned long)count, bin_path + 1);
+  fprintf(csv, "# Frame,Timestamp(us),Steering(millis),Throttle(millis),ResultFrame(us),InputFill(us),Invoke(us),MotorLeft,MotorRight,Flags\n");
+
+  int written = 0;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const flight_record_t *r = &g_ring->records[(first + i) % FLIGHT_RECORDER_FRAMES];
+    int pixels = r->rows * r->cols;
+    if (pixels <= 0 || pixels > MAX_FRAME_PIXELS)
+      continue; // Torn by a crash in the middle of record()
+
+    log_record_header_t record = {};
+    record.magic = LOG_RECORD_MAGIC;
+    record.frame = r->frame;
+    record.timestamp_us = r->timestamp_us;
+    record.steering_millis = r->steering_millis;
+    record.throttle_millis = r->throttle_millis;
+    record.width = r->cols;
+    record.height = r->rows;
+    record.pixel_encoding = LOG_PIXELS_RAW;
+    record.payload_bytes = (uint16_t)pixels;
+    fwrite(&record, 1, sizeof(record), bin);
+    fwrite(r->pixels, 1, pixels, bin);
+
+    // Integers only, float formatting needs more stack than this task has
+    fprintf(csv, "%lu,%lld,%d,%d,%lld,%lu,%lu,%d,%d,%u\n", (unsigned long)r->frame, (long long)r->timestamp_us,
+            r->steering_millis, r->throttle_millis, (long long)r->result_frame_us, (unsigned long)r->input_fill_us,
+            (unsigned long)r->invoke_us, r->motor_left, r->motor_right, r->flags);
+    written++;
+  }
+
+  bool ok = fclose(bin) == 0;
+  ok = fclose(csv) == 0 && ok;
+  if (!ok)
+  {
+    printf("FLIGHT_ERROR:Write failed for %s\n", bin_path);
+    return;
+  }
+  printf("FLIGHT_SAVED:%s:frames:%d:trigger:%s:ms:%d\n", bin_path, written, trigger_names[trigger],
+         (int)((esp_timer_get_time() - t_start) / 1000));
+}
+
+static void flight_recorder_task(void *pvParameters)
+{
+  char *file_buffer = (char *)memory_alloc("flight_file_buffer", FLIGHT_FILE_BUFFER, MEMORY_COLD);
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int trigger = g_pending.load();
+    if (trigger < 0)
+      continue;
+
+    // Take the ring from record() on the other core
+    g_frozen.store(true);
+    while (g_writing.load())
+      vTaskDelay(1);
+
+    writeDump((flight_trigger_t)trigger, file_buffer);
+    g_ring->count = 0; // Written, don't dump the same frames twice
+    g_frozen.store(false);
+    g_pending.store(-1);
+  }
+}
+
+// -------------------- Initialization --------------------
+
+void flight_recorder_init()
+{
+  bool crashed = false;
+#if CONFIG_SPIRAM_ALLOW_NOINIT_SEG_EXTERNAL_MEMORY
+  g_ring = &g_flight_ring_storage;
+  esp_reset_reason_t reason = esp_reset_reason();
+  crashed = (reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+             reason == ESP_RST_WDT) &&
+            g_ring->magic == FLIGHT_RING_MAGIC && g_ring->head < FLIGHT_RECORDER_FRAMES &&
+            g_ring->count > 0 && g_ring->count <= FLIGHT_RECORDER_FRAMES;
+#else
+  g_ring = (flight_ring_t *)heap_caps_malloc(sizeof(flight_ring_t), MALLOC_CAP_SPIRAM);
+  if (g_ring == NULL)
+  {
+    printf("Flight recorder: out of PSRAM for %d frames, disabled\n", FLIGHT_RECORDER_FRAMES);
+    return;
+  }
+#endif
+  if (!crashed)
+  {
+    g_ring->head = 0;
+    g_ring->count = 0;
+  }
+  g_ring->magic = FLIGHT_RING_MAGIC;
+
+  if (xTaskCreatePinnedToCore(flight_recorder_task, "flight_rec", FLIGHT_RECORDER_TASK_STACK, NULL,
+                              FLIGHT_RECORDER_TASK_PRIORITY,
+                              &g_task, FLIGHT_RECORDER_TASK_CORE) != pdPASS)
+  {
+    printf("Flight recorder: cannot create writer task, disabled\n");
+    g_ring = NULL;
+    return;
+  }
+  memory_report_add_task("flight_rec", FLIGHT_RECORDER_TASK_STACK);
+  memory_report_add("flight_ring", g_ring, sizeof(flight_ring_t));
+  printf("Flight recorder: last %d s of inference mode (%d frames, %d KB PSRAM)\n", FLIGHT_RECORDER_SECONDS,
+         FLIGHT_RECORDER_FRAMES, (int)(sizeof(flight_ring_t) / 1024));
+
+  if (crashed)
+  {
+    printf("Flight recorder: %lu frames survived the reset, writing them\n", (unsigned long)g_ring->count);
+    flight_recorder_trigger(FLIGHT_TRIGGER_CRASH);
+  }
+}
+
+#else
+
+void flight_recorder_init()
+{
+}
+
+void flight_recorder_record(const sensor_frame_t *frame)
+{
+}
+
+void flight_recorder_set_command(int left, int right, uint8_t flags)
+{
+}
+
+bool flight_recorder_trigger(flight_trigger_t trigger)
+{
+  return false;
+}
+
+#endif // FLIGHT_RECORDER
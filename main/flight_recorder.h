@@ -0,0 +1,63 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include "drive_system/depth_sensor.h"
+
+// Keep the last FLIGHT_RECORDER_SECONDS of inference mode (raw sensor frames,
+// model outputs, stage timings and motor commands) in a PSRAM ring and write
+// it to SD in one burst on a trigger. Recording is one memcpy per frame.
+// Comment out to disable.
+#define FLIGHT_RECORDER
+#define FLIGHT_RECORDER_SECONDS 20
+#define FLIGHT_RECORDER_FRAMES (FLIGHT_RECORDER_SECONDS * SENSOR_FPS)
+#define FLIGHT_RECORDER_HOLDOFF_S 30 // Min time between two deadline-miss or reflex stop dumps
+
+// What started a dump, written into the telemetry file
+typedef enum
+{
+  FLIGHT_TRIGGER_CH3 = 0,  // Left inference mode with CH3
+  FLIGHT_TRIGGER_SERIAL,   // FLIGHT_DUMP command
+  FLIGHT_TRIGGER_DEADLINE, // Result later than the inference deadline
+  FLIGHT_TRIGGER_CRASH,    // Ring survived a panic/watchdog reset, written at the next boot
+  FLIGHT_TRIGGER_REFLEX,   // Reflex stop stopped the car
+} flight_trigger_t;
+
+// Motor command flags
+#define FLIGHT_FLAG_FALLBACK 0x01 // Result was stale, the fallback policy drove the motors
+#define FLIGHT_FLAG_BRAKE 0x02    // Motors were braked
+#define FLIGHT_FLAG_REFLEX 0x04   // Reflex stop held the result off the motors
+
+/**
+ * @brief Set up the ring and the task that writes dumps. Call after
+ *        depth_sensor_init(), which names the session; a ring left over from a
+ *        crash is written right away.
+ */
+void flight_recorder_init();
+
+/**
+ * @brief Record one sensor frame with the newest model output, its timings
+ *        and the last motor command (depth sensor task, inference mode)
+ */
+void flight_recorder_record(const sensor_frame_t *frame);
+
+/**
+ * @brief Note the motor command just sent (drive task, inference mode)
+ *
+ * @param left Left motor speed, -100..100
+ * @param right Right motor speed, -100..100
+ * @param flags FLIGHT_FLAG_*
+ */
+void flight_recorder_set_command(int left, int right, uint8_t flags);
+
+/**
+ * @brief Ask the writer task to dump the ring. Returns at once; recording
+ *        pauses while the dump is written.
+ *
+ * @return false if there is nothing to write, a dump is already running, or
+ *         (for FLIGHT_TRIGGER_DEADLINE and FLIGHT_TRIGGER_REFLEX) the last
+ *         automatic dump is less than FLIGHT_RECORDER_HOLDOFF_S ago
+ */
+bool flight_recorder_trigger(flight_trigger_t trigger);
+
+#endif // FLIGHT_RECORDER_H
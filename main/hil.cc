@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic> // Before WS2812FX.h (via depth_sensor.h), which defines min()
+#include "hil.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "main_functions.h"
+#include "drive_system/depth_sensor.h"
+#include "drive_system/drive_system.h"
+#include "drive_system/frame_parser.h"
+
+// One parsed frame on its way from the console task to the main loop
+typedef struct
+{
+  int64_t received_us; // When its last byte was parsed
+  uint16_t frame_id;   // FrameHeader frame_id, echoed in HIL_RESULT
+  uint8_t rows;        // 0 = end of the session
+  uint8_t cols;
+  uint8_t pixels[MAX_FRAME_PIXELS];
+} hil_frame_t;
+
+static QueueHandle_t g_hil_queue = NULL;
+static std::atomic<bool> g_hil_active{false};
+
+// Console task side
+static frame_parser_t g_hil_parser;
+static uint8_t g_hil_frame_bytes[MAX_FRAME_BYTES];
+static hil_frame_t g_hil_staging;
+static uint32_t g_hil_checksum_errors = 0;
+static uint32_t g_hil_invalid_frames = 0;
+
+bool hil_begin()
+{
+  if (g_hil_queue == NULL)
+  {
+    g_hil_queue = xQueueCreate(HIL_QUEUE_FRAMES, sizeof(hil_frame_t));
+    if (g_hil_queue == NULL)
+      return false;
+  }
+  xQueueReset(g_hil_queue); // Leftovers of a session that timed out
+  frame_parser_reset(&g_hil_parser);
+  g_hil_checksum_errors = 0;
+  g_hil_invalid_frames = 0;
+  g_hil_active.store(true);
+  return true;
+}
+
+void hil_cancel()
+{
+  g_hil_active.store(false);
+}
+
+bool hil_active()
+{
+  return g_hil_active.load();
+}
+
+void hil_feed(const uint8_t *data, size_t len)
+{
+  frame_parser_push(&g_hil_parser, data, len);
+
+  bool checksum_ok = false;
+  size_t frame_len;
+  while (g_hil_active.load() &&
+         (frame_len = frame_parser_next(&g_hil_parser, g_hil_frame_bytes, sizeof(g_hil_frame_bytes), &checksum_ok)) > 0)
+  {
+    FrameHeader header;
+    memcpy(&header, g_hil_frame_bytes, sizeof(FrameHeader));
+    if (!checksum_ok)
+    {
+      g_hil_checksum_errors++;
+      printf("HIL_DROPPED:frame_id:%u:checksum\n", header.frame_id);
+      continue;
+    }
+    int pixels = header.resolution_rows * header.resolution_cols;
+    bool end = pixels == 0;
+    if (!end && (header.resolution_rows > MAX_IMAGE_SIZE || header.resolution_cols > MAX_IMAGE_SIZE ||
+                 frame_len < (size_t)(HEADER_SIZE + pixels + FRAME_TRAILER_SIZE)))
+    {
+      g_hil_invalid_frames++;
+      printf("HIL_DROPPED:frame_id:%u:resolution\n", header.frame_id);
+      continue;
+    }
+
+    g_hil_staging.received_us = esp_timer_get_time();
+    g_hil_staging.frame_id = header.frame_id;
+    g_hil_staging.rows = end ? 0 : header.resolution_rows;
+    g_hil_staging.cols = end ? 0 : header.resolution_cols;
+    memcpy(g_hil_staging.pixels, g_hil_frame_bytes + HEADER_SIZE, pixels);
+    xQueueSend(g_hil_queue, &g_hil_staging, portMAX_DELAY);
+    if (end)
+    {
+      g_hil_active.store(false); // Whatever follows is a command again
+      return;
+    }
+  }
+}
+
+void hil_run()
+{
+  static hil_frame_t frame;
+
+  // Motors stay off for the whole session, like REPLAY_BENCH
+  drive_system_hold(true);
+  while (inference_in_progress())
+  {
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  reset_frame_buffer();
+
+  // The host converts millimetres back to sensor bytes with the encoding the firmware was built with
+  log_file_header_t log_header;
+  fillLogFileHeader(&log_header);
+  printf("HIL_READY:max_size:%d:queue:%d:encoding:%u:unit:%u\n", MAX_IMAGE_SIZE, HIL_QUEUE_FRAMES,
+         log_header.depth_encoding, (unsigned)log_header.unit_mm);
+  fflush(stdout);
+
+  int frames = 0;
+  int inferences = 0;
+  bool timed_out = false;
+  while (true)
+  {
+    if (xQueueReceive(g_hil_queue, &frame, pdMS_TO_TICKS(HIL_IDLE_TIMEOUT_MS)) != pdTRUE)
+    {
+      timed_out = true;
+      break;
+    }
+    if (frame.rows == 0)
+      break;
+
+    int64_t t0 = esp_timer_get_time();
+    add_raw_frame_to_buffer(frame.pixels, frame.rows, frame.cols, t0);
+    int64_t t1 = esp_timer_get_time();
+    bool ran = run_inference();
+    int64_t t2 = esp_timer_get_time();
+    inference_timing_t timing = get_last_inference_timing();
+    frames++;
+
+    // HIL_RESULT:<frame_id>:<ran>:<steering millis>:<throttle millis>:<stage times in us>
+    if (ran)
+    {
+      control_state_t result;
+      get_inference_result(&result);
+      inferences++;
+      printf("HIL_RESULT:frame_id:%u:ran:1:steering:%d:throttle:%d:queue_us:%lld:add_frame_us:%lld:"
+             "input_fill_us:%lld:invoke_us:%lld:total_us:%lld\n",
+             frame.frame_id, (int)(result.steering * 1000), (int)(result.throttle * 1000),
+             (long long)(t0 - frame.received_us), (long long)(t1 - t0), (long long)timing.input_fill_us,
+             (long long)timing.invoke_us, (long long)(t2 - t0));
+    }
+    else
+    {
+      // Window not full yet
+      printf("HIL_RESULT:frame_id:%u:ran:0:queue_us:%lld:add_frame_us:%lld:total_us:%lld\n", frame.frame_id,
+             (long long)(t0 - frame.received_us), (long long)(t1 - t0), (long long)(t2 - t0));
+    }
+    if (frames % 50 == 0)
+    {
+      vTaskDelay(1); // Give the idle task a chance to run on this core
+    }
+  }
+  g_hil_active.store(false);
+
+  // Don't let the injected frames leak into live inference
+  reset_frame_buffer();
+  drive_system_hold(false);
+
+  printf("HIL_END:frames:%d:inferences:%d:checksum_errors:%lu:invalid_frames:%lu%s\n", frames, inferences,
+         (unsigned long)g_hil_checksum_errors, (unsigned long)g_hil_invalid_frames, timed_out ? ":timeout" : "");
+  fflush(stdout);
+}
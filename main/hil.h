@@ -0,0 +1,47 @@
+#ifndef HIL_H
+#define HIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hardware-in-the-loop: after HIL_START the host sends depth frames over the
+// console in the sensor's own format (FrameHeader, pixels, checksum, 0xDD).
+// They run through the inference pipeline in place of the sensor and every
+// frame is answered with a HIL_RESULT line. A frame with a 0x0 resolution
+// ends the session.
+#define HIL_QUEUE_FRAMES 4       // Frames the host may send ahead of their results
+#define HIL_IDLE_TIMEOUT_MS 5000 // The session also ends when no frame arrives for this long
+
+/**
+ * @brief Start a session (console task, HIL_START). From now on the console
+ *        bytes go to hil_feed() until hil_active() turns false.
+ *
+ * @return false if the frame queue can't be allocated
+ */
+bool hil_begin();
+
+/**
+ * @brief Give the console back without running the session (HIL_START could
+ *        not be queued for the main loop)
+ */
+void hil_cancel();
+
+/**
+ * @brief True while a session takes the console input
+ */
+bool hil_active();
+
+/**
+ * @brief Console bytes of a running session. Blocks while HIL_QUEUE_FRAMES
+ *        frames wait for the main loop.
+ */
+void hil_feed(const uint8_t *data, size_t len);
+
+/**
+ * @brief Run the session's frames through add_raw_frame_to_buffer() and
+ *        run_inference() with the motors stopped. Blocks the caller (the main
+ *        loop) until the session ends, then prints HIL_END.
+ */
+void hil_run();
+
+#endif // HIL_H
@@ -0,0 +1,142 @@
+#include "input_kernels.h"
+
+namespace
+{
+  constexpr float MAX_DEPTH_MM = 2550.0f; // Depth sensor range: 0-2550mm
+
+  inline int32_t clamp_int8(int32_t value)
+  {
+    if (value < -128)
+      value = -128;
+    if (value > 127)
+      value = 127;
+    return value;
+  }
+
+  // Source index in the 25x25 frame for every pixel of the rotated, cropped
+  // 24x24 frame: rotated[i][j] = original[24-j][i]
+  struct RotateCropMap
+  {
+    uint16_t src[INPUT_KERNEL_DST_SIZE * INPUT_KERNEL_DST_SIZE];
+    constexpr RotateCropMap() : src()
+    {
+      for (int row = 0; row < INPUT_KERNEL_DST_SIZE; row++)
+        for (int col = 0; col < INPUT_KERNEL_DST_SIZE; col++)
+          src[row * INPUT_KERNEL_DST_SIZE + col] = (uint16_t)((24 - col) * INPUT_KERNEL_SRC_SIZE + row);
+    }
+  };
+  constexpr RotateCropMap kRotateCrop;
+} // namespace
+
+void ingest_frame_scalar(const float depth[INPUT_KERNEL_SRC_SIZE][INPUT_KERNEL_SRC_SIZE],
+                         int8_t *dst, float scale, int32_t zero_point)
+{
+  // For 90° clockwise rotation: rotated[i][j] = original[24-j][i]
+  for (int row = 0; row < INPUT_KERNEL_DST_SIZE; row++)
+  {
+    for (int col = 0; col < INPUT_KERNEL_DST_SIZE; col++)
+    {
+      // Apply 90° clockwise rotation, then crop center 24x24
+      int src_row = 24 - col; // For clockwise: new_row comes from flipped col
+      int src_col = row;      // For clockwise: new_col comes from row
+
+      // Normalize depth to [0, 1] range
+      float normalized = depth[src_row][src_col] / MAX_DEPTH_MM;
+      normalized = normalized > 1.0f ? 1.0f : normalized; // Clamp to [0, 1]
+
+      // quantized = (value / scale + zero_point) truncated to int8
+      float quantized_float = normalized / scale + zero_point;
+      dst[row * INPUT_KERNEL_DST_SIZE + col] = (int8_t)clamp_int8(static_cast<int32_t>(quantized_float));
+    }
+  }
+}
+
+void scatter_channel_scalar(const int8_t *src, int8_t *dst, int stride, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    dst[i * stride] = src[i];
+  }
+}
+
+void scatter_channel_fast(const int8_t *src, int8_t *dst, int stride, int count)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    dst[0] = src[i];
+    dst[stride] = src[i + 1];
+    dst[2 * stride] = src[i + 2];
+    dst[3 * stride] = src[i + 3];
+    dst += 4 * stride;
+  }
+  for (; i < count; i++)
+  {
+    *dst = src[i];
+    dst += stride;
+  }
+}
+
+void build_raw_input_lut(const float mm_lut[INPUT_KERNEL_LUT_SIZE], int8_t lut[INPUT_KERNEL_LUT_SIZE],
+                         float scale, int32_t zero_point)
+{
+  // Same arithmetic as ingest_frame_scalar(), once per possible byte instead of once per pixel
+  for (int raw = 0; raw < INPUT_KERNEL_LUT_SIZE; raw++)
+  {
+    float normalized = mm_lut[raw] / MAX_DEPTH_MM;
+    normalized = normalized > 1.0f ? 1.0f : normalized;
+    float quantized_float = normalized / scale + zero_point;
+    lut[raw] = (int8_t)clamp_int8(static_cast<int32_t>(quantized_float));
+  }
+}
+
+// dst must be 4-byte aligned (every 24x24 frame slot is)
+void ingest_raw_frame(const uint8_t *pixels, int8_t *dst, const int8_t lut[INPUT_KERNEL_LUT_SIZE])
+{
+  const uint16_t *src = kRotateCrop.src;
+  uint32_t *out = reinterpret_cast<uint32_t *>(dst);
+  for (int i = 0; i < INPUT_KERNEL_DST_SIZE * INPUT_KERNEL_DST_SIZE; i += 4)
+  {
+    uint32_t q0 = (uint8_t)lut[pixels[src[0]]];
+    uint32_t q1 = (uint8_t)lut[pixels[src[1]]];
+    uint32_t q2 = (uint8_t)lut[pixels[src[2]]];
+    uint32_t q3 = (uint8_t)lut[pixels[src[3]]];
+    *out++ = q0 | (q1 << 8) | (q2 << 16) | (q3 << 24);
+    src += 4;
+  }
+}
+
+void resample_frame(const float *depth, int rows, int cols, float *dst, int dst_rows, int dst_cols)
+{
+  // The rotated frame is cols x rows. Pick the pool factor so the pooled
+  // frame is at least the output size; a smaller sensor repeats its edge.
+  int pool_r = cols / dst_rows;
+  int pool_c = rows / dst_cols;
+  int pool = pool_r < pool_c ? pool_r : pool_c;
+  if (pool < 1)
+    pool = 1;
+  const float inv_area = 1.0f / (float)(pool * pool);
+
+  for (int row = 0; row < dst_rows; row++)
+  {
+    for (int col = 0; col < dst_cols; col++)
+    {
+      // Rotated block (row, col) covers original rows [rows - (col + 1) * pool, rows - col * pool)
+      // and original columns [row * pool, (row + 1) * pool): rotated[i][j] = original[rows-1-j][i]
+      float sum = 0.0f;
+      for (int dy = 0; dy < pool; dy++)
+      {
+        int src_row = rows - (col + 1) * pool + dy;
+        src_row = src_row < 0 ? 0 : src_row;
+        for (int dx = 0; dx < pool; dx++)
+        {
+          int src_col = row * pool + dx;
+          src_col = src_col >= cols ? cols - 1 : src_col;
+          sum += depth[src_row * cols + src_col];
+        }
+      }
+      float normalized = sum * inv_area / MAX_DEPTH_MM;
+      dst[row * dst_cols + col] = normalized > 1.0f ? 1.0f : normalized; // Clamp to [0, 1]
+    }
+  }
+}
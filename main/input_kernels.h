@@ -0,0 +1,141 @@
+#ifndef INPUT_KERNELS_H
+#define INPUT_KERNELS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define INPUT_KERNEL_SRC_SIZE 25 // Depth map is 25x25
+#define INPUT_KERNEL_DST_SIZE 24 // Model frame is 24x24
+
+/**
+ * @brief Rotate the depth map 90° clockwise, crop it to 24x24, normalize the
+ *        depth to [0, 1] (0-2550 mm) and quantize it to the input tensor format
+ *
+ * @param depth Depth map in millimetres
+ * @param dst Output frame, 24x24 int8 in row-major order
+ * @param scale Input tensor quantization scale
+ * @param zero_point Input tensor quantization zero point
+ */
+void ingest_frame_scalar(const float depth[INPUT_KERNEL_SRC_SIZE][INPUT_KERNEL_SRC_SIZE],
+                         int8_t *dst, float scale, int32_t zero_point);
+
+/**
+ * @brief Write one quantized frame into its channel of an HWC tensor
+ *
+ * @param src Frame pixels in row-major order
+ * @param dst Pointer to the frame's channel of pixel 0
+ * @param stride Number of channels in the tensor
+ * @param count Number of pixels
+ */
+void scatter_channel_scalar(const int8_t *src, int8_t *dst, int stride, int count);
+void scatter_channel_fast(const int8_t *src, int8_t *dst, int stride, int count);
+
+// Window lengths (input channels) a model may have. The window kernels below
+// are instantiated for each of them, so the channel loops are unrolled with
+// the stride known at compile time.
+#define MIN_WINDOW_FRAMES 10
+#define MAX_WINDOW_FRAMES 30
+
+/**
+ * @brief scatter_channel_fast() with the stride fixed at Frames channels.
+ *        Kept out of the vectorizer: packing the strided byte stores into
+ *        vector shuffles makes it several times slower.
+ *
+ * @param src Frame pixels in row-major order
+ * @param dst Pointer to the frame's channel of pixel 0
+ * @param count Number of pixels
+ */
+template <int Frames>
+__attribute__((optimize("no-tree-vectorize"))) inline void scatter_window_channel(const int8_t *src, int8_t *dst, int count)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4, dst += 4 * Frames)
+  {
+    dst[0] = src[i];
+    dst[Frames] = src[i + 1];
+    dst[2 * Frames] = src[i + 2];
+    dst[3 * Frames] = src[i + 3];
+  }
+  for (; i < count; i++, dst += Frames)
+  {
+    *dst = src[i];
+  }
+}
+
+/**
+ * @brief Write Frames quantized frames into the channels of an HWC window
+ *
+ * @param frames Frame pointers, frames[c] goes to channel c
+ * @param dst Window tensor, count * Frames int8
+ * @param count Number of pixels per frame
+ */
+template <int Frames>
+inline void gather_window(const int8_t *const frames[Frames], int8_t *dst, int count)
+{
+  for (int c = 0; c < Frames; c++)
+  {
+    scatter_window_channel<Frames>(frames[c], dst + c, count);
+  }
+}
+
+/**
+ * @brief Rotate the channels of every row of Frames values: channel c of src
+ *        goes to channel (c + offset) mod Frames of dst
+ *
+ * @param src Rows of Frames values
+ * @param dst Output rows, must not overlap src
+ * @param rows Number of rows
+ * @param offset Rotation, 0 to Frames - 1
+ */
+template <int Frames>
+inline void rotate_window_channels(const int8_t *src, int8_t *dst, int rows, int offset)
+{
+  for (int r = 0; r < rows; r++, src += Frames, dst += Frames)
+  {
+    memcpy(dst + offset, src, Frames - offset);
+    memcpy(dst, src + Frames - offset, offset);
+  }
+}
+
+#define INPUT_KERNEL_LUT_SIZE 256 // One entry per raw sensor byte
+
+/**
+ * @brief Build the table that takes a raw sensor byte straight to its
+ *        quantized input value: millimetres, normalization, clamping and
+ *        quantization folded into one lookup. Entries match ingest_frame_scalar().
+ *
+ * @param mm_lut Millimetres for every raw byte (depth_mm_lut in depth_sensor.h)
+ * @param lut Output table
+ * @param scale Input tensor quantization scale
+ * @param zero_point Input tensor quantization zero point
+ */
+void build_raw_input_lut(const float mm_lut[INPUT_KERNEL_LUT_SIZE], int8_t lut[INPUT_KERNEL_LUT_SIZE],
+                         float scale, int32_t zero_point);
+
+/**
+ * @brief Rotate, crop and quantize a raw 25x25 sensor frame in a single pass,
+ *        with a precomputed rotation/crop index map and the raw input LUT
+ *
+ * @param pixels Raw sensor bytes, 25x25 in row-major order
+ * @param dst Output frame, 24x24 int8 in row-major order, 4-byte aligned
+ * @param lut Table from build_raw_input_lut()
+ */
+void ingest_raw_frame(const uint8_t *pixels, int8_t *dst, const int8_t lut[INPUT_KERNEL_LUT_SIZE]);
+
+/**
+ * @brief Generic input stage for any sensor resolution and model input shape:
+ *        rotate 90° clockwise, average-pool by the largest integer factor that
+ *        still covers the output, crop to the output size and normalize the
+ *        depth to [0, 1]. With a 25x25 source and 24x24 output (pool factor 1)
+ *        this is the same rotation and crop as ingest_frame_scalar().
+ *
+ * @param depth Depth map in millimetres, rows x cols in row-major order
+ * @param rows Source rows
+ * @param cols Source columns
+ * @param dst Output frame, dst_rows x dst_cols normalized floats in row-major order
+ * @param dst_rows Output rows (model input height)
+ * @param dst_cols Output columns (model input width)
+ */
+void resample_frame(const float *depth, int rows, int cols, float *dst, int dst_rows, int dst_cols);
+
+#endif // INPUT_KERNELS_H
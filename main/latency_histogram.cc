@@ -0,0 +1,153 @@
+#include "latency_histogram.h"
+#include <stdio.h>
+#include <string.h>
+
+LatencyHistogram g_sensor_to_motor_latency("sensor_to_motor");
+LatencyHistogram g_reflex_stop_latency("reflex_stop", 1000);
+LatencyHistogram g_input_fill_latency("input_fill", 100);
+LatencyHistogram g_invoke_latency("invoke", 1000);
+LatencyHistogram g_frame_to_result_latency("frame_to_result");
+LatencyHistogram g_frame_copy_latency("frame_copy", 5);
+LatencyHistogram g_add_frame_latency("add_frame", 50);
+LatencyHistogram g_wake_latency("wake", 20);
+LatencyHistogram g_head_latency("head", 1000);
+LatencyHistogram g_handoff_latency("handoff", 500);
+LatencyHistogram g_gate_latency("gate", 200);
+LatencyHistogram g_sensor_parse_latency("sensor_parse", 50);
+LatencyHistogram g_log_append_latency("log_append", 100);
+
+// Upper edge of the bin the p-th percentile falls in, max_us for the overflow
+// bin (it has no upper edge) and 0 without samples
+static int64_t bins_percentile_us(const uint32_t *bins, uint32_t count, int p, int64_t bin_us, int64_t max_us)
+{
+  if (count == 0)
+    return 0;
+  uint32_t rank = (uint32_t)(((uint64_t)p * count + 99) / 100);
+  uint32_t seen = 0;
+  int bin = 0;
+  for (; bin < LATENCY_BINS; bin++)
+  {
+    seen += bins[bin];
+    if (seen >= rank)
+      break;
+  }
+  return bin < LATENCY_BINS ? (int64_t)(bin + 1) * bin_us : max_us;
+}
+
+void LatencyHistogram::record(int64_t latency_us)
+{
+  if (latency_us < 0)
+    latency_us = 0;
+  int64_t bin = latency_us / bin_us_;
+  if (bin > LATENCY_BINS)
+    bin = LATENCY_BINS;
+  portENTER_CRITICAL(&lock_);
+  bins_[bin]++;
+  count_++;
+  sum_us_ += latency_us;
+  if (latency_us < min_us_)
+    min_us_ = latency_us;
+  if (latency_us > max_us_)
+    max_us_ = latency_us;
+  window_bins_[bin]++;
+  window_count_++;
+  if (latency_us > window_max_us_)
+    window_max_us_ = latency_us;
+  portEXIT_CRITICAL(&lock_);
+}
+
+void LatencyHistogram::reset()
+{
+  portENTER_CRITICAL(&lock_);
+  memset(bins_, 0, sizeof(bins_));
+  count_ = 0;
+  sum_us_ = 0;
+  min_us_ = INT64_MAX;
+  max_us_ = 0;
+  memset(window_bins_, 0, sizeof(window_bins_));
+  window_count_ = 0;
+  window_max_us_ = 0;
+  portEXIT_CRITICAL(&lock_);
+}
+
+int64_t LatencyHistogram::percentile_us(int p)
+{
+  portENTER_CRITICAL(&lock_);
+  int64_t us = bins_percentile_us(bins_, count_, p, bin_us_, max_us_);
+  portEXIT_CRITICAL(&lock_);
+  return us;
+}
+
+void LatencyHistogram::dump()
+{
+  // Copy under the lock, print outside it
+  static uint32_t bins[LATENCY_BINS + 1];
+  portENTER_CRITICAL(&lock_);
+  memcpy(bins, bins_, sizeof(bins));
+  uint32_t count = count_;
+  int64_t sum_us = sum_us_;
+  int64_t min_us = min_us_;
+  int64_t max_us = max_us_;
+  portEXIT_CRITICAL(&lock_);
+
+  printf("LATENCY_START:%s\n", name_);
+  if (count == 0)
+  {
+    printf("LATENCY_ERROR:No samples recorded (switch to inference mode first)\n");
+    printf("LATENCY_END\n");
+    fflush(stdout);
+    return;
+  }
+  printf("LATENCY_STATS:count:%lu:min_us:%lld:mean_us:%lld:p50_us:%lld:p95_us:%lld:p99_us:%lld:max_us:%lld\n",
+         (unsigned long)count, (long long)min_us, (long long)(sum_us / count),
+         (long long)percentile_us(50), (long long)percentile_us(95), (long long)percentile_us(99),
+         (long long)max_us);
+  // LATENCY_BIN:<from ms>:<to ms>:<count>, empty bins skipped, -1 = no upper edge
+  for (int bin = 0; bin <= LATENCY_BINS; bin++)
+  {
+    if (bins[bin] == 0)
+      continue;
+    printf("LATENCY_BIN:%d:%d:%lu\n", (int)(bin * bin_us_ / 1000),
+           bin < LATENCY_BINS ? (int)((bin + 1) * bin_us_ / 1000) : -1, (unsigned long)bins[bin]);
+  }
+  printf("LATENCY_END\n");
+  fflush(stdout);
+}
+
+void LatencyHistogram::print_summary()
+{
+  static uint32_t bins[LATENCY_BINS + 1];
+  portENTER_CRITICAL(&lock_);
+  memcpy(bins, bins_, sizeof(bins));
+  uint32_t count = count_;
+  int64_t sum_us = sum_us_;
+  int64_t max_us = max_us_;
+  portEXIT_CRITICAL(&lock_);
+
+  printf("STATS_STAGE:%s:count:%lu:mean_us:%lld:p50_us:%lld:p95_us:%lld:p99_us:%lld:max_us:%lld\n", name_,
+         (unsigned long)count, (long long)(count ? sum_us / count : 0), (long long)percentile_us(50),
+         (long long)percentile_us(95), (long long)percentile_us(99), (long long)max_us);
+  // STATS_HIST:<name>:bin_us:<width>:<count per bin, the last one is the overflow bin>
+  printf("STATS_HIST:%s:bin_us:%lld:", name_, (long long)bin_us_);
+  for (int bin = 0; bin <= LATENCY_BINS; bin++)
+  {
+    printf(bin < LATENCY_BINS ? "%lu," : "%lu\n", (unsigned long)bins[bin]);
+  }
+}
+
+void LatencyHistogram::print_window(const char *label)
+{
+  uint32_t bins[LATENCY_BINS + 1]; // On the stack, the profiles print from more than one task
+  portENTER_CRITICAL(&lock_);
+  memcpy(bins, window_bins_, sizeof(bins));
+  uint32_t count = window_count_;
+  int64_t max_us = window_max_us_;
+  memset(window_bins_, 0, sizeof(window_bins_));
+  window_count_ = 0;
+  window_max_us_ = 0;
+  portEXIT_CRITICAL(&lock_);
+
+  printf("  %-13s: p50 %.2f ms  p99 %.2f ms  max %.2f ms (%lu)\n", label,
+         bins_percentile_us(bins, count, 50, bin_us_, max_us) / 1000.0,
+         bins_percentile_us(bins, count, 99, bin_us_, max_us) / 1000.0, max_us / 1000.0, (unsigned long)count);
+}
@@ -0,0 +1,101 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#define LATENCY_BIN_US 5000 // Default 5 ms per bin
+#define LATENCY_BINS 60     // Up to 300 ms at the default width, anything slower lands in the overflow bin
+#define STAGE_TIMING        // Comment out to compile the stage timers out (their histograms stay empty)
+
+// Fixed-bin latency histogram. record() is cheap enough for the control loop;
+// dump() prints it for the serial protocol. Samples count twice: towards the
+// totals since the last reset(), and towards the window print_window() reports
+// and restarts, so the periodic profiles do not clear what GET_STATS shows.
+class LatencyHistogram
+{
+public:
+  explicit LatencyHistogram(const char *name, int64_t bin_us = LATENCY_BIN_US) : name_(name), bin_us_(bin_us) {}
+
+  void record(int64_t latency_us);
+  void reset();
+
+  // Approximate percentile (upper edge of the bin it falls in), 0 if empty
+  int64_t percentile_us(int p);
+
+  // Print LATENCY_START:<name> ... LATENCY_END
+  void dump();
+
+  // Print one STATS_STAGE line and one STATS_HIST line for GET_STATS
+  void print_summary();
+
+  // Print p50/p99/max of the samples since the last call, and start a new window
+  void print_window(const char *label);
+
+private:
+  const char *name_;
+  int64_t bin_us_;
+  portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+  uint32_t bins_[LATENCY_BINS + 1] = {}; // Last one is the overflow bin
+  uint32_t count_ = 0;
+  int64_t sum_us_ = 0;
+  int64_t min_us_ = INT64_MAX;
+  int64_t max_us_ = 0;
+  uint32_t window_bins_[LATENCY_BINS + 1] = {};
+  uint32_t window_count_ = 0;
+  int64_t window_max_us_ = 0;
+};
+
+// Records the time from its construction to the end of the scope:
+//   { StageTimer timer(g_invoke_latency); interpreter->Invoke(); }
+// Nothing is left of it without STAGE_TIMING.
+class StageTimer
+{
+public:
+#ifdef STAGE_TIMING
+  explicit StageTimer(LatencyHistogram &histogram) : histogram_(histogram), start_us_(esp_timer_get_time()) {}
+  ~StageTimer() { histogram_.record(esp_timer_get_time() - start_us_); }
+
+private:
+  LatencyHistogram &histogram_;
+  int64_t start_us_;
+#else
+  explicit StageTimer(LatencyHistogram &) {}
+#endif
+};
+
+// For stages timed anyway, or that do not end with a scope
+inline void stage_record(LatencyHistogram &histogram, int64_t us)
+{
+#ifdef STAGE_TIMING
+  histogram.record(us);
+#else
+  (void)histogram;
+  (void)us;
+#endif
+}
+
+// Sensor frame start-of-frame to the motor command computed from it
+extern LatencyHistogram g_sensor_to_motor_latency;
+
+// Sensor frame start-of-frame to the motors stopped by the reflex stop
+// (reflex_stop.h), per trigger
+extern LatencyHistogram g_reflex_stop_latency;
+
+// Inference stages, per run_inference() call and per published result
+extern LatencyHistogram g_input_fill_latency;     // Window to input tensor
+extern LatencyHistogram g_invoke_latency;         // interpreter->Invoke()
+extern LatencyHistogram g_frame_to_result_latency; // Newest frame of the window to its prediction
+extern LatencyHistogram g_frame_copy_latency;      // request_inference() hand-off
+extern LatencyHistogram g_add_frame_latency;       // Frame into the ring, per frame
+extern LatencyHistogram g_wake_latency;            // request_inference() notify to the start of Invoke()
+extern LatencyHistogram g_head_latency;            // Head half of a split model (core 0)
+extern LatencyHistogram g_handoff_latency;         // Front done to head start
+extern LatencyHistogram g_gate_latency;            // Gate model of a cascade, copy and Invoke()
+
+// Depth sensor stages, per frame
+extern LatencyHistogram g_sensor_parse_latency; // UART read and parse, excluding the wait (sensor_rx task)
+extern LatencyHistogram g_log_append_latency;   // Frame into the SD log in logging mode
+
+#endif // LATENCY_HISTOGRAM_H
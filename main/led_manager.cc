@@ -1,183 +1,141 @@
 #include "led_manager.h"
+#include "memory_report.h"
+#include "task_layout.h"
 #include <stdio.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+#define LED_PRIORITY_COUNT (LED_PRIORITY_CRITICAL + 1)
+
+// Latest command per priority. A slot stays active until its expiry (or for
+// good with duration 0) and is replaced by the next command of its priority.
+typedef struct
+{
+  led_command_t cmd;
+  int64_t expires_ms; // 0 = until replaced or cleared
+  bool active;
+} led_slot_t;
 
 static WS2812FX *g_fx = nullptr;
-static QueueHandle_t g_led_queue = nullptr;
-static led_command_t g_current_cmd = {LED_PRIORITY_LOW, 0, 0, 0, 0};
-static int64_t g_current_cmd_start_time = 0;
+static portMUX_TYPE g_slots_lock = portMUX_INITIALIZER_UNLOCKED;
+static led_slot_t g_slots[LED_PRIORITY_COUNT] = {};
+static bool g_reset = false; // led_manager_clear() asked for the idle look, under g_slots_lock
+// On the strip, LED task only
+static led_command_t g_applied_cmd = {LED_PRIORITY_LOW, 0, 0, 0, 0};
+static bool g_applied = false;
 
-#define LED_QUEUE_SIZE 10
+static void led_task(void *arg);
 
 void led_manager_init(WS2812FX *fx_ptr)
 {
   g_fx = fx_ptr;
-  g_led_queue = xQueueCreate(LED_QUEUE_SIZE, sizeof(led_command_t));
-  
-  if (g_led_queue == nullptr)
-  {
-    printf("ERROR: Failed to create LED queue\n");
-  }
-  else
+  if (xTaskCreatePinnedToCore(led_task, "leds", LED_TASK_STACK, NULL, LED_TASK_PRIORITY, NULL, LED_TASK_CORE) !=
+      pdPASS)
   {
-    printf("LED Manager initialized with queue size %d\n", LED_QUEUE_SIZE);
+    printf("LED Manager: cannot create the LED task, LEDs stay as they are\n");
+    g_fx = nullptr;
+    return;
   }
-  
-  // Initialize with idle state
-  g_current_cmd.priority = LED_PRIORITY_LOW;
-  g_current_cmd_start_time = 0;
+  memory_report_add_task("leds", LED_TASK_STACK);
+  printf("LED Manager initialized with %d priority slots, task on core %d\n", LED_PRIORITY_COUNT, LED_TASK_CORE);
 }
 
 bool led_manager_set(led_priority_t priority, uint8_t mode, uint32_t color, uint16_t speed, uint32_t duration_ms)
 {
-  if (g_led_queue == nullptr)
-  {
-    printf("ERROR: LED queue not initialized\n");
-    return false;
-  }
-  
-  // Don't queue commands with lower priority than current active command
-  if (priority < g_current_cmd.priority)
+  if (priority < LED_PRIORITY_LOW || priority > LED_PRIORITY_CRITICAL)
   {
     return false;
   }
-  
-  led_command_t cmd;
-  cmd.priority = priority;
-  cmd.mode = mode;
-  cmd.color = color;
-  cmd.speed = speed;
-  cmd.duration_ms = duration_ms;
-  
-  // Try to add to queue (non-blocking)
-  if (xQueueSend(g_led_queue, &cmd, 0) != pdTRUE)
-  {
-    // Queue full, try to replace if higher priority
-    led_command_t peek_cmd;
-    if (xQueuePeek(g_led_queue, &peek_cmd, 0) == pdTRUE)
-    {
-      if (cmd.priority > peek_cmd.priority)
-      {
-        // Remove lowest priority item and add new one
-        xQueueReceive(g_led_queue, &peek_cmd, 0);
-        xQueueSend(g_led_queue, &cmd, 0);
-        return true;
-      }
-    }
-    return false; // Queue full and no room for this priority
-  }
-  
+
+  int64_t expires_ms = duration_ms > 0 ? esp_timer_get_time() / 1000 + duration_ms : 0;
+  portENTER_CRITICAL(&g_slots_lock);
+  led_slot_t *slot = &g_slots[priority];
+  slot->cmd.priority = priority;
+  slot->cmd.mode = mode;
+  slot->cmd.color = color;
+  slot->cmd.speed = speed;
+  slot->cmd.duration_ms = duration_ms;
+  slot->expires_ms = expires_ms;
+  slot->active = true;
+  portEXIT_CRITICAL(&g_slots_lock);
   return true;
 }
 
-void led_manager_update()
+// Show the highest active priority
+static void led_manager_update()
 {
-  if (g_fx == nullptr || g_led_queue == nullptr)
-  {
-    return;
-  }
-  
   int64_t now = esp_timer_get_time() / 1000; // Convert to ms
-  
-  // Check if current command has expired
-  if (g_current_cmd.duration_ms > 0)
+
+  // Highest active priority wins; expired slots are cleared on the way
+  led_command_t next = {};
+  bool found = false;
+  portENTER_CRITICAL(&g_slots_lock);
+  bool reset = g_reset;
+  g_reset = false;
+  for (int p = LED_PRIORITY_CRITICAL; p >= LED_PRIORITY_LOW && !found; p--)
   {
-    int64_t elapsed = now - g_current_cmd_start_time;
-    if (elapsed >= g_current_cmd.duration_ms)
+    led_slot_t *slot = &g_slots[p];
+    if (slot->active && slot->expires_ms != 0 && now >= slot->expires_ms)
     {
-      // Current command expired, clear it
-      g_current_cmd.priority = LED_PRIORITY_LOW;
-      g_current_cmd.duration_ms = 0;
+      slot->active = false;
     }
-  }
-  
-  // Check if there's a higher priority command in queue
-  led_command_t next_cmd;
-  led_command_t highest_priority_cmd;
-  bool found_higher = false;
-  int queue_count = uxQueueMessagesWaiting(g_led_queue);
-  
-  // Scan queue for highest priority command
-  for (int i = 0; i < queue_count; i++)
-  {
-    if (xQueueReceive(g_led_queue, &next_cmd, 0) == pdTRUE)
+    if (slot->active)
     {
-      // Check if this is higher priority than current
-      if (next_cmd.priority > g_current_cmd.priority)
-      {
-        if (!found_higher || next_cmd.priority > highest_priority_cmd.priority)
-        {
-          if (found_higher)
-          {
-            // Put previous highest back in queue
-            xQueueSend(g_led_queue, &highest_priority_cmd, 0);
-          }
-          highest_priority_cmd = next_cmd;
-          found_higher = true;
-        }
-        else
-        {
-          // Put it back
-          xQueueSend(g_led_queue, &next_cmd, 0);
-        }
-      }
-      else if (next_cmd.priority == g_current_cmd.priority)
-      {
-        // Same priority, replace current
-        if (!found_higher)
-        {
-          highest_priority_cmd = next_cmd;
-          found_higher = true;
-        }
-        else
-        {
-          xQueueSend(g_led_queue, &next_cmd, 0);
-        }
-      }
-      else
-      {
-        // Lower priority, put back
-        xQueueSend(g_led_queue, &next_cmd, 0);
-      }
+      next = slot->cmd;
+      found = true;
     }
   }
-  
-  // Apply highest priority command if found
-  if (found_higher)
+  portEXIT_CRITICAL(&g_slots_lock);
+
+  if (reset)
+  {
+    g_fx->setMode(FX_MODE_STATIC);
+    g_fx->setColor(YELLOW);
+    g_applied = false;
+  }
+
+  // Nothing active: the strip keeps showing the last command
+  if (!found)
   {
-    g_current_cmd = highest_priority_cmd;
-    g_current_cmd_start_time = now;
-    
-    // Apply to LED strip
-    g_fx->setMode(g_current_cmd.mode);
-    g_fx->setColor(g_current_cmd.color);
-    if (g_current_cmd.speed > 0)
-    {
-      g_fx->setSpeed(g_current_cmd.speed);
-    }
+    return;
   }
-}
 
-void led_manager_clear()
-{
-  if (g_led_queue == nullptr)
+  // Only touch the strip when the command changes, setMode() restarts the animation
+  if (g_applied && next.priority == g_applied_cmd.priority && next.mode == g_applied_cmd.mode &&
+      next.color == g_applied_cmd.color && next.speed == g_applied_cmd.speed)
   {
     return;
   }
-  
-  // Empty the queue
-  led_command_t dummy;
-  while (xQueueReceive(g_led_queue, &dummy, 0) == pdTRUE)
+  g_applied_cmd = next;
+  g_applied = true;
+
+  // Apply to LED strip
+  g_fx->setMode(next.mode);
+  g_fx->setColor(next.color);
+  if (next.speed > 0)
   {
-    // Just drain the queue
+    g_fx->setSpeed(next.speed);
   }
-  
-  // Reset current command to idle
-  g_current_cmd.priority = LED_PRIORITY_LOW;
-  g_current_cmd.duration_ms = 0;
-  
-  if (g_fx != nullptr)
+}
+
+void led_manager_clear()
+{
+  portENTER_CRITICAL(&g_slots_lock);
+  for (int p = 0; p < LED_PRIORITY_COUNT; p++)
   {
-    g_fx->setMode(FX_MODE_STATIC);
-    g_fx->setColor(YELLOW);
+    g_slots[p].active = false;
+  }
+  g_reset = true; // The LED task resets the strip to idle
+  portEXIT_CRITICAL(&g_slots_lock);
+}
+
+static void led_task(void *arg)
+{
+  TickType_t last_wake = xTaskGetTickCount();
+  while (true)
+  {
+    led_manager_update();
+    g_fx->service();
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(LED_TASK_PERIOD_MS));
   }
 }
@@ -3,7 +3,12 @@
 
 #include <WS2812FX.h>
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
+
+// The strip is owned by its own task: it picks the command to show and runs
+// WS2812FX::service(), so animations keep their speed whatever the main loop
+// does. Everything else only calls led_manager_set() / led_manager_clear().
+// Core, priority and stack are in task_layout.h.
+#define LED_TASK_PERIOD_MS 10 // Finer than the fastest animation step
 
 // Priority levels (higher number = higher priority)
 typedef enum {
@@ -22,16 +27,14 @@ typedef struct {
   uint32_t duration_ms; // How long to display (0 = until overridden)
 } led_command_t;
 
-// Initialize the LED manager
+// Start the LED task, which owns fx_ptr from now on
 void led_manager_init(WS2812FX *fx_ptr);
 
-// Submit a command to the queue
+// Make this the latest command of its priority (any task, constant time). It
+// shows while no higher priority is active; duration_ms counts from now.
 bool led_manager_set(led_priority_t priority, uint8_t mode, uint32_t color, uint16_t speed, uint32_t duration_ms);
 
-// Process queued commands (call this periodically, e.g., in main loop)
-void led_manager_update();
-
-// Clear all pending commands and reset to idle
+// Drop the commands of all priorities and reset to idle (any task)
 void led_manager_clear();
 
 #endif // LED_MANAGER_H
@@ -0,0 +1,42 @@
+#include "log_index.h"
+#include <string.h>
+#include "sdcard/sd.h"
+
+void log_segment_path(const char *log_path, int segment, char *out, size_t out_size)
+{
+  const char *dot = strrchr(log_path, '.');
+  int stem = dot ? (int)(dot - log_path) : (int)strlen(log_path);
+  if (segment == 0)
+    snprintf(out, out_size, "%s", log_path);
+  else
+    snprintf(out, out_size, "%.*s_%03d%s", stem, log_path, segment, dot ? dot : "");
+}
+
+void log_index_path(const char *log_path, char *out, size_t out_size)
+{
+  const char *dot = strrchr(log_path, '.');
+  int stem = dot ? (int)(dot - log_path) : (int)strlen(log_path);
+  snprintf(out, out_size, "%.*s.idx", stem, log_path);
+}
+
+bool log_index_seek(const char *log_path, uint32_t frame, log_index_entry_t *out)
+{
+  char path[80];
+  log_index_path(log_path, path, sizeof(path));
+  FILE *fp = sd_card_fopen(path, "rb");
+  if (!fp)
+    return false;
+
+  // Entries are in frame order, about 2300 per hour of recording: a linear scan is fine
+  bool found = false;
+  log_index_entry_t entry;
+  while (fread(&entry, 1, sizeof(entry), fp) == sizeof(entry))
+  {
+    if (entry.frame > frame)
+      break;
+    *out = entry;
+    found = true;
+  }
+  fclose(fp);
+  return found;
+}
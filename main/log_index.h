@@ -0,0 +1,49 @@
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// A recording session is split into segment files of at most SD_SEGMENT_MB
+// (depth_sensor.h), each starting with its own file header:
+//   /revised_log_0024.bin, /revised_log_0024_001.bin, /revised_log_0024_002.bin, ...
+// and /revised_log_0024.idx, one log_index_entry_t per keyframe (or every
+// LOG_KEYFRAME_INTERVAL frames in logs without keyframes). A record named by
+// an entry can be decoded without anything before it.
+typedef struct __attribute__((packed))
+{
+  uint32_t frame;       // Log frame number of the record
+  uint16_t segment;     // 0 = the session's first file
+  uint16_t reserved;
+  uint32_t offset;      // Byte offset of the record in the segment
+  int64_t timestamp_us; // Start-of-frame time of the record
+} log_index_entry_t;
+
+/**
+ * @brief Path of one segment of a session
+ *
+ * @param log_path The session's first file (g_depth_log_filename, e.g. "/revised_log_0024.bin")
+ * @param segment Segment number, 0 is log_path itself
+ * @param out Output path
+ * @param out_size Size of out
+ */
+void log_segment_path(const char *log_path, int segment, char *out, size_t out_size);
+
+/**
+ * @brief Path of the index of a session ("/revised_log_0024.idx")
+ */
+void log_index_path(const char *log_path, char *out, size_t out_size);
+
+/**
+ * @brief Find where to start reading to get a frame: the last index entry at
+ *        or before it
+ *
+ * @param log_path The session's first file
+ * @param frame Log frame number to seek to
+ * @param out Entry found
+ * @return true if the index exists and has an entry at or before frame
+ */
+bool log_index_seek(const char *log_path, uint32_t frame, log_index_entry_t *out);
+
+#endif // LOG_INDEX_H
@@ -17,16 +17,32 @@ limitations under the License.
 #include "tensorflow/lite/micro/micro_interpreter.h"
 #include "tensorflow/lite/micro/system_setup.h"
 #include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+#include <atomic>
+#include <new>
 
 #include "main_functions.h"
 #include "model.h"
 #include "constants.h"
 #include "output_handler.h"
+#include "input_kernels.h"
+#include "model_ops.h" // Generated from model.cc by generate_op_resolver.py
+#include "op_profiler.h"
+#include "latency_histogram.h"
+#include "trace_events.h"
+#include "memory_report.h"
+#include "power_manager.h"
+#include "boot_init.h"
+#include "flight_recorder.h"
+#include "task_layout.h"
+#include "net_telemetry.h"
 
 #include "drive_system/drive_system.h"
 #include "drive_system/depth_sensor.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include "sdcard/sd.h"
 #include <esp_heap_caps.h>
 #include <esp_timer.h>
@@ -38,6 +54,52 @@ limitations under the License.
 // Serial commands
 #include "serial_commands.h"
 
+// Quantize each frame once when it arrives and keep the window as int8 in the
+// model's input format. Comment out to keep the float window and quantize the
+// whole window on every inference instead.
+#define QUANTIZE_ON_INGEST
+
+// Keep a persistent copy of the input window and only write the channel of
+// each new frame (channel = frame number % window length) instead of reordering
+// all of them on every inference. The first Conv2D's filter is rotated
+// along its input channels to match, which needs the model in RAM.
+#define SLIDING_WINDOW_INPUT
+
+// Build the input window on core 0 as each frame arrives, in one of two
+// staging buffers, so that core 1 only copies the newest one into the input
+// tensor before Invoke() instead of gathering it from the frame ring. Takes
+// the input fill off the inference path. Falls back to reading the ring on
+// core 1 when the newest window isn't staged (after a reset, or when core 0
+// found both buffers in use).
+#define PIPELINED_INPUT
+
+// Skip Invoke() while the depth scene is static and reuse the last
+// steering/throttle, for at most MAX_SKIPPED_FRAMES frames in a row. Comment
+// out to run the model on every frame.
+#define ADAPTIVE_INFERENCE_SKIP
+
+// Run the model as two halves when /model_front.tflite and /model_head.tflite
+// are on the SD card (see split_model.py): core 1 runs the front for frame N
+// while core 0 runs the head for frame N-1. Falls back to the single model
+// when the files are missing or don't fit together.
+#define SPLIT_MODEL_PIPELINE
+
+// Run a small gate model from /model_gate.tflite on every window before the
+// full model. It takes the same input and gives throttle, steering and a
+// confidence (0..1); when it is confident its prediction is used and the full
+// model is skipped, except for a refresh every GATE_REFRESH_INFERENCES
+// windows. It can only use the ops registered for g_model. Without the file,
+// or with a split model loaded, every window runs the full model.
+#define CASCADED_INFERENCE
+#define GATE_CONFIDENCE_THRESHOLD 0.8f // Below this the full model decides
+#define GATE_REFRESH_INFERENCES 10     // Gated windows in a row before the full model runs anyway
+
+// Time Invoke() at boot with the tensor arena in every placement that has room
+// (see tensor_arena_t), this many runs each, before the inference task starts.
+// Printed then and with GET_MEMORY. Comment out to save the time.
+#define ARENA_PLACEMENT_BENCH 5
+#define ARENA_PERSISTENT_SIZE (16 * 1024) // PSRAM section of a split arena
+
 // Globals, used for compatibility with Arduino-style sketches.
 namespace
 {
@@ -48,395 +110,1758 @@ namespace
   TfLiteTensor *output_throttle = nullptr;
   int inference_count = 0;
 
-  constexpr int kTensorArenaSize = 96 * 1024; // 96 KB for larger model
-  // Allocate tensor arena in PSRAM for ESP32-S3
-  uint8_t *tensor_arena = nullptr;
+  // kTensorArenaSize comes from model_ops.h. Every op reads and writes the
+  // arena's non-persistent section (activations and scratch buffers), so that
+  // is what must sit in internal SRAM. The persistent section (tensor
+  // structs, op data, quantization parameters) is small and written once by
+  // AllocateTensors(). Placements, best first:
+  //   internal - the whole arena in internal SRAM
+  //   split    - non-persistent section in internal SRAM, ARENA_PERSISTENT_SIZE
+  //              of persistent section in PSRAM
+  //   psram    - the whole arena in PSRAM
+  typedef enum
+  {
+    ARENA_INTERNAL = 0,
+    ARENA_SPLIT,
+    ARENA_PSRAM,
+    ARENA_PLACEMENT_COUNT,
+  } arena_placement_t;
+  const char *const kArenaPlacementNames[ARENA_PLACEMENT_COUNT] = {"internal", "split", "psram"};
+
+  typedef struct
+  {
+    arena_placement_t placement;
+    uint8_t *arena;       // Whole arena, or its non-persistent section when split
+    int size;
+    uint8_t *persistent;  // Split only
+    int persistent_size;
+  } tensor_arena_t;
+
+  tensor_arena_t tensor_arena = {};
+  int tensor_arena_size = 0; // Budget, both sections together
+#ifdef ARENA_PLACEMENT_BENCH
+  int32_t arena_bench_us[ARENA_PLACEMENT_COUNT] = {-1, -1, -1}; // Mean Invoke(), -1 = no room
+#endif
+
+  // A model on the SD card replaces the bundled g_model without reflashing.
+  // It may be bigger than the bundled one, so it gets the old 96 KB arena
+  // budget, but it can only use the ops registered for g_model.
+  constexpr const char *SD_MODEL_PATH = "/model.tflite";
+  constexpr int kSdModelArenaSize = 96 * 1024;
+  uint8_t *sd_model = nullptr;
+
+#ifdef SPLIT_MODEL_PIPELINE
+  constexpr const char *SD_FRONT_MODEL_PATH = "/model_front.tflite";
+  constexpr const char *SD_HEAD_MODEL_PATH = "/model_head.tflite";
+  constexpr int kHeadArenaSize = 16 * 1024;
+  bool split_enabled = false;
+  uint8_t *head_model = nullptr;
+  uint8_t *head_arena = nullptr;
+  tflite::MicroInterpreter *head_interpreter = nullptr;
+  alignas(tflite::MicroInterpreter) uint8_t head_interpreter_storage[sizeof(tflite::MicroInterpreter)];
+  TfLiteTensor *front_output = nullptr; // Interpreter output when split, copied into head_input
+  TfLiteTensor *head_input = nullptr;
+
+  // Front output for the head task: a length-1 queue that holds only the
+  // newest frame, so a slow head drops stale frames instead of queueing them
+  typedef struct
+  {
+    int64_t front_done_us;
+    int64_t frame_arrival_us; // For the deadline monitor
+    int8_t data[];            // front_output->bytes
+  } head_job_t;
+  QueueHandle_t head_queue = nullptr;
+  head_job_t *head_job = nullptr; // Staging buffer on core 1
+  TaskHandle_t head_task_handle = nullptr;
+#endif
+
+#ifdef CASCADED_INFERENCE
+  constexpr const char *SD_GATE_MODEL_PATH = "/model_gate.tflite";
+  constexpr int kGateArenaSize = 16 * 1024;
+  bool gate_enabled = false;
+  uint8_t *gate_model = nullptr;
+  uint8_t *gate_arena = nullptr;
+  tflite::MicroInterpreter *gate_interpreter = nullptr;
+  alignas(tflite::MicroInterpreter) uint8_t gate_interpreter_storage[sizeof(tflite::MicroInterpreter)];
+  TfLiteTensor *gate_input = nullptr;
+  int gated_in_a_row = 0; // Inference task only
+
+  // Written by run_inference(), read by the profile and GET_STATS
+  std::atomic<uint32_t> gate_gated{0};
+  std::atomic<uint32_t> gate_uncertain{0};
+  std::atomic<uint32_t> gate_refreshes{0};
+  std::atomic<int64_t> gate_us_total{0};
+  std::atomic<int64_t> gate_full_us_total{0};
+  gate_stats_t gate_window_start = {}; // Counters at the last profile print
+#endif
+
+  ModelOpResolver resolver;
+  // The interpreter is constructed in place so a failed model can be torn down and replaced
+  alignas(tflite::MicroInterpreter) uint8_t interpreter_storage[sizeof(tflite::MicroInterpreter)];
 
   const int NUM_LEDS = 8;
   const int LED_GPIO = 50;
   led_strip_handle_t led_strip = nullptr;
   WS2812FX *fx = nullptr;
 
-  // Inference results - persist between frames
-  float inference_steering = 0.0f;
-  float inference_throttle = 0.0f;
-
   // FPS tracking
   int64_t fps_window_start_us = 0;
   int fps_window_count = 0;
   float inference_fps = 0.0f;
 
-  // Per-section timing accumulators (reset every second with FPS report)
-  int64_t acc_input_fill_us = 0; // Time to quantize input tensor
-  int64_t acc_invoke_us = 0;     // Time for interpreter->Invoke()
-  int64_t acc_frame_copy_us = 0; // Time for memcpy in request_inference()
-  int64_t acc_add_frame_us = 0;  // Time for add_frame_to_buffer()
+  // Stage times go to the histograms in latency_histogram.h, this is the last run for hil.cc
+  inference_timing_t last_timing = {};
 
   // Inference task handle and synchronization for async inference on core 1
   TaskHandle_t inference_task_handle = nullptr;
-  SemaphoreHandle_t depth_mutex = nullptr;
-  volatile bool inference_requested = false;
+  std::atomic<bool> inference_requested{false};
+  std::atomic<int64_t> inference_notify_us{0}; // When request_inference() woke the task
+
+  // Frame buffer: store the last num_frames frames for inference. The window
+  // length and a frame's H x W (20 frames of 24x24 for the bundled model) are
+  // read from the model's input in init_model().
+  constexpr int DEFAULT_NUM_FRAMES = 20;
+  constexpr int DEFAULT_FRAME_ROWS = INPUT_KERNEL_DST_SIZE;
+  constexpr int DEFAULT_FRAME_COLS = INPUT_KERNEL_DST_SIZE;
+  int frame_rows = DEFAULT_FRAME_ROWS;
+  int frame_cols = DEFAULT_FRAME_COLS;
+  int frame_size = DEFAULT_FRAME_ROWS * DEFAULT_FRAME_COLS;
+  int num_frames = DEFAULT_NUM_FRAMES;
+  float *resample_scratch = nullptr; // One normalized frame, for other sensor/model shapes
+  float *mm_scratch = nullptr;       // One sensor frame in millimetres, for the same
+
+  // The frame ring is shared between cores without a lock. The sensor side
+  // writes frame N into slot N % ring_slots and then publishes N + 1 in
+  // frames_published. The inference task reads the newest num_frames slots in
+  // place, so the spare slots let the sensor run RING_SPARE_SLOTS frames ahead
+  // before it touches a slot that may still be read. The reader re-checks
+  // frames_published afterwards and retries if it was lapped (seqlock style).
+  constexpr int RING_SPARE_SLOTS = 4;
+  constexpr int MIN_RING_SLOTS = MIN_WINDOW_FRAMES + RING_SPARE_SLOTS;
+  constexpr int MAX_RING_SLOTS = MAX_WINDOW_FRAMES + RING_SPARE_SLOTS;
+  int ring_slots = DEFAULT_NUM_FRAMES + RING_SPARE_SLOTS;
+  constexpr int MAX_WINDOW_RETRIES = 3;
+#ifdef QUANTIZE_ON_INGEST
+  typedef int8_t frame_sample_t; // Already quantized with the input tensor's scale/zero_point
+#else
+  typedef float frame_sample_t;  // Normalized depth in [0, 1]
+#endif
+  frame_sample_t *frame_buffer = nullptr;       // Frame ring: [ring_slots][frame_rows][frame_cols]
+  std::atomic<uint32_t> frames_published{0};    // Total frames written since the last reset
+  std::atomic<uint32_t> reset_epoch{0};         // reset_frame_buffer() calls, frame numbers restart with each
+  int window_retries = 0;                       // Window reads redone because the sensor lapped them
+
+  // Deadline monitor: latency runs from the arrival of the newest frame in the
+  // window to the result. drive_system_loop() switches to its fallback policy
+  // when the result gets older than INFERENCE_RESULT_MAX_AGE_MS.
+  constexpr int64_t INFERENCE_DEADLINE_US = 100 * 1000;
+  int64_t frame_arrival_us[MAX_RING_SLOTS] = {};          // When each ring slot's frame was added
+  int64_t window_arrival_us = 0;                          // Newest frame of the window being inferred (core 1)
+  std::atomic<int64_t> results_reset_us{0};               // reset_frame_buffer(): results from older frames are void
+  std::atomic<int> deadline_misses{0};                    // Since the last FPS report
+  std::atomic<int> results_count{0};
+
+#ifdef ADAPTIVE_INFERENCE_SKIP
+  // Frames are compared with the newest frame of the last inference that ran,
+  // so slow drift adds up instead of staying under the threshold frame by frame
+  constexpr float SKIP_THRESHOLD_LSB = 2.0f; // Mean absolute change in quantized steps (~10 mm each)
+  constexpr int MAX_SKIPPED_FRAMES = 4;      // Max consecutive frames that reuse the last result
+  static_assert(MAX_SKIPPED_FRAMES + 1 < MIN_RING_SLOTS, "reference frame must still be in the ring");
+  constexpr uint32_t NO_REFERENCE = UINT32_MAX;
+  uint32_t reference_seq = NO_REFERENCE; // Newest frame of the last requested inference
+  bool scene_unchanged = false;          // Newest frame is within SKIP_THRESHOLD_LSB of the reference
+  float last_scene_change = 0.0f;
+  int consecutive_skips = 0;
+  std::atomic<int> skipped_frames{0}; // Since the last FPS report
+#endif
+
+#ifdef SLIDING_WINDOW_INPUT
+  // Input window in tensor layout (H, W, num_frames), where channel c holds
+  // the frame with number % num_frames == c. The input tensor itself can't hold
+  // this state because the arena planner reuses its memory during Invoke().
+  bool sliding_window_enabled = false;
+  int8_t *window_tensor = nullptr;
+  uint32_t window_written_end = 0;   // Frames below this number are already in window_tensor
+  uint32_t window_written_epoch = 0; // reset_epoch those frames are from, older means rewrite everything
+
+  // Writable model copy, and the first Conv2D filter in it (OHWI, I == num_frames)
+  uint8_t *model_ram = nullptr;
+  int8_t *conv_filter = nullptr;          // Filter data inside model_ram, rotated in place
+  int8_t *conv_filter_original = nullptr; // Filter in chronological channel order
+  int conv_filter_rows = 0;               // O * H * W, each row holds num_frames channels
+  int conv_filter_offset = 0;             // Current rotation applied to conv_filter
+#endif
+
+#ifdef PIPELINED_INPUT
+  // Core 1 only takes the staging buffer with the newest complete window and
+  // core 0 only writes one that is neither the newest nor being copied. Both
+  // facts live in one atomic word so that taking a buffer is one exchange.
+  typedef struct
+  {
+    int8_t *data;         // input->bytes, same layout as the input tensor
+    uint32_t window_end;  // Holds frames window_end - num_frames .. window_end - 1
+    uint32_t written_end; // Sliding layout: frames below this number are in data (core 0 only)
+    int64_t arrival_us;   // Newest frame of the window
+  } staged_window_t;
+  constexpr uint32_t NO_STAGED = 0xff;
+  bool pipelined_input = false;
+  staged_window_t staged_windows[2] = {};
+  std::atomic<uint32_t> staged_state{NO_STAGED | (NO_STAGED << 8)}; // Newest in bits 0-7, being copied in 8-15
+  int staged_inputs = 0; // Windows copied from staging since the last profile print (core 1)
+#endif
+
+  // Quantize a normalized depth value: quantized = (value / scale + zero_point) truncated to int8
+  inline int8_t quantize_input(float normalized)
+  {
+    float quantized_float = normalized / input->params.scale + input->params.zero_point;
+    int32_t quantized = static_cast<int32_t>(quantized_float);
+    // Clamp to int8 range
+    if (quantized < -128)
+      quantized = -128;
+    if (quantized > 127)
+      quantized = 127;
+    return static_cast<int8_t>(quantized);
+  }
+
+  // ---- Window kernels ----
+  // The per-frame and per-window input code, instantiated for every window
+  // length in kWindowKernels. init_model() picks the entry matching the
+  // model's input channels, so the loops over the window run with the channel
+  // stride as a constant.
+  typedef struct
+  {
+    int frames;
+    // Write frames[0..frames) into channels 0..frames) of an HWC window
+    void (*fill)(const frame_sample_t *const *frames, int8_t *dst, int pixels);
+    // Write one frame into its channel of an HWC window
+    void (*write_channel)(const frame_sample_t *src, int8_t *dst, int pixels);
+    // rotate_window_channels() for this window length
+    void (*rotate)(const int8_t *src, int8_t *dst, int rows, int offset);
+  } window_kernels_t;
+
+  template <int Frames>
+  void fill_window(const frame_sample_t *const *frames, int8_t *dst, int pixels)
+  {
+#ifdef QUANTIZE_ON_INGEST
+    gather_window<Frames>(frames, dst, pixels);
+#else
+    for (int i = 0; i < pixels; i++, dst += Frames)
+    {
+      for (int c = 0; c < Frames; c++)
+      {
+        dst[c] = quantize_input(frames[c][i]);
+      }
+    }
+#endif
+  }
+
+  template <int Frames>
+  void write_window_frame(const frame_sample_t *src, int8_t *dst, int pixels)
+  {
+#ifdef QUANTIZE_ON_INGEST
+    scatter_window_channel<Frames>(src, dst, pixels);
+#else
+    for (int i = 0; i < pixels; i++, dst += Frames)
+    {
+      *dst = quantize_input(src[i]);
+    }
+#endif
+  }
+
+  template <int Frames>
+  constexpr window_kernels_t make_window_kernels()
+  {
+    static_assert(Frames >= MIN_WINDOW_FRAMES && Frames <= MAX_WINDOW_FRAMES, "window length out of range");
+    return {Frames, fill_window<Frames>, write_window_frame<Frames>, rotate_window_channels<Frames>};
+  }
+
+  const window_kernels_t kWindowKernels[] = {
+      make_window_kernels<10>(),
+      make_window_kernels<20>(),
+      make_window_kernels<30>(),
+  };
+  const window_kernels_t *window_kernels = &kWindowKernels[1]; // For num_frames
+
+  const window_kernels_t *find_window_kernels(int frames)
+  {
+    for (const window_kernels_t &k : kWindowKernels)
+    {
+      if (k.frames == frames)
+      {
+        return &k;
+      }
+    }
+    return nullptr;
+  }
+
+  // Frame size and window length from the model's (1, H, W, frames) input,
+  // read from the flatbuffer so the buffers can be sized before the
+  // interpreter exists. Only window lengths in kWindowKernels are accepted.
+  bool read_input_frame_shape(const tflite::Model *m, int *rows, int *cols, int *frames)
+  {
+    const tflite::SubGraph *subgraph = m->subgraphs()->Get(0);
+    const tflite::Tensor *tensor = subgraph->tensors()->Get(subgraph->inputs()->Get(0));
+    const auto *shape = tensor->shape();
+    if (shape == nullptr || shape->size() != 4 || find_window_kernels(shape->Get(3)) == nullptr ||
+        shape->Get(1) <= 0 || shape->Get(2) <= 0)
+    {
+      return false;
+    }
+    *rows = shape->Get(1);
+    *cols = shape->Get(2);
+    *frames = shape->Get(3);
+    return true;
+  }
+
+  // Frames in chronological order (oldest to newest). Input layout is
+  // (H, W, num_frames) row-major, so pixel i of frame f lives at i * num_frames + f
+  void fill_window_from_ring(uint32_t window_end, int8_t *dst)
+  {
+    const frame_sample_t *window_frames[MAX_WINDOW_FRAMES];
+    for (int frame_idx = 0; frame_idx < num_frames; frame_idx++)
+    {
+      uint32_t frame_seq = window_end - num_frames + frame_idx;
+      window_frames[frame_idx] = &frame_buffer[(frame_seq % ring_slots) * frame_size];
+    }
+    window_kernels->fill(window_frames, dst, frame_size);
+  }
+
+#ifdef SLIDING_WINDOW_INPUT
+  // Find the filter of the Conv2D that consumes the model input, if its input
+  // channels are exactly the frame window.
+  int8_t *find_input_conv_filter(const tflite::Model *m, int *rows)
+  {
+    const tflite::SubGraph *subgraph = m->subgraphs()->Get(0);
+    const auto *tensors = subgraph->tensors();
+    int32_t input_tensor = subgraph->inputs()->Get(0);
+
+    for (uint32_t i = 0; i < subgraph->operators()->size(); i++)
+    {
+      const tflite::Operator *op = subgraph->operators()->Get(i);
+      const tflite::OperatorCode *code = m->operator_codes()->Get(op->opcode_index());
+      if (tflite::GetBuiltinCode(code) != tflite::BuiltinOperator_CONV_2D ||
+          op->inputs()->Get(0) != input_tensor)
+      {
+        continue;
+      }
+
+      const tflite::Tensor *filter = tensors->Get(op->inputs()->Get(1));
+      const auto *shape = filter->shape();
+      const auto *data = m->buffers()->Get(filter->buffer())->data();
+      if (filter->type() != tflite::TensorType_INT8 || shape == nullptr || shape->size() != 4 ||
+          shape->Get(3) != num_frames || data == nullptr)
+      {
+        return nullptr;
+      }
+
+      *rows = shape->Get(0) * shape->Get(1) * shape->Get(2);
+      if ((int)data->size() != *rows * num_frames)
+      {
+        return nullptr;
+      }
+      return reinterpret_cast<int8_t *>(const_cast<uint8_t *>(data->data()));
+    }
+    return nullptr;
+  }
+
+  // Rotate the filter so that input channel c is multiplied with the weights of
+  // chronological channel (c - offset) mod num_frames. offset is the channel
+  // of the oldest frame in the window.
+  void rotate_conv_filter(int offset)
+  {
+    if (offset == conv_filter_offset)
+    {
+      return;
+    }
+    window_kernels->rotate(conv_filter_original, conv_filter, conv_filter_rows, offset);
+    conv_filter_offset = offset;
+  }
+
+  // Copy frame `seq` from the ring into its channel of a sliding window
+  void write_window_channel(uint32_t seq, int8_t *window)
+  {
+    const frame_sample_t *frame_data = &frame_buffer[(seq % ring_slots) * frame_size];
+    window_kernels->write_channel(frame_data, &window[seq % num_frames], frame_size);
+  }
+
+  // Bring a sliding window that holds the frames below written_end up to
+  // window_end, only writing the frames that arrived since
+  void update_window_channels(int8_t *window, uint32_t written_end, uint32_t window_end)
+  {
+    uint32_t first_seq = window_end - num_frames;
+    if (written_end > first_seq && written_end <= window_end)
+    {
+      first_seq = written_end;
+    }
+    for (uint32_t seq = first_seq; seq < window_end; seq++)
+    {
+      write_window_channel(seq, window);
+    }
+  }
+#endif
+
+#ifdef PIPELINED_INPUT
+  // ---- Pipelined input ----
+  uint32_t staged_newest(uint32_t state)
+  {
+    return state & 0xff;
+  }
+
+  uint32_t staged_busy(uint32_t state)
+  {
+    return state >> 8;
+  }
+
+  void setup_input_staging()
+  {
+    int8_t *data = (int8_t *)memory_alloc("input_staging", 2 * input->bytes, MEMORY_HOT);
+    if (data == nullptr)
+    {
+      MicroPrintf("No room for the input staging windows, core 1 fills the input");
+      return;
+    }
+    staged_windows[0].data = data;
+    staged_windows[1].data = data + input->bytes;
+    pipelined_input = true;
+    MicroPrintf("Pipelined input: core 0 stages the window (2 x %d bytes)", (int)input->bytes);
+  }
+
+  // Core 0, once frame window_end - 1 is published. The sensor side is the
+  // only writer of the ring, so the window can't be lapped while it is read.
+  void stage_window(uint32_t window_end, int64_t arrival_us)
+  {
+    uint32_t state = staged_state.load(std::memory_order_acquire);
+    uint32_t b = 0;
+    while (b < 2 && (b == staged_newest(state) || b == staged_busy(state)))
+    {
+      b++;
+    }
+    if (b == 2)
+    {
+      return; // Core 1 is still copying the older window, it reads this one from the ring
+    }
+
+    staged_window_t *w = &staged_windows[b];
+#ifdef SLIDING_WINDOW_INPUT
+    if (sliding_window_enabled)
+    {
+      update_window_channels(w->data, w->written_end, window_end);
+    }
+    else
+#endif
+    {
+      fill_window_from_ring(window_end, w->data);
+    }
+    w->written_end = window_end;
+    w->window_end = window_end;
+    w->arrival_us = arrival_us;
+
+    // Core 1 may have taken or released the newest buffer meanwhile, never b
+    while (!staged_state.compare_exchange_weak(state, b | (state & 0xff00), std::memory_order_release,
+                                               std::memory_order_relaxed))
+    {
+    }
+  }
+
+  // Core 0, from reset_frame_buffer(): the staged windows are from before the reset
+  void reset_staged_windows()
+  {
+    uint32_t state = staged_state.load(std::memory_order_relaxed);
+    while (!staged_state.compare_exchange_weak(state, NO_STAGED | (state & 0xff00), std::memory_order_release,
+                                               std::memory_order_relaxed))
+    {
+    }
+    staged_windows[0].written_end = 0;
+    staged_windows[1].written_end = 0;
+  }
+
+  // Core 1: copy the newest staged window into the input tensor. False if it
+  // isn't the newest published window, the caller then reads the ring.
+  bool copy_staged_window()
+  {
+    uint32_t state = staged_state.load(std::memory_order_relaxed);
+    uint32_t newest;
+    do
+    {
+      newest = staged_newest(state);
+      if (newest == NO_STAGED)
+      {
+        return false;
+      }
+    } while (!staged_state.compare_exchange_weak(state, newest | (newest << 8), std::memory_order_acquire,
+                                                 std::memory_order_relaxed));
+
+    const staged_window_t *w = &staged_windows[newest];
+    bool fresh = w->window_end == frames_published.load(std::memory_order_acquire);
+    if (fresh)
+    {
+      memcpy(input->data.int8, w->data, input->bytes);
+      window_arrival_us = w->arrival_us;
+#ifdef SLIDING_WINDOW_INPUT
+      if (sliding_window_enabled)
+      {
+        rotate_conv_filter(w->window_end % num_frames);
+      }
+#endif
+    }
+
+    // Done with it, core 0 may write it again
+    state = staged_state.load(std::memory_order_relaxed);
+    while (!staged_state.compare_exchange_weak(state, staged_newest(state) | (NO_STAGED << 8),
+                                               std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return fresh;
+  }
+#endif
+
+#ifdef ADAPTIVE_INFERENCE_SKIP
+  // Mean absolute difference between two frames, in quantized input steps
+  float frame_difference(const frame_sample_t *a, const frame_sample_t *b)
+  {
+#ifdef QUANTIZE_ON_INGEST
+    int32_t sum = 0;
+    for (int i = 0; i < frame_size; i++)
+    {
+      int32_t diff = a[i] - b[i];
+      sum += diff < 0 ? -diff : diff;
+    }
+    return (float)sum / frame_size;
+#else
+    float sum = 0.0f;
+    for (int i = 0; i < frame_size; i++)
+    {
+      float diff = a[i] - b[i];
+      sum += diff < 0.0f ? -diff : diff;
+    }
+    return sum / frame_size / input->params.scale;
+#endif
+  }
+#endif
 
-  // Frame buffer: store last 10 frames for inference (24x24 each)
-  constexpr int NUM_FRAMES = 20;
-  constexpr int FRAME_SIZE = 24 * 24;
-  float *frame_buffer = nullptr;     // Buffer for 10 frames: [10][24][24]
-  float *inference_buffer = nullptr; // Snapshot for inference computation
-  int frame_count = 0;               // Total frames received
-  int buffer_index = 0;              // Current write position in circular buffer
+#ifdef QUANTIZE_ON_INGEST
+  // Raw sensor byte -> quantized input, rebuilt when the input quantization changes
+  int8_t raw_input_lut[INPUT_KERNEL_LUT_SIZE];
+  float raw_lut_scale = 0.0f;
+  int32_t raw_lut_zero_point = 0;
+  uint8_t last_raw_frame[INPUT_KERNEL_SRC_SIZE * INPUT_KERNEL_SRC_SIZE]; // Newest raw 25x25 frame, for GET_KERNEL_PROFILE
+  bool last_raw_frame_default = false;                                    // last_raw_frame holds a frame
 
+#endif
+
+  // Dequantize and clamp the two outputs, then publish them to the drive system.
+  // arrival_us is when the newest frame of the window was added.
+  void store_prediction(const TfLiteTensor *throttle_tensor, const TfLiteTensor *steering_tensor, int64_t arrival_us)
+  {
+    // Dequantize outputs: dequantized = (quantized - zero_point) * scale
+    int8_t steering_quantized = steering_tensor->data.int8[0];
+    int8_t throttle_quantized = throttle_tensor->data.int8[0];
+
+    float steering = (float)(steering_quantized - steering_tensor->params.zero_point) *
+                     steering_tensor->params.scale;
+    float throttle = (float)(throttle_quantized - throttle_tensor->params.zero_point) *
+                     throttle_tensor->params.scale;
+
+    // Clamp outputs to expected ranges
+    // Steering: [-1, 1] (tanh activation)
+    // Throttle: [-1, 1] (linear activation, allows reverse)
+    steering = steering < -1.0f ? -1.0f : (steering > 1.0f ? 1.0f : steering);
+    throttle = throttle < -1.0f ? -1.0f : (throttle > 1.0f ? 1.0f : throttle);
+
+    // Publish the result for the drive task on the other core
+    control_state_t result = {};
+    result.source = CONTROL_SOURCE_INFERENCE;
+    result.mode = (int8_t)write_to_sd;
+    result.timestamp_us = esp_timer_get_time();
+    result.frame_us = arrival_us;
+    result.steering = steering;
+    result.throttle = throttle;
+    g_inference_result.publish(result);
+
+    // Deadline bookkeeping
+    int64_t latency = result.timestamp_us - arrival_us;
+    g_frame_to_result_latency.record(latency);
+    if (latency > INFERENCE_DEADLINE_US)
+    {
+      deadline_misses.fetch_add(1, std::memory_order_relaxed);
+      if (write_to_sd == 3)
+      {
+        flight_recorder_trigger(FLIGHT_TRIGGER_DEADLINE); // Keep what led up to it (rate limited)
+      }
+    }
+    results_count.fetch_add(1, std::memory_order_relaxed);
+    trace_event(TRACE_RESULT, (int32_t)latency);
+  }
+
+#ifdef SPLIT_MODEL_PIPELINE
+  // Copy the front output into the head input, requantizing if the two
+  // models were quantized with different parameters for the shared tensor
+  void requantize_into_head_input(const int8_t *src)
+  {
+    const float src_scale = front_output->params.scale;
+    const int32_t src_zp = front_output->params.zero_point;
+    const float dst_scale = head_input->params.scale;
+    const int32_t dst_zp = head_input->params.zero_point;
+    int8_t *dst = head_input->data.int8;
+    if (src_scale == dst_scale && src_zp == dst_zp)
+    {
+      memcpy(dst, src, head_input->bytes);
+      return;
+    }
+    const float ratio = src_scale / dst_scale;
+    for (size_t i = 0; i < head_input->bytes; i++)
+    {
+      float q = (float)(src[i] - src_zp) * ratio + (float)dst_zp;
+      int32_t rounded = (int32_t)(q < 0.0f ? q - 0.5f : q + 0.5f);
+      dst[i] = rounded < -128 ? -128 : (rounded > 127 ? 127 : rounded);
+    }
+  }
+#endif
 } // namespace
 
+#ifdef SPLIT_MODEL_PIPELINE
+// Runs the head half of a split model on core 0
+void head_task(void *pvParameters)
+{
+  head_job_t *job = (head_job_t *)malloc(sizeof(head_job_t) + front_output->bytes);
+  while (job != nullptr)
+  {
+    if (xQueueReceive(head_queue, job, portMAX_DELAY) != pdTRUE)
+    {
+      continue;
+    }
+    PowerLock full_clock(POWER_LOCK_INFERENCE);
+    int64_t t_start = esp_timer_get_time();
+    trace_event(TRACE_HEAD_START);
+    stage_record(g_handoff_latency, t_start - job->front_done_us);
+    requantize_into_head_input(job->data);
+    if (head_interpreter->Invoke() != kTfLiteOk)
+    {
+      MicroPrintf("Head Invoke failed");
+      continue;
+    }
+    store_prediction(head_interpreter->output(0), head_interpreter->output(1), job->frame_arrival_us);
+    int64_t head_us = esp_timer_get_time() - t_start;
+    stage_record(g_head_latency, head_us);
+    trace_event(TRACE_HEAD_END, (int32_t)head_us);
+  }
+  MicroPrintf("Failed to allocate head job buffer");
+  vTaskDelete(nullptr);
+}
+#endif
+
 // Inference task that runs on core 1
 void inference_task(void *pvParameters)
 {
   while (true)
   {
-    // Check if inference is requested
-    if (inference_requested)
+    // Block until request_inference() notifies us
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (inference_requested.load(std::memory_order_acquire))
     {
       run_inference();
-      inference_requested = false;
-    }
-    else
-    {
-      // Wait briefly before checking again
-      vTaskDelay(pdMS_TO_TICKS(1));
+      inference_requested.store(false, std::memory_order_release);
     }
   }
 }
 
-// Non-blocking function to request inference with frame copy
+// Non-blocking function to request inference. The inference task reads the
+// frame ring in place, so no snapshot copy is needed.
 void request_inference()
 {
-  if (!inference_requested && frame_buffer != nullptr && inference_buffer != nullptr && depth_mutex != nullptr)
+  if (!inference_requested.load(std::memory_order_acquire) && frame_buffer != nullptr &&
+      inference_task_handle != nullptr)
   {
-    // Check if we have at least 10 frames
-    if (frame_count < NUM_FRAMES)
+    // Check if we have a full window
+    int64_t t_copy_start = esp_timer_get_time();
+    if (frames_published.load(std::memory_order_acquire) < (uint32_t)num_frames)
     {
       return; // Not enough frames yet
     }
+#ifdef ADAPTIVE_INFERENCE_SKIP
+    // Keep the last result while nothing moves, but not for too long
+    if (scene_unchanged && consecutive_skips < MAX_SKIPPED_FRAMES)
+    {
+      consecutive_skips++;
+      skipped_frames.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    consecutive_skips = 0;
+    reference_seq = frames_published.load(std::memory_order_relaxed) - 1;
+#endif
+    inference_requested.store(true, std::memory_order_release);
+    stage_record(g_frame_copy_latency, esp_timer_get_time() - t_copy_start);
+
+    // Wake the inference task
+    inference_notify_us.store(esp_timer_get_time(), std::memory_order_relaxed);
+    trace_event(TRACE_INFER_REQUEST);
+    xTaskNotifyGive(inference_task_handle);
+  }
+}
 
-    // Use mutex to safely copy frame buffer from core 0 to core 1
-    if (xSemaphoreTake(depth_mutex, pdMS_TO_TICKS(5)) == pdTRUE)
+bool inference_in_progress()
+{
+  return inference_requested.load(std::memory_order_acquire);
+}
+
+// Add new frame to circular buffer (called from depth sensor task)
+void add_frame_to_buffer(int64_t arrival_us)
+{
+  add_depth_map_to_buffer(depthMap, imageRows, imageCols, arrival_us);
+}
+
+namespace
+{
+  // Ring slot for the next frame. Fill it, then hand it to publish_frame().
+  frame_sample_t *claim_frame_slot(uint32_t *seq)
+  {
+    *seq = frames_published.load(std::memory_order_relaxed);
+
+    // Order the previous publish before any write into the next slot, so a
+    // reader that sees these writes also sees the published count move past its window
+    std::atomic_thread_fence(std::memory_order_release);
+    return &frame_buffer[(*seq % ring_slots) * frame_size];
+  }
+
+  void publish_frame(uint32_t seq, const frame_sample_t *current_frame, int64_t t_add_start, int64_t arrival_us)
+  {
+#ifdef ADAPTIVE_INFERENCE_SKIP
+    // Cheap scene-change metric for request_inference(), against the last frame that was inferred
+    scene_unchanged = false;
+    if (reference_seq != NO_REFERENCE && seq > reference_seq && seq - reference_seq < (uint32_t)ring_slots)
     {
-      // Copy all 10 frames to inference buffer for computation
-      int64_t t_copy_start = esp_timer_get_time();
-      memcpy(inference_buffer, frame_buffer, NUM_FRAMES * FRAME_SIZE * sizeof(float));
-      acc_frame_copy_us += esp_timer_get_time() - t_copy_start;
-      xSemaphoreGive(depth_mutex);
+      last_scene_change = frame_difference(current_frame, &frame_buffer[(reference_seq % ring_slots) * frame_size]);
+      scene_unchanged = last_scene_change < SKIP_THRESHOLD_LSB;
+    }
+#endif
+
+    // Publish the frame to the inference task
+    frame_arrival_us[seq % ring_slots] = arrival_us != 0 ? arrival_us : t_add_start;
+    frames_published.store(seq + 1, std::memory_order_release);
+#ifdef PIPELINED_INPUT
+    // Counted in the add-frame time, it moved there from the input fill
+    if (pipelined_input && seq + 1 >= (uint32_t)num_frames)
+    {
+      stage_window(seq + 1, frame_arrival_us[seq % ring_slots]);
+    }
+#endif
 
-      inference_requested = true;
+    stage_record(g_add_frame_latency, esp_timer_get_time() - t_add_start);
+    trace_event(TRACE_FRAME_ADDED, (int32_t)(seq + 1));
+  }
+} // namespace
+
+// Only one caller may add frames at a time (the depth sensor task, or the replay benchmark)
+void add_depth_map_to_buffer(const float *depth_map, int rows, int cols, int64_t arrival_us)
+{
+  if (frame_buffer == nullptr || input == nullptr)
+  {
+    return;
+  }
+
+  int64_t t_add_start = esp_timer_get_time();
+  uint32_t seq;
+
+  // Rotate 90° clockwise, then pool/crop to the model's frame size
+  frame_sample_t *current_frame = claim_frame_slot(&seq);
+
+#ifdef QUANTIZE_ON_INGEST
+  if (rows == INPUT_KERNEL_SRC_SIZE && cols == INPUT_KERNEL_SRC_SIZE &&
+      frame_rows == INPUT_KERNEL_DST_SIZE && frame_cols == INPUT_KERNEL_DST_SIZE)
+  {
+    ingest_frame_scalar(reinterpret_cast<const float(*)[INPUT_KERNEL_SRC_SIZE]>(depth_map), current_frame,
+                        input->params.scale, input->params.zero_point);
+  }
+  else
+  {
+    resample_frame(depth_map, rows, cols, resample_scratch, frame_rows, frame_cols);
+    for (int i = 0; i < frame_size; i++)
+    {
+      current_frame[i] = quantize_input(resample_scratch[i]);
     }
   }
+#else
+  // Normalized depth in [0, 1] (depth sensor range: 0-2550mm)
+  resample_frame(depth_map, rows, cols, current_frame, frame_rows, frame_cols);
+#endif
+
+  publish_frame(seq, current_frame, t_add_start, arrival_us);
 }
 
-// Add new frame to circular buffer (called from depth sensor task)
-void add_frame_to_buffer()
+// Raw sensor bytes to the model input in one pass: one table lookup per pixel
+// through a precomputed rotation/crop map, no millimetre floats in between
+void add_raw_frame_to_buffer(const uint8_t *pixels, int rows, int cols, int64_t arrival_us)
 {
-  if (frame_buffer == nullptr || depth_mutex == nullptr)
+  if (frame_buffer == nullptr || input == nullptr)
   {
     return;
   }
 
-  // Use mutex to safely update frame buffer
-  if (xSemaphoreTake(depth_mutex, pdMS_TO_TICKS(5)) == pdTRUE)
+#ifdef QUANTIZE_ON_INGEST
+  if (rows == INPUT_KERNEL_SRC_SIZE && cols == INPUT_KERNEL_SRC_SIZE &&
+      frame_rows == INPUT_KERNEL_DST_SIZE && frame_cols == INPUT_KERNEL_DST_SIZE)
   {
     int64_t t_add_start = esp_timer_get_time();
-    // Get depth sensor data (25x25), rotate 90° clockwise, then crop to 24x24
-    // For 90° clockwise rotation: rotated[i][j] = original[24-j][i]
-    float *current_frame = &frame_buffer[buffer_index * FRAME_SIZE];
 
-    for (int row = 0; row < 24; row++)
+    // The table depends on the input quantization, which changes with the model
+    if (input->params.scale != raw_lut_scale || input->params.zero_point != raw_lut_zero_point)
     {
-      for (int col = 0; col < 24; col++)
-      {
-        // Apply 90° clockwise rotation, then crop center 24x24
-        int src_row = 24 - col; // For clockwise: new_row comes from flipped col
-        int src_col = row;      // For clockwise: new_col comes from row
+      build_raw_input_lut(depth_mm_lut.mm, raw_input_lut, input->params.scale, input->params.zero_point);
+      raw_lut_scale = input->params.scale;
+      raw_lut_zero_point = input->params.zero_point;
+    }
+    memcpy(last_raw_frame, pixels, sizeof(last_raw_frame));
+    last_raw_frame_default = true;
+
+    uint32_t seq;
+    frame_sample_t *current_frame = claim_frame_slot(&seq);
+    ingest_raw_frame(pixels, current_frame, raw_input_lut);
+    publish_frame(seq, current_frame, t_add_start, arrival_us);
+    return;
+  }
+#endif
+
+  // Other shapes pool in millimetres, so go through the generic path
+  for (int i = 0; i < rows * cols; i++)
+    mm_scratch[i] = depth_mm_lut.mm[pixels[i]];
+  add_depth_map_to_buffer(mm_scratch, rows, cols, arrival_us);
+}
 
-        float depth_value = depthMap[src_row][src_col];
+// Called from the depth sensor task (the only writer), so no lock is needed.
+// A window read that is in progress on core 1 sees the count go backwards and
+// is discarded.
+void reset_frame_buffer()
+{
+  if (frame_buffer == nullptr)
+    return;
 
-        // Normalize depth to [0, 1] range (depth sensor range: 0-2550mm)
-        float normalized = depth_value / 2550.0f;
-        normalized = normalized > 1.0f ? 1.0f : normalized; // Clamp to [0, 1]
+  // Before the count restarts, so a reader that sees the new count sees the new epoch
+  reset_epoch.fetch_add(1, std::memory_order_release);
+  frames_published.store(0, std::memory_order_release);
+  inference_requested.store(false, std::memory_order_release);
+  results_reset_us.store(esp_timer_get_time(), std::memory_order_release); // Old results don't count as fresh
+#ifdef ADAPTIVE_INFERENCE_SKIP
+  reference_seq = NO_REFERENCE;
+  scene_unchanged = false;
+  consecutive_skips = 0;
+#endif
+#ifdef PIPELINED_INPUT
+  reset_staged_windows();
+#endif
+}
+
+namespace
+{
+  // Read a model file into an aligned PSRAM buffer and check that it is a
+  // valid TFLite flatbuffer. Returns nullptr if there is no usable file.
+  uint8_t *load_sd_model(const char *path, size_t *len)
+  {
+    bool exists = false;
+    if (sd_card_file_exists(path, &exists) != ESP_OK || !exists)
+    {
+      MicroPrintf("No %s on the SD card, using the bundled model", path);
+      return nullptr;
+    }
+    size_t size = 0;
+    FILE *fp = nullptr;
+    if (sd_card_get_file_size(path, &size) != ESP_OK || size == 0 ||
+        (fp = sd_card_fopen(path, "rb")) == nullptr)
+    {
+      MicroPrintf("Cannot open %s, using the bundled model", path);
+      return nullptr;
+    }
+
+    int64_t t_start = esp_timer_get_time();
+    // Flatbuffers need at least 16-byte alignment for their int64/double fields
+    uint8_t *data = (uint8_t *)heap_caps_aligned_alloc(16, size, MALLOC_CAP_SPIRAM);
+    size_t bytes_read = data != nullptr ? fread(data, 1, size, fp) : 0;
+    fclose(fp);
+    if (bytes_read != size)
+    {
+      MicroPrintf("Failed to read %s (%d of %d bytes), using the bundled model", path, (int)bytes_read, (int)size);
+      heap_caps_free(data);
+      return nullptr;
+    }
+
+    flatbuffers::Verifier verifier(data, size);
+    if (!tflite::VerifyModelBuffer(verifier))
+    {
+      MicroPrintf("%s is not a valid TFLite model, using the bundled model", path);
+      heap_caps_free(data);
+      return nullptr;
+    }
+
+    MicroPrintf("Loaded %s: %d bytes in %.1f ms", path, (int)size,
+                static_cast<double>((float)(esp_timer_get_time() - t_start) / 1000.0f));
+    *len = size;
+    return data;
+  }
+
+#ifdef SLIDING_WINDOW_INPUT
+  void release_sliding_window()
+  {
+    memory_free("model_copy", model_ram);
+    memory_free("window_tensor", window_tensor);
+    memory_free("conv_filter_original", conv_filter_original);
+    model_ram = nullptr;
+    window_tensor = nullptr;
+    conv_filter_original = nullptr;
+    conv_filter = nullptr;
+    window_written_end = 0;
+    sliding_window_enabled = false;
+  }
 
-        current_frame[row * 24 + col] = normalized;
+  // The first Conv2D filter gets rotated at runtime, so the model has to be in
+  // RAM. A writable model (loaded from SD) is used in place, a read-only one
+  // (g_model in flash) is copied to PSRAM first: the weights are streamed
+  // through the cache once per Invoke() either way, from flash or from PSRAM.
+  // Switches `model` to the RAM copy on success.
+  void setup_sliding_window(const uint8_t *data, size_t len, bool writable)
+  {
+    const uint8_t *ram_data = data;
+    if (!writable)
+    {
+      model_ram = (uint8_t *)memory_alloc("model_copy", len, MEMORY_COLD);
+      if (model_ram != nullptr)
+      {
+        memcpy(model_ram, data, len);
+      }
+      ram_data = model_ram;
+    }
+    window_tensor = (int8_t *)memory_alloc("window_tensor", frame_size * num_frames, MEMORY_HOT);
+    if (ram_data != nullptr && window_tensor != nullptr)
+    {
+      conv_filter = find_input_conv_filter(tflite::GetModel(ram_data), &conv_filter_rows);
+      if (conv_filter != nullptr)
+      {
+        conv_filter_original = (int8_t *)memory_alloc("conv_filter_original", conv_filter_rows * num_frames, MEMORY_HOT);
       }
     }
+    if (conv_filter_original != nullptr)
+    {
+      memcpy(conv_filter_original, conv_filter, conv_filter_rows * num_frames);
+      conv_filter_offset = 0;
+      model = tflite::GetModel(ram_data);
+      sliding_window_enabled = true;
+      MicroPrintf("Sliding window input enabled (first Conv2D filter: %d x %d)", conv_filter_rows, num_frames);
+    }
+    else
+    {
+      release_sliding_window();
+      MicroPrintf("Sliding window input unavailable, filling the full window per inference");
+    }
+  }
+#endif
 
-    // Update circular buffer index
-    buffer_index = (buffer_index + 1) % NUM_FRAMES;
-    frame_count++;
+  // ---- Tensor arena ----
+  // Take the arena in exactly `placement`, `size` bytes for both sections
+  bool arena_alloc(tensor_arena_t *a, arena_placement_t placement, int size)
+  {
+    *a = {placement, nullptr, size, nullptr, 0};
+    if (placement == ARENA_SPLIT)
+    {
+      if (size <= ARENA_PERSISTENT_SIZE)
+      {
+        return false;
+      }
+      a->size = size - ARENA_PERSISTENT_SIZE;
+      a->persistent_size = ARENA_PERSISTENT_SIZE;
+      a->persistent = (uint8_t *)heap_caps_aligned_alloc(16, a->persistent_size, MALLOC_CAP_SPIRAM);
+      if (a->persistent == nullptr)
+      {
+        return false;
+      }
+    }
+    uint32_t caps = placement == ARENA_PSRAM ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    a->arena = (uint8_t *)heap_caps_aligned_alloc(16, a->size, caps);
+    if (a->arena == nullptr)
+    {
+      heap_caps_free(a->persistent);
+      a->persistent = nullptr;
+      return false;
+    }
+    return true;
+  }
 
-    acc_add_frame_us += esp_timer_get_time() - t_add_start;
-    xSemaphoreGive(depth_mutex);
+  void arena_free(tensor_arena_t *a)
+  {
+    heap_caps_free(a->arena);
+    heap_caps_free(a->persistent);
+    a->arena = nullptr;
+    a->persistent = nullptr;
   }
-}
 
-void reset_frame_buffer()
-{
-  if (frame_buffer == nullptr || depth_mutex == nullptr)
-    return;
+  // Place tensor_arena in the first placement from `first` on that has room
+  bool arena_place(arena_placement_t first)
+  {
+    bool placed = false;
+    for (int p = first; p < ARENA_PLACEMENT_COUNT && !placed; p++)
+    {
+      placed = arena_alloc(&tensor_arena, (arena_placement_t)p, tensor_arena_size);
+    }
+    if (!placed)
+    {
+      MicroPrintf("Failed to allocate tensor arena (%d bytes)", tensor_arena_size);
+      return false;
+    }
+    memory_report_add("tensor_arena", tensor_arena.arena, tensor_arena.size);
+    memory_report_add("tensor_arena_persistent", tensor_arena.persistent, tensor_arena.persistent_size);
+    MicroPrintf("Tensor arena: %d bytes, placement %s%s", tensor_arena_size, kArenaPlacementNames[tensor_arena.placement],
+                tensor_arena.placement == ARENA_SPLIT ? " (persistent section in PSRAM)" : "");
+    return true;
+  }
 
-  if (xSemaphoreTake(depth_mutex, pdMS_TO_TICKS(50)) == pdTRUE)
+  // Interpreter for `m` in arena `a`, constructed in `storage`. nullptr
+  // without an arena.
+  tflite::MicroInterpreter *arena_interpreter(uint8_t *storage, const tflite::Model *m, const tensor_arena_t *a)
   {
-    memset(frame_buffer, 0, NUM_FRAMES * FRAME_SIZE * sizeof(float));
-    frame_count = 0;
-    buffer_index = 0;
-    inference_requested = false;
-    xSemaphoreGive(depth_mutex);
+    if (a->arena == nullptr)
+    {
+      return nullptr;
+    }
+    if (a->persistent == nullptr)
+    {
+      return new (storage) tflite::MicroInterpreter(m, resolver, a->arena, a->size, nullptr, &g_op_profiler);
+    }
+    tflite::MicroAllocator *allocator = tflite::MicroAllocator::Create(a->persistent, a->persistent_size, a->arena, a->size);
+    if (allocator == nullptr)
+    {
+      return nullptr;
+    }
+    return new (storage) tflite::MicroInterpreter(m, resolver, allocator, nullptr, &g_op_profiler);
   }
-}
 
-// The name of this function is important for Arduino compatibility.
-void setup()
-{
-  vTaskDelay(pdMS_TO_TICKS(100)); // 100ms delay before init
-  // xTaskCreate(depth_sensor_task, "depth_sensor_task", 8192, NULL, 5, NULL);
-  sd_card_config_t config = sd_card_get_default_config();
-  esp_err_t ret = sd_card_init(&config);
-  if (ret == ESP_OK)
+#ifdef ARENA_PLACEMENT_BENCH
+  // Mean Invoke() over ARENA_PLACEMENT_BENCH runs on whatever the input holds, -1 on failure
+  int32_t time_invokes(tflite::MicroInterpreter *bench_interpreter)
   {
-    ESP_LOGI("MAIN", "SD card initialized successfully!");
-    sd_card_print_info();
+    int64_t total_us = 0;
+    for (int i = 0; i < ARENA_PLACEMENT_BENCH; i++)
+    {
+      g_op_profiler.begin_inference(); // Without end_inference() the runs stay out of GET_OP_PROFILE
+      int64_t t_start = esp_timer_get_time();
+      if (bench_interpreter->Invoke() != kTfLiteOk)
+      {
+        return -1;
+      }
+      total_us += esp_timer_get_time() - t_start;
+    }
+    return (int32_t)(total_us / ARENA_PLACEMENT_BENCH);
   }
-  else
+
+  // Time the loaded model in every arena placement before the inference task
+  // starts. The placement in use runs in place, the others on a temporary
+  // arena and interpreter if there is room for them next to it.
+  void bench_arena_placements()
   {
-    ESP_LOGE("MAIN", "SD card init failed: %s", esp_err_to_name(ret));
+    alignas(tflite::MicroInterpreter) static uint8_t bench_storage[sizeof(tflite::MicroInterpreter)];
+    for (int p = 0; p < ARENA_PLACEMENT_COUNT; p++)
+    {
+      if (p == tensor_arena.placement)
+      {
+        arena_bench_us[p] = time_invokes(interpreter);
+        continue;
+      }
+      tensor_arena_t bench_arena;
+      if (!arena_alloc(&bench_arena, (arena_placement_t)p, tensor_arena_size))
+      {
+        continue;
+      }
+      tflite::MicroInterpreter *bench_interpreter = arena_interpreter(bench_storage, model, &bench_arena);
+      if (bench_interpreter != nullptr && bench_interpreter->AllocateTensors() == kTfLiteOk)
+      {
+        memcpy(bench_interpreter->input(0)->data.int8, input->data.int8, input->bytes);
+        arena_bench_us[p] = time_invokes(bench_interpreter);
+      }
+      if (bench_interpreter != nullptr)
+      {
+        bench_interpreter->~MicroInterpreter();
+      }
+      arena_free(&bench_arena);
+    }
+
+    MicroPrintf("Arena placements, mean Invoke() over %d runs:", ARENA_PLACEMENT_BENCH);
+    int32_t in_use_us = arena_bench_us[tensor_arena.placement];
+    for (int p = 0; p < ARENA_PLACEMENT_COUNT; p++)
+    {
+      if (arena_bench_us[p] < 0)
+      {
+        MicroPrintf("  %-8s : no room", kArenaPlacementNames[p]);
+      }
+      else if (p == tensor_arena.placement || in_use_us <= 0)
+      {
+        MicroPrintf("  %-8s : %.2f ms%s", kArenaPlacementNames[p],
+                    static_cast<double>((float)arena_bench_us[p] / 1000.0f),
+                    p == tensor_arena.placement ? " <- in use" : "");
+      }
+      else
+      {
+        MicroPrintf("  %-8s : %.2f ms (%+.1f%% against the one in use)", kArenaPlacementNames[p],
+                    static_cast<double>((float)arena_bench_us[p] / 1000.0f),
+                    static_cast<double>(100.0f * (float)(arena_bench_us[p] - in_use_us) / (float)in_use_us));
+      }
+    }
   }
+#endif
 
-  depth_sensor_init();
-  xTaskCreatePinnedToCore(sd_writer_task, "sd_writer", 4096, NULL, 5, NULL, 1);
-  drive_system_setup();
-  setup_leds();
-  serial_commands_init();
+  // Build the interpreter for the model in `data` and check that its tensors
+  // match the frame window and the two outputs (or a single output for the
+  // front half of a split model). Leaves nothing allocated on failure.
+  bool init_model(const uint8_t *data, size_t len, bool writable, const char *source, bool split_front = false)
+  {
+    int64_t t_start = esp_timer_get_time();
 
-  // Allocate frame buffer for last 10 frames (24x24 each)
-  frame_buffer = (float *)malloc(NUM_FRAMES * FRAME_SIZE * sizeof(float));
-  if (frame_buffer == nullptr)
+    // Map the model into a usable data structure. This doesn't involve any
+    // copying or parsing, it's a very lightweight operation.
+    model = tflite::GetModel(data);
+    if (model->version() != TFLITE_SCHEMA_VERSION)
+    {
+      MicroPrintf("Model from %s is schema version %d not equal to supported "
+                  "version %d.",
+                  source, model->version(), TFLITE_SCHEMA_VERSION);
+      return false;
+    }
+    if (!read_input_frame_shape(model, &frame_rows, &frame_cols, &num_frames))
+    {
+      MicroPrintf("Model from %s doesn't take a (1, H, W, frames) window with %d to %d frames", source,
+                  MIN_WINDOW_FRAMES, MAX_WINDOW_FRAMES);
+      return false;
+    }
+    frame_size = frame_rows * frame_cols;
+    window_kernels = find_window_kernels(num_frames);
+    ring_slots = num_frames + RING_SPARE_SLOTS;
+
+#ifdef SLIDING_WINDOW_INPUT
+    setup_sliding_window(data, len, writable);
+#endif
+
+    // Build an interpreter to run the model with, timing every op for GET_OP_PROFILE.
+    interpreter = arena_interpreter(interpreter_storage, model, &tensor_arena);
+
+    // Allocate memory from the tensor_arena for the model's tensors.
+    TfLiteStatus allocate_status = interpreter != nullptr ? interpreter->AllocateTensors() : kTfLiteError;
+    if (allocate_status != kTfLiteOk && tensor_arena.placement == ARENA_SPLIT)
+    {
+      // A section is too small for this model; the whole budget in one PSRAM block is not
+      MicroPrintf("Split arena too small for the model from %s, moving the arena to PSRAM", source);
+      if (interpreter != nullptr)
+      {
+        interpreter->~MicroInterpreter();
+      }
+      arena_free(&tensor_arena);
+      interpreter = arena_place(ARENA_PSRAM) ? arena_interpreter(interpreter_storage, model, &tensor_arena) : nullptr;
+      allocate_status = interpreter != nullptr ? interpreter->AllocateTensors() : kTfLiteError;
+    }
+    bool tensors_ok = allocate_status == kTfLiteOk && interpreter->outputs_size() >= (split_front ? 1u : 2u);
+    if (tensors_ok)
+    {
+      // Obtain pointers to the model's input and output tensors.
+      input = interpreter->input(0);
+      // IMPORTANT: Output 0 is THROTTLE, Output 1 is STEERING (based on training code)
+      // A split front has only the intermediate tensor; both then point at it until the head takes over.
+      output_throttle = interpreter->output(0);                      // First output: throttle
+      output_steering = interpreter->output(split_front ? 0 : 1);    // Second output: steering
+      tensors_ok = input->type == kTfLiteInt8 && input->bytes == (size_t)(frame_size * num_frames) &&
+                   output_throttle->type == kTfLiteInt8 && output_steering->type == kTfLiteInt8;
+    }
+    if (!tensors_ok)
+    {
+      MicroPrintf(allocate_status != kTfLiteOk ? "AllocateTensors() failed for model from %s"
+                                               : "Model from %s doesn't take a %dx%dx%d int8 window with two int8 outputs",
+                  source, frame_rows, frame_cols, num_frames);
+      if (interpreter != nullptr)
+      {
+        interpreter->~MicroInterpreter();
+      }
+      interpreter = nullptr;
+      input = nullptr;
+      output_throttle = nullptr;
+      output_steering = nullptr;
+#ifdef SLIDING_WINDOW_INPUT
+      release_sliding_window();
+#endif
+      return false;
+    }
+
+    // Feed this back with -DTINYNAV_ARENA_USED_BYTES to size the arena exactly
+    MicroPrintf("Model from %s ready in %.1f ms: %d bytes, arena used %d of %d bytes (%d ops registered)",
+                source, static_cast<double>((float)(esp_timer_get_time() - t_start) / 1000.0f), (int)len,
+                (int)interpreter->arena_used_bytes(), tensor_arena_size, kModelOpCount);
+    return true;
+  }
+
+#ifdef SPLIT_MODEL_PIPELINE
+  bool split_models_present()
   {
-    MicroPrintf("Failed to allocate frame buffer");
-    return;
+    bool front = false, head = false;
+    return sd_card_file_exists(SD_FRONT_MODEL_PATH, &front) == ESP_OK && front &&
+           sd_card_file_exists(SD_HEAD_MODEL_PATH, &head) == ESP_OK && head;
   }
-  memset(frame_buffer, 0, NUM_FRAMES * FRAME_SIZE * sizeof(float));
-  MicroPrintf("Frame buffer allocated: %d bytes", NUM_FRAMES * FRAME_SIZE * sizeof(float));
 
-  // Allocate inference buffer for snapshot during computation
-  inference_buffer = (float *)malloc(NUM_FRAMES * FRAME_SIZE * sizeof(float));
-  if (inference_buffer == nullptr)
+  void release_split_models()
   {
-    MicroPrintf("Failed to allocate inference buffer");
-    return;
+    if (head_interpreter != nullptr)
+    {
+      head_interpreter->~MicroInterpreter();
+      head_interpreter = nullptr;
+    }
+    if (interpreter != nullptr)
+    {
+      interpreter->~MicroInterpreter();
+      interpreter = nullptr;
+    }
+#ifdef SLIDING_WINDOW_INPUT
+    release_sliding_window();
+#endif
+    heap_caps_free(sd_model);
+    heap_caps_free(head_model);
+    heap_caps_free(head_arena);
+    memory_free("head_job", head_job);
+    sd_model = nullptr;
+    head_model = nullptr;
+    head_arena = nullptr;
+    head_job = nullptr;
+    input = nullptr;
+    front_output = nullptr;
+    head_input = nullptr;
   }
-  MicroPrintf("Inference buffer allocated: %d bytes", NUM_FRAMES * FRAME_SIZE * sizeof(float));
 
-  // Allocate tensor arena in PSRAM (External SPIRAM)
-  tensor_arena = (uint8_t *)heap_caps_malloc(kTensorArenaSize, MALLOC_CAP_SPIRAM);
-  if (tensor_arena == nullptr)
+  // Load both halves from the SD card. The front runs in the main arena with
+  // the usual interpreter, the head gets its own small arena.
+  bool init_split_models()
   {
-    MicroPrintf("Failed to allocate tensor arena in PSRAM");
-    return;
+    if (!split_models_present())
+    {
+      return false;
+    }
+    size_t front_len = 0, head_len = 0;
+    sd_model = load_sd_model(SD_FRONT_MODEL_PATH, &front_len);
+    head_model = load_sd_model(SD_HEAD_MODEL_PATH, &head_len);
+    head_arena = (uint8_t *)heap_caps_aligned_alloc(16, kHeadArenaSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (sd_model == nullptr || head_model == nullptr || head_arena == nullptr ||
+        !init_model(sd_model, front_len, true, "SD card (front)", true))
+    {
+      release_split_models();
+      return false;
+    }
+    front_output = interpreter->output(0);
+
+    const tflite::Model *head = tflite::GetModel(head_model);
+    bool head_ok = head->version() == TFLITE_SCHEMA_VERSION;
+    if (head_ok)
+    {
+      head_interpreter = new (head_interpreter_storage) tflite::MicroInterpreter(
+          head, resolver, head_arena, kHeadArenaSize);
+      head_ok = head_interpreter->AllocateTensors() == kTfLiteOk && head_interpreter->outputs_size() >= 2;
+    }
+    if (head_ok)
+    {
+      head_input = head_interpreter->input(0);
+      head_ok = head_input->type == kTfLiteInt8 && head_input->bytes == front_output->bytes &&
+                head_interpreter->output(0)->type == kTfLiteInt8 && head_interpreter->output(1)->type == kTfLiteInt8;
+    }
+    size_t job_size = sizeof(head_job_t) + front_output->bytes;
+    head_job = head_ok ? (head_job_t *)memory_alloc("head_job", job_size, MEMORY_HOT) : nullptr;
+    if (head_ok && head_queue == nullptr)
+    {
+      head_queue = xQueueCreate(1, job_size);
+    }
+    if (head_job == nullptr || head_queue == nullptr)
+    {
+      MicroPrintf("Head model from %s doesn't match the front output (%d int8 values) or is out of memory",
+                  SD_HEAD_MODEL_PATH, (int)front_output->bytes);
+      release_split_models();
+      return false;
+    }
+
+    MicroPrintf("Split model: front %d bytes, head %d bytes, %d values handed over, head arena used %d of %d bytes",
+                (int)front_len, (int)head_len, (int)front_output->bytes,
+                (int)head_interpreter->arena_used_bytes(), kHeadArenaSize);
+    split_enabled = true;
+    return true;
   }
-  MicroPrintf("Tensor arena allocated in PSRAM: %d bytes", kTensorArenaSize);
+#endif
 
-  // Map the model into a usable data structure. This doesn't involve any
-  // copying or parsing, it's a very lightweight operation.
-  model = tflite::GetModel(g_model);
-  if (model->version() != TFLITE_SCHEMA_VERSION)
+#ifdef CASCADED_INFERENCE
+  void release_gate_model()
   {
-    MicroPrintf("Model provided is schema version %d not equal to supported "
-                "version %d.",
-                model->version(), TFLITE_SCHEMA_VERSION);
-    return;
+    if (gate_interpreter != nullptr)
+    {
+      gate_interpreter->~MicroInterpreter();
+      gate_interpreter = nullptr;
+    }
+    heap_caps_free(gate_model);
+    heap_caps_free(gate_arena);
+    gate_model = nullptr;
+    gate_arena = nullptr;
+    gate_input = nullptr;
   }
 
-  static tflite::MicroMutableOpResolver<21> resolver;
-
-  resolver.AddConv2D();
-  resolver.AddDepthwiseConv2D();
-  resolver.AddShape();
-  resolver.AddStridedSlice();
-  resolver.AddPack();
-  resolver.AddReshape();
-  resolver.AddAdd();
-  resolver.AddFullyConnected();
-  resolver.AddTranspose();
-  resolver.AddBatchMatMul();
-  resolver.AddMul();
-  resolver.AddSoftmax();
-  resolver.AddMean();
-  resolver.AddDequantize();
-  resolver.AddNeg();
-  resolver.AddQuantize();
-  resolver.AddSquaredDifference();
-  resolver.AddRsqrt();
-  resolver.AddTanh();
-  resolver.AddLogistic();
-  resolver.AddConcatenation();
-
-  // Pull in only the operation implementations we need.
-  // Model uses: Conv2D, DepthwiseConv2D, ReLU6, GlobalAveragePooling2D (Mean), FullyConnected, Tanh
-  // static tflite::MicroMutableOpResolver<18> resolver;
-  // resolver.AddConv2D();
-  // resolver.AddDepthwiseConv2D();
-  // resolver.AddMean(); // GlobalAveragePooling2D becomes Mean
-  // resolver.AddFullyConnected();
-  // resolver.AddRelu6();
-  // resolver.AddTanh();
-  // resolver.AddLogistic();
-  // resolver.AddMul();
-  // resolver.AddConcatenation();
-  // resolver.AddMaxPool2D();
-  // resolver.AddAdd();
-  // resolver.AddSpaceToBatchNd();
-  // resolver.AddBatchToSpaceNd();
-  // resolver.AddReduceMax();
-  // resolver.AddReshape();
-  // resolver.AddShape();
-  // resolver.AddStridedSlice();
-  // resolver.AddPack();
-
-  // static tflite::MicroMutableOpResolver<8> resolver;
-  // resolver.AddConv2D();
-  // resolver.AddDepthwiseConv2D();
-  // resolver.AddMean();    // For GlobalAveragePooling2D
-  // resolver.AddReshape(); // <--- Often needed between Pooling and Dense
-  // resolver.AddFullyConnected();
-  // resolver.AddHardSwish();
-  // resolver.AddTanh();
-  // resolver.AddLogistic();
-
-  // Build an interpreter to run the model with.
-  static tflite::MicroInterpreter static_interpreter(
-      model, resolver, tensor_arena, kTensorArenaSize);
-  interpreter = &static_interpreter;
-
-  // Allocate memory from the tensor_arena for the model's tensors.
-  TfLiteStatus allocate_status = interpreter->AllocateTensors();
-  if (allocate_status != kTfLiteOk)
-  {
-    MicroPrintf("AllocateTensors() failed");
-    return;
+  // Load the gate model next to the main one, which decided the input shape.
+  // The full model's input tensor is copied into the gate's as it is, so both
+  // have to take the same window with the same quantization. Not with a split
+  // model: head_task() publishes its results, and a result channel has one
+  // writer (control_state.h).
+  void init_gate_model()
+  {
+    bool present = false;
+    if (sd_card_file_exists(SD_GATE_MODEL_PATH, &present) != ESP_OK || !present)
+    {
+      return;
+    }
+    if (split_enabled)
+    {
+      MicroPrintf("Gate model on %s ignored: the split model's head task publishes the results", SD_GATE_MODEL_PATH);
+      return;
+    }
+    size_t gate_len = 0;
+    gate_model = load_sd_model(SD_GATE_MODEL_PATH, &gate_len);
+    gate_arena = (uint8_t *)heap_caps_aligned_alloc(16, kGateArenaSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    bool gate_ok = gate_model != nullptr && gate_arena != nullptr;
+    if (gate_ok)
+    {
+      const tflite::Model *gate = tflite::GetModel(gate_model);
+      gate_ok = gate->version() == TFLITE_SCHEMA_VERSION;
+      if (gate_ok)
+      {
+        gate_interpreter = new (gate_interpreter_storage) tflite::MicroInterpreter(
+            gate, resolver, gate_arena, kGateArenaSize);
+        gate_ok = gate_interpreter->AllocateTensors() == kTfLiteOk && gate_interpreter->outputs_size() >= 3;
+      }
+    }
+    if (gate_ok)
+    {
+      gate_input = gate_interpreter->input(0);
+      gate_ok = gate_input->type == kTfLiteInt8 && gate_input->bytes == input->bytes &&
+                gate_input->params.scale == input->params.scale &&
+                gate_input->params.zero_point == input->params.zero_point;
+      for (int i = 0; i < 3 && gate_ok; i++)
+      {
+        gate_ok = gate_interpreter->output(i)->type == kTfLiteInt8;
+      }
+    }
+    if (!gate_ok)
+    {
+      MicroPrintf("Gate model from %s doesn't fit (same int8 input as the main model, three int8 outputs) "
+                  "or is out of memory, running the full model on every window",
+                  SD_GATE_MODEL_PATH);
+      release_gate_model();
+      return;
+    }
+    MicroPrintf("Gate model: %d bytes, arena used %d of %d bytes, full model below confidence %.2f or every %d windows",
+                (int)gate_len, (int)gate_interpreter->arena_used_bytes(), kGateArenaSize,
+                static_cast<double>(GATE_CONFIDENCE_THRESHOLD), GATE_REFRESH_INFERENCES + 1);
+    gate_enabled = true;
   }
 
-  // Obtain pointers to the model's input and output tensors.
-  input = interpreter->input(0);
-  // IMPORTANT: Output 0 is THROTTLE, Output 1 is STEERING (based on training code)
-  output_throttle = interpreter->output(0); // First output: throttle
-  output_steering = interpreter->output(1); // Second output: steering
+  // Gate input in chronological channel order. With the sliding window the
+  // input tensor holds frame n in channel n % num_frames, for the rotated
+  // filter of the full model; the gate's filter is not rotated.
+  void fill_gate_input()
+  {
+#ifdef SLIDING_WINDOW_INPUT
+    int rotation = conv_filter_offset; // Of the window in the input, wherever it came from
+    if (sliding_window_enabled && rotation != 0)
+    {
+      window_kernels->rotate(input->data.int8, gate_input->data.int8, frame_size, num_frames - rotation);
+      return;
+    }
+#endif
+    memcpy(gate_input->data.int8, input->data.int8, input->bytes);
+  }
 
-  // Log input/output tensor shapes for debugging
-  MicroPrintf("Input shape: [%d, %d, %d, %d]",
-              input->dims->data[0], input->dims->data[1],
-              input->dims->data[2], input->dims->data[3]);
-  MicroPrintf("Output steering shape: [%d, %d]",
-              output_steering->dims->data[0], output_steering->dims->data[1]);
-  MicroPrintf("Output throttle shape: [%d, %d]",
-              output_throttle->dims->data[0], output_throttle->dims->data[1]);
+  // Run the gate on the filled input. True when its prediction was published
+  // and the full model can be skipped for this window.
+  bool run_gate()
+  {
+    int64_t t_start = esp_timer_get_time();
+    fill_gate_input();
+    TfLiteStatus status = gate_interpreter->Invoke();
+    int64_t gate_us = esp_timer_get_time() - t_start;
+    stage_record(g_gate_latency, gate_us);
+    gate_us_total.fetch_add(gate_us, std::memory_order_relaxed);
+    if (status != kTfLiteOk)
+    {
+      MicroPrintf("Gate Invoke failed");
+      return false;
+    }
 
-  // Keep track of how many inferences we have performed.
-  inference_count = 0;
+    const TfLiteTensor *confidence_tensor = gate_interpreter->output(2);
+    float confidence = (float)(confidence_tensor->data.int8[0] - confidence_tensor->params.zero_point) *
+                       confidence_tensor->params.scale;
+    if (confidence < GATE_CONFIDENCE_THRESHOLD)
+    {
+      gate_uncertain.fetch_add(1, std::memory_order_relaxed);
+      gated_in_a_row = 0;
+      return false;
+    }
+    if (gated_in_a_row >= GATE_REFRESH_INFERENCES)
+    {
+      gate_refreshes.fetch_add(1, std::memory_order_relaxed);
+      gated_in_a_row = 0;
+      return false;
+    }
+    gated_in_a_row++;
+    gate_gated.fetch_add(1, std::memory_order_relaxed);
+    trace_event(TRACE_GATED, (int32_t)(confidence * 1000.0f));
+    last_timing.invoke_us = gate_us;
+    store_prediction(gate_interpreter->output(0), gate_interpreter->output(1), window_arrival_us);
+    return true;
+  }
 
-  // Create mutex for thread-safe depth data access
-  depth_mutex = xSemaphoreCreateMutex();
-  if (depth_mutex == nullptr)
+  // Model time saved by the gate: every window would have cost the average
+  // full Invoke(), it cost the gate plus the full model when that ran
+  int32_t gate_saved_permille(const gate_stats_t &stats)
   {
-    MicroPrintf("Failed to create depth mutex");
-    return;
+    uint32_t full_runs = stats.uncertain + stats.refreshes;
+    uint32_t windows = full_runs + stats.gated;
+    if (full_runs == 0 || windows == 0)
+    {
+      return 0;
+    }
+    int64_t baseline_us = stats.full_us * windows / full_runs;
+    return baseline_us > 0 ? (int32_t)(1000 - (stats.gate_us + stats.full_us) * 1000 / baseline_us) : 0;
   }
+#endif
+} // namespace
 
-  // Create inference task on core 1
-  BaseType_t result = xTaskCreatePinnedToCore(
-      inference_task,         // Task function
-      "inference_task",       // Task name
-      8192,                   // Stack size (8KB)
-      nullptr,                // Parameters
-      5,                      // Priority (same as main loop)
-      &inference_task_handle, // Task handle
-      1                       // Pin to core 1
-  );
+// The name of this function is important for Arduino compatibility.
+namespace
+{
+  // ---- Boot steps (boot_init.h) ----
+  bool setup_sd_card()
+  {
+    sd_card_config_t config = sd_card_get_default_config();
+    esp_err_t ret = sd_card_init(&config);
+    if (ret != ESP_OK)
+    {
+      ESP_LOGE("MAIN", "SD card init failed: %s", esp_err_to_name(ret));
+      return false;
+    }
+    ESP_LOGI("MAIN", "SD card initialized successfully!");
+    sd_card_print_info();
+    return true;
+  }
 
-  if (result != pdPASS)
+  // Runs without a card too: logging then starts in the serial-only mode
+  bool setup_sd_log()
   {
-    MicroPrintf("Failed to create inference task on core 1");
-    return;
+    bool ok = depth_sensor_log_init();
+    xTaskCreatePinnedToCore(sd_writer_task, "sd_writer", SD_WRITER_TASK_STACK, NULL, SD_WRITER_TASK_PRIORITY, NULL,
+                            SD_WRITER_TASK_CORE);
+    memory_report_add_task("sd_writer", SD_WRITER_TASK_STACK);
+    flight_recorder_init(); // Writes a crash dump to the card straight away
+    return ok;
+  }
+
+  bool setup_drive()
+  {
+    drive_system_setup();
+    return true;
+  }
+
+  // Interpreter, arenas, frame ring and the inference task
+  bool setup_model()
+  {
+    // Conv2D, DepthwiseConv2D, FullyConnected, Mul, Add, etc. only get the
+    // ESP-NN (PIE SIMD) implementations when esp-tflite-micro is built with it
+#if CONFIG_NN_OPTIMIZED
+    MicroPrintf("ESP-NN optimized kernels: enabled");
+#else
+    MicroPrintf("ESP-NN optimized kernels: DISABLED (CONFIG_NN_OPTIMIZED not set), using reference kernels");
+#endif
+
+    // Pull in only the operation implementations the model uses (see model_ops.h)
+    if (register_model_ops(resolver) != kTfLiteOk)
+    {
+      MicroPrintf("Failed to register model ops");
+      return false;
+    }
+
+    // Prefer a model on the SD card over the bundled one
+    bool sd_models_present = false;
+    size_t sd_model_len = 0;
+#ifdef SPLIT_MODEL_PIPELINE
+    sd_models_present = split_models_present();
+    if (!sd_models_present)
+#endif
+    {
+      sd_model = load_sd_model(SD_MODEL_PATH, &sd_model_len);
+      sd_models_present = sd_model != nullptr;
+    }
+
+    // Allocate tensor arena in the best placement with room (see tensor_arena_t)
+    tensor_arena_size = sd_models_present && kSdModelArenaSize > kTensorArenaSize ? kSdModelArenaSize : kTensorArenaSize;
+    if (!arena_place(ARENA_INTERNAL))
+    {
+      return false;
+    }
+
+    bool model_ready = false;
+#ifdef SPLIT_MODEL_PIPELINE
+    model_ready = init_split_models();
+    if (!model_ready && sd_model == nullptr)
+    {
+      sd_model = load_sd_model(SD_MODEL_PATH, &sd_model_len);
+    }
+#endif
+    if (!model_ready && sd_model != nullptr)
+    {
+      model_ready = init_model(sd_model, sd_model_len, true, "SD card");
+      if (!model_ready)
+      {
+        heap_caps_free(sd_model);
+        sd_model = nullptr;
+        MicroPrintf("Falling back to the bundled model");
+      }
+    }
+    if (!model_ready && !init_model(g_model, g_model_len, false, "bundled g_model"))
+    {
+      return false;
+    }
+#ifdef CASCADED_INFERENCE
+    init_gate_model();
+#endif
+
+    // Allocate frame ring for the last num_frames frames plus spare slots, at the model's frame size
+    size_t frame_buffer_bytes = ring_slots * frame_size * sizeof(frame_sample_t);
+    frame_buffer = (frame_sample_t *)memory_alloc("frame_buffer", frame_buffer_bytes, MEMORY_HOT);
+    resample_scratch = (float *)memory_alloc("resample_scratch", frame_size * sizeof(float), MEMORY_HOT);
+    mm_scratch = (float *)memory_alloc("mm_scratch", MAX_FRAME_PIXELS * sizeof(float), MEMORY_HOT);
+    if (frame_buffer == nullptr || resample_scratch == nullptr || mm_scratch == nullptr)
+    {
+      MicroPrintf("Failed to allocate frame buffer");
+      memory_free("frame_buffer", frame_buffer);
+      frame_buffer = nullptr;
+      return false;
+    }
+    memset(frame_buffer, 0, frame_buffer_bytes);
+#ifdef PIPELINED_INPUT
+    setup_input_staging();
+#endif
+    MicroPrintf("Frame buffer allocated: %d bytes (%d slots of %dx%d frames from %dx%d sensor frames)",
+                (int)frame_buffer_bytes, ring_slots, frame_rows, frame_cols, MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
+
+    // Log input/output tensor shapes for debugging
+    MicroPrintf("Input shape: [%d, %d, %d, %d]",
+                input->dims->data[0], input->dims->data[1],
+                input->dims->data[2], input->dims->data[3]);
+#ifdef SPLIT_MODEL_PIPELINE
+    if (split_enabled)
+    {
+      // The head half runs next to the depth sensor loop
+      if (xTaskCreatePinnedToCore(head_task, "head_task", HEAD_TASK_STACK, nullptr, HEAD_TASK_PRIORITY,
+                                  &head_task_handle, HEAD_TASK_CORE) != pdPASS)
+      {
+        MicroPrintf("Failed to create head task on core %d", HEAD_TASK_CORE);
+        return false;
+      }
+      memory_report_add_task("head_task", HEAD_TASK_STACK);
+      MicroPrintf("Head task created on core %d", HEAD_TASK_CORE);
+    }
+    else
+#endif
+    {
+      MicroPrintf("Output steering shape: [%d, %d]",
+                  output_steering->dims->data[0], output_steering->dims->data[1]);
+      MicroPrintf("Output throttle shape: [%d, %d]",
+                  output_throttle->dims->data[0], output_throttle->dims->data[1]);
+    }
+
+#ifdef ARENA_PLACEMENT_BENCH
+    bench_arena_placements();
+#endif
+
+    // Keep track of how many inferences we have performed.
+    inference_count = 0;
+
+    // Create the inference task, on core 1 by default (task_layout.h)
+    BaseType_t result = xTaskCreatePinnedToCore(
+        inference_task,          // Task function
+        "inference_task",        // Task name
+        INFERENCE_TASK_STACK,    // Stack size
+        nullptr,                 // Parameters
+        INFERENCE_TASK_PRIORITY, // Priority
+        &inference_task_handle,  // Task handle
+        INFERENCE_TASK_CORE      // Core
+    );
+
+    if (result != pdPASS)
+    {
+      MicroPrintf("Failed to create inference task on core %d", INFERENCE_TASK_CORE);
+      return false;
+    }
+    memory_report_add_task("inference_task", INFERENCE_TASK_STACK);
+
+    MicroPrintf("Inference task created on core %d", INFERENCE_TASK_CORE);
+
+    // What the model setup kept; models read from the SD card are sized by
+    // the heap. The rest registered itself with memory_alloc().
+    if (sd_model != nullptr)
+    {
+      memory_report_add("sd_model", sd_model, heap_caps_get_allocated_size(sd_model));
+    }
+#ifdef SPLIT_MODEL_PIPELINE
+    if (split_enabled)
+    {
+      memory_report_add("head_model", head_model, heap_caps_get_allocated_size(head_model));
+      memory_report_add("head_arena", head_arena, kHeadArenaSize);
+    }
+#endif
+#ifdef CASCADED_INFERENCE
+    if (gate_enabled)
+    {
+      memory_report_add("gate_model", gate_model, heap_caps_get_allocated_size(gate_model));
+      memory_report_add("gate_arena", gate_arena, kGateArenaSize);
+    }
+#endif
+    return true;
   }
+} // namespace
 
-  MicroPrintf("Inference task created on core 1");
+void setup()
+{
+  vTaskDelay(pdMS_TO_TICKS(100)); // 100ms delay before init
+  power_init();
+  boot_init();
+  setup_leds(); // First, the LEDs show the boot progress
+
+  // The card (and the log file on it) and the model don't need the sensor:
+  // they set up on their own tasks while this one does the sensor handshake.
+  // The model waits for the card because it may load from it.
+  boot_start(BOOT_STEP_SD, setup_sd_card, 0, 0);
+  boot_start(BOOT_STEP_SD_LOG, setup_sd_log, BOOT_BIT(BOOT_STEP_SD), 0);
+  boot_start(BOOT_STEP_MODEL, setup_model, BOOT_BIT(BOOT_STEP_SD), 1);
+  memory_report_add_task("main", CONFIG_ESP_MAIN_TASK_STACK_SIZE);
+  boot_run(BOOT_STEP_DRIVE, setup_drive);
+  boot_run(BOOT_STEP_SENSOR, depth_sensor_init);
+
+  // Frames and serial commands only once everything they use is there
+  boot_wait(BOOT_ALL_STEPS);
+  depth_sensor_start();
+  serial_commands_init();
+  net_telemetry_init(); // Wi-Fi comes up in the background
+  vTaskPrioritySet(NULL, MAIN_TASK_PRIORITY); // loop() from here on
+  boot_print();
+  memory_report_print();
 }
-void run_inference()
+bool run_inference()
 {
+  PowerLock full_clock(POWER_LOCK_INFERENCE); // Core 1 drops to the low clock between inferences
   // Check if interpreter is initialized
   if (interpreter == nullptr || input == nullptr || output_steering == nullptr || output_throttle == nullptr)
   {
     MicroPrintf("Inference skipped: model not initialized");
-    return;
+    return false;
   }
 
-  // Use inference_buffer which contains snapshot of 10 frames
-  // Input shape expected: (24, 24, 10)
-  // Fill input tensor with 10 frames
+  // Read the newest num_frames frames straight out of the frame ring into the
+  // (H, W, num_frames) input tensor
   int64_t t_input_start = esp_timer_get_time();
-  for (int frame_idx = 0; frame_idx < NUM_FRAMES; frame_idx++)
+  trace_event(TRACE_INFER_START);
+  bool window_valid = false;
+#ifdef PIPELINED_INPUT
+  // Core 0 built the window already, then the loop below doesn't run
+  window_valid = pipelined_input && copy_staged_window();
+  staged_inputs += window_valid ? 1 : 0;
+#endif
+  for (int attempt = 0; attempt < MAX_WINDOW_RETRIES && !window_valid; attempt++)
   {
-    // Get the frame in chronological order (oldest to newest)
-    // buffer_index points to the next write position, so oldest frame is at buffer_index
-    int actual_frame_idx = (buffer_index + frame_idx) % NUM_FRAMES;
-    float *frame_data = &inference_buffer[actual_frame_idx * FRAME_SIZE];
+    uint32_t window_end = frames_published.load(std::memory_order_acquire);
+    uint32_t epoch = reset_epoch.load(std::memory_order_acquire);
+    if (window_end < (uint32_t)num_frames)
+    {
+      break; // Buffer was reset, wait for fresh frames
+    }
 
-    for (int row = 0; row < 24; row++)
+#ifdef SLIDING_WINDOW_INPUT
+    if (sliding_window_enabled)
     {
-      for (int col = 0; col < 24; col++)
-      {
-        float normalized = frame_data[row * 24 + col];
-
-        // Quantize the input: quantized = (value / scale + zero_point) truncated to int8
-        // Input layout: (24, 24, 10) - row-major
-        int input_index = (row * 24 + col) * NUM_FRAMES + frame_idx;
-        float quantized_float = normalized / input->params.scale + input->params.zero_point;
-        int32_t quantized = static_cast<int32_t>(quantized_float);
-        // Clamp to int8 range
-        if (quantized < -128)
-          quantized = -128;
-        if (quantized > 127)
-          quantized = 127;
-        input->data.int8[input_index] = static_cast<int8_t>(quantized);
-      }
+      // Only write the frames that arrived since the last inference. After a
+      // reset the numbers restart, so frames below window_written_end may
+      // be older ones with the same numbers.
+      uint32_t written_end = window_written_epoch == epoch ? window_written_end : 0;
+      update_window_channels(window_tensor, written_end, window_end);
+    }
+    else
+#endif
+    {
+      fill_window_from_ring(window_end, input->data.int8);
     }
+
+    // The window is intact if the sensor has not started writing into its oldest slot
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t lag = frames_published.load(std::memory_order_relaxed) - window_end;
+    window_valid = lag < (uint32_t)RING_SPARE_SLOTS && reset_epoch.load(std::memory_order_relaxed) == epoch;
+    window_arrival_us = frame_arrival_us[(window_end - 1) % ring_slots];
+    if (!window_valid)
+    {
+      window_retries++;
+    }
+#ifdef SLIDING_WINDOW_INPUT
+    // A lapped read may have left torn channels behind, rewrite them all next time
+    window_written_end = window_valid ? window_end : 0;
+    window_written_epoch = epoch;
+    if (window_valid && sliding_window_enabled)
+    {
+      memcpy(input->data.int8, window_tensor, frame_size * num_frames);
+      rotate_conv_filter(window_end % num_frames);
+    }
+#endif
+  }
+  last_timing.input_fill_us = esp_timer_get_time() - t_input_start;
+  stage_record(g_input_fill_latency, last_timing.input_fill_us);
+  if (!window_valid)
+  {
+    return false; // Frame window was reset or kept getting overwritten
   }
-  acc_input_fill_us += esp_timer_get_time() - t_input_start;
 
   // Run inference
   int64_t t_invoke_start = esp_timer_get_time();
-  TfLiteStatus invoke_status = interpreter->Invoke();
-  acc_invoke_us += esp_timer_get_time() - t_invoke_start;
-  if (invoke_status != kTfLiteOk)
+  stage_record(g_wake_latency, t_invoke_start - inference_notify_us.load(std::memory_order_relaxed));
+  bool gated = false;
+#ifdef CASCADED_INFERENCE
+  gated = gate_enabled && run_gate();
+  t_invoke_start = esp_timer_get_time();
+#endif
+  if (!gated)
   {
-    MicroPrintf("Invoke failed\n");
-    return;
-  }
-
-  // Dequantize outputs: dequantized = (quantized - zero_point) * scale
-  int8_t steering_quantized = output_steering->data.int8[0];
-  int8_t throttle_quantized = output_throttle->data.int8[0];
-
-  float steering = (float)(steering_quantized - output_steering->params.zero_point) *
-                   output_steering->params.scale;
-  float throttle = (float)(throttle_quantized - output_throttle->params.zero_point) *
-                   output_throttle->params.scale;
-
-  // Clamp outputs to expected ranges
-  // Steering: [-1, 1] (tanh activation)
-  // Throttle: [-1, 1] (linear activation, allows reverse)
-  steering = steering < -1.0f ? -1.0f : (steering > 1.0f ? 1.0f : steering);
-  throttle = throttle < -1.0f ? -1.0f : (throttle > 1.0f ? 1.0f : throttle);
+    trace_event(TRACE_INVOKE_START);
+    g_op_profiler.begin_inference();
+    TfLiteStatus invoke_status = interpreter->Invoke();
+    last_timing.invoke_us = esp_timer_get_time() - t_invoke_start;
+    stage_record(g_invoke_latency, last_timing.invoke_us);
+    trace_event(TRACE_INVOKE_END, (int32_t)last_timing.invoke_us);
+    if (invoke_status != kTfLiteOk)
+    {
+      MicroPrintf("Invoke failed\n");
+      return false;
+    }
+    g_op_profiler.end_inference();
+#ifdef CASCADED_INFERENCE
+    if (gate_enabled)
+    {
+      gate_full_us_total.fetch_add(last_timing.invoke_us, std::memory_order_relaxed);
+    }
+#endif
 
-  // Save inference results to persist between frames
-  inference_steering = steering;
-  inference_throttle = throttle;
+#ifdef SPLIT_MODEL_PIPELINE
+    if (split_enabled)
+    {
+      // Hand the front output to core 0 and move on to the next frame
+      head_job->front_done_us = esp_timer_get_time();
+      head_job->frame_arrival_us = window_arrival_us;
+      memcpy(head_job->data, front_output->data.int8, front_output->bytes);
+      xQueueOverwrite(head_queue, head_job);
+    }
+    else
+#endif
+    {
+      store_prediction(output_throttle, output_steering, window_arrival_us);
+    }
+  }
 
-  // TODO: Apply steering and throttle to drive system
+  // drive_system_loop() reads the result from g_inference_result and drives the motors
   // MicroPrintf("Inference: steering=%.3f, throttle=%.3f",
   //             static_cast<double>(steering), static_cast<double>(throttle));
 
@@ -451,34 +1876,203 @@ void run_inference()
   if (elapsed_us >= 1000000) // 1 second window
   {
     inference_fps = (float)fps_window_count * 1e6f / (float)elapsed_us;
-    // Average time per inference for each section (in ms)
-    float count = fps_window_count > 0 ? (float)fps_window_count : 1.0f;
-    MicroPrintf("=== Inference Profile (avg over %.0f inferences) ===", static_cast<double>(count));
-    MicroPrintf("  FPS          : %.2f", static_cast<double>(inference_fps));
-    MicroPrintf("  Input fill   : %.2f ms", static_cast<double>((float)acc_input_fill_us / count / 1000.0f));
-    MicroPrintf("  Invoke       : %.2f ms", static_cast<double>((float)acc_invoke_us / count / 1000.0f));
-    MicroPrintf("  Frame copy   : %.2f ms", static_cast<double>((float)acc_frame_copy_us / count / 1000.0f));
-    MicroPrintf("  Add frame    : %.2f ms (per frame add, not per inference)", static_cast<double>((float)acc_add_frame_us / count / 1000.0f));
+    float count = (float)fps_window_count;
+    MicroPrintf("=== Inference Profile (%d inferences) ===", fps_window_count);
+    MicroPrintf("  FPS          : %.2f, %d window retries", static_cast<double>(inference_fps), window_retries);
+#ifdef PIPELINED_INPUT
+    if (pipelined_input)
+    {
+      MicroPrintf("  Staged input : %d of %d windows, the rest from the ring", staged_inputs, fps_window_count);
+    }
+    staged_inputs = 0;
+#endif
+#ifdef STAGE_TIMING
+    // Per stage over this window (samples in brackets)
+    g_input_fill_latency.print_window("Input fill");
+    g_invoke_latency.print_window("Invoke");
+    g_frame_copy_latency.print_window("Frame copy");
+    g_add_frame_latency.print_window("Add frame");
+    g_wake_latency.print_window("Wake->Invoke");
+#ifdef SPLIT_MODEL_PIPELINE
+    if (split_enabled)
+    {
+      g_head_latency.print_window("Core 0 head");
+      g_handoff_latency.print_window("Hand-off");
+    }
+#endif
+#endif
+    g_frame_to_result_latency.print_window("Frame->result");
+    int results = results_count.exchange(0, std::memory_order_relaxed);
+    MicroPrintf("  Deadline     : %d misses of %d results (> %d ms)", deadline_misses.exchange(0, std::memory_order_relaxed),
+                results, (int)(INFERENCE_DEADLINE_US / 1000));
+#ifdef ADAPTIVE_INFERENCE_SKIP
+    int skipped = skipped_frames.exchange(0, std::memory_order_relaxed);
+    MicroPrintf("  Skipped      : %d frames (%.0f%% of frames, scene change %.2f, threshold %.1f LSB)", skipped,
+                static_cast<double>(100.0f * skipped / (skipped + count)), static_cast<double>(last_scene_change),
+                static_cast<double>(SKIP_THRESHOLD_LSB));
+#endif
+#ifdef CASCADED_INFERENCE
+    if (gate_enabled)
+    {
+      gate_stats_t total = get_gate_stats();
+      gate_stats_t window = {total.gated - gate_window_start.gated, total.uncertain - gate_window_start.uncertain,
+                             total.refreshes - gate_window_start.refreshes, total.gate_us - gate_window_start.gate_us,
+                             total.full_us - gate_window_start.full_us, 0};
+      int32_t saved = gate_saved_permille(window);
+      MicroPrintf("  Gate         : %lu gated, %lu uncertain, %lu refreshes, model time saved %.1f%%",
+                  (unsigned long)window.gated, (unsigned long)window.uncertain, (unsigned long)window.refreshes,
+                  static_cast<double>((float)saved / 10.0f));
+      gate_window_start = total;
+    }
+#endif
     fps_window_start_us = now_us;
     fps_window_count = 0;
-    acc_input_fill_us = 0;
-    acc_invoke_us = 0;
-    acc_frame_copy_us = 0;
-    acc_add_frame_us = 0;
+    window_retries = 0;
   }
 
   inference_count += 1;
+  return true;
+}
+
+ControlChannel g_inference_result;
+
+#define KERNEL_BENCH_REPEAT 10
+
+// Console task, on request: the kernels run on a copy of the newest frame and
+// never on the inference core's time, so the deadline numbers stay clean
+void print_input_kernel_profile()
+{
+  printf("KERNEL_PROFILE_START\n");
+#ifdef QUANTIZE_ON_INGEST
+  static uint8_t raw_frame[INPUT_KERNEL_SRC_SIZE * INPUT_KERNEL_SRC_SIZE];
+  static float depth_map[INPUT_KERNEL_SRC_SIZE][INPUT_KERNEL_SRC_SIZE];
+  constexpr int FRAME_SIZE = DEFAULT_FRAME_ROWS * DEFAULT_FRAME_COLS;
+  static int8_t frame_scalar[FRAME_SIZE] __attribute__((aligned(4)));
+  static int8_t frame_raw[FRAME_SIZE] __attribute__((aligned(4)));
+  static int8_t channel_scratch[FRAME_SIZE * MAX_WINDOW_FRAMES];
+  if (input == nullptr || !last_raw_frame_default)
+  {
+    printf("KERNEL_PROFILE_ERROR:No model or no frame yet\n");
+  }
+  else if (frame_rows != DEFAULT_FRAME_ROWS || frame_cols != DEFAULT_FRAME_COLS)
+  {
+    printf("KERNEL_PROFILE_ERROR:Generic resample (sensor or model isn't 25x25 -> 24x24)\n");
+  }
+  else
+  {
+    const float scale = input->params.scale;
+    const int32_t zero_point = input->params.zero_point;
+    // Snapshot, the sensor side keeps overwriting last_raw_frame from core 0
+    memcpy(raw_frame, last_raw_frame, sizeof(raw_frame));
+
+    // What processDepth() + loadDepthMap() used to produce before ingest
+    int64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < KERNEL_BENCH_REPEAT; r++)
+      for (int i = 0; i < INPUT_KERNEL_SRC_SIZE * INPUT_KERNEL_SRC_SIZE; i++)
+        depth_map[i / INPUT_KERNEL_SRC_SIZE][i % INPUT_KERNEL_SRC_SIZE] = depth_mm_lut.mm[raw_frame[i]];
+    int64_t t1 = esp_timer_get_time();
+    for (int r = 0; r < KERNEL_BENCH_REPEAT; r++)
+      ingest_frame_scalar(depth_map, frame_scalar, scale, zero_point);
+    int64_t t2 = esp_timer_get_time();
+    for (int r = 0; r < KERNEL_BENCH_REPEAT; r++)
+      ingest_raw_frame(raw_frame, frame_raw, raw_input_lut);
+    int64_t t3 = esp_timer_get_time();
+    for (int r = 0; r < KERNEL_BENCH_REPEAT; r++)
+      scatter_channel_scalar(frame_scalar, channel_scratch, num_frames, FRAME_SIZE);
+    int64_t t4 = esp_timer_get_time();
+    for (int r = 0; r < KERNEL_BENCH_REPEAT; r++)
+      scatter_channel_fast(frame_scalar, channel_scratch, num_frames, FRAME_SIZE);
+    int64_t t5 = esp_timer_get_time();
+
+    // The raw LUT uses the scalar arithmetic, so it should match exactly
+    int raw_mismatches = 0;
+    for (int i = 0; i < FRAME_SIZE; i++)
+    {
+      if (frame_raw[i] != frame_scalar[i])
+        raw_mismatches++;
+    }
+
+    // Nanoseconds per call, no float formatting on the console task stack
+    printf("KERNEL:mm_convert:ns:%d\n", (int)((t1 - t0) * 1000 / KERNEL_BENCH_REPEAT));
+    printf("KERNEL:ingest_scalar:ns:%d\n", (int)((t2 - t1) * 1000 / KERNEL_BENCH_REPEAT));
+    printf("KERNEL:ingest_raw:ns:%d\n", (int)((t3 - t2) * 1000 / KERNEL_BENCH_REPEAT));
+    printf("KERNEL:scatter_scalar:ns:%d\n", (int)((t4 - t3) * 1000 / KERNEL_BENCH_REPEAT));
+    printf("KERNEL:scatter_fast:ns:%d\n", (int)((t5 - t4) * 1000 / KERNEL_BENCH_REPEAT));
+    printf("KERNEL_CHECK:ingest_raw_vs_scalar:mismatches:%d\n", raw_mismatches);
+  }
+#else
+  printf("KERNEL_PROFILE_ERROR:Built without QUANTIZE_ON_INGEST\n");
+#endif
+  printf("KERNEL_PROFILE_END\n");
+  fflush(stdout);
 }
 
-// Getter functions for inference results
-float get_inference_steering()
+bool get_inference_result(control_state_t *result)
 {
-  return inference_steering;
+  if (!g_inference_result.read(result) ||
+      result->frame_us < results_reset_us.load(std::memory_order_acquire))
+  {
+    *result = {};
+    return false;
+  }
+  return true;
+}
+
+inference_timing_t get_last_inference_timing()
+{
+  return last_timing;
+}
+
+arena_usage_t get_arena_usage()
+{
+  arena_usage_t usage = {};
+  if (interpreter != nullptr)
+  {
+    usage.used_bytes = (int)interpreter->arena_used_bytes();
+    usage.size_bytes = tensor_arena_size;
+    usage.placement = kArenaPlacementNames[tensor_arena.placement];
+  }
+#ifdef SPLIT_MODEL_PIPELINE
+  if (split_enabled && head_interpreter != nullptr)
+  {
+    usage.head_used_bytes = (int)head_interpreter->arena_used_bytes();
+    usage.head_size_bytes = kHeadArenaSize;
+  }
+#endif
+#ifdef CASCADED_INFERENCE
+  if (gate_enabled)
+  {
+    usage.gate_used_bytes = (int)gate_interpreter->arena_used_bytes();
+    usage.gate_size_bytes = kGateArenaSize;
+  }
+#endif
+  return usage;
+}
+
+int get_arena_placements(arena_placement_stats_t *out, int max)
+{
+  int count = 0;
+#ifdef ARENA_PLACEMENT_BENCH
+  for (int p = 0; p < ARENA_PLACEMENT_COUNT && count < max && interpreter != nullptr; p++)
+  {
+    out[count++] = {kArenaPlacementNames[p], arena_bench_us[p], p == tensor_arena.placement};
+  }
+#endif
+  return count;
 }
 
-float get_inference_throttle()
+gate_stats_t get_gate_stats()
 {
-  return inference_throttle;
+  gate_stats_t stats = {};
+#ifdef CASCADED_INFERENCE
+  stats.gated = gate_gated.load(std::memory_order_relaxed);
+  stats.uncertain = gate_uncertain.load(std::memory_order_relaxed);
+  stats.refreshes = gate_refreshes.load(std::memory_order_relaxed);
+  stats.gate_us = gate_us_total.load(std::memory_order_relaxed);
+  stats.full_us = gate_full_us_total.load(std::memory_order_relaxed);
+  stats.saved_permille = gate_saved_permille(stats);
+#endif
+  return stats;
 }
 
 void setup_leds()
@@ -495,9 +2089,9 @@ void setup_leds()
   led_strip_rmt_config_t rmt_config = {
       .clk_src = RMT_CLK_SRC_DEFAULT,
       .resolution_hz = 10 * 1000 * 1000,
-      .mem_block_symbols = 0, // Let the driver choose
+      .mem_block_symbols = 256, // DMA buffer: a whole frame (24 symbols per LED + reset) in one go
       .flags = {
-          .with_dma = false,
+          .with_dma = true, // WS2812FX::show() only queues the frame, the DMA sends it
       }};
 
   ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip));
@@ -512,7 +2106,7 @@ void setup_leds()
   fx->setColor(YELLOW);
   fx->start();
 
-  // Initialize LED manager
+  // Initialize LED manager, the LED task drives fx from here on
   led_manager_init(fx);
 }
 // The name of this function is important for Arduino compatibility.
@@ -520,16 +2114,15 @@ void loop()
 {
   // run_inference();
 
-  // Run drive system and LED updates
-  drive_system_loop();
+  // RC and motor updates run in the drive task (DRIVE_LOOP_HZ)
 
-  // Run depth sensor with shared channel values
-  depth_sensor_task(&steering_scaled, &throttle_scaled, &ch3_scaled);
+  // Run depth sensor (reads the drive command for logging and CH3)
+  depth_sensor_task();
 
-  // LED stuff
-  led_manager_update();
-  fx->service();
+  // Status LEDs and battery; the LED task shows them
+  drive_system_update_status();
+  power_update(write_to_sd);
 
-  // Process serial commands
+  // Serial commands run in the console task; only a replay bench comes back here
   serial_commands_process();
 }
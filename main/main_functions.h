@@ -16,6 +16,10 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_MICRO_EXAMPLES_HELLO_WORLD_MAIN_FUNCTIONS_H_
 #define TENSORFLOW_LITE_MICRO_EXAMPLES_HELLO_WORLD_MAIN_FUNCTIONS_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "control_state.h"
+
 // Expose a C friendly interface for main functions.
 #ifdef __cplusplus
 extern "C"
@@ -32,14 +36,64 @@ extern "C"
   // compatibility.
   void loop();
 
-  void run_inference();
+  bool run_inference(); // Returns true if the model was invoked on a full frame window
   void request_inference(); // Non-blocking inference request for core 1
-  void add_frame_to_buffer(); // Add new frame to circular buffer
+  bool inference_in_progress(); // True while the core 1 task is handling a request
+  void add_frame_to_buffer(int64_t arrival_us = 0); // Add depthMap to circular buffer; arrival time for the deadline monitor, 0 = now
+  void add_depth_map_to_buffer(const float *depth_map, int rows, int cols, int64_t arrival_us = 0); // Same, from any rows x cols millimetre map (e.g. replayed from SD)
+  void add_raw_frame_to_buffer(const uint8_t *pixels, int rows, int cols, int64_t arrival_us = 0); // Same, from raw sensor bytes (one pass for 25x25)
   void reset_frame_buffer(); // Clear buffer so inference waits for 10 fresh frames
   
-  // Get current inference results (only valid in inference mode)
-  float get_inference_steering();
-  float get_inference_throttle();
+  // Newest model output, as one consistent snapshot (frame_us is the arrival of its newest frame).
+  // False if there is none since the last reset_frame_buffer().
+  bool get_inference_result(control_state_t *result);
+
+  // Stage timings of the most recent run_inference() call
+  typedef struct
+  {
+    int64_t input_fill_us;
+    int64_t invoke_us;
+  } inference_timing_t;
+  inference_timing_t get_last_inference_timing();
+
+  // GET_KERNEL_PROFILE: time the input kernels on a copy of the newest frame
+  // and print KERNEL_PROFILE_START ... KERNEL_PROFILE_END (console task)
+  void print_input_kernel_profile();
+
+  // Tensor arena use of the loaded model, of the head model when split and of the gate model (0 = none)
+  typedef struct
+  {
+    int used_bytes;
+    int size_bytes;
+    int head_used_bytes;
+    int head_size_bytes;
+    int gate_used_bytes;
+    int gate_size_bytes;
+    const char *placement; // Where the arena is: "internal", "split" or "psram", nullptr without a model
+  } arena_usage_t;
+  arena_usage_t get_arena_usage();
+
+  // Mean Invoke() of the loaded model with the tensor arena in each placement,
+  // timed at boot (ARENA_PLACEMENT_BENCH). 0 entries when it is built out.
+  typedef struct
+  {
+    const char *name;  // "internal", "split" or "psram"
+    int32_t invoke_us; // -1 if there was no room for this placement
+    bool in_use;
+  } arena_placement_stats_t;
+  int get_arena_placements(arena_placement_stats_t *out, int max);
+
+  // Cascaded inference since boot, all 0 without a gate model
+  typedef struct
+  {
+    uint32_t gated;         // Results the gate model gave on its own
+    uint32_t uncertain;     // Gate below its confidence threshold, the full model ran
+    uint32_t refreshes;     // The full model ran for the periodic refresh
+    int64_t gate_us;        // Gate Invoke() time, all windows
+    int64_t full_us;        // Full model Invoke() time behind the gate
+    int32_t saved_permille; // Model time saved against the full model on every window
+  } gate_stats_t;
+  gate_stats_t get_gate_stats();
 
 #ifdef __cplusplus
 }
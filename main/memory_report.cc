@@ -0,0 +1,175 @@
+#include "memory_report.h"
+#include "main_functions.h"
+#include <stdio.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_memory_utils.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+typedef enum
+{
+  REGION_INTERNAL = 0,
+  REGION_PSRAM,
+  REGION_FLASH,
+  REGION_COUNT,
+} region_t;
+
+static const char *const g_region_names[REGION_COUNT] = {"internal", "psram", "flash"};
+
+typedef struct
+{
+  const char *name;
+  size_t bytes;
+  uint8_t region; // region_t
+} buffer_entry_t;
+
+typedef struct
+{
+  const char *name;
+  uint32_t stack_bytes;
+} task_entry_t;
+
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static buffer_entry_t g_buffers[MEMORY_REPORT_MAX_BUFFERS];
+static int g_buffer_count = 0;
+static task_entry_t g_tasks[MEMORY_REPORT_MAX_TASKS];
+static int g_task_count = 0;
+
+static region_t region_of(const void *ptr)
+{
+  if (esp_ptr_external_ram(ptr))
+    return REGION_PSRAM;
+  if (esp_ptr_internal(ptr))
+    return REGION_INTERNAL;
+  return REGION_FLASH;
+}
+
+void memory_report_add(const char *name, const void *ptr, size_t bytes)
+{
+  region_t region = ptr != nullptr ? region_of(ptr) : REGION_INTERNAL;
+  portENTER_CRITICAL(&g_lock);
+  int i = 0;
+  while (i < g_buffer_count && strcmp(g_buffers[i].name, name) != 0)
+    i++;
+  if (ptr == nullptr)
+  {
+    // Keep the order of the others
+    if (i < g_buffer_count)
+    {
+      memmove(&g_buffers[i], &g_buffers[i + 1], (g_buffer_count - i - 1) * sizeof(buffer_entry_t));
+      g_buffer_count--;
+    }
+  }
+  else if (i < MEMORY_REPORT_MAX_BUFFERS)
+  {
+    g_buffers[i] = {name, bytes, (uint8_t)region};
+    if (i == g_buffer_count)
+      g_buffer_count++;
+  }
+  portEXIT_CRITICAL(&g_lock);
+}
+
+void *memory_alloc(const char *name, size_t bytes, memory_placement_t placement)
+{
+  const uint32_t internal = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+  const uint32_t psram = MALLOC_CAP_SPIRAM;
+  void *ptr = heap_caps_aligned_alloc(16, bytes, placement == MEMORY_HOT ? internal : psram);
+  if (ptr == nullptr && placement == MEMORY_HOT)
+  {
+    ptr = heap_caps_aligned_alloc(16, bytes, psram);
+  }
+  if (ptr != nullptr)
+  {
+    memory_report_add(name, ptr, bytes);
+  }
+  return ptr;
+}
+
+void memory_free(const char *name, void *ptr)
+{
+  if (ptr != nullptr)
+  {
+    memory_report_add(name, nullptr, 0);
+    heap_caps_free(ptr);
+  }
+}
+
+void memory_report_add_task(const char *name, uint32_t stack_bytes)
+{
+  portENTER_CRITICAL(&g_lock);
+  if (g_task_count < MEMORY_REPORT_MAX_TASKS)
+    g_tasks[g_task_count++] = {name, stack_bytes};
+  portEXIT_CRITICAL(&g_lock);
+}
+
+void memory_report_print()
+{
+  // Copy under the lock, print outside it
+  static buffer_entry_t buffers[MEMORY_REPORT_MAX_BUFFERS];
+  static task_entry_t tasks[MEMORY_REPORT_MAX_TASKS];
+  portENTER_CRITICAL(&g_lock);
+  int buffer_count = g_buffer_count;
+  int task_count = g_task_count;
+  memcpy(buffers, g_buffers, buffer_count * sizeof(buffer_entry_t));
+  memcpy(tasks, g_tasks, task_count * sizeof(task_entry_t));
+  portEXIT_CRITICAL(&g_lock);
+
+  size_t totals[REGION_COUNT] = {};
+  printf("MEM_START\n");
+  for (int i = 0; i < buffer_count; i++)
+  {
+    printf("MEM_BUFFER:%s:bytes:%u:region:%s\n", buffers[i].name, (unsigned)buffers[i].bytes,
+           g_region_names[buffers[i].region]);
+    totals[buffers[i].region] += buffers[i].bytes;
+  }
+  for (int i = 0; i < task_count; i++)
+  {
+    // Stacks come from internal RAM (xTaskCreatePinnedToCore()), the high-water mark is in bytes
+    TaskHandle_t handle = xTaskGetHandle(tasks[i].name);
+    if (handle != nullptr)
+    {
+      printf("MEM_TASK:%s:stack:%lu:stack_free:%lu\n", tasks[i].name, (unsigned long)tasks[i].stack_bytes,
+             (unsigned long)uxTaskGetStackHighWaterMark(handle));
+    }
+    else
+    {
+      printf("MEM_TASK:%s:stack:%lu:stack_free:-1\n", tasks[i].name, (unsigned long)tasks[i].stack_bytes);
+    }
+    totals[REGION_INTERNAL] += tasks[i].stack_bytes;
+  }
+
+  arena_usage_t arena = get_arena_usage();
+  printf("MEM_ARENA:used:%d:size:%d:placement:%s\n", arena.used_bytes, arena.size_bytes,
+         arena.placement != nullptr ? arena.placement : "none");
+  if (arena.head_size_bytes > 0)
+  {
+    printf("MEM_ARENA_HEAD:used:%d:size:%d\n", arena.head_used_bytes, arena.head_size_bytes);
+  }
+  if (arena.gate_size_bytes > 0)
+  {
+    printf("MEM_ARENA_GATE:used:%d:size:%d\n", arena.gate_used_bytes, arena.gate_size_bytes);
+  }
+
+  arena_placement_stats_t placements[4];
+  int placement_count = get_arena_placements(placements, 4);
+  for (int i = 0; i < placement_count; i++)
+  {
+    printf("MEM_ARENA_BENCH:%s:invoke_us:%ld:in_use:%d\n", placements[i].name, (long)placements[i].invoke_us,
+           placements[i].in_use ? 1 : 0);
+  }
+
+  printf("MEM_TOTAL:internal:%u:psram:%u\n", (unsigned)totals[REGION_INTERNAL], (unsigned)totals[REGION_PSRAM]);
+  printf("MEM_HEAP:internal:free:%u:min_free:%u:largest:%u:total:%u\n",
+         (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+         (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+         (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+         (unsigned)heap_caps_get_total_size(MALLOC_CAP_INTERNAL));
+  printf("MEM_HEAP:psram:free:%u:min_free:%u:largest:%u:total:%u\n",
+         (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+         (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM),
+         (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM),
+         (unsigned)heap_caps_get_total_size(MALLOC_CAP_SPIRAM));
+  printf("MEM_END\n");
+  fflush(stdout);
+}
@@ -0,0 +1,40 @@
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Where the RAM went: every long-lived buffer and task stack is registered
+// where it is allocated, and memory_report_print() lists them with their
+// region next to the tensor arena use and the heap. Printed at boot and for
+// GET_MEMORY.
+
+#define MEMORY_REPORT_MAX_BUFFERS 40
+#define MEMORY_REPORT_MAX_TASKS 16
+
+// Register a buffer, or update the one registered under the same name (a
+// reallocated arena). nullptr removes it. The region is taken from the address.
+void memory_report_add(const char *name, const void *ptr, size_t bytes);
+
+// Placement policy for long-lived buffers, by access pattern
+typedef enum
+{
+  MEMORY_HOT = 0, // Touched every frame or every op (frame ring, scratch): internal SRAM, PSRAM if full
+  MEMORY_COLD,    // Bulk data touched rarely or sequentially (SD staging, model copies): PSRAM only,
+                  // so it never takes internal SRAM from hot data
+} memory_placement_t;
+
+// Allocate a 16-byte aligned buffer by its placement and register it under
+// `name`. nullptr if there is no room.
+void *memory_alloc(const char *name, size_t bytes, memory_placement_t placement);
+
+// Free a buffer from memory_alloc() (nullptr is fine) and unregister it
+void memory_free(const char *name, void *ptr);
+
+// Register a task stack; the report adds its high-water mark
+void memory_report_add_task(const char *name, uint32_t stack_bytes);
+
+// Print MEM_START ... MEM_END, see SERIAL_DOWNLOAD.md
+void memory_report_print();
+
+#endif // MEMORY_REPORT_H
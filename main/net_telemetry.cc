@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <atomic> // Before WS2812FX.h (via depth_sensor.h), which defines min()
+#include "net_telemetry.h"
+#include "sdkconfig.h"
+
+#if CONFIG_TINYNAV_NET_TELEMETRY
+
+#include <string.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+#include "drive_system/depth_format.h"
+#include "latency_histogram.h"
+#include "main_functions.h"
+#include "memory_report.h"
+#include "task_layout.h"
+
+typedef struct
+{
+  int len; // Header and payload
+  uint8_t data[NET_PACKET_MAX];
+} net_buffer_t;
+
+typedef enum
+{
+  NET_STARTING = 0,
+  NET_CONNECTING,
+  NET_CONNECTED,
+  NET_FAILED, // Wi-Fi didn't start, telemetry stays off
+} net_state_t;
+
+static const char *const g_state_names[] = {"starting", "connecting", "connected", "failed"};
+
+// Pool buffers go main loop -> g_send_queue -> sender task -> g_free_queue,
+// like the SD writer's
+static net_buffer_t *g_pool = NULL;
+static QueueHandle_t g_send_queue = NULL;
+static QueueHandle_t g_free_queue = NULL;
+static std::atomic<int> g_state{NET_STARTING};
+static std::atomic<uint32_t> g_ip{0}; // Network byte order
+
+// Main loop only
+static uint32_t g_seq = 0;
+static int64_t g_tokens = 0; // Bytes
+static int64_t g_tokens_us = 0;
+static int64_t g_last_status_us = 0;
+static log_file_header_t g_log_header; // Depth encoding for the status packets
+
+// Sender task or main loop, read by net_telemetry_print()
+static std::atomic<uint32_t> g_sent_packets{0};
+static std::atomic<uint32_t> g_sent_bytes{0};
+static std::atomic<uint32_t> g_rate_drops{0};
+static std::atomic<uint32_t> g_queue_drops{0};
+static std::atomic<uint32_t> g_send_errors{0};
+
+static const int64_t kRateBytesPerS = (int64_t)CONFIG_TINYNAV_NET_MAX_KBYTES_PER_S * 1024;
+static const int64_t kBurstBytes = kRateBytesPerS * NET_RATE_BURST_MS / 1000 > (int64_t)NET_PACKET_MAX
+                                       ? kRateBytesPerS * NET_RATE_BURST_MS / 1000
+                                       : (int64_t)NET_PACKET_MAX;
+
+static void on_network_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+  if (base == WIFI_EVENT && id == WIFI_EVENT_STA_START)
+  {
+    esp_wifi_connect();
+  }
+  else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED)
+  {
+    // Frames are dropped at the source until the link is back; keep trying
+    if (g_state.exchange(NET_CONNECTING) == NET_CONNECTED)
+    {
+      printf("Net: Wi-Fi lost, reconnecting\n");
+    }
+    esp_wifi_connect();
+  }
+  else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP)
+  {
+    const ip_event_got_ip_t *event = (const ip_event_got_ip_t *)data;
+    g_ip.store(event->ip_info.ip.addr);
+    g_state.store(NET_CONNECTED);
+    printf("Net: connected as " IPSTR ", sending to %s:%d\n", IP2STR(&event->ip_info.ip), CONFIG_TINYNAV_NET_HOST,
+           CONFIG_TINYNAV_NET_PORT);
+  }
+}
+
+static bool wifi_start()
+{
+  if (esp_netif_init() != ESP_OK)
+    return false;
+  esp_err_t err = esp_event_loop_create_default();
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // Already created is fine
+    return false;
+  if (esp_netif_create_default_wifi_sta() == NULL)
+    return false;
+
+  wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+  init.nvs_enable = false; // Credentials come from menuconfig, nothing to keep in NVS
+  if (esp_wifi_init(&init) != ESP_OK)
+    return false;
+  esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, on_network_event, NULL);
+  esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, on_network_event, NULL);
+
+  wifi_config_t config = {};
+  // A full-length SSID or password needs no terminator
+  strncpy((char *)config.sta.ssid, CONFIG_TINYNAV_NET_SSID, sizeof(config.sta.ssid));
+  strncpy((char *)config.sta.password, CONFIG_TINYNAV_NET_PASSWORD, sizeof(config.sta.password));
+  g_state.store(NET_CONNECTING);
+  return esp_wifi_set_mode(WIFI_MODE_STA) == ESP_OK && esp_wifi_set_config(WIFI_IF_STA, &config) == ESP_OK &&
+         esp_wifi_set_ps(WIFI_PS_NONE) == ESP_OK && // Modem sleep adds up to a beacon interval per datagram
+         esp_wifi_start() == ESP_OK;
+}
+
+static void net_task(void *pvParameters)
+{
+  if (!wifi_start())
+  {
+    printf("Net: Wi-Fi didn't start, telemetry off\n");
+    g_state.store(NET_FAILED);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  struct sockaddr_in dest = {};
+  dest.sin_family = AF_INET;
+  dest.sin_port = htons(CONFIG_TINYNAV_NET_PORT);
+  int sock = -1;
+  if (inet_pton(AF_INET, CONFIG_TINYNAV_NET_HOST, &dest.sin_addr) == 1)
+  {
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+  }
+  if (sock < 0)
+  {
+    printf("Net: no socket for %s:%d, telemetry off\n", CONFIG_TINYNAV_NET_HOST, CONFIG_TINYNAV_NET_PORT);
+    g_state.store(NET_FAILED);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  while (true)
+  {
+    net_buffer_t *item;
+    if (xQueueReceive(g_send_queue, &item, portMAX_DELAY) != pdTRUE)
+      continue;
+    // Frames above 25x25 are bigger than one Wi-Fi MTU and leave as IP fragments
+    int sent = sendto(sock, item->data, item->len, 0, (const struct sockaddr *)&dest, sizeof(dest));
+    if (sent == item->len)
+    {
+      g_sent_packets.fetch_add(1, std::memory_order_relaxed);
+      g_sent_bytes.fetch_add((uint32_t)sent, std::memory_order_relaxed);
+    }
+    else
+    {
+      g_send_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    xQueueSend(g_free_queue, &item, 0);
+  }
+}
+
+void net_telemetry_init()
+{
+  g_pool = (net_buffer_t *)memory_alloc("net_pool", NET_POOL_BUFFERS * sizeof(net_buffer_t), MEMORY_COLD);
+  g_send_queue = xQueueCreate(NET_POOL_BUFFERS, sizeof(net_buffer_t *));
+  g_free_queue = xQueueCreate(NET_POOL_BUFFERS, sizeof(net_buffer_t *));
+  if (g_pool == NULL || g_send_queue == NULL || g_free_queue == NULL)
+  {
+    printf("Net: out of memory for %d datagram buffers, telemetry off\n", NET_POOL_BUFFERS);
+    g_state.store(NET_FAILED);
+    return;
+  }
+  for (int i = 0; i < NET_POOL_BUFFERS; i++)
+  {
+    net_buffer_t *buffer = &g_pool[i];
+    xQueueSend(g_free_queue, &buffer, 0);
+  }
+
+  fillLogFileHeader(&g_log_header);
+  g_tokens = kBurstBytes;
+  g_tokens_us = esp_timer_get_time();
+
+  if (xTaskCreatePinnedToCore(net_task, "net", NET_TASK_STACK, NULL, NET_TASK_PRIORITY, NULL, NET_TASK_CORE) !=
+      pdPASS)
+  {
+    printf("Net: cannot create the sender task, telemetry off\n");
+    g_state.store(NET_FAILED);
+    return;
+  }
+  memory_report_add_task("net", NET_TASK_STACK);
+  printf("Net: joining \"%s\" for UDP telemetry to %s:%d, at most %d KB/s\n", CONFIG_TINYNAV_NET_SSID,
+         CONFIG_TINYNAV_NET_HOST, CONFIG_TINYNAV_NET_PORT, CONFIG_TINYNAV_NET_MAX_KBYTES_PER_S);
+}
+
+// A pool buffer for a datagram of `bytes`, with its header filled, or NULL
+// if it has to be dropped. Never waits.
+static net_buffer_t *take_buffer(net_packet_type_t type, int bytes)
+{
+  if (g_state.load(std::memory_order_relaxed) != NET_CONNECTED)
+    return NULL; // Nobody to send to, not a drop
+  uint32_t seq = g_seq++;
+
+  // Token bucket: refill for the time since the last datagram, up to the burst
+  int64_t now = esp_timer_get_time();
+  g_tokens += (now - g_tokens_us) * kRateBytesPerS / 1000000;
+  g_tokens_us = now;
+  if (g_tokens > kBurstBytes)
+    g_tokens = kBurstBytes;
+  if (g_tokens < bytes)
+  {
+    g_rate_drops.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+  }
+
+  net_buffer_t *item;
+  if (xQueueReceive(g_free_queue, &item, 0) != pdTRUE)
+  {
+    g_queue_drops.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+  }
+  g_tokens -= bytes;
+
+  net_packet_header_t *header = (net_packet_header_t *)item->data;
+  header->magic = NET_PACKET_MAGIC;
+  header->seq = seq;
+  header->type = (uint8_t)type;
+  header->version = LOG_FORMAT_VERSION;
+  header->payload_bytes = (uint16_t)(bytes - sizeof(net_packet_header_t));
+  item->len = bytes;
+  return item;
+}
+
+void net_telemetry_frame(const sensor_frame_t *frame, float steering, float throttle)
+{
+  int bytes = (int)(sizeof(net_packet_header_t) + sizeof(log_record_header_t)) + frame->rows * frame->cols;
+  net_buffer_t *item = take_buffer(NET_PACKET_FRAME, bytes);
+  if (item == NULL)
+    return;
+  depth_format_record(frame, frame->seq, steering, throttle, item->data + sizeof(net_packet_header_t));
+  xQueueSend(g_send_queue, &item, 0); // Never full: it has room for every pool buffer
+}
+
+void net_telemetry_update(int mode)
+{
+  int64_t now = esp_timer_get_time();
+  if (now - g_last_status_us < NET_STATUS_INTERVAL_MS * 1000)
+    return;
+  g_last_status_us = now;
+
+  net_buffer_t *item = take_buffer(NET_PACKET_STATUS, (int)(sizeof(net_packet_header_t) + sizeof(net_status_t)));
+  if (item == NULL)
+    return;
+  net_status_t status = {};
+  status.timestamp_us = now;
+  control_state_t result;
+  if (get_inference_result(&result))
+  {
+    status.result_frame_us = result.frame_us;
+    status.result_steering_millis = (int16_t)(result.steering * 1000);
+    status.result_throttle_millis = (int16_t)(result.throttle * 1000);
+  }
+  inference_timing_t timing = get_last_inference_timing();
+  status.input_fill_us = (int32_t)timing.input_fill_us;
+  status.invoke_us = (int32_t)timing.invoke_us;
+  status.frame_to_result_p50_us = (int32_t)g_frame_to_result_latency.percentile_us(50);
+  status.frame_to_result_p99_us = (int32_t)g_frame_to_result_latency.percentile_us(99);
+  status.sensor_to_motor_p50_us = (int32_t)g_sensor_to_motor_latency.percentile_us(50);
+  status.sensor_to_motor_p99_us = (int32_t)g_sensor_to_motor_latency.percentile_us(99);
+  status.mode = (uint8_t)mode;
+  status.depth_encoding = g_log_header.depth_encoding;
+  status.binning_factor = g_log_header.binning_factor;
+  status.unit_mm = g_log_header.unit_mm;
+  memcpy(item->data + sizeof(net_packet_header_t), &status, sizeof(status));
+  xQueueSend(g_send_queue, &item, 0);
+}
+
+void net_telemetry_print()
+{
+  uint32_t ip = g_ip.load();
+  printf("NET_START\n");
+  printf("NET_STATE:%s:ip:%d.%d.%d.%d\n", g_state_names[g_state.load()], (int)(ip & 0xff), (int)((ip >> 8) & 0xff),
+         (int)((ip >> 16) & 0xff), (int)(ip >> 24));
+  printf("NET_TARGET:%s:%d:max_kbytes_per_s:%d\n", CONFIG_TINYNAV_NET_HOST, CONFIG_TINYNAV_NET_PORT,
+         CONFIG_TINYNAV_NET_MAX_KBYTES_PER_S);
+  printf("NET_COUNTERS:sent:%lu:bytes:%lu:rate_drops:%lu:queue_drops:%lu:send_errors:%lu\n",
+         (unsigned long)g_sent_packets.load(), (unsigned long)g_sent_bytes.load(), (unsigned long)g_rate_drops.load(),
+         (unsigned long)g_queue_drops.load(), (unsigned long)g_send_errors.load());
+  printf("NET_END\n");
+  fflush(stdout);
+}
+
+#else
+
+void net_telemetry_init()
+{
+}
+
+void net_telemetry_frame(const sensor_frame_t *frame, float steering, float throttle)
+{
+}
+
+void net_telemetry_update(int mode)
+{
+}
+
+void net_telemetry_print()
+{
+  printf("NET_START\n");
+  printf("NET_STATE:disabled:ip:0.0.0.0\n");
+  printf("NET_END\n");
+  fflush(stdout);
+}
+
+#endif // CONFIG_TINYNAV_NET_TELEMETRY
@@ -0,0 +1,82 @@
+#ifndef NET_TELEMETRY_H
+#define NET_TELEMETRY_H
+
+#include <stdint.h>
+#include "drive_system/depth_sensor.h"
+
+// Live telemetry over Wi-Fi as UDP datagrams to one host, a high-bandwidth
+// alternative to the serial stream and the SD log (menuconfig "TinyNav
+// network telemetry", off by default). Every frame the main loop takes from
+// the frame ring goes out as the same binary record the SD writer stores,
+// whatever the mode, plus a status packet with the model output and stage
+// timings every NET_STATUS_INTERVAL_MS. The main loop only copies into a
+// pool buffer and never waits: datagrams over the rate limit
+// (TINYNAV_NET_MAX_KBYTES_PER_S) or without a free buffer are dropped, and
+// the seq gap tells the receiver (net_receive.py).
+#define NET_POOL_BUFFERS 16        // Datagrams the sender task can fall behind by
+#define NET_STATUS_INTERVAL_MS 100
+#define NET_RATE_BURST_MS 100      // Token bucket depth, in time at the rate limit
+#define NET_PACKET_MAGIC 0x544E4E54 // "TNNT" in byte order
+
+typedef enum
+{
+  NET_PACKET_FRAME = 0,  // log_record_header_t (LOG_PIXELS_RAW, frame = sensor_frame_t::seq) and the raw pixels
+  NET_PACKET_STATUS = 1, // net_status_t
+} net_packet_type_t;
+
+// Every datagram: this header, then payload_bytes. Little-endian.
+typedef struct __attribute__((packed))
+{
+  uint32_t magic;         // NET_PACKET_MAGIC
+  uint32_t seq;           // Datagrams attempted since boot, gaps mean drops
+  uint8_t type;           // net_packet_type_t
+  uint8_t version;        // LOG_FORMAT_VERSION of the frame records
+  uint16_t payload_bytes;
+} net_packet_header_t;
+
+typedef struct __attribute__((packed))
+{
+  int64_t timestamp_us;           // When the packet was filled
+  int64_t result_frame_us;        // Newest frame behind the last model output, 0 = none since the last reset
+  int16_t result_steering_millis; // Last model output
+  int16_t result_throttle_millis;
+  int32_t input_fill_us;          // Last run_inference()
+  int32_t invoke_us;
+  int32_t frame_to_result_p50_us; // Since boot or RESET_LATENCY
+  int32_t frame_to_result_p99_us;
+  int32_t sensor_to_motor_p50_us;
+  int32_t sensor_to_motor_p99_us;
+  uint8_t mode;                   // write_to_sd
+  uint8_t depth_encoding;         // As in log_file_header_t, to turn frame pixels into millimetres
+  uint8_t binning_factor;
+  uint8_t reserved;
+  uint16_t unit_mm;
+} net_status_t;
+
+#define NET_PACKET_MAX (sizeof(net_packet_header_t) + SD_RECORD_MAX)
+
+/**
+ * @brief Start Wi-Fi and the sender task. Returns at once, the connection
+ *        comes up in the background. Does nothing when telemetry is off.
+ */
+void net_telemetry_init();
+
+/**
+ * @brief Queue one frame (main loop, for every frame taken from the ring)
+ */
+void net_telemetry_frame(const sensor_frame_t *frame, float steering, float throttle);
+
+/**
+ * @brief Queue a status packet when the last one is NET_STATUS_INTERVAL_MS
+ *        old (main loop, every call)
+ *
+ * @param mode write_to_sd
+ */
+void net_telemetry_update(int mode);
+
+/**
+ * @brief Print NET_START ... NET_END, see SERIAL_DOWNLOAD.md
+ */
+void net_telemetry_print();
+
+#endif // NET_TELEMETRY_H
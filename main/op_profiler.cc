@@ -0,0 +1,102 @@
+#include "op_profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <esp_cpu.h>
+
+OpProfiler g_op_profiler;
+
+void OpProfiler::begin_inference()
+{
+  num_events_ = 0;
+}
+
+uint32_t OpProfiler::BeginEvent(const char *tag)
+{
+  if (num_events_ >= OP_PROFILER_MAX_OPS)
+  {
+    return OP_PROFILER_MAX_OPS; // Past the last slot, not recorded
+  }
+  current_tags_[num_events_] = tag;
+  event_start_ = esp_cpu_get_cycle_count();
+  return num_events_++;
+}
+
+void OpProfiler::EndEvent(uint32_t event_handle)
+{
+  uint32_t end = esp_cpu_get_cycle_count();
+  if (event_handle < OP_PROFILER_MAX_OPS)
+  {
+    // Ops don't nest, so the last BeginEvent() is this event's start
+    current_cycles_[event_handle] = end - event_start_;
+  }
+}
+
+void OpProfiler::end_inference()
+{
+  portENTER_CRITICAL(&lock_);
+  if (num_events_ != num_ops_)
+  {
+    // Graph changed (or first inference), drop the old history
+    num_ops_ = num_events_;
+    next_slot_ = 0;
+    recorded_ = 0;
+  }
+  memcpy(tags_, current_tags_, num_ops_ * sizeof(tags_[0]));
+  memcpy(cycles_[next_slot_], current_cycles_, num_ops_ * sizeof(cycles_[0][0]));
+  next_slot_ = (next_slot_ + 1) % OP_PROFILER_WINDOW;
+  if (recorded_ < OP_PROFILER_WINDOW)
+  {
+    recorded_++;
+  }
+  portEXIT_CRITICAL(&lock_);
+}
+
+void OpProfiler::dump()
+{
+  // Sum under the lock, print outside it
+  static uint64_t totals[OP_PROFILER_MAX_OPS];
+  static const char *tags[OP_PROFILER_MAX_OPS];
+  portENTER_CRITICAL(&lock_);
+  int num_ops = num_ops_;
+  int recorded = recorded_;
+  memcpy(tags, tags_, num_ops * sizeof(tags[0]));
+  for (int op = 0; op < num_ops; op++)
+  {
+    totals[op] = 0;
+    for (int slot = 0; slot < recorded; slot++)
+    {
+      totals[op] += cycles_[slot][op];
+    }
+  }
+  portEXIT_CRITICAL(&lock_);
+
+  printf("OP_PROFILE_START\n");
+  if (recorded == 0)
+  {
+    printf("OP_PROFILE_ERROR:No inferences recorded (switch to inference mode first)\n");
+    printf("OP_PROFILE_END\n");
+    fflush(stdout);
+    return;
+  }
+
+  uint64_t all_ops = 0;
+  for (int op = 0; op < num_ops; op++)
+  {
+    all_ops += totals[op];
+  }
+  const float cycles_per_us = (float)CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+
+  // OP:<layer index>:<op name>:<avg cycles>:<avg us>:<percent of Invoke>
+  printf("OP_PROFILE_INFERENCES:%d\n", recorded);
+  for (int op = 0; op < num_ops; op++)
+  {
+    uint32_t avg = (uint32_t)(totals[op] / recorded);
+    printf("OP:%d:%s:%lu:%.1f:%.1f\n", op, tags[op] ? tags[op] : "?", (unsigned long)avg,
+           (double)(avg / cycles_per_us),
+           all_ops > 0 ? (double)(100.0f * totals[op] / all_ops) : 0.0);
+  }
+  uint32_t avg_total = (uint32_t)(all_ops / recorded);
+  printf("OP_PROFILE_TOTAL:%lu:%.1f\n", (unsigned long)avg_total, (double)(avg_total / cycles_per_us));
+  printf("OP_PROFILE_END\n");
+  fflush(stdout);
+}
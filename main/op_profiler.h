@@ -0,0 +1,47 @@
+#ifndef OP_PROFILER_H
+#define OP_PROFILER_H
+
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include "tensorflow/lite/micro/micro_profiler_interface.h"
+
+#define OP_PROFILER_MAX_OPS 64    // Ops per inference that get their own slot
+#define OP_PROFILER_WINDOW 16     // Inferences averaged by GET_OP_PROFILE
+
+// Per-operator profiler for the MicroInterpreter. TFLM calls BeginEvent() /
+// EndEvent() around every op in Invoke(); the op's position in the graph is
+// its layer index. Cycle counts for the last OP_PROFILER_WINDOW inferences
+// are kept so they can be averaged on request.
+class OpProfiler : public tflite::MicroProfilerInterface
+{
+public:
+  // Call around interpreter->Invoke() to delimit one inference
+  void begin_inference();
+  void end_inference();
+
+  uint32_t BeginEvent(const char *tag) override;
+  void EndEvent(uint32_t event_handle) override;
+
+  // Print the per-op averages as OP_PROFILE_START ... OP_PROFILE_END
+  void dump();
+
+private:
+  // Current inference, only touched by the inference task
+  const char *current_tags_[OP_PROFILER_MAX_OPS] = {};
+  uint32_t current_cycles_[OP_PROFILER_MAX_OPS] = {};
+  uint32_t event_start_ = 0;
+  int num_events_ = 0;
+
+  // Completed inferences, shared with the serial command handler
+  portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+  const char *tags_[OP_PROFILER_MAX_OPS] = {};
+  uint32_t cycles_[OP_PROFILER_WINDOW][OP_PROFILER_MAX_OPS] = {};
+  int num_ops_ = 0;
+  int next_slot_ = 0;
+  int recorded_ = 0; // Inferences in cycles_, up to OP_PROFILER_WINDOW
+};
+
+// Profiler attached to the interpreter in setup()
+extern OpProfiler g_op_profiler;
+
+#endif // OP_PROFILER_H
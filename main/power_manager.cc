@@ -0,0 +1,163 @@
+#include "power_manager.h"
+#include <stdio.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <sdkconfig.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+#define POWER_MODES 5 // write_to_sd -1 (no SD card) to 3
+
+static const char *const g_lock_names[POWER_LOCK_COUNT] = {"inference", "frames", "sd", "console", "boot"};
+static const char *const g_mode_names[POWER_MODES] = {"no_sd", "idle", "serial", "logging", "inference"};
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t g_pm_locks[POWER_LOCK_COUNT] = {};
+static bool g_pm_configured = false;
+#endif
+
+// Accounting, under g_lock. The clock is at full speed while any lock is held.
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static int g_holders[POWER_LOCK_COUNT] = {};
+static int g_total_holders = 0;
+static int64_t g_lock_since_us[POWER_LOCK_COUNT] = {};
+static int64_t g_lock_us[POWER_LOCK_COUNT] = {};
+static int64_t g_full_since_us = 0;
+static int g_mode = 1; // Index into the mode tables, write_to_sd + 1
+static int64_t g_mode_since_us = 0;
+static int64_t g_mode_us[POWER_MODES] = {};
+static int64_t g_mode_full_us[POWER_MODES] = {};
+
+void power_init()
+{
+  g_mode_since_us = esp_timer_get_time();
+#if CONFIG_PM_ENABLE
+  esp_pm_config_t config = {
+      .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+      .min_freq_mhz = POWER_MIN_CPU_MHZ,
+      .light_sleep_enable = false,
+  };
+  esp_err_t err = esp_pm_configure(&config);
+  if (err != ESP_OK)
+  {
+    printf("Power: esp_pm_configure failed (%s), CPU stays at %d MHz\n", esp_err_to_name(err),
+           CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    return;
+  }
+  for (int i = 0; i < POWER_LOCK_COUNT; i++)
+  {
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, g_lock_names[i], &g_pm_locks[i]);
+  }
+  g_pm_configured = true;
+  printf("Power: CPU %d MHz while busy, %d MHz otherwise\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, POWER_MIN_CPU_MHZ);
+#else
+  printf("Power: CONFIG_PM_ENABLE not set, CPU fixed at %d MHz\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+}
+
+void power_acquire(power_lock_t lock)
+{
+#if CONFIG_PM_ENABLE
+  if (g_pm_locks[lock] != nullptr)
+    esp_pm_lock_acquire(g_pm_locks[lock]);
+#endif
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_lock);
+  if (g_holders[lock]++ == 0)
+    g_lock_since_us[lock] = now;
+  if (g_total_holders++ == 0)
+    g_full_since_us = now;
+  portEXIT_CRITICAL(&g_lock);
+}
+
+void power_release(power_lock_t lock)
+{
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_lock);
+  if (--g_holders[lock] == 0)
+    g_lock_us[lock] += now - g_lock_since_us[lock];
+  if (--g_total_holders == 0)
+    g_mode_full_us[g_mode] += now - g_full_since_us;
+  portEXIT_CRITICAL(&g_lock);
+#if CONFIG_PM_ENABLE
+  if (g_pm_locks[lock] != nullptr)
+    esp_pm_lock_release(g_pm_locks[lock]);
+#endif
+}
+
+void power_update(int mode)
+{
+  int index = mode + 1;
+  if (index < 0 || index >= POWER_MODES)
+    return;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_lock);
+  g_mode_us[g_mode] += now - g_mode_since_us;
+  g_mode_since_us = now;
+  if (g_total_holders > 0)
+  {
+    // Split a running full-clock stretch at the update
+    g_mode_full_us[g_mode] += now - g_full_since_us;
+    g_full_since_us = now;
+  }
+  g_mode = index;
+  portEXIT_CRITICAL(&g_lock);
+}
+
+void power_print()
+{
+  power_update(g_mode - 1); // Bring the current mode up to date
+  int64_t mode_us[POWER_MODES];
+  int64_t mode_full_us[POWER_MODES];
+  int64_t lock_us[POWER_LOCK_COUNT];
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&g_lock);
+  for (int i = 0; i < POWER_MODES; i++)
+  {
+    mode_us[i] = g_mode_us[i];
+    mode_full_us[i] = g_mode_full_us[i];
+  }
+  for (int i = 0; i < POWER_LOCK_COUNT; i++)
+  {
+    lock_us[i] = g_lock_us[i] + (g_holders[i] > 0 ? now - g_lock_since_us[i] : 0);
+  }
+  portEXIT_CRITICAL(&g_lock);
+
+#if CONFIG_PM_ENABLE
+  bool enabled = g_pm_configured;
+#else
+  bool enabled = false;
+#endif
+  printf("POWER_START\n");
+  printf("POWER_CONFIG:dfs:%d:max_mhz:%d:min_mhz:%d\n", enabled ? 1 : 0, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+         POWER_MIN_CPU_MHZ);
+  // Tenths of a percent, no float formatting on the console stack
+  for (int i = 0; i < POWER_MODES; i++)
+  {
+    if (mode_us[i] == 0)
+      continue;
+    uint32_t full_permille = (uint32_t)(mode_full_us[i] * 1000 / mode_us[i]);
+    if (full_permille > 1000)
+      full_permille = 1000;
+    // CPU dynamic power scales with the clock: at the low clock the rest of the time costs min/max of it
+    uint32_t cost_permille =
+        full_permille + (1000 - full_permille) * POWER_MIN_CPU_MHZ / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    uint32_t saving_permille = enabled ? 1000 - cost_permille : 0;
+    printf("POWER_MODE:%s:seconds:%lu:full_clock_pct:%lu.%lu:cpu_saving_pct:%lu.%lu\n", g_mode_names[i],
+           (unsigned long)(mode_us[i] / 1000000), (unsigned long)(full_permille / 10),
+           (unsigned long)(full_permille % 10), (unsigned long)(saving_permille / 10),
+           (unsigned long)(saving_permille % 10));
+  }
+  int64_t total_us = 0;
+  for (int i = 0; i < POWER_MODES; i++)
+    total_us += mode_us[i];
+  for (int i = 0; i < POWER_LOCK_COUNT; i++)
+  {
+    uint32_t permille = total_us > 0 ? (uint32_t)(lock_us[i] * 1000 / total_us) : 0;
+    printf("POWER_LOCK:%s:held_pct:%lu.%lu\n", g_lock_names[i], (unsigned long)(permille / 10),
+           (unsigned long)(permille % 10));
+  }
+  printf("POWER_END\n");
+  fflush(stdout);
+}
@@ -0,0 +1,54 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <stdint.h>
+
+// Dynamic frequency scaling: the CPU idles at POWER_MIN_CPU_MHZ and runs at
+// the full clock only while a power lock is held, around the work that has
+// a deadline (a sensor frame, an inference, an SD block). Peripheral drivers
+// (UART, MCPWM, RMT, ADC, SDMMC) take the locks their clocks need themselves.
+// Light sleep stays off: the sensor streams over UART in every mode and the
+// console must keep taking bytes.
+//
+// Needs CONFIG_PM_ENABLE; without it the locks only feed the accounting that
+// GET_POWER reports.
+
+#define POWER_MIN_CPU_MHZ 40 // XTAL clock between deadlines; raise it if LINK:uart_overflows climbs
+
+typedef enum
+{
+  POWER_LOCK_INFERENCE = 0, // run_inference() and the split head
+  POWER_LOCK_FRAMES,        // Parsing, logging or ingesting a sensor frame
+  POWER_LOCK_SD,            // SD writer flushing a block
+  POWER_LOCK_CONSOLE,       // A serial command (downloads, replays)
+  POWER_LOCK_BOOT,          // From boot_init() until every boot step is done
+  POWER_LOCK_COUNT,
+} power_lock_t;
+
+// Configure esp_pm and create the locks. Call once, early in setup().
+void power_init();
+
+// Run at the full clock until the matching power_release(). Nests, any task, not from an ISR.
+void power_acquire(power_lock_t lock);
+void power_release(power_lock_t lock);
+
+// Time accounting per driving mode (write_to_sd). Call periodically from the main loop.
+void power_update(int mode);
+
+// Print POWER_START ... POWER_END, see SERIAL_DOWNLOAD.md
+void power_print();
+
+// Full clock for the rest of the scope
+class PowerLock
+{
+public:
+  explicit PowerLock(power_lock_t lock) : lock_(lock) { power_acquire(lock); }
+  ~PowerLock() { power_release(lock_); }
+  PowerLock(const PowerLock &) = delete;
+  PowerLock &operator=(const PowerLock &) = delete;
+
+private:
+  power_lock_t lock_;
+};
+
+#endif // POWER_MANAGER_H
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include "replay_bench.h"
+#include "log_index.h"
+#include "main_functions.h"
+#include "sdcard/sd.h"
+#include "drive_system/depth_sensor.h"
+#include "drive_system/depth_format.h"
+#include "drive_system/drive_system.h"
+
+// Pipeline stages timed per frame
+enum
+{
+  STAGE_READ = 0,  // Read and parse the CSV line
+  STAGE_ADD_FRAME, // add_depth_map_to_buffer()
+  STAGE_INPUT_FILL,
+  STAGE_INVOKE,
+  STAGE_TOTAL,
+  STAGE_COUNT
+};
+
+static const char *stage_names[STAGE_COUNT] = {"read", "add_frame", "input_fill", "invoke", "total"};
+
+static int compare_u32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Nearest-rank percentile of a sorted array
+static uint32_t percentile(const uint32_t *sorted, int count, int p)
+{
+  int rank = (p * count + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Parse "frame,steering,throttle,width,height,d0,d1,..." into map (height x width, row-major).
+// Returns false for comments and bad lines.
+static bool parse_log_line(char *line, float *map, int *frame, int *width_out, int *height_out)
+{
+  if (line[0] == '#' || line[0] == '\n' || line[0] == '\0')
+    return false;
+
+  char *p = line;
+  long fields[5];
+  for (int i = 0; i < 5; i++)
+  {
+    char *end;
+    fields[i] = strtol(p, &end, 10);
+    if (end == p || *end != ',')
+      return false;
+    p = end + 1;
+  }
+  int width = (int)fields[3];
+  int height = (int)fields[4];
+  if (width <= 0 || height <= 0 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE)
+    return false;
+
+  for (int i = 0; i < height; i++)
+  {
+    for (int j = 0; j < width; j++)
+    {
+      char *end;
+      long value = strtol(p, &end, 10);
+      if (end == p)
+        return false;
+      map[i * width + j] = (float)value;
+      p = (*end == ',') ? end + 1 : end;
+    }
+  }
+  *frame = (int)fields[0];
+  *width_out = width;
+  *height_out = height;
+  return true;
+}
+
+// Read the binary log file header and build its raw byte -> millimetre table.
+// Returns false (and rewinds) when the file is not a binary log.
+static bool read_binary_header(FILE *fp, float mm_table[256])
+{
+  log_file_header_t header;
+  if (fread(&header, 1, sizeof(header), fp) != sizeof(header) ||
+      memcmp(header.magic, LOG_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != LOG_FORMAT_VERSION || header.record_header_size != sizeof(log_record_header_t))
+  {
+    rewind(fp);
+    return false;
+  }
+  fseek(fp, header.header_size, SEEK_SET);
+  for (int raw = 0; raw < 256; raw++)
+  {
+    if (header.depth_encoding == LOG_DEPTH_LINEAR)
+      mm_table[raw] = (float)(raw * header.unit_mm);
+    else if (header.depth_encoding == LOG_DEPTH_NONLINEAR)
+      mm_table[raw] = (raw / 5.1f) * (raw / 5.1f);
+    else
+      mm_table[raw] = (float)raw;
+  }
+  return true;
+}
+
+// Read the next binary record into map (height x width, row-major). raw
+// keeps each sensor's previous frame bytes for delta records; raw_pixels[n]
+// is their count, 0 before sensor n's first keyframe. *used is false for
+// records to skip: sensors outside INFERENCE_SENSORS, and deltas whose
+// keyframe is before the start of the replay. Returns false at the end of
+// the file or on a torn record.
+static bool read_binary_record(FILE *fp, const float mm_table[256], uint8_t raw[][MAX_FRAME_PIXELS], int *raw_pixels,
+                               uint8_t *payload, float *map, int *frame, int *width_out, int *height_out, bool *used)
+{
+  log_record_header_t record;
+  if (fread(&record, 1, sizeof(record), fp) != sizeof(record) || record.magic != LOG_RECORD_MAGIC ||
+      record.width == 0 || record.height == 0 || record.width > MAX_IMAGE_SIZE || record.height > MAX_IMAGE_SIZE ||
+      record.payload_bytes > MAX_FRAME_PIXELS)
+    return false;
+  int pixels = record.width * record.height;
+  if (fread(payload, 1, record.payload_bytes, fp) != record.payload_bytes)
+    return false;
+  *used = record.sensor < DEPTH_SENSOR_COUNT && (INFERENCE_SENSORS & (1u << record.sensor)) != 0;
+  if (!*used)
+    return true;
+  uint8_t *prev = raw[record.sensor];
+  if (record.pixel_encoding == LOG_PIXELS_RAW && record.payload_bytes == pixels)
+  {
+    memcpy(prev, payload, pixels);
+  }
+  else if (record.pixel_encoding == LOG_PIXELS_DELTA && raw_pixels[record.sensor] == 0)
+  {
+    *used = false; // No keyframe of this sensor yet
+    return true;
+  }
+  else if (record.pixel_encoding != LOG_PIXELS_DELTA || raw_pixels[record.sensor] != pixels ||
+           !log_delta_apply(payload, record.payload_bytes, prev, pixels))
+  {
+    return false;
+  }
+  raw_pixels[record.sensor] = pixels;
+  for (int i = 0; i < pixels; i++)
+    map[i] = mm_table[prev[i]];
+  *frame = (int)record.frame;
+  *width_out = record.width;
+  *height_out = record.height;
+  return true;
+}
+
+void replay_bench_run(const char *path, uint32_t first_frame)
+{
+  printf("REPLAY_START:%s\n", path);
+  fflush(stdout);
+
+  // With a start frame, jump to the keyframe the index has at or before it
+  int segment = 0;
+  uint32_t offset = 0;
+  if (first_frame > 0)
+  {
+    log_index_entry_t entry;
+    if (!log_index_seek(path, first_frame, &entry))
+    {
+      printf("REPLAY_ERROR:No index entry at or before frame %lu\n", (unsigned long)first_frame);
+      fflush(stdout);
+      return;
+    }
+    segment = entry.segment;
+    offset = entry.offset;
+  }
+
+  char segment_path[80];
+  log_segment_path(path, segment, segment_path, sizeof(segment_path));
+  FILE *fp = sd_card_fopen(segment_path, "r");
+  if (!fp)
+  {
+    printf("REPLAY_ERROR:Cannot open file\n");
+    fflush(stdout);
+    return;
+  }
+
+  // Per-frame results live in PSRAM, printed once the timing-sensitive part is over
+  uint32_t *stage_us = (uint32_t *)heap_caps_malloc(sizeof(uint32_t) * STAGE_COUNT * REPLAY_MAX_FRAMES, MALLOC_CAP_SPIRAM);
+  int16_t *predictions = (int16_t *)heap_caps_malloc(sizeof(int16_t) * 2 * REPLAY_MAX_FRAMES, MALLOC_CAP_SPIRAM);
+  int *frame_numbers = (int *)heap_caps_malloc(sizeof(int) * REPLAY_MAX_FRAMES, MALLOC_CAP_SPIRAM);
+  uint32_t *sorted = (uint32_t *)heap_caps_malloc(sizeof(uint32_t) * REPLAY_MAX_FRAMES, MALLOC_CAP_SPIRAM);
+  static char line[SD_LINE_MAX + 2];
+  static float map[MAX_FRAME_PIXELS];
+  static uint8_t raw[DEPTH_SENSOR_COUNT][MAX_FRAME_PIXELS];
+  static uint8_t payload[MAX_FRAME_PIXELS];
+  int raw_pixels[DEPTH_SENSOR_COUNT] = {};
+  static float mm_table[256];
+  if (!stage_us || !predictions || !frame_numbers || !sorted)
+  {
+    printf("REPLAY_ERROR:Out of memory\n");
+    fflush(stdout);
+    heap_caps_free(stage_us);
+    heap_caps_free(predictions);
+    heap_caps_free(frame_numbers);
+    heap_caps_free(sorted);
+    fclose(fp);
+    return;
+  }
+
+  // Motors stay off for the whole run, and the main loop (so the sensor pipeline) is blocked until we return
+  drive_system_hold(true);
+
+  // Let an inference that the live pipeline already started finish, then start from an empty window
+  while (inference_in_progress())
+  {
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  reset_frame_buffer();
+
+  bool binary = read_binary_header(fp, mm_table);
+  if (offset > 0)
+    fseek(fp, offset, SEEK_SET);
+
+  int frames = 0;
+  int inferences = 0;
+  int64_t t_bench_start = esp_timer_get_time();
+  while (frames < REPLAY_MAX_FRAMES)
+  {
+    int64_t t0 = esp_timer_get_time();
+    int frame_number = 0, width = 0, height = 0;
+    if (binary)
+    {
+      bool used = false;
+      if (!read_binary_record(fp, mm_table, raw, raw_pixels, payload, map, &frame_number, &width, &height, &used))
+      {
+        // End of this segment: carry on in the next one, which starts with a keyframe
+        fclose(fp);
+        log_segment_path(path, ++segment, segment_path, sizeof(segment_path));
+        fp = sd_card_fopen(segment_path, "r");
+        if (!fp || !read_binary_header(fp, mm_table))
+          break;
+        memset(raw_pixels, 0, sizeof(raw_pixels));
+        continue;
+      }
+      if (!used)
+        continue;
+    }
+    else
+    {
+      if (!fgets(line, sizeof(line), fp))
+        break;
+      if (!parse_log_line(line, map, &frame_number, &width, &height))
+        continue;
+    }
+    int64_t t1 = esp_timer_get_time();
+    add_depth_map_to_buffer(map, height, width);
+    int64_t t2 = esp_timer_get_time();
+    bool ran = run_inference();
+    int64_t t3 = esp_timer_get_time();
+
+    inference_timing_t timing = get_last_inference_timing();
+    uint32_t *row = &stage_us[frames * STAGE_COUNT];
+    row[STAGE_READ] = (uint32_t)(t1 - t0);
+    row[STAGE_ADD_FRAME] = (uint32_t)(t2 - t1);
+    row[STAGE_INPUT_FILL] = ran ? (uint32_t)timing.input_fill_us : 0;
+    row[STAGE_INVOKE] = ran ? (uint32_t)timing.invoke_us : 0;
+    row[STAGE_TOTAL] = (uint32_t)(t3 - t0);
+
+    frame_numbers[frames] = frame_number;
+    if (ran)
+    {
+      inferences++;
+      control_state_t result;
+      get_inference_result(&result);
+      // Same integer-millis encoding as the log itself
+      predictions[frames * 2] = (int16_t)(result.steering * 1000);
+      predictions[frames * 2 + 1] = (int16_t)(result.throttle * 1000);
+    }
+    else
+    {
+      predictions[frames * 2] = INT16_MIN; // Window not full yet, no prediction
+    }
+    frames++;
+
+    // Give the idle task a chance to run on this core
+    if (frames % 50 == 0)
+    {
+      vTaskDelay(1);
+    }
+  }
+  int64_t elapsed_us = esp_timer_get_time() - t_bench_start;
+  if (fp)
+    fclose(fp);
+
+  // Don't let replayed frames leak into live inference
+  reset_frame_buffer();
+  drive_system_hold(false);
+
+  float seconds = (float)elapsed_us / 1e6f;
+  printf("REPLAY_STATS:frames:%d:inferences:%d:seconds:%.3f:fps:%.2f\n", frames, inferences,
+         (double)seconds, seconds > 0 ? (double)(frames / seconds) : 0.0);
+
+  // Percentiles per stage. Only frames that ran the model count for the inference stages.
+  for (int stage = 0; stage < STAGE_COUNT; stage++)
+  {
+    int count = 0;
+    for (int i = 0; i < frames; i++)
+    {
+      bool inference_stage = stage == STAGE_INPUT_FILL || stage == STAGE_INVOKE;
+      if (!inference_stage || predictions[i * 2] != INT16_MIN)
+      {
+        sorted[count++] = stage_us[i * STAGE_COUNT + stage];
+      }
+    }
+    if (count == 0)
+      continue;
+    qsort(sorted, count, sizeof(sorted[0]), compare_u32);
+    printf("REPLAY_STAGE:%s:p50:%lu:p95:%lu:p99:%lu\n", stage_names[stage],
+           (unsigned long)percentile(sorted, count, 50),
+           (unsigned long)percentile(sorted, count, 95),
+           (unsigned long)percentile(sorted, count, 99));
+  }
+
+  // REPLAY_FRAME:<log frame>:<steering millis>:<throttle millis>
+  for (int i = 0; i < frames; i++)
+  {
+    if (predictions[i * 2] != INT16_MIN)
+    {
+      printf("REPLAY_FRAME:%d:%d:%d\n", frame_numbers[i], predictions[i * 2], predictions[i * 2 + 1]);
+    }
+  }
+  printf("REPLAY_END\n");
+  fflush(stdout);
+
+  heap_caps_free(stage_us);
+  heap_caps_free(predictions);
+  heap_caps_free(frame_numbers);
+  heap_caps_free(sorted);
+}
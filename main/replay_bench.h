@@ -0,0 +1,24 @@
+#ifndef REPLAY_BENCH_H
+#define REPLAY_BENCH_H
+
+#include <stdint.h>
+
+#define REPLAY_MAX_FRAMES 20000 // Frames with per-stage timings kept for the percentiles
+
+/**
+ * @brief Replay a recorded depth log through the inference pipeline
+ *
+ * Streams every frame of a revised_log_XXXX.csv or .bin file from the SD card through
+ * add_depth_map_to_buffer() and run_inference() as fast as possible, with the
+ * motors stopped. Blocks the caller (the main loop) until the log is done, then
+ * prints throughput, p50/p95/p99 latency per stage and the predicted
+ * steering/throttle for each frame. A segmented binary log is read on into
+ * its following segment files.
+ *
+ * @param path Log file path relative to the SD mount point (e.g. "/revised_log_0024.csv")
+ * @param first_frame 0 to replay the whole log, otherwise start at the keyframe
+ *        the log's index has at or before this frame (binary logs only)
+ */
+void replay_bench_run(const char *path, uint32_t first_frame);
+
+#endif // REPLAY_BENCH_H
@@ -8,12 +8,18 @@
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "sd_pwr_ctrl_by_on_chip_ldo.h"
 
 static const char *TAG = "sd_card";
 
 #define MAX_PATH_LEN 256
 
+// Mount-time throughput self-test
+#define SELFTEST_PATH "/sdspeed.tmp"
+#define SELFTEST_BYTES (128 * 1024)
+#define SELFTEST_CHUNK (16 * 1024)
+
 // Global SD card handle
 static sd_card_handle_t *g_sd_handle = NULL;
 
@@ -50,6 +56,140 @@ static esp_err_t build_full_path(const char *path, char *full_path, size_t max_l
   return ESP_OK;
 }
 
+/*
+ * File handle cache. All of these expect files_lock to be held.
+ */
+
+/**
+ * @brief Push unsynced writes of a cached file to the card
+ */
+static bool cache_sync(sd_file_cache_entry_t *entry)
+{
+  if (entry->dirty_bytes == 0)
+  {
+    return true;
+  }
+  bool ok = fflush(entry->fp) == 0 && fsync(fileno(entry->fp)) == 0;
+  entry->dirty_bytes = 0;
+  return ok;
+}
+
+static void cache_close(sd_file_cache_entry_t *entry)
+{
+  fclose(entry->fp); // Syncs, like cache_sync()
+  entry->fp = NULL;
+  entry->dirty_bytes = 0;
+}
+
+static sd_file_cache_entry_t *cache_find(const char *full_path)
+{
+  for (int i = 0; i < SD_FILE_CACHE_SIZE; i++)
+  {
+    sd_file_cache_entry_t *entry = &g_sd_handle->files[i];
+    if (entry->fp && strcmp(entry->path, full_path) == 0)
+    {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Close the cached handle of a file, before something else opens or removes it
+ */
+static void cache_evict(const char *full_path)
+{
+  sd_file_cache_entry_t *entry = cache_find(full_path);
+  if (entry)
+  {
+    cache_close(entry);
+  }
+}
+
+static void cache_evict_all(void)
+{
+  for (int i = 0; i < SD_FILE_CACHE_SIZE; i++)
+  {
+    if (g_sd_handle->files[i].fp)
+    {
+      cache_close(&g_sd_handle->files[i]);
+    }
+  }
+}
+
+/**
+ * @brief Cached handle for a file, opened read/write on a miss
+ *
+ * The least recently used entry makes room. Returns NULL when the path is too
+ * long for the cache or the file can't be opened (or, without create, doesn't
+ * exist); the caller then falls back to a plain fopen().
+ */
+static sd_file_cache_entry_t *cache_open(const char *full_path, bool create)
+{
+  if (strlen(full_path) >= SD_FILE_CACHE_PATH_MAX)
+  {
+    return NULL;
+  }
+
+  sd_file_cache_entry_t *entry = cache_find(full_path);
+  if (!entry)
+  {
+    entry = &g_sd_handle->files[0];
+    for (int i = 0; i < SD_FILE_CACHE_SIZE; i++)
+    {
+      sd_file_cache_entry_t *candidate = &g_sd_handle->files[i];
+      if (!candidate->fp)
+      {
+        entry = candidate;
+        break;
+      }
+      if (candidate->last_used < entry->last_used)
+      {
+        entry = candidate;
+      }
+    }
+    if (entry->fp)
+    {
+      cache_close(entry);
+    }
+
+    FILE *f = fopen(full_path, "r+");
+    if (!f && create)
+    {
+      f = fopen(full_path, "w+");
+    }
+    if (!f)
+    {
+      return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    entry->fp = f;
+    strcpy(entry->path, full_path);
+    entry->size = size > 0 ? (size_t)size : 0;
+    entry->dirty_bytes = 0;
+  }
+  entry->last_used = ++g_sd_handle->file_use_counter;
+  return entry;
+}
+
+/**
+ * @brief Sync cached files whose unsynced appends are over the flush policy
+ */
+static void cache_apply_flush_policy(int64_t now_us)
+{
+  for (int i = 0; i < SD_FILE_CACHE_SIZE; i++)
+  {
+    sd_file_cache_entry_t *entry = &g_sd_handle->files[i];
+    if (entry->fp && entry->dirty_bytes > 0 &&
+        (entry->dirty_bytes >= SD_FILE_CACHE_FLUSH_BYTES ||
+         now_us - entry->dirty_since_us >= (int64_t)SD_FILE_CACHE_FLUSH_MS * 1000))
+    {
+      cache_sync(entry);
+    }
+  }
+}
+
 sd_card_config_t sd_card_get_default_config(void)
 {
   sd_card_config_t config = {
@@ -58,7 +198,7 @@ sd_card_config_t sd_card_get_default_config(void)
       .max_files = 5,
       .allocation_unit_size = 16 * 1024,
       .bus_width = 4,
-      .high_speed_mode = false}; // Default to 20MHz
+      .high_speed_mode = true}; // Negotiated down at mount if the bus can't take it
   return config;
 }
 
@@ -76,7 +216,84 @@ FILE* sd_card_fopen(const char *path, const char *mode)
     return NULL;
   }
 
-  return fopen(full_path, mode);
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  cache_evict(full_path);
+  FILE *f = fopen(full_path, mode);
+  if (!f)
+  {
+    // Out of FATFS file slots? The cached handles give theirs back
+    cache_evict_all();
+    f = fopen(full_path, mode);
+  }
+  xSemaphoreGive(g_sd_handle->files_lock);
+  return f;
+}
+
+/**
+ * @brief Write, sync and read back a test file, checking every byte
+ *
+ * The SDMMC driver reports CRC and timeout errors as failed reads/writes, so
+ * a clock the bus can't take fails here even when the mount went through.
+ */
+static esp_err_t run_speed_selftest(float *write_mbps, float *read_mbps)
+{
+  char full_path[MAX_PATH_LEN];
+  esp_err_t ret = build_full_path(SELFTEST_PATH, full_path, sizeof(full_path));
+  if (ret != ESP_OK)
+  {
+    return ret;
+  }
+
+  uint8_t *chunk = (uint8_t *)malloc(SELFTEST_CHUNK);
+  if (!chunk)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+
+  ret = ESP_FAIL;
+  FILE *f = fopen(full_path, "wb");
+  if (f)
+  {
+    int64_t t0 = esp_timer_get_time();
+    bool ok = true;
+    for (int offset = 0; ok && offset < SELFTEST_BYTES; offset += SELFTEST_CHUNK)
+    {
+      for (int i = 0; i < SELFTEST_CHUNK; i++)
+      {
+        chunk[i] = (uint8_t)((offset + i) * 31 + (offset >> 14));
+      }
+      ok = fwrite(chunk, 1, SELFTEST_CHUNK, f) == SELFTEST_CHUNK;
+    }
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    int64_t t_write = esp_timer_get_time() - t0;
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok && (f = fopen(full_path, "rb")) != NULL)
+    {
+      t0 = esp_timer_get_time();
+      for (int offset = 0; ok && offset < SELFTEST_BYTES; offset += SELFTEST_CHUNK)
+      {
+        ok = fread(chunk, 1, SELFTEST_CHUNK, f) == SELFTEST_CHUNK;
+        for (int i = 0; ok && i < SELFTEST_CHUNK; i++)
+        {
+          ok = chunk[i] == (uint8_t)((offset + i) * 31 + (offset >> 14));
+        }
+      }
+      int64_t t_read = esp_timer_get_time() - t0;
+      fclose(f);
+
+      if (ok)
+      {
+        *write_mbps = t_write > 0 ? (float)SELFTEST_BYTES / (float)t_write : 0.0f; // bytes/us == MB/s
+        *read_mbps = t_read > 0 ? (float)SELFTEST_BYTES / (float)t_read : 0.0f;
+        ret = ESP_OK;
+      }
+    }
+    unlink(full_path);
+  }
+
+  free(chunk);
+  return ret;
 }
 
 esp_err_t sd_card_init(const sd_card_config_t *config)
@@ -107,11 +324,23 @@ esp_err_t sd_card_init(const sd_card_config_t *config)
   g_sd_handle->is_mounted = false;
   g_sd_handle->card = NULL;
   g_sd_handle->pwr_ctrl_handle = NULL;
+  g_sd_handle->freq_khz = 0;
+  g_sd_handle->write_mbps = 0.0f;
+  g_sd_handle->read_mbps = 0.0f;
+  memset(g_sd_handle->files, 0, sizeof(g_sd_handle->files));
+  g_sd_handle->file_use_counter = 0;
+  g_sd_handle->files_lock = xSemaphoreCreateMutex();
+  if (!g_sd_handle->files_lock)
+  {
+    free(g_sd_handle);
+    g_sd_handle = NULL;
+    return ESP_ERR_NO_MEM;
+  }
 
   // Configure mount options
   esp_vfs_fat_sdmmc_mount_config_t mount_config = {
       .format_if_mount_failed = config->format_if_mount_failed,
-      .max_files = config->max_files,
+      .max_files = config->max_files + SD_FILE_CACHE_SIZE, // The handle cache has its own slots
       .allocation_unit_size = config->allocation_unit_size,
       .disk_status_check_enable = false,
       .use_one_fat = false};
@@ -125,19 +354,6 @@ esp_err_t sd_card_init(const sd_card_config_t *config)
   // Increase timeout and initialization attempts
   host.command_timeout_ms = 5000; // Increase from default 1000ms
 
-  // Configure for high-speed mode if requested (40 MHz)
-  if (config->high_speed_mode)
-  {
-    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
-    ESP_LOGI(TAG, "Using high-speed mode (40 MHz)");
-  }
-  else
-  {
-    // Start with lower frequency for better compatibility
-    host.max_freq_khz = SDMMC_FREQ_PROBING; // Start at 400kHz
-    ESP_LOGI(TAG, "Using default speed mode (20 MHz)");
-  }
-
   // Initialize LDO power control for ESP32-P4
   // This is CRITICAL for proper SD card operation on ESP32-P4
   sd_pwr_ctrl_ldo_config_t ldo_config = {
@@ -149,6 +365,7 @@ esp_err_t sd_card_init(const sd_card_config_t *config)
   if (ret != ESP_OK)
   {
     ESP_LOGE(TAG, "Failed to create LDO power control driver: %s", esp_err_to_name(ret));
+    vSemaphoreDelete(g_sd_handle->files_lock);
     free(g_sd_handle);
     g_sd_handle = NULL;
     return ret;
@@ -176,27 +393,60 @@ esp_err_t sd_card_init(const sd_card_config_t *config)
 
   ESP_LOGI(TAG, "Slot configured with internal pull-ups enabled");
 
-  ESP_LOGI(TAG, "Mounting filesystem");
-  ret = esp_vfs_fat_sdmmc_mount(config->mount_point, &host, &slot_config,
-                                &mount_config, &g_sd_handle->card);
+  // Fastest clock first; drop to the next one when the mount or the self-test fails
+  const int speeds_khz[] = {SDMMC_FREQ_HIGHSPEED, SDMMC_FREQ_DEFAULT, SDMMC_FREQ_PROBING};
+  const int first = config->high_speed_mode ? 0 : 1;
+  const int speed_count = sizeof(speeds_khz) / sizeof(speeds_khz[0]);
 
-  if (ret != ESP_OK)
+  ret = ESP_FAIL;
+  for (int s = first; s < speed_count; s++)
   {
-    if (ret == ESP_FAIL)
+    host.max_freq_khz = speeds_khz[s];
+    ESP_LOGI(TAG, "Mounting filesystem at %d kHz", speeds_khz[s]);
+    ret = esp_vfs_fat_sdmmc_mount(config->mount_point, &host, &slot_config,
+                                  &mount_config, &g_sd_handle->card);
+    if (ret != ESP_OK)
     {
-      ESP_LOGE(TAG, "Failed to mount filesystem");
+      if (ret == ESP_FAIL)
+      {
+        ESP_LOGE(TAG, "Failed to mount filesystem");
+      }
+      else
+      {
+        ESP_LOGE(TAG, "Failed to initialize card (%s)", esp_err_to_name(ret));
+      }
+      continue;
     }
-    else
+
+    g_sd_handle->is_mounted = true;
+    ret = run_speed_selftest(&g_sd_handle->write_mbps, &g_sd_handle->read_mbps);
+    if (ret == ESP_OK)
     {
-      ESP_LOGE(TAG, "Failed to initialize card (%s)", esp_err_to_name(ret));
+      g_sd_handle->freq_khz = speeds_khz[s];
+      break;
     }
+
+    ESP_LOGW(TAG, "Self-test failed at %d kHz, trying a slower clock", speeds_khz[s]);
+    esp_vfs_fat_sdcard_unmount(g_sd_handle->mount_point, g_sd_handle->card);
+    g_sd_handle->is_mounted = false;
+    g_sd_handle->card = NULL;
+  }
+
+  if (ret != ESP_OK)
+  {
+    if (g_sd_handle->pwr_ctrl_handle)
+    {
+      sd_pwr_ctrl_del_on_chip_ldo((sd_pwr_ctrl_handle_t)g_sd_handle->pwr_ctrl_handle);
+    }
+    vSemaphoreDelete(g_sd_handle->files_lock);
     free(g_sd_handle);
     g_sd_handle = NULL;
     return ret;
   }
 
-  g_sd_handle->is_mounted = true;
   ESP_LOGI(TAG, "Filesystem mounted");
+  ESP_LOGI(TAG, "Bus %d kHz, self-test write %.2f MB/s, read %.2f MB/s", g_sd_handle->freq_khz,
+           (double)g_sd_handle->write_mbps, (double)g_sd_handle->read_mbps);
 
   // Print card info
   sdmmc_card_print_info(stdout, g_sd_handle->card);
@@ -211,6 +461,10 @@ esp_err_t sd_card_deinit(void)
     return ESP_ERR_INVALID_STATE;
   }
 
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  cache_evict_all();
+  xSemaphoreGive(g_sd_handle->files_lock);
+
   if (g_sd_handle->is_mounted)
   {
     esp_vfs_fat_sdcard_unmount(g_sd_handle->mount_point, g_sd_handle->card);
@@ -232,6 +486,7 @@ esp_err_t sd_card_deinit(void)
     }
   }
 
+  vSemaphoreDelete(g_sd_handle->files_lock);
   free(g_sd_handle);
   g_sd_handle = NULL;
   return ESP_OK;
@@ -251,24 +506,43 @@ esp_err_t sd_card_write_file(const char *path, const char *data, size_t len)
     return ret;
   }
 
+  if (len == 0)
+  {
+    len = strlen(data);
+  }
+
   ESP_LOGI(TAG, "Writing file %s", full_path);
-  FILE *f = fopen(full_path, "w");
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  sd_file_cache_entry_t *entry = cache_open(full_path, true);
+  FILE *f = entry ? entry->fp : fopen(full_path, "w");
   if (!f)
   {
+    xSemaphoreGive(g_sd_handle->files_lock);
     ESP_LOGE(TAG, "Failed to open file for writing");
     return ESP_FAIL;
   }
 
-  if (len == 0)
+  bool ok;
+  if (entry)
   {
-    fprintf(f, "%s", data);
+    // Rewrite in place and cut off whatever the old contents had beyond len
+    ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(data, 1, len, f) == len && fflush(f) == 0 &&
+         ftruncate(fileno(f), len) == 0 && fsync(fileno(f)) == 0;
+    entry->size = len;
+    entry->dirty_bytes = 0;
   }
   else
   {
-    fwrite(data, 1, len, f);
+    ok = fwrite(data, 1, len, f) == len;
+    ok = fclose(f) == 0 && ok;
   }
+  xSemaphoreGive(g_sd_handle->files_lock);
 
-  fclose(f);
+  if (!ok)
+  {
+    ESP_LOGE(TAG, "Failed to write file");
+    return ESP_FAIL;
+  }
   ESP_LOGI(TAG, "File written");
 
   return ESP_OK;
@@ -288,27 +562,44 @@ esp_err_t sd_card_append_file(const char *path, const char *data, size_t len)
     return ret;
   }
 
+  if (len == 0)
+  {
+    len = strlen(data);
+  }
+
   // ESP_LOGI(TAG, "Appending to file %s", full_path);
-  FILE *f = fopen(full_path, "a");
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  sd_file_cache_entry_t *entry = cache_open(full_path, true);
+  FILE *f = entry ? entry->fp : fopen(full_path, "a");
   if (!f)
   {
+    xSemaphoreGive(g_sd_handle->files_lock);
     ESP_LOGE(TAG, "Failed to open file for appending");
     return ESP_FAIL;
   }
 
-  if (len == 0)
+  bool ok;
+  int64_t now_us = esp_timer_get_time();
+  if (entry)
   {
-    fprintf(f, "%s", data);
+    ok = fseek(f, 0, SEEK_END) == 0 && fwrite(data, 1, len, f) == len;
+    entry->size += len;
+    if (entry->dirty_bytes == 0)
+    {
+      entry->dirty_since_us = now_us;
+    }
+    entry->dirty_bytes += len;
   }
   else
   {
-    fwrite(data, 1, len, f);
+    ok = fwrite(data, 1, len, f) == len;
+    ok = fclose(f) == 0 && ok;
   }
-
-  fclose(f);
+  cache_apply_flush_policy(now_us);
+  xSemaphoreGive(g_sd_handle->files_lock);
   // ESP_LOGI(TAG, "Data appended");
 
-  return ESP_OK;
+  return ok ? ESP_OK : ESP_FAIL;
 }
 
 esp_err_t sd_card_read_file(const char *path, char *buffer, size_t buffer_size, size_t *bytes_read)
@@ -326,13 +617,20 @@ esp_err_t sd_card_read_file(const char *path, char *buffer, size_t buffer_size,
   }
 
   ESP_LOGI(TAG, "Reading file %s", full_path);
-  FILE *f = fopen(full_path, "r");
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  sd_file_cache_entry_t *entry = cache_open(full_path, false);
+  FILE *f = entry ? entry->fp : fopen(full_path, "r");
   if (!f)
   {
+    xSemaphoreGive(g_sd_handle->files_lock);
     ESP_LOGE(TAG, "Failed to open file for reading");
     return ESP_FAIL;
   }
 
+  if (entry)
+  {
+    fseek(f, 0, SEEK_SET); // Also required between a write and a read on the same stream
+  }
   size_t read = fread(buffer, 1, buffer_size - 1, f);
   buffer[read] = '\0'; // Null terminate
 
@@ -341,7 +639,11 @@ esp_err_t sd_card_read_file(const char *path, char *buffer, size_t buffer_size,
     *bytes_read = read;
   }
 
-  fclose(f);
+  if (!entry)
+  {
+    fclose(f);
+  }
+  xSemaphoreGive(g_sd_handle->files_lock);
   ESP_LOGI(TAG, "Read %zu bytes from file", read);
 
   return ESP_OK;
@@ -362,7 +664,11 @@ esp_err_t sd_card_delete_file(const char *path)
   }
 
   ESP_LOGI(TAG, "Deleting file %s", full_path);
-  if (unlink(full_path) != 0)
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  cache_evict(full_path); // FAT can't remove an open file
+  int result = unlink(full_path);
+  xSemaphoreGive(g_sd_handle->files_lock);
+  if (result != 0)
   {
     ESP_LOGE(TAG, "Failed to delete file");
     return ESP_FAIL;
@@ -395,7 +701,12 @@ esp_err_t sd_card_rename_file(const char *old_path, const char *new_path)
   }
 
   ESP_LOGI(TAG, "Renaming %s to %s", old_full, new_full);
-  if (rename(old_full, new_full) != 0)
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  cache_evict(old_full);
+  cache_evict(new_full);
+  int result = rename(old_full, new_full);
+  xSemaphoreGive(g_sd_handle->files_lock);
+  if (result != 0)
   {
     ESP_LOGE(TAG, "Failed to rename file");
     return ESP_FAIL;
@@ -419,8 +730,10 @@ esp_err_t sd_card_file_exists(const char *path, bool *exists)
     return ret;
   }
 
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
   struct stat st;
-  *exists = (stat(full_path, &st) == 0);
+  *exists = cache_find(full_path) != NULL || stat(full_path, &st) == 0;
+  xSemaphoreGive(g_sd_handle->files_lock);
 
   return ESP_OK;
 }
@@ -439,17 +752,44 @@ esp_err_t sd_card_get_file_size(const char *path, size_t *size)
     return ret;
   }
 
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  sd_file_cache_entry_t *entry = cache_find(full_path);
   struct stat st;
-  if (stat(full_path, &st) != 0)
+  bool found = entry != NULL || stat(full_path, &st) == 0;
+  if (found)
+  {
+    *size = entry ? entry->size : st.st_size;
+  }
+  xSemaphoreGive(g_sd_handle->files_lock);
+
+  if (!found)
   {
     ESP_LOGE(TAG, "Failed to get file stats");
     return ESP_FAIL;
   }
-
-  *size = st.st_size;
   return ESP_OK;
 }
 
+esp_err_t sd_card_flush_cache(void)
+{
+  if (!g_sd_handle || !g_sd_handle->is_mounted)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  bool ok = true;
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  for (int i = 0; i < SD_FILE_CACHE_SIZE; i++)
+  {
+    if (g_sd_handle->files[i].fp)
+    {
+      ok = cache_sync(&g_sd_handle->files[i]) && ok;
+    }
+  }
+  xSemaphoreGive(g_sd_handle->files_lock);
+  return ok ? ESP_OK : ESP_FAIL;
+}
+
 esp_err_t sd_card_print_info(void)
 {
   if (!g_sd_handle || !g_sd_handle->is_mounted)
@@ -458,6 +798,10 @@ esp_err_t sd_card_print_info(void)
   }
 
   sdmmc_card_print_info(stdout, g_sd_handle->card);
+  printf("Bus clock: %d kHz (negotiated at mount, card reports %d kHz)\n", g_sd_handle->freq_khz,
+         g_sd_handle->card->real_freq_khz);
+  printf("Self-test: write %.2f MB/s, read %.2f MB/s\n", (double)g_sd_handle->write_mbps,
+         (double)g_sd_handle->read_mbps);
   return ESP_OK;
 }
 
@@ -469,6 +813,9 @@ esp_err_t sd_card_format(void)
   }
 
   ESP_LOGI(TAG, "Formatting SD card");
+  xSemaphoreTake(g_sd_handle->files_lock, portMAX_DELAY);
+  cache_evict_all();
+  xSemaphoreGive(g_sd_handle->files_lock);
   esp_err_t ret = esp_vfs_fat_sdcard_format(g_sd_handle->mount_point, g_sd_handle->card);
   if (ret != ESP_OK)
   {
@@ -1,8 +1,20 @@
 #ifndef SD_CARD_H
 #define SD_CARD_H
 
+#include <stdio.h>
 #include "esp_err.h"
 #include "sdmmc_cmd.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Files that sd_card_write_file(), sd_card_append_file() and
+// sd_card_read_file() keep open between calls, so repeated small writes skip
+// the FAT directory lookup of fopen() and the sync of fclose(). Each one also
+// holds a FATFS file slot, counted on top of sd_card_config_t.max_files.
+#define SD_FILE_CACHE_SIZE 4
+#define SD_FILE_CACHE_PATH_MAX 64      // Longer paths bypass the cache
+#define SD_FILE_CACHE_FLUSH_BYTES 4096 // Appended bytes before a cached file is synced to the card
+#define SD_FILE_CACHE_FLUSH_MS 1000    // Or when its oldest unsynced append is this old
 
 #ifdef __cplusplus
 extern "C"
@@ -19,9 +31,22 @@ extern "C"
     int max_files;
     size_t allocation_unit_size;
     uint8_t bus_width;    // 1 or 4
-    bool high_speed_mode; // true for 40MHz, false for 20MHz
+    bool high_speed_mode; // Try 40MHz first; otherwise start at 20MHz
   } sd_card_config_t;
 
+  /**
+   * @brief One open file kept by the handle cache (internal use only)
+   */
+  typedef struct
+  {
+    FILE *fp;                           // NULL = free slot
+    char path[SD_FILE_CACHE_PATH_MAX]; // Full path, mount point included
+    size_t size;                        // Current file size, kept up to date by the helpers
+    size_t dirty_bytes;                 // Written since the last sync
+    int64_t dirty_since_us;             // Time of the oldest unsynced write
+    uint32_t last_used;                 // For least-recently-used eviction
+  } sd_file_cache_entry_t;
+
   /**
    * @brief SD card handle structure (internal use only)
    */
@@ -31,11 +56,22 @@ extern "C"
     const char *mount_point;
     bool is_mounted;
     void *pwr_ctrl_handle; // Power control handle for LDO
+    int freq_khz;          // Bus clock that passed the self-test
+    float write_mbps;      // Self-test sequential throughput at that clock
+    float read_mbps;
+    sd_file_cache_entry_t files[SD_FILE_CACHE_SIZE];
+    uint32_t file_use_counter;
+    SemaphoreHandle_t files_lock; // Guards files[], the helpers run on several tasks
   } sd_card_handle_t;
 
   /**
    * @brief Initialize and mount SD card
    *
+   * Tries the high-speed (if enabled), default and probing clocks in turn. At
+   * each clock the card must mount and pass a short sequential write/read
+   * self-test; CRC or timeout errors drop to the next slower clock. The chosen
+   * clock and measured throughput are reported by sd_card_print_info().
+   *
    * @param config SD card configuration
    * @return esp_err_t ESP_OK on success
    */
@@ -44,12 +80,17 @@ extern "C"
   /**
    * @brief Unmount and deinitialize SD card
    *
+   * Syncs and closes the files in the handle cache first.
+   *
    * @return esp_err_t ESP_OK on success
    */
   esp_err_t sd_card_deinit(void);
 
   /**
-   * @brief Write data to file on SD card
+   * @brief Write data to file on SD card, replacing its contents
+   *
+   * Synced before returning, like a close would; the file stays open in the
+   * handle cache for the next call.
    *
    * @param path File path relative to mount point (e.g., "/hello.txt")
    * @param data Data to write
@@ -61,6 +102,10 @@ extern "C"
   /**
    * @brief Append data to file on SD card
    *
+   * The file stays open in the handle cache. The data reaches the card after
+   * SD_FILE_CACHE_FLUSH_BYTES or SD_FILE_CACHE_FLUSH_MS, on the next
+   * sd_card_flush_cache(), or when anything else opens, stats or removes the file.
+   *
    * @param path File path relative to mount point
    * @param data Data to append
    * @param len Length of data (0 for null-terminated string)
@@ -69,7 +114,7 @@ extern "C"
   esp_err_t sd_card_append_file(const char *path, const char *data, size_t len);
 
   /**
-   * @brief Read data from file on SD card
+   * @brief Read data from file on SD card (through the handle cache)
    *
    * @param path File path relative to mount point
    * @param buffer Buffer to store read data
@@ -97,7 +142,7 @@ extern "C"
   esp_err_t sd_card_rename_file(const char *old_path, const char *new_path);
 
   /**
-   * @brief Check if file exists on SD card
+   * @brief Check if file exists on SD card (no stat for files in the handle cache)
    *
    * @param path File path relative to mount point
    * @param exists Pointer to store result
@@ -106,7 +151,7 @@ extern "C"
   esp_err_t sd_card_file_exists(const char *path, bool *exists);
 
   /**
-   * @brief Get file size
+   * @brief Get file size (no stat for files in the handle cache)
    *
    * @param path File path relative to mount point
    * @param size Pointer to store file size
@@ -115,7 +160,14 @@ extern "C"
   esp_err_t sd_card_get_file_size(const char *path, size_t *size);
 
   /**
-   * @brief Print SD card information
+   * @brief Sync every file in the handle cache with unsynced appends
+   *
+   * @return esp_err_t ESP_OK on success
+   */
+  esp_err_t sd_card_flush_cache(void);
+
+  /**
+   * @brief Print SD card information, bus clock and self-test throughput
    *
    * @return esp_err_t ESP_OK on success
    */
@@ -137,7 +189,10 @@ extern "C"
 
   /**
    * @brief Open file on SD card (returns FILE* for direct operations)
-   * 
+   *
+   * A cached handle for the same file is closed first, so the caller sees
+   * everything the helpers wrote and owns the file alone.
+   *
    * @param path File path relative to mount point
    * @param mode File mode ("r", "w", "a", etc.)
    * @return FILE* File pointer, or NULL on failure
@@ -1,30 +1,107 @@
 #include "serial_commands.h"
 #include "sdcard/sd.h"
 #include "drive_system/depth_sensor.h"
+#include "drive_system/battery.h"
+#include "drive_system/reflex_stop.h"
+#include "op_profiler.h"
+#include "latency_histogram.h"
+#include "trace_events.h"
+#include "memory_report.h"
+#include "power_manager.h"
+#include "boot_init.h"
+#include "replay_bench.h"
+#include "log_index.h"
+#include "flight_recorder.h"
+#include "hil.h"
+#include "main_functions.h"
+#include "task_layout.h"
+#include "net_telemetry.h"
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <errno.h>
-#include <fcntl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include "driver/uart.h"
+#include "driver/uart_vfs.h"
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG || CONFIG_ESP_CONSOLE_SECONDARY_USB_SERIAL_JTAG
+#include "driver/usb_serial_jtag.h"
+#include "driver/usb_serial_jtag_vfs.h"
+#endif
 
 #define COMMAND_BUFFER_SIZE 256
+#define STATS_MAX_TASKS 32 // Tasks GET_STATS keeps runtime counters for
 #define FILE_CHUNK_SIZE 512
+#define HEX_LINE_BYTES 64 // Binary files are sent as hex lines of this many bytes
+
+// DOWNLOAD_BIN: raw chunks with a CRC, a sliding window of unacknowledged
+// chunks and go-back-N retransmission
+#define BIN_CHUNK_SIZE 4096
+#define BIN_WINDOW 8              // Chunks in flight before the sender waits for an ACK
+#define BIN_ACK_TIMEOUT_MS 500    // No ACK for this long: resend from the oldest unacknowledged chunk
+#define BIN_MAX_TIMEOUTS 10       // Give up after this many timeouts in a row
+#define BIN_CHUNK_MAGIC 0x4B434E54 // "TNCK"
+
+typedef struct __attribute__((packed))
+{
+  uint32_t magic;    // BIN_CHUNK_MAGIC
+  uint32_t seq;      // Chunk number, 0 = the chunk at the start offset
+  uint32_t offset;   // File offset of the payload
+  uint16_t length;   // Payload bytes, 0 = end of file
+  uint16_t reserved; // 0
+  uint32_t crc;      // CRC32 (zlib) of the header before this field and the payload
+} bin_chunk_header_t;
+
+#if CONFIG_LIBC_STDOUT_LINE_ENDING_LF
+#define CONSOLE_TX_LINE_ENDINGS ESP_LINE_ENDINGS_LF
+#elif CONFIG_LIBC_STDOUT_LINE_ENDING_CR
+#define CONSOLE_TX_LINE_ENDINGS ESP_LINE_ENDINGS_CR
+#else
+#define CONSOLE_TX_LINE_ENDINGS ESP_LINE_ENDINGS_CRLF
+#endif
 
 static char command_buffer[COMMAND_BUFFER_SIZE];
 static int buffer_pos = 0;
 
+// Commands the console task passes to the main loop, one at a time
+static QueueHandle_t g_main_loop_commands = NULL;
+
 extern char g_depth_log_filename[64];
 
-void serial_commands_init()
+/**
+ * @brief Read what the console has received, waiting up to timeout for the
+ *        first byte
+ *
+ * @return Bytes read, 0 on timeout
+ */
+static int console_read(char *buf, size_t len, TickType_t timeout)
 {
-    buffer_pos = 0;
-    memset(command_buffer, 0, sizeof(command_buffer));
-    
-    // Make stdin non-blocking
-    int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+#if CONFIG_ESP_CONSOLE_UART
+  int n = uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, buf, 1, timeout);
+  if (n <= 0)
+    return 0;
+  size_t buffered = 0;
+  uart_get_buffered_data_len(CONFIG_ESP_CONSOLE_UART_NUM, &buffered);
+  if (buffered > len - 1)
+    buffered = len - 1;
+  if (buffered > 0)
+    n += uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, buf + 1, buffered, 0);
+  return n;
+#elif CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+  int n = usb_serial_jtag_read_bytes(buf, len, timeout);
+  return n > 0 ? n : 0;
+#else
+  vTaskDelay(timeout);
+  return 0;
+#endif
 }
 
 static void handle_get_log_filename()
@@ -82,6 +159,24 @@ static void handle_list_files()
   fflush(stdout);
 }
 
+// Send bytes as lines of hex, HEX_LINE_BYTES per line
+static void send_hex(const uint8_t *data, size_t len)
+{
+  static const char digits[] = "0123456789abcdef";
+  char line[HEX_LINE_BYTES * 2 + 1];
+  for (size_t i = 0; i < len; i += HEX_LINE_BYTES)
+  {
+    size_t n = len - i < HEX_LINE_BYTES ? len - i : HEX_LINE_BYTES;
+    for (size_t k = 0; k < n; k++)
+    {
+      line[2 * k] = digits[data[i + k] >> 4];
+      line[2 * k + 1] = digits[data[i + k] & 0x0F];
+    }
+    line[2 * n] = '\n';
+    fwrite(line, 1, 2 * n + 1, stdout);
+  }
+}
+
 static void handle_download_file(const char *filename)
 {
   bool exists = false;
@@ -105,7 +200,15 @@ static void handle_download_file(const char *filename)
     return;
   }
 
+  // The console is line-based text, so binary logs go out hex encoded
+  size_t name_len = strlen(filename);
+  bool hex = name_len >= 4 && strcmp(filename + name_len - 4, ".bin") == 0;
+
   printf("FILE_SIZE:%zu\n", file_size);
+  if (hex)
+  {
+    printf("FILE_ENCODING:hex\n");
+  }
   printf("FILE_START\n");
   fflush(stdout);
 
@@ -124,7 +227,14 @@ static void handle_download_file(const char *filename)
 
   while ((bytes_read = fread(chunk, 1, sizeof(chunk), fp)) > 0)
   {
-    fwrite(chunk, 1, bytes_read, stdout);
+    if (hex)
+    {
+      send_hex((const uint8_t *)chunk, bytes_read);
+    }
+    else
+    {
+      fwrite(chunk, 1, bytes_read, stdout);
+    }
     fflush(stdout);
   }
 
@@ -134,8 +244,425 @@ static void handle_download_file(const char *filename)
   fflush(stdout);
 }
 
+// Raw bytes on the console: stdout turns every \n into \r\n, which would
+// corrupt the payload, so binary transfers switch that off while they run
+static void set_console_binary(bool binary)
+{
+  fflush(stdout);
+  esp_line_endings_t mode = binary ? ESP_LINE_ENDINGS_LF : CONSOLE_TX_LINE_ENDINGS;
+#if CONFIG_ESP_CONSOLE_UART
+  uart_vfs_dev_port_set_tx_line_endings(CONFIG_ESP_CONSOLE_UART_NUM, mode);
+#endif
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG || CONFIG_ESP_CONSOLE_SECONDARY_USB_SERIAL_JTAG
+  usb_serial_jtag_vfs_set_tx_line_endings(mode);
+#endif
+}
+
+// Read and send the chunk seq of a DOWNLOAD_BIN transfer, header and payload in one write
+static bool send_bin_chunk(FILE *fp, size_t file_size, size_t start, uint32_t seq)
+{
+  static uint8_t frame[sizeof(bin_chunk_header_t) + BIN_CHUNK_SIZE];
+  bin_chunk_header_t *header = (bin_chunk_header_t *)frame;
+  size_t offset = start + (size_t)seq * BIN_CHUNK_SIZE;
+  size_t length = offset < file_size ? file_size - offset : 0;
+  if (length > BIN_CHUNK_SIZE)
+    length = BIN_CHUNK_SIZE;
+
+  if (length > 0 && (fseek(fp, offset, SEEK_SET) != 0 ||
+                     fread(frame + sizeof(bin_chunk_header_t), 1, length, fp) != length))
+    return false;
+
+  header->magic = BIN_CHUNK_MAGIC;
+  header->seq = seq;
+  header->offset = (uint32_t)offset;
+  header->length = (uint16_t)length;
+  header->reserved = 0;
+  uint32_t crc = esp_rom_crc32_le(0, frame, offsetof(bin_chunk_header_t, crc));
+  header->crc = esp_rom_crc32_le(crc, frame + sizeof(bin_chunk_header_t), length);
+  fwrite(frame, 1, sizeof(bin_chunk_header_t) + length, stdout);
+  fflush(stdout);
+  return true;
+}
+
+// DOWNLOAD_BIN:<path>[:<offset>]
+// Sends the file from offset on as BIN_CHUNK_SIZE binary chunks. The host
+// answers ACK:<seq> when it has every chunk up to seq and NAK:<seq> when
+// chunk seq arrived damaged or out of order; ABORT stops the transfer. A
+// partial download resumes by asking for the bytes it doesn't have yet.
+static void handle_download_binary(const char *args)
+{
+  char path[80];
+  strncpy(path, args, sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+  size_t start = 0;
+  char *sep = strrchr(path, ':');
+  if (sep)
+  {
+    *sep = '\0';
+    start = strtoul(sep + 1, NULL, 10);
+  }
+
+  size_t file_size = 0;
+  if (sd_card_get_file_size(path, &file_size) != ESP_OK)
+  {
+    printf("BIN_ERROR:File not found\n");
+    fflush(stdout);
+    return;
+  }
+  if (start > file_size)
+  {
+    printf("BIN_ERROR:Offset %zu past the end of the file (%zu bytes)\n", start, file_size);
+    fflush(stdout);
+    return;
+  }
+  FILE *fp = sd_card_fopen(path, "rb");
+  if (!fp)
+  {
+    printf("BIN_ERROR:Cannot open file\n");
+    fflush(stdout);
+    return;
+  }
+
+  // The last chunk is the empty end-of-file marker
+  uint32_t last = (uint32_t)((file_size - start + BIN_CHUNK_SIZE - 1) / BIN_CHUNK_SIZE);
+  printf("BIN_START:size:%zu:offset:%zu:chunk:%d:window:%d\n", file_size, start, BIN_CHUNK_SIZE, BIN_WINDOW);
+  set_console_binary(true);
+
+  uint32_t base = 0; // Oldest chunk not acknowledged yet
+  uint32_t next = 0; // Next chunk to send
+  int timeouts = 0;
+  int64_t last_progress_us = esp_timer_get_time();
+  char line[32];
+  int line_pos = 0;
+  const char *error = NULL;
+  while (base <= last && error == NULL)
+  {
+    while (next <= last && next < base + BIN_WINDOW)
+    {
+      if (!send_bin_chunk(fp, file_size, start, next))
+      {
+        error = "Read failed";
+        break;
+      }
+      next++;
+    }
+
+    // Replies are short text lines
+    char replies[64];
+    int received = console_read(replies, sizeof(replies), 0);
+    bool idle = received == 0;
+    for (int i = 0; i < received && error == NULL; i++)
+    {
+      char c = replies[i];
+      if (c != '\n' && c != '\r')
+      {
+        if (line_pos < (int)sizeof(line) - 1)
+          line[line_pos++] = c;
+        continue;
+      }
+      line[line_pos] = '\0';
+      line_pos = 0;
+      if (strncmp(line, "ACK:", 4) == 0)
+      {
+        uint32_t seq = (uint32_t)strtoul(line + 4, NULL, 10);
+        if (seq >= base && seq < next)
+        {
+          base = seq + 1;
+          timeouts = 0;
+          last_progress_us = esp_timer_get_time();
+        }
+      }
+      else if (strncmp(line, "NAK:", 4) == 0)
+      {
+        // Everything before seq arrived, go back and resend from seq
+        uint32_t seq = (uint32_t)strtoul(line + 4, NULL, 10);
+        if (seq >= base && seq < next)
+        {
+          base = seq;
+          next = seq;
+          last_progress_us = esp_timer_get_time();
+        }
+      }
+      else if (strcmp(line, "ABORT") == 0)
+      {
+        error = "Aborted";
+      }
+    }
+
+    bool waiting = next == base + BIN_WINDOW || next > last; // Nothing left to send until an ACK
+    if (idle && waiting)
+    {
+      if (esp_timer_get_time() - last_progress_us > (int64_t)BIN_ACK_TIMEOUT_MS * 1000)
+      {
+        if (++timeouts > BIN_MAX_TIMEOUTS)
+          error = "Timeout";
+        next = base;
+        last_progress_us = esp_timer_get_time();
+      }
+      else
+      {
+        vTaskDelay(1); // Window full, wait for the host
+      }
+    }
+  }
+
+  fclose(fp);
+  set_console_binary(false);
+  if (error)
+    printf("\nBIN_ERROR:%s\n", error);
+  else
+    printf("\nBIN_END:bytes:%zu\n", file_size - start);
+  fflush(stdout);
+}
+
+// Open a segment of a binary log and check its file header; NULL if it isn't one
+static FILE *open_binary_segment(const char *log_path, int segment, log_file_header_t *header)
+{
+  char path[80];
+  log_segment_path(log_path, segment, path, sizeof(path));
+  FILE *fp = sd_card_fopen(path, "rb");
+  if (!fp)
+    return NULL;
+  if (fread(header, 1, sizeof(*header), fp) != sizeof(*header) ||
+      memcmp(header->magic, LOG_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != LOG_FORMAT_VERSION || header->record_header_size != sizeof(log_record_header_t))
+  {
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+// DOWNLOAD_FRAMES:<log path>:<first>:<last>
+// Sends a binary log holding frames first..last, starting at the keyframe the
+// index has at or before first (so every delta can be decoded), across
+// segment boundaries
+static void handle_download_frames(const char *args)
+{
+  char log_path[80];
+  const char *last_sep = strrchr(args, ':');
+  const char *first_sep = last_sep ? (const char *)memrchr(args, ':', last_sep - args) : NULL;
+  if (!first_sep || first_sep - args >= (int)sizeof(log_path))
+  {
+    printf("FILE_ERROR:Usage DOWNLOAD_FRAMES:<log path>:<first>:<last>\n");
+    fflush(stdout);
+    return;
+  }
+  memcpy(log_path, args, first_sep - args);
+  log_path[first_sep - args] = '\0';
+  uint32_t first = (uint32_t)strtoul(first_sep + 1, NULL, 10);
+  uint32_t last = (uint32_t)strtoul(last_sep + 1, NULL, 10);
+
+  log_index_entry_t entry;
+  if (!log_index_seek(log_path, first, &entry))
+  {
+    printf("FILE_ERROR:No index entry at or before frame %lu\n", (unsigned long)first);
+    fflush(stdout);
+    return;
+  }
+  int segment = entry.segment;
+  log_file_header_t header;
+  FILE *fp = open_binary_segment(log_path, segment, &header);
+  if (!fp)
+  {
+    printf("FILE_ERROR:Cannot open segment %d (frame ranges need a binary log)\n", segment);
+    fflush(stdout);
+    return;
+  }
+  fseek(fp, entry.offset, SEEK_SET);
+
+  printf("FILE_ENCODING:hex\n");
+  printf("FILE_START\n");
+  send_hex((const uint8_t *)&header, sizeof(header));
+
+  static uint8_t record[SD_RECORD_MAX];
+  log_record_header_t *rec = (log_record_header_t *)record;
+  int frames = 0;
+  uint32_t prev_frame = entry.frame;
+  while (fp)
+  {
+    bool ok = fread(record, 1, sizeof(log_record_header_t), fp) == sizeof(log_record_header_t) &&
+              rec->magic == LOG_RECORD_MAGIC && rec->payload_bytes <= MAX_FRAME_PIXELS &&
+              rec->frame >= prev_frame;
+    if (!ok)
+    {
+      // End of the segment (or the reserved tail of an unfinished one): go on in the next
+      fclose(fp);
+      fp = open_binary_segment(log_path, ++segment, &header);
+      continue;
+    }
+    if (rec->frame > last)
+      break;
+    if (fread(record + sizeof(log_record_header_t), 1, rec->payload_bytes, fp) != rec->payload_bytes)
+      continue; // Torn record, the next read moves on
+    send_hex(record, sizeof(log_record_header_t) + rec->payload_bytes);
+    prev_frame = rec->frame;
+    frames++;
+    if (frames % 20 == 0)
+      fflush(stdout);
+  }
+  if (fp)
+    fclose(fp);
+
+  printf("FILE_END\n");
+  printf("FRAMES_SENT:%d\n", frames);
+  fflush(stdout);
+}
+
+// The LINK lines of one sensor
+static void print_link_health(int sensor)
+{
+  link_health_t health;
+  depth_sensor_get_link_health(sensor, &health);
+
+  // Everything the sensor sent: frames that arrived (used or not) plus the frame_id gaps
+  uint32_t sent = health.frames_received + health.invalid_frames + health.ring_overruns + health.frames_missed;
+  float seconds = (float)health.elapsed_us / 1e6f;
+
+  printf("LINK:sensor:%s\n", depth_sensor_name(sensor));
+  printf("LINK:seconds:%.1f\n", (double)seconds);
+  printf("LINK:configured_fps:%d\n", SENSOR_FPS);
+  printf("LINK:sensor_fps:%.2f\n", seconds > 0 ? (double)(sent / seconds) : 0.0);
+  printf("LINK:received_fps:%.2f\n", seconds > 0 ? (double)(health.frames_received / seconds) : 0.0);
+
+  // Throughput estimate: can the UART carry the configured rate at this resolution?
+  float link_max_fps = depth_sensor_link_max_fps(MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
+  printf("LINK:resolution:%dx%d\n", MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
+  printf("LINK:baud:%d\n", UART_BAUD_RATE);
+  printf("LINK:link_max_fps:%.2f\n", (double)link_max_fps);
+  printf("LINK:link_utilization_pct:%.1f\n", seconds > 0 ? (double)(100.0f * sent / seconds / link_max_fps) : 0.0);
+  printf("LINK:frames_received:%lu\n", (unsigned long)health.frames_received);
+  printf("LINK:frames_missed:%lu\n", (unsigned long)health.frames_missed);
+  printf("LINK:invalid_frames:%lu\n", (unsigned long)health.invalid_frames);
+  printf("LINK:error_frames:%lu\n", (unsigned long)health.error_frames);
+  printf("LINK:checksum_errors:%lu\n", (unsigned long)health.checksum_errors);
+  printf("LINK:resync_bytes:%lu\n", (unsigned long)health.resync_bytes);
+  printf("LINK:parser_overflow_bytes:%lu\n", (unsigned long)health.parser_overflow_bytes);
+  printf("LINK:uart_overflows:%lu\n", (unsigned long)health.uart_overflows);
+  printf("LINK:ring_overruns:%lu\n", (unsigned long)health.ring_overruns);
+  printf("LINK:sd_queue_drops:%lu\n", (unsigned long)health.sd_queue_drops);
+  printf("LINK:stream_drops:%lu\n", (unsigned long)health.stream_drops);
+  printf("LINK:last_error_code:%d\n", health.last_error_code);
+  printf("LINK:sensor_temp:%d\n", health.sensor_temp);
+  printf("LINK:driver_temp:%d\n", health.driver_temp);
+}
+
+static void handle_get_link_health()
+{
+  printf("LINK_HEALTH_START\n");
+  for (int sensor = 0; sensor < DEPTH_SENSOR_COUNT; sensor++)
+  {
+    print_link_health(sensor);
+  }
+  printf("LINK_HEALTH_END\n");
+  fflush(stdout);
+}
+
+// Reported by GET_STATS in pipeline order, and cleared by RESET_LATENCY
+static LatencyHistogram *const g_histograms[] = {
+    &g_sensor_parse_latency, &g_add_frame_latency, &g_frame_copy_latency, &g_wake_latency,
+    &g_input_fill_latency, &g_gate_latency, &g_invoke_latency, &g_head_latency, &g_handoff_latency,
+    &g_log_append_latency, &g_frame_to_result_latency, &g_sensor_to_motor_latency, &g_reflex_stop_latency,
+};
+
+// GET_STATS: resource headroom snapshot. CPU shares cover the time since the
+// previous GET_STATS (since boot for the first one).
+static void handle_get_stats()
+{
+  printf("STATS_START\n");
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+  static TaskStatus_t tasks[STATS_MAX_TASKS];
+  static struct
+  {
+    TaskHandle_t handle;
+    configRUN_TIME_COUNTER_TYPE runtime;
+  } previous[STATS_MAX_TASKS];
+  static int previous_count = 0;
+  static configRUN_TIME_COUNTER_TYPE previous_total = 0;
+
+  configRUN_TIME_COUNTER_TYPE total = 0;
+  int count = (int)uxTaskGetSystemState(tasks, STATS_MAX_TASKS, &total);
+  configRUN_TIME_COUNTER_TYPE elapsed = total - previous_total;
+  printf("STATS_WINDOW:ms:%lu\n", (unsigned long)(elapsed / 1000));
+  for (int i = 0; i < count; i++)
+  {
+    const TaskStatus_t *task = &tasks[i];
+    configRUN_TIME_COUNTER_TYPE before = 0;
+    for (int k = 0; k < previous_count; k++)
+    {
+      if (previous[k].handle == task->xHandle)
+        before = previous[k].runtime;
+    }
+    // Share of one core, in tenths of a percent (no float formatting on the console task stack)
+    uint32_t permille = elapsed > 0 ? (uint32_t)((uint64_t)(task->ulRunTimeCounter - before) * 1000 / elapsed) : 0;
+    BaseType_t core = xTaskGetCoreID(task->xHandle);
+    printf("STATS_TASK:%s:core:%d:priority:%u:cpu_pct:%lu.%lu:stack_free:%lu\n", task->pcTaskName,
+           core == tskNO_AFFINITY ? -1 : (int)core, (unsigned)task->uxCurrentPriority, (unsigned long)(permille / 10),
+           (unsigned long)(permille % 10), (unsigned long)task->usStackHighWaterMark);
+  }
+  for (int i = 0; i < count; i++)
+  {
+    previous[i].handle = tasks[i].xHandle;
+    previous[i].runtime = tasks[i].ulRunTimeCounter;
+  }
+  previous_count = count;
+  previous_total = total;
+#else
+  printf("STATS_ERROR:Task statistics need CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n");
+#endif
+
+  printf("STATS_HEAP:internal:free:%u:min_free:%u:largest:%u\n",
+         (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+         (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+         (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+  printf("STATS_HEAP:psram:free:%u:min_free:%u:largest:%u\n",
+         (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+         (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM),
+         (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+
+  arena_usage_t arena = get_arena_usage();
+  printf("STATS_ARENA:used:%d:size:%d\n", arena.used_bytes, arena.size_bytes);
+  if (arena.head_size_bytes > 0)
+  {
+    printf("STATS_ARENA_HEAD:used:%d:size:%d\n", arena.head_used_bytes, arena.head_size_bytes);
+  }
+  if (arena.gate_size_bytes > 0)
+  {
+    printf("STATS_ARENA_GATE:used:%d:size:%d\n", arena.gate_used_bytes, arena.gate_size_bytes);
+    gate_stats_t gate = get_gate_stats();
+    int32_t saved = gate.saved_permille < 0 ? -gate.saved_permille : gate.saved_permille;
+    printf("STATS_GATE:gated:%lu:uncertain:%lu:refreshes:%lu:gate_us:%lld:full_us:%lld:saved_pct:%s%ld.%ld\n",
+           (unsigned long)gate.gated, (unsigned long)gate.uncertain, (unsigned long)gate.refreshes,
+           (long long)gate.gate_us, (long long)gate.full_us, gate.saved_permille < 0 ? "-" : "", (long)(saved / 10),
+           (long)(saved % 10));
+  }
+
+  int queued = 0;
+  int free_buffers = 0;
+  depth_sensor_get_sd_queue(&queued, &free_buffers);
+  printf("STATS_SD_QUEUE:queued:%d:free:%d:capacity:%d\n", queued, free_buffers, SD_POOL_BUFFERS);
+  printf("STATS_BATTERY:mv:%d:state:%s\n", (int)(battery_voltage() * 1000), battery_state_name(battery_state()));
+#ifdef REFLEX_STOP
+  reflex_stop_stats_t reflex;
+  reflex_stop_get_stats(&reflex);
+  printf("STATS_REFLEX:triggers:%lu:near_frames:%lu:frames:%lu:last_min_mm:%u:active:%d:threshold_mm:%d\n",
+         (unsigned long)reflex.triggers, (unsigned long)reflex.near_frames, (unsigned long)reflex.frames_checked,
+         (unsigned)reflex.last_min_mm, reflex.active ? 1 : 0, REFLEX_STOP_MM);
+#endif
+
+  for (LatencyHistogram *histogram : g_histograms)
+  {
+    histogram->print_summary();
+  }
+
+  printf("STATS_END\n");
+  fflush(stdout);
+}
+
 static void process_command(const char *cmd)
 {
+  PowerLock full_clock(POWER_LOCK_CONSOLE); // Downloads and reports at the full clock
   if (strncmp(cmd, "GET_LOG_FILENAME", 16) == 0)
   {
     handle_get_log_filename();
@@ -149,30 +676,213 @@ static void process_command(const char *cmd)
     const char *filename = cmd + 14;
     handle_download_file(filename);
   }
+  else if (strncmp(cmd, "DOWNLOAD_BIN:", 13) == 0)
+  {
+    handle_download_binary(cmd + 13);
+  }
+  else if (strncmp(cmd, "FLIGHT_DUMP", 11) == 0)
+  {
+    // The writer task reports FLIGHT_SAVED or FLIGHT_ERROR when it is done
+    if (flight_recorder_trigger(FLIGHT_TRIGGER_SERIAL))
+      printf("FLIGHT_DUMP_STARTED\n");
+    else
+      printf("FLIGHT_ERROR:Nothing recorded or a dump is running\n");
+    fflush(stdout);
+  }
+  else if (strncmp(cmd, "DOWNLOAD_FRAMES:", 16) == 0)
+  {
+    handle_download_frames(cmd + 16);
+  }
+  else if (strncmp(cmd, "GET_OP_PROFILE", 14) == 0)
+  {
+    g_op_profiler.dump();
+  }
+  else if (strncmp(cmd, "GET_KERNEL_PROFILE", 18) == 0)
+  {
+    print_input_kernel_profile();
+  }
+  else if (strncmp(cmd, "GET_STATS", 9) == 0)
+  {
+    handle_get_stats();
+  }
+  else if (strncmp(cmd, "GET_LINK_HEALTH", 15) == 0)
+  {
+    handle_get_link_health();
+  }
+  else if (strncmp(cmd, "RESET_LINK_HEALTH", 17) == 0)
+  {
+    depth_sensor_reset_link_health();
+    printf("LINK_HEALTH_RESET\n");
+    fflush(stdout);
+  }
+  else if (strncmp(cmd, "GET_LATENCY", 11) == 0)
+  {
+    g_sensor_to_motor_latency.dump();
+  }
+  else if (strncmp(cmd, "RESET_LATENCY", 13) == 0)
+  {
+    for (LatencyHistogram *histogram : g_histograms)
+    {
+      histogram->reset();
+    }
+#ifdef TRACE_EVENTS
+    trace_reset();
+#endif
+    printf("LATENCY_RESET\n");
+    fflush(stdout);
+  }
+  else if (strncmp(cmd, "GET_POWER", 9) == 0)
+  {
+    power_print();
+  }
+  else if (strncmp(cmd, "GET_MEMORY", 10) == 0)
+  {
+    memory_report_print();
+  }
+  else if (strncmp(cmd, "GET_BOOT", 8) == 0)
+  {
+    boot_print();
+  }
+  else if (strncmp(cmd, "GET_NET", 7) == 0)
+  {
+    net_telemetry_print();
+  }
+  else if (strncmp(cmd, "GET_TRACE", 9) == 0)
+  {
+#ifdef TRACE_EVENTS
+    trace_dump();
+#else
+    printf("TRACE_ERROR:Built without TRACE_EVENTS\n");
+    fflush(stdout);
+#endif
+  }
+  else if (strncmp(cmd, "REPLAY_BENCH:", 13) == 0)
+  {
+    // The bench drives the inference pipeline itself, so the main loop has to stand still
+    if (xQueueSend(g_main_loop_commands, cmd, 0) != pdTRUE)
+    {
+      printf("REPLAY_ERROR:A replay is already queued\n");
+      fflush(stdout);
+    }
+  }
+  else if (strncmp(cmd, "HIL_START", 9) == 0)
+  {
+    // Frames are taken from the console right away and wait in the HIL queue
+    // until the main loop gets to hil_run()
+    if (!hil_begin())
+    {
+      printf("HIL_ERROR:Out of memory for the frame queue\n");
+      fflush(stdout);
+    }
+    else if (xQueueSend(g_main_loop_commands, cmd, 0) != pdTRUE)
+    {
+      hil_cancel();
+      printf("HIL_ERROR:A replay is already queued\n");
+      fflush(stdout);
+    }
+  }
 }
 
-void serial_commands_process()
+static void console_task(void *pvParameters)
 {
-    char c;
-    ssize_t len = read(STDIN_FILENO, &c, 1);
-    
-    if (len > 0)
+  char received[64];
+  while (true)
+  {
+    int len = console_read(received, sizeof(received), portMAX_DELAY);
+    for (int i = 0; i < len; i++)
     {
-        if (c == '\n' || c == '\r')
+      if (hil_active())
+      {
+        // The rest of the chunk is frame bytes, up to the session's end frame
+        hil_feed((const uint8_t *)received + i, len - i);
+        break;
+      }
+      char c = received[i];
+      if (c == '\n' || c == '\r')
+      {
+        if (buffer_pos > 0)
         {
-            if (buffer_pos > 0)
-            {
-                command_buffer[buffer_pos] = '\0';
-                process_command(command_buffer);
-                buffer_pos = 0;
-            }
+          command_buffer[buffer_pos] = '\0';
+          process_command(command_buffer);
+          buffer_pos = 0;
         }
-        else if (c >= 32 && c <= 126)  // Printable characters only
+      }
+      else if (c >= 32 && c <= 126) // Printable characters only
+      {
+        if (buffer_pos < COMMAND_BUFFER_SIZE - 1)
         {
-            if (buffer_pos < COMMAND_BUFFER_SIZE - 1)
-            {
-                command_buffer[buffer_pos++] = c;
-            }
+          command_buffer[buffer_pos++] = c;
         }
+      }
     }
+  }
+}
+
+void serial_commands_init()
+{
+  buffer_pos = 0;
+  memset(command_buffer, 0, sizeof(command_buffer));
+  g_main_loop_commands = xQueueCreate(1, COMMAND_BUFFER_SIZE);
+
+  // Driver-backed console: the task sleeps until bytes arrive, and printf()
+  // returns once its output is in the TX ring instead of spinning on the FIFO
+#if CONFIG_ESP_CONSOLE_UART
+  uart_driver_install(CONFIG_ESP_CONSOLE_UART_NUM, CONSOLE_RX_BUFFER, CONSOLE_TX_BUFFER, 0, NULL, 0);
+  uart_vfs_dev_use_driver(CONFIG_ESP_CONSOLE_UART_NUM);
+#elif CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+  usb_serial_jtag_driver_config_t usj_config = USB_SERIAL_JTAG_DRIVER_CONFIG_DEFAULT();
+  usb_serial_jtag_driver_install(&usj_config);
+  usb_serial_jtag_vfs_use_driver();
+#endif
+
+  if (g_main_loop_commands == NULL ||
+      xTaskCreatePinnedToCore(console_task, "console", CONSOLE_TASK_STACK, NULL, CONSOLE_TASK_PRIORITY, NULL,
+                              CONSOLE_TASK_CORE) != pdPASS)
+  {
+    printf("Cannot start the console task, serial commands disabled\n");
+    return;
+  }
+  memory_report_add_task("console", CONSOLE_TASK_STACK);
+}
+
+bool serial_stream_write(const void *data, size_t len)
+{
+#if CONFIG_ESP_CONSOLE_UART
+  // Bypasses the VFS, so no line ending translation. Another task's printf()
+  // can still take the space between the check and the write, then this
+  // waits for a few bytes to drain.
+  size_t free_bytes = 0;
+  if (uart_get_tx_buffer_free_size(CONFIG_ESP_CONSOLE_UART_NUM, &free_bytes) != ESP_OK || free_bytes < len)
+    return false;
+  return uart_write_bytes(CONFIG_ESP_CONSOLE_UART_NUM, data, len) == (int)len;
+#else
+  return false;
+#endif
+}
+
+void serial_commands_process()
+{
+  char cmd[COMMAND_BUFFER_SIZE];
+  if (xQueueReceive(g_main_loop_commands, cmd, 0) != pdTRUE)
+    return;
+  PowerLock full_clock(POWER_LOCK_CONSOLE); // Bench numbers at the clock the car drives with
+
+  if (strncmp(cmd, "HIL_START", 9) == 0)
+  {
+    hil_run();
+    return;
+  }
+
+  // REPLAY_BENCH:<path>[:<first frame>]
+  char path[80];
+  strncpy(path, cmd + 13, sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+  uint32_t first_frame = 0;
+  char *sep = strrchr(path, ':');
+  if (sep)
+  {
+    *sep = '\0';
+    first_frame = (uint32_t)strtoul(sep + 1, NULL, 10);
+  }
+  replay_bench_run(path, first_frame);
 }
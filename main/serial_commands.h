@@ -1,22 +1,39 @@
 #ifndef SERIAL_COMMANDS_H
 #define SERIAL_COMMANDS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
 
+// Commands are read and run by their own task, so typing them and long
+// transfers don't hold up the drive loop (core, priority and stack in
+// task_layout.h)
+#define CONSOLE_RX_BUFFER 1024  // Console UART driver receive buffer
+#define CONSOLE_TX_BUFFER 8192  // Console UART driver transmit ring, printf() output and stream packets queue here
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- * @brief Initialize serial command handler
+ * @brief Install the console driver and start the console task
  */
 void serial_commands_init();
 
 /**
- * @brief Process incoming serial commands (call from main loop)
+ * @brief Run commands that need the main loop stopped (REPLAY_BENCH), which
+ *        the console task hands over (call from main loop)
  */
 void serial_commands_process();
 
+/**
+ * @brief Queue bytes on the console without waiting (binary live stream)
+ *
+ * @return false, with nothing sent, if the console TX ring can't take all of
+ *         them right now (or the console has no TX ring)
+ */
+bool serial_stream_write(const void *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
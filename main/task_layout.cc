@@ -0,0 +1,57 @@
+#include "task_layout.h"
+#include <stdio.h>
+#include "drive_system/depth_sensor.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+typedef struct
+{
+  const char *name; // As passed to xTaskCreatePinnedToCore()
+  int core;         // -1 = not pinned
+  int priority;
+  int stack;
+} task_config_t;
+
+#if CONFIG_ESP_MAIN_TASK_AFFINITY_CPU0
+#define MAIN_TASK_CORE 0
+#elif CONFIG_ESP_MAIN_TASK_AFFINITY_CPU1
+#define MAIN_TASK_CORE 1
+#else
+#define MAIN_TASK_CORE -1
+#endif
+
+static const task_config_t g_layout[] = {
+    {"sensor_rx", SENSOR_RX_TASK_CORE, SENSOR_RX_TASK_PRIORITY, SENSOR_RX_TASK_STACK},
+#if DEPTH_SENSOR_COUNT > 1
+    {"sensor_rx1", SENSOR_RX_TASK_CORE, SENSOR_RX_TASK_PRIORITY, SENSOR_RX_TASK_STACK},
+#endif
+    {"drive", DRIVE_TASK_CORE, DRIVE_TASK_PRIORITY, DRIVE_TASK_STACK},
+    {"main", MAIN_TASK_CORE, MAIN_TASK_PRIORITY, CONFIG_ESP_MAIN_TASK_STACK_SIZE},
+    {"head_task", HEAD_TASK_CORE, HEAD_TASK_PRIORITY, HEAD_TASK_STACK},
+    {"sd_writer", SD_WRITER_TASK_CORE, SD_WRITER_TASK_PRIORITY, SD_WRITER_TASK_STACK},
+    {"flight_rec", FLIGHT_RECORDER_TASK_CORE, FLIGHT_RECORDER_TASK_PRIORITY, FLIGHT_RECORDER_TASK_STACK},
+#if CONFIG_TINYNAV_NET_TELEMETRY
+    {"net", NET_TASK_CORE, NET_TASK_PRIORITY, NET_TASK_STACK},
+#endif
+    {"inference_task", INFERENCE_TASK_CORE, INFERENCE_TASK_PRIORITY, INFERENCE_TASK_STACK},
+    {"leds", LED_TASK_CORE, LED_TASK_PRIORITY, LED_TASK_STACK},
+    {"console", CONSOLE_TASK_CORE, CONSOLE_TASK_PRIORITY, CONSOLE_TASK_STACK},
+};
+
+void task_layout_print()
+{
+  for (const task_config_t &t : g_layout)
+  {
+    int core = t.core;
+    int priority = t.priority;
+    TaskHandle_t handle = xTaskGetHandle(t.name);
+    if (handle != NULL)
+    {
+      BaseType_t id = xTaskGetCoreID(handle);
+      core = id == tskNO_AFFINITY ? -1 : (int)id;
+      priority = (int)uxTaskPriorityGet(handle);
+    }
+    printf("BOOT_TASK:%s:core:%d:priority:%d:stack:%d:running:%d\n", t.name, core, priority, t.stack,
+           handle != NULL ? 1 : 0);
+  }
+}
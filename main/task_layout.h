@@ -0,0 +1,57 @@
+#ifndef TASK_LAYOUT_H
+#define TASK_LAYOUT_H
+
+#include "sdkconfig.h"
+
+// Core, priority and stack of every long-lived task, from the "TinyNav task
+// layout" menu (Kconfig.projbuild). By default core 0 runs the sensor side,
+// the drive loop and everything that writes to the SD card, and core 1 the
+// inference task with only the LEDs and the console below it, so an SD stall
+// can't delay Invoke(). Boot step tasks are in boot_init.h.
+#define SENSOR_RX_TASK_CORE CONFIG_TINYNAV_SENSOR_TASK_CORE
+#define SENSOR_RX_TASK_PRIORITY CONFIG_TINYNAV_SENSOR_TASK_PRIORITY
+#define SENSOR_RX_TASK_STACK CONFIG_TINYNAV_SENSOR_TASK_STACK
+
+#define DRIVE_TASK_CORE CONFIG_TINYNAV_DRIVE_TASK_CORE
+#define DRIVE_TASK_PRIORITY CONFIG_TINYNAV_DRIVE_TASK_PRIORITY
+#define DRIVE_TASK_STACK CONFIG_TINYNAV_DRIVE_TASK_STACK
+
+#define HEAD_TASK_CORE CONFIG_TINYNAV_HEAD_TASK_CORE
+#define HEAD_TASK_PRIORITY CONFIG_TINYNAV_HEAD_TASK_PRIORITY
+#define HEAD_TASK_STACK CONFIG_TINYNAV_HEAD_TASK_STACK
+
+#define INFERENCE_TASK_CORE CONFIG_TINYNAV_INFERENCE_TASK_CORE
+#define INFERENCE_TASK_PRIORITY CONFIG_TINYNAV_INFERENCE_TASK_PRIORITY
+#define INFERENCE_TASK_STACK CONFIG_TINYNAV_INFERENCE_TASK_STACK
+
+#define SD_WRITER_TASK_CORE CONFIG_TINYNAV_SD_WRITER_TASK_CORE
+#define SD_WRITER_TASK_PRIORITY CONFIG_TINYNAV_SD_WRITER_TASK_PRIORITY
+#define SD_WRITER_TASK_STACK CONFIG_TINYNAV_SD_WRITER_TASK_STACK
+
+#define FLIGHT_RECORDER_TASK_CORE CONFIG_TINYNAV_FLIGHT_RECORDER_TASK_CORE
+#define FLIGHT_RECORDER_TASK_PRIORITY CONFIG_TINYNAV_FLIGHT_RECORDER_TASK_PRIORITY
+#define FLIGHT_RECORDER_TASK_STACK CONFIG_TINYNAV_FLIGHT_RECORDER_TASK_STACK
+
+#if CONFIG_TINYNAV_NET_TELEMETRY
+#define NET_TASK_CORE CONFIG_TINYNAV_NET_TASK_CORE
+#define NET_TASK_PRIORITY CONFIG_TINYNAV_NET_TASK_PRIORITY
+#define NET_TASK_STACK CONFIG_TINYNAV_NET_TASK_STACK
+#endif
+
+#define LED_TASK_CORE CONFIG_TINYNAV_LED_TASK_CORE
+#define LED_TASK_PRIORITY CONFIG_TINYNAV_LED_TASK_PRIORITY
+#define LED_TASK_STACK CONFIG_TINYNAV_LED_TASK_STACK
+
+#define CONSOLE_TASK_CORE CONFIG_TINYNAV_CONSOLE_TASK_CORE
+#define CONSOLE_TASK_PRIORITY CONFIG_TINYNAV_CONSOLE_TASK_PRIORITY
+#define CONSOLE_TASK_STACK CONFIG_TINYNAV_CONSOLE_TASK_STACK
+
+// The main task (loop()) is created by ESP-IDF on ESP_MAIN_TASK_AFFINITY;
+// setup() only sets its priority
+#define MAIN_TASK_PRIORITY CONFIG_TINYNAV_MAIN_TASK_PRIORITY
+
+// Print BOOT_TASK lines with each task's core and priority as they are now
+// (the configured ones if it isn't running), see SERIAL_DOWNLOAD.md
+void task_layout_print();
+
+#endif // TASK_LAYOUT_H
@@ -0,0 +1,72 @@
+#include "trace_events.h"
+
+#ifdef TRACE_EVENTS
+#include <atomic>
+#include <stdio.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+typedef struct
+{
+  uint32_t time_us; // Low 32 bits of esp_timer_get_time(), wraps after 71 minutes
+  int32_t arg;
+  TaskHandle_t task;
+  uint8_t event; // trace_event_t
+  uint8_t core;
+  uint16_t reserved;
+} trace_record_t;
+
+static const char *const g_event_names[TRACE_EVENT_COUNT] = {
+    "frame_rx", "frame_added", "infer_request", "infer_start", "invoke_start", "invoke_end",
+    "head_start", "head_end", "gated", "result", "motor", "log_append", "reflex_stop",
+};
+
+static trace_record_t g_trace[TRACE_RING_EVENTS];
+static std::atomic<uint32_t> g_trace_next{0};   // Events recorded since boot or trace_reset()
+static std::atomic<bool> g_trace_paused{false}; // While trace_dump() copies the ring
+
+void trace_event(trace_event_t event, int32_t arg)
+{
+  if (g_trace_paused.load(std::memory_order_relaxed))
+    return;
+  uint32_t n = g_trace_next.fetch_add(1, std::memory_order_relaxed);
+  trace_record_t *record = &g_trace[n % TRACE_RING_EVENTS];
+  record->time_us = (uint32_t)esp_timer_get_time();
+  record->arg = arg;
+  record->task = xTaskGetCurrentTaskHandle();
+  record->event = (uint8_t)event;
+  record->core = (uint8_t)xPortGetCoreID();
+}
+
+void trace_dump()
+{
+  // Recording stops while the ring prints; an event being written when the
+  // pause started may come out torn, the rest are whole
+  g_trace_paused.store(true, std::memory_order_relaxed);
+  vTaskDelay(1);
+  uint32_t next = g_trace_next.load(std::memory_order_relaxed);
+  uint32_t count = next < TRACE_RING_EVENTS ? next : TRACE_RING_EVENTS;
+
+  printf("TRACE_START:events:%lu:recorded:%lu\n", (unsigned long)count, (unsigned long)next);
+  for (uint32_t i = next - count; i != next; i++)
+  {
+    const trace_record_t *record = &g_trace[i % TRACE_RING_EVENTS];
+    // The pipeline tasks are never deleted, so their names are still there
+    printf("TRACE:%lu:%u:%s:%s:%ld\n", (unsigned long)record->time_us, record->core,
+           record->task != nullptr ? pcTaskGetName(record->task) : "?",
+           record->event < TRACE_EVENT_COUNT ? g_event_names[record->event] : "?", (long)record->arg);
+  }
+  printf("TRACE_END\n");
+  fflush(stdout);
+  g_trace_paused.store(false, std::memory_order_relaxed);
+}
+
+void trace_reset()
+{
+  g_trace_paused.store(true, std::memory_order_relaxed);
+  vTaskDelay(1);
+  g_trace_next.store(0, std::memory_order_relaxed);
+  g_trace_paused.store(false, std::memory_order_relaxed);
+}
+#endif
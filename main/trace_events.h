@@ -0,0 +1,45 @@
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include <stdint.h>
+
+// Timeline of the frame pipeline across tasks and cores: every stage drops a
+// timestamped event into a ring, and GET_TRACE prints the newest ones. The
+// stage histograms (latency_histogram.h) say how long a stage takes, the trace
+// shows what ran next to what when a frame was late.
+
+#define TRACE_EVENTS            // Comment out to compile trace_event() out
+#define TRACE_RING_EVENTS 1024  // Events kept, the oldest are overwritten (16 bytes each)
+
+typedef enum
+{
+  TRACE_FRAME_RX = 0,  // sensor_rx: frame published to the frame ring, arg = seq
+  TRACE_FRAME_ADDED,   // Frame into the inference ring, arg = frames published
+  TRACE_INFER_REQUEST, // request_inference() woke the inference task
+  TRACE_INFER_START,   // Input fill begins
+  TRACE_INVOKE_START,  // interpreter->Invoke()
+  TRACE_INVOKE_END,    // arg = Invoke() in us
+  TRACE_HEAD_START,    // Head half of a split model (core 0)
+  TRACE_HEAD_END,      // arg = head in us
+  TRACE_GATED,         // Gate model confident, full model skipped, arg = confidence x 1000
+  TRACE_RESULT,        // Prediction published, arg = frame to result in us
+  TRACE_MOTOR,         // Drive task applied a new result, arg = sensor to motor in us
+  TRACE_LOG_APPEND,    // Frame into the SD log, arg = append in us
+  TRACE_REFLEX_STOP,   // sensor_rx: reflex stop stopped the motors, arg = sensor to stop in us
+  TRACE_EVENT_COUNT,
+} trace_event_t;
+
+#ifdef TRACE_EVENTS
+// Record an event for the calling task. Lock-free, any task, not from an ISR.
+void trace_event(trace_event_t event, int32_t arg = 0);
+
+// Print TRACE_START ... TRACE_END, oldest event first
+void trace_dump();
+
+// Drop everything recorded so far
+void trace_reset();
+#else
+inline void trace_event(trace_event_t, int32_t = 0) {}
+#endif
+
+#endif // TRACE_EVENTS_H
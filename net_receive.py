@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+Receive the car's Wi-Fi telemetry (TINYNAV_NET_TELEMETRY in menuconfig, see
+main/net_telemetry.h) and write the frames to a binary depth log that
+depth_log.py, visualize.py and hil_bench.py read like one from the SD card.
+
+    python net_receive.py -o logs/net_log.bin
+    python net_receive.py --port 5005 --quiet
+
+Prints the model output and latency from the status packets once a second,
+and the datagrams lost on the way or dropped on the car (gaps in seq).
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+PACKET_MAGIC = 0x544E4E54
+PACKET_HEADER = struct.Struct('<IIBBH')  # magic, seq, type, version, payload bytes
+PACKET_FRAME, PACKET_STATUS = 0, 1
+# net_status_t: timestamp, result frame, steering/throttle millis, input fill, invoke,
+# frame-to-result p50/p99, sensor-to-motor p50/p99, mode, depth encoding, binning, reserved, unit
+STATUS = struct.Struct('<qqhhiiiiiiBBBBH')
+# log_file_header_t: magic, version, header size, record header size, binning, encoding, reserved, unit
+FILE_HEADER = struct.Struct('<4sBBBBBBH')
+RECORD_HEADER_SIZE = 28
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Receive UDP telemetry from the car',
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument('--port', type=int, default=5005, help='UDP port (TINYNAV_NET_PORT)')
+    parser.add_argument('-o', '--output', help='Binary depth log to write the frames to')
+    parser.add_argument('--quiet', action='store_true', help='Only print the summary at the end')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(('', args.port))
+    sock.settimeout(1.0)
+    print('Listening on UDP port %d' % args.port)
+
+    out = open(args.output, 'wb') if args.output else None
+    pending = []  # Frame records until the first status packet gives the file header
+    header_written = False
+    expected_seq = None
+    received = lost = frames = 0
+    status = None
+    last_print = time.time()
+    try:
+        while True:
+            try:
+                data, _ = sock.recvfrom(65536)
+            except socket.timeout:
+                data = None
+            if data is not None and len(data) >= PACKET_HEADER.size:
+                magic, seq, ptype, version, payload_bytes = PACKET_HEADER.unpack_from(data, 0)
+                payload = data[PACKET_HEADER.size:PACKET_HEADER.size + payload_bytes]
+                if magic == PACKET_MAGIC and len(payload) == payload_bytes:
+                    received += 1
+                    if expected_seq is not None and seq > expected_seq:
+                        lost += seq - expected_seq
+                    elif expected_seq is not None and seq < expected_seq:
+                        print('Sequence restarted (car rebooted?)')
+                    expected_seq = seq + 1
+                    if ptype == PACKET_FRAME:
+                        frames += 1
+                        if out and header_written:
+                            out.write(payload)
+                        elif out:
+                            pending.append(payload)
+                    elif ptype == PACKET_STATUS and len(payload) >= STATUS.size:
+                        status = STATUS.unpack_from(payload, 0)
+                        if out and not header_written:
+                            _, _, _, _, _, _, _, _, _, _, _, encoding, binning, _, unit_mm = status
+                            out.write(FILE_HEADER.pack(b'TNLG', version, FILE_HEADER.size, RECORD_HEADER_SIZE,
+                                                       binning, encoding, 0, unit_mm))
+                            out.writelines(pending)
+                            pending = []
+                            header_written = True
+
+            now = time.time()
+            if not args.quiet and status is not None and now - last_print >= 1.0:
+                (timestamp_us, _, steering, throttle, input_fill_us, invoke_us,
+                 f2r_p50, f2r_p99, s2m_p50, s2m_p99, mode, _, _, _, _) = status
+                print('t=%.1fs mode=%d steering=%+.3f throttle=%+.3f fill=%dus invoke=%dus '
+                      'frame->result p50/p99=%d/%dus sensor->motor p50/p99=%d/%dus frames=%d lost=%d'
+                      % (timestamp_us / 1e6, mode, steering / 1000.0, throttle / 1000.0, input_fill_us, invoke_us,
+                         f2r_p50, f2r_p99, s2m_p50, s2m_p99, frames, lost))
+                last_print = now
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if out:
+            if pending:
+                print('No status packet received, %d frames not written' % len(pending), file=sys.stderr)
+            out.close()
+        total = received + lost
+        print('Received %d datagrams (%d frames), lost %d (%.1f%%)'
+              % (received, frames, lost, 100.0 * lost / total if total else 0.0))
+
+
+if __name__ == "__main__":
+    main()
@@ -2,7 +2,12 @@ import serial
 import numpy as np
 import matplotlib.pyplot as plt
 import argparse
+import struct
 import sys
+import time
+import zlib
+
+from depth_log import _millimeter_table
 
 # --- Parse command-line arguments ---
 parser = argparse.ArgumentParser(
@@ -14,9 +19,14 @@ parser.add_argument('-p', '--port', default='/dev/ttyACM0',
 parser.add_argument('-b', '--baud', type=int, default=921600,
                     help='Baud rate')
 parser.add_argument('-r', '--rows', type=int, default=25,
-                    help='Number of rows in depth grid')
+                    help='Number of rows in depth grid (--ascii only, binary packets carry their size)')
 parser.add_argument('-c', '--cols', type=int, default=25,
-                    help='Number of columns in depth grid')
+                    help='Number of columns in depth grid (--ascii only)')
+parser.add_argument('--max-depth', type=float, default=2550.0,
+                    help='Depth in mm at the top of the color scale')
+parser.add_argument('--ascii', action='store_true',
+                    help='Read the old FRAME_START/FRAME_END character preview '
+                         '(firmware built without SERIAL_STREAM_BINARY)')
 parser.add_argument('--cmap', default='inferno',
                     help='Matplotlib colormap name')
 parser.add_argument('--timeout', type=float, default=1.0,
@@ -32,6 +42,11 @@ COLS = args.cols
 DEPTH_CHARS = " .:-=+*#%@"
 CHAR_TO_VALUE = {c: i for i, c in enumerate(DEPTH_CHARS)}
 
+# stream_packet_header_t in main/drive_system/depth_sensor.h
+STREAM_HEADER = struct.Struct('<IIqhhBBBBI')  # magic, seq, timestamp_us, steering, throttle, width, height, encoding, unit, crc
+STREAM_MAGIC = struct.pack('<I', 0x53444E54)
+STREAM_CRC_BYTES = STREAM_HEADER.size - 4  # Header bytes covered by the CRC
+
 try:
     ser = serial.Serial(PORT, BAUD, timeout=args.timeout)
     print(f"Connected to {PORT} at {BAUD} baud")
@@ -65,7 +80,83 @@ def read_frame():
                 rows.pop(0)
 
 
-def main():
+class StreamReader:
+    """Parses binary stream packets out of the serial bytes. Console text
+    between packets is skipped; damaged packets fail the CRC and are dropped."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.last_seq = None
+        self.packets = 0
+        self.dropped = 0  # Gaps in seq: dropped by the firmware or damaged here
+
+    def read_newest(self):
+        """Read what has arrived and return the newest complete packet as
+        (header tuple, depth in mm), or None. Older packets are skipped so the
+        display never falls behind."""
+        self.buffer += ser.read(ser.in_waiting or 1)
+        newest = None
+        while True:
+            pos = self.buffer.find(STREAM_MAGIC)
+            if pos < 0:
+                del self.buffer[:max(0, len(self.buffer) - 3)]
+                return newest
+            del self.buffer[:pos]
+            if len(self.buffer) < STREAM_HEADER.size:
+                return newest
+            header = STREAM_HEADER.unpack_from(self.buffer)
+            _, seq, _, _, _, width, height, encoding, unit_mm, crc = header
+            end = STREAM_HEADER.size + width * height
+            if len(self.buffer) < end:
+                return newest
+            pixels = bytes(self.buffer[STREAM_HEADER.size:end])
+            if width == 0 or height == 0 or \
+                    zlib.crc32(pixels, zlib.crc32(bytes(self.buffer[:STREAM_CRC_BYTES]))) != crc:
+                del self.buffer[:1]
+                continue
+            del self.buffer[:end]
+
+            if self.last_seq is not None and seq > self.last_seq + 1:
+                self.dropped += seq - self.last_seq - 1
+            self.last_seq = seq
+            self.packets += 1
+            table = _millimeter_table(encoding, unit_mm)
+            depth = table[np.frombuffer(pixels, dtype=np.uint8)].reshape(height, width)
+            newest = (header, depth)
+
+
+def run_binary():
+    plt.ion()
+    img = plt.imshow(np.zeros((ROWS, COLS)), cmap=args.cmap, vmin=0, vmax=args.max_depth)
+    plt.colorbar(label="Depth (mm)")
+    plt.axis("off")
+
+    reader = StreamReader()
+    rate_start = time.time()
+    rate_packets = 0
+    fps = 0.0
+    while True:
+        packet = reader.read_newest()
+        if packet is None:
+            plt.pause(0.001)  # Keep the window responsive while waiting
+            continue
+        header, depth = packet
+        _, seq, _, steering, throttle, _, _, _, _, _ = header
+        if depth.shape != img.get_array().shape:
+            img.set_extent((-0.5, depth.shape[1] - 0.5, depth.shape[0] - 0.5, -0.5))
+        img.set_data(depth)
+
+        now = time.time()
+        if now - rate_start >= 1.0:
+            fps = (reader.packets - rate_packets) / (now - rate_start)
+            rate_start, rate_packets = now, reader.packets
+        plt.title(f"{depth.shape[1]}x{depth.shape[0]} @ {fps:.1f} FPS, frame {seq}, "
+                  f"dropped {reader.dropped} | steering {steering / 1000:.2f} throttle {throttle / 1000:.2f}",
+                  fontsize=9)
+        plt.pause(0.001)
+
+
+def run_ascii():
     plt.ion()
     frame = np.zeros((ROWS, COLS))
 
@@ -74,12 +165,19 @@ def main():
     plt.title(f"Depth Visualization - {PORT} @ {BAUD} baud")
     plt.axis("off")
 
+    while True:
+        frame = read_frame()
+        img.set_data(frame)
+        plt.pause(0.001)
+
+
+def main():
     print("Receiving data... (Press Ctrl+C to stop)")
     try:
-        while True:
-            frame = read_frame()
-            img.set_data(frame)
-            plt.pause(0.001)
+        if args.ascii:
+            run_ascii()
+        else:
+            run_binary()
     except KeyboardInterrupt:
         print("\nStopped by user")
         ser.close()
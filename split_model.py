@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""
+Split a trained Keras model into a front and a head TFLite model.
+
+The firmware runs the two halves on different cores (SPLIT_MODEL_PIPELINE in
+main/main_functions.cc): core 1 runs the front on frame N while core 0 runs
+the head on frame N-1. Copy the two output files to the root of the SD card
+as model_front.tflite and model_head.tflite.
+
+Both halves are fully int8 quantized. Calibration data comes from recorded
+depth logs, preprocessed the same way as on the car (rotate 90 degrees
+clockwise, crop to 24x24, scale 0-2550 mm to [0, 1], stack 20 frames). The
+firmware requantizes the hand-over tensor if the two halves end up with
+different quantization parameters for it.
+
+Example:
+    python split_model.py model.keras --split-layer global_average_pooling2d \\
+        --logs logs/revised_log_0024.csv logs/revised_log_0025.csv -o split/
+"""
+
+import argparse
+import os
+import sys
+
+import numpy as np
+
+from depth_log import read_depth_log
+
+parser = argparse.ArgumentParser(
+    description='Split a Keras model into int8 front/head TFLite models',
+    formatter_class=argparse.ArgumentDefaultsHelpFormatter
+)
+parser.add_argument('model', help='Trained Keras model (.keras or .h5)')
+parser.add_argument('--split-layer', required=True,
+                    help='Name of the last layer of the front half')
+parser.add_argument('--logs', nargs='+', required=True,
+                    help='Depth log files (CSV or binary) used for quantization calibration')
+parser.add_argument('-o', '--output-dir', default='.',
+                    help='Directory for model_front.tflite and model_head.tflite')
+parser.add_argument('--samples', type=int, default=300,
+                    help='Number of calibration windows')
+
+NUM_FRAMES = 20
+FRAME_SIZE = 24
+MAX_DEPTH_MM = 2550.0
+
+
+def load_windows(paths, max_windows):
+    """Return float32 windows of shape (N, 24, 24, 20) from depth logs"""
+    windows = []
+    for path in paths:
+        frames = []
+        for log_frame in read_depth_log(path):
+            depth = log_frame.depth
+            # Same as add_depth_map_to_buffer(): rotated[i][j] = original[24-j][i], crop to 24x24
+            rotated = np.rot90(depth, k=-1)[:FRAME_SIZE, :FRAME_SIZE]
+            frames.append(np.minimum(rotated / MAX_DEPTH_MM, 1.0))
+        for end in range(NUM_FRAMES, len(frames) + 1):
+            windows.append(np.stack(frames[end - NUM_FRAMES:end], axis=-1))
+    if not windows:
+        sys.exit('split_model.py: logs contain fewer than %d frames' % NUM_FRAMES)
+    windows = np.asarray(windows, dtype=np.float32)
+    if len(windows) > max_windows:
+        picks = np.linspace(0, len(windows) - 1, max_windows).astype(int)
+        windows = windows[picks]
+    return windows
+
+
+def convert_int8(tf, model, samples):
+    converter = tf.lite.TFLiteConverter.from_keras_model(model)
+    converter.optimizations = [tf.lite.Optimize.DEFAULT]
+    converter.representative_dataset = lambda: ([s[np.newaxis]] for s in samples)
+    converter.target_spec.supported_ops = [tf.lite.OpsSet.TFLITE_BUILTINS_INT8]
+    converter.inference_input_type = tf.int8
+    converter.inference_output_type = tf.int8
+    return converter.convert()
+
+
+def main():
+    args = parser.parse_args()
+    import tensorflow as tf
+
+    model = tf.keras.models.load_model(args.model, compile=False)
+    split = model.get_layer(args.split_layer)
+
+    # Functional models can be cut at any intermediate tensor
+    front = tf.keras.Model(model.inputs, split.output, name='front')
+    head = tf.keras.Model(split.output, model.outputs, name='head')
+
+    windows = load_windows(args.logs, args.samples)
+    activations = front.predict(windows, verbose=0)
+    print('Calibration windows: %d, hand-over tensor: %s' % (len(windows), activations.shape[1:]))
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    for name, half, samples in (('model_front.tflite', front, windows),
+                                ('model_head.tflite', head, activations)):
+        data = convert_int8(tf, half, samples)
+        path = os.path.join(args.output_dir, name)
+        with open(path, 'wb') as f:
+            f.write(data)
+        print('Wrote %s (%d bytes)' % (path, len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,5 +1,4 @@
 import numpy as np
-import pandas as pd
 import matplotlib
 matplotlib.use("Agg")
 
@@ -9,13 +8,15 @@ from tqdm import tqdm
 import argparse
 import sys
 
+from depth_log import read_depth_log
+
 # --- Parse command-line arguments ---
 parser = argparse.ArgumentParser(
-    description='Create GIF animation from CSV depth log files',
+    description='Create GIF animation from depth log files (CSV or binary)',
     formatter_class=argparse.ArgumentDefaultsHelpFormatter
 )
 parser.add_argument('csv_file', nargs='?', default='revised_log_0053.csv',
-                    help='Input CSV file path')
+                    help='Input log file path (.csv or .bin)')
 parser.add_argument('-o', '--output', default='depth_animation.gif',
                     help='Output file path (GIF format)')
 parser.add_argument('-f', '--fps', type=int, default=15,
@@ -42,26 +43,18 @@ FPS = args.fps
 FRAME_DT_MS = 1000 / FPS
 csv_path = args.csv_file
 
-# --- Load CSV ---
+# --- Load log ---
 try:
-    df = pd.read_csv(csv_path, comment="#", header=None)
+    log_frames = read_depth_log(csv_path)
 except FileNotFoundError:
     print(f"ERROR: File not found: {csv_path}")
     sys.exit(1)
 except Exception as e:
-    print(f"ERROR: Failed to read CSV: {e}")
+    print(f"ERROR: Failed to read log: {e}")
     sys.exit(1)
 
 # --- Parse frames ---
-frames = []
-
-for _, row in df.iterrows():
-    w = int(row.iloc[3])
-    h = int(row.iloc[4])
-    data = row.iloc[5:].to_numpy(dtype=np.float32)
-    frames.append(data.reshape((h, w)))
-
-frames = np.stack(frames)
+frames = np.stack([f.depth for f in log_frames])
 num_frames = len(frames)
 
 # --- Figure setup (keep it minimal) ---